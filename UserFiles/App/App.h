@@ -14,6 +14,7 @@
 #include "ble_utils.h"
 #include "gap.h"
 #include "security_manager.h"
+#include "l2cap.h"
 #include "Master.h"
 #include "Slave.h"
 
@@ -36,6 +37,8 @@ void App_Run(void);
 #define BLE_SLAVE   0
 #define BLE_MASTER  1
 #define BLE_NODE BLE_MASTER
+#define APP_DATA_CID		0x0040 /* Channel of the data sent by the client, used by both nodes without signaling */
+#define APP_DATA_SDU_SIZE	64	   /* Bytes of each SDU sent by the client */
 
 
 /****************************************************************/
@@ -77,17 +77,15 @@ void Client( void )
 		if( /* TimeBase_DelayMs( &Timer3, 10, TRUE ) */ 1 )
 		{
 
-			HCI_ACL_DATA_PCKT_HEADER ACLDataPacketHeader;
+			/* L2CAP cuts the SDU in ACL data packets of the controller size */
+			uint32_t Data[APP_DATA_SDU_SIZE / sizeof(uint32_t)];
 
-			uint32_t Data;
-			ACLDataPacketHeader.Handle = SlaveInfo.Connection_Handle;
-			ACLDataPacketHeader.PB_Flag = 0x0;
-			ACLDataPacketHeader.BC_Flag = 0x0;
-			ACLDataPacketHeader.Data_Total_Length = sizeof(Data);
-
-			Data = HAL_GetTick();
+			for( uint8_t i = 0; i < ( sizeof(Data) / sizeof(uint32_t) ); i++ )
+			{
+				Data[i] = HAL_GetTick();
+			}
 
-			if( HCI_Host_ACL_Data( &ACLDataPacketHeader, (uint8_t*)&Data ) )
+			if( L2CAP_Send( SlaveInfo.Connection_Handle, APP_DATA_CID, (uint8_t*)&Data[0], sizeof(Data) ) )
 			{
 				NoDataPacketRspTimer = 0;
 			}else if( TimeBase_DelayMs( &NoDataPacketRspTimer, 500, TRUE ) )
@@ -231,14 +229,14 @@ static void HCI_Disconnect_Status( CONTROLLER_ERROR_CODES Status )
 
 #if ( BLE_NODE == BLE_MASTER )
 /****************************************************************/
-/* HCI_Controller_ACL_Data()                					*/
-/* Location: 1892 Core_v5.2		 								*/
+/* L2CAP_Received()                								*/
+/* Location: 					 								*/
 /* Purpose:														*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-void HCI_Controller_ACL_Data( HCI_ACL_DATA_PCKT_HEADER* ACLDataPacketHeader, uint8_t Data[] )
+void L2CAP_Received( uint16_t Connection_Handle, uint16_t CID, uint8_t Data[], uint16_t Length )
 {
 	//HAL_GPIO_WritePin( HEART_BEAT_GPIO_Port, HEART_BEAT_Pin, GPIO_PIN_RESET );
 	//HAL_GPIO_TogglePin( HEART_BEAT_GPIO_Port, HEART_BEAT_Pin );
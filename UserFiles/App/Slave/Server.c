@@ -76,15 +76,9 @@ void Server( void )
 		if( /* TimeBase_DelayMs( &Timer, 100, TRUE ) */ 1 )
 		{
 
-			HCI_ACL_DATA_PCKT_HEADER ACLDataPacketHeader;
+			uint8_t Data[3] = { 2, 15, 2 }; /* ATT_EXCHANGE_MTU_REQ */
 
-			uint8_t Data[7] = { 3, 0, 4, 0, 2, 15, 2 };
-			ACLDataPacketHeader.Handle = MasterInfo.Connection_Handle;
-			ACLDataPacketHeader.PB_Flag = 0x0;
-			ACLDataPacketHeader.BC_Flag = 0x0;
-			ACLDataPacketHeader.Data_Total_Length = sizeof(Data);
-
-			if( HCI_Host_ACL_Data( &ACLDataPacketHeader, (uint8_t*)&Data ) )
+			if( L2CAP_Send( MasterInfo.Connection_Handle, L2CAP_ATT_CID, &Data[0], sizeof(Data) ) )
 			{
 				NoDataPacketRspTimer = 0;
 			}else if( TimeBase_DelayMs( &NoDataPacketRspTimer, 500, TRUE ) )
@@ -195,18 +189,24 @@ static void LE_Read_Remote_Features_Status( CONTROLLER_ERROR_CODES Status )
 
 #if ( BLE_NODE == BLE_SLAVE )
 /****************************************************************/
-/* HCI_Controller_ACL_Data()                					*/
-/* Location: 1892 Core_v5.2		 								*/
+/* L2CAP_Received()                								*/
+/* Location: 					 								*/
 /* Purpose:														*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-void HCI_Controller_ACL_Data( HCI_ACL_DATA_PCKT_HEADER* ACLDataPacketHeader, uint8_t Data[] )
+void L2CAP_Received( uint16_t Connection_Handle, uint16_t CID, uint8_t Data[], uint16_t Length )
 {
 	static uint32_t Previous = 0;
 	static uint32_t index = 0;
 	static uint32_t Diff[100];
+
+	if( ( CID != APP_DATA_CID ) || ( Length < sizeof(uint32_t) ) )
+	{
+		return;
+	}
+
 	uint32_t actual = ( Data[3] << 24 ) | ( Data[2] << 16 ) | ( Data[1] << 8 ) | Data[0];
 
 	Diff[index] = actual - Previous;
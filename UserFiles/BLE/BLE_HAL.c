@@ -1,5 +1,10 @@
 
 
+/* On the host build (BLE_HAL_SIMULATION) the hardware layer is replaced by the
+ * simulated controller found in BLE/Sim/BLE_HAL_Sim.c */
+#ifndef BLE_HAL_SIMULATION
+
+
 /****************************************************************/
 /* Includes                                                     */
 /****************************************************************/
@@ -200,6 +205,9 @@ void Bluenrg_Error(BLUENRG_ERROR_CODES Errorcode)
 }
 
 
+#endif /* BLE_HAL_SIMULATION */
+
+
 /****************************************************************/
 /* End of file	                                                */
 /****************************************************************/
@@ -4,6 +4,7 @@
 /* Includes                                                     */
 /****************************************************************/
 #include "Bluenrg.h"
+#include "main.h"
 
 
 /****************************************************************/
@@ -13,19 +14,34 @@
 #define CTRL_READ  	  0x0B
 #define DEVICE_READY  0x02
 #define SIZE_OF_LOCAL_MEMORY_BUFFER 255
-#define DEVICE_NOT_READY_THRESHOLD	  3 /* Number of not ready responses in sequence to put device in hold mode for DEVICE_HOLD_TIME */
-#define NO_ALLOWED_WRITE_THRESHOLD	  3 /* Number of not allowed write responses (in sequence) to put device in hold mode for DEVICE_HOLD_TIME */
-#define ERRONEOUS_RESPONSE_THRESHOLD  3 /* Number of erroneous responses (in sequence) to put device in hold mode for DEVICE_HOLD_TIME */
-#define DEVICE_HOLD_TIME			  20UL /* Time in ms to wait until frames are sent to the device again after
-											device not ready for DEVICE_NOT_READY_THRESHOLD times */
-#define NUMBER_OF_WRITE_ATTEMPTS	  3
-
-#define SIZE_OF_FRAME_BUFFER 		  8
-#define SIZE_OF_CALLBACK_BUFFER 	  4
-
-#define SIZE_OF_CMD_MEM_BUFFER 		  2
+#define DEVICE_NOT_READY_THRESHOLD	  3 /* Number of not ready responses in sequence to put device in hold mode */
+#define NO_ALLOWED_WRITE_THRESHOLD	  3 /* Number of not allowed write responses (in sequence) to put device in hold mode */
+#define ERRONEOUS_RESPONSE_THRESHOLD  3 /* Number of erroneous responses (in sequence) to put device in hold mode */
+#define DEVICE_MIN_HOLD_TIME_US		  250UL /* First hold when a threshold is reached. Doubled for each further response of the same reason */
+#define DEVICE_HOLD_TIME			  20UL /* Longest time in ms to wait until frames are sent to the device again */
+#define NUMBER_OF_WRITE_ATTEMPTS	  10 /* Slave headers before giving up a write: the holds in between add up to about 50 ms */
+
+#define SIZE_OF_FRAME_BUFFER 		  8 /* HCI packets waiting for transmission. Must be a power of two */
+#define SIZE_OF_TRANSPORT_BUFFER 	  4 /* Slave headers and reads waiting for transmission. Must be a power of two */
+#define SIZE_OF_CALLBACK_BUFFER 	  4 /* Must be a power of two */
+#define SIZE_OF_HCI_TRACE_BUFFER	  32 /* Last HCI packets kept by the trace. Must be a power of two */
+#define SIZE_OF_COALESCE_BUFFER		  128 /* Largest write made of several ACL data packets. The WBUF of the BlueNRG-MS is up to 127 */
+
+#if ( ( SIZE_OF_FRAME_BUFFER & ( SIZE_OF_FRAME_BUFFER - 1 ) ) || ( SIZE_OF_TRANSPORT_BUFFER & ( SIZE_OF_TRANSPORT_BUFFER - 1 ) ) || \
+		( SIZE_OF_CALLBACK_BUFFER & ( SIZE_OF_CALLBACK_BUFFER - 1 ) ) || ( SIZE_OF_HCI_TRACE_BUFFER & ( SIZE_OF_HCI_TRACE_BUFFER - 1 ) ) )
+#error "The frame, callback and trace queue sizes must be powers of two"
+#endif
+
+#define HCI_TRACE_PAYLOAD_SIZE		  32 /* Bytes kept of each traced packet, packet type included */
+#define BTSNOOP_DATALINK_H4			  1002 /* The packet type precedes each packet, as in the UART transport */
+#define BTSNOOP_EPOCH_US			  0x00DCDDB30F2F8000ULL /* Microseconds from year 0 to 1970: the trace starts at 1970-01-01 */
+
+#define RECEIVED_PACKET_LEAK_TIME_US  1000000UL /* A received packet held longer by the application is reported as leaked */
+#define CALLBACK_TIME_BUDGET_US		  500UL /* Time in us to handle callbacks in each Run_Bluenrg() call. At least one callback
+											of each queue is handled per call. Zero handles all the callbacks enqueued before the call */
+
+#define SIZE_OF_CMD_MEM_BUFFER 		  4
 #define SIZE_OF_DAT_MEM_BUFFER 		  4
-#define SIZE_OF_EVT_MEM_BUFFER 		  2
 
 
 /****************************************************************/
@@ -53,7 +69,8 @@ typedef enum
 	BUFFER_FREE 		= 0,
 	BUFFER_FULL 		= 1,
 	BUFFER_TRANSMITTING = 2,
-	BUFFER_PAUSED 		= 3
+	BUFFER_PAUSED 		= 3,
+	BUFFER_HELD			= 4  /* Read callback already handled, but the application still references the packet */
 }BUFFER_STATUS;
 
 
@@ -67,38 +84,57 @@ typedef struct
 	uint16_t RemainingBytes;
 	uint16_t Counter;
 	uint8_t WriteAttempts;
-	void* Next;
+	uint8_t CoalescedFrames; /* Write frames after this one sent in the same transfer */
 	TRANSFER_DESCRIPTOR TransferDesc;
 }BUFFER_DESC;
 
 
 typedef struct
 {
-	uint16_t AllowedWriteSize;
+	volatile uint8_t Head; /* Free running index of the frame to be transmitted first. Only moved by the transmission side */
+	volatile uint8_t Tail; /* Free running index of the next free frame. Only moved by the side enqueuing frames */
+	uint8_t Size;		   /* Number of frames (power of two) */
+	BUFFER_DESC* Frame;
+	QUEUE_STATISTICS Statistics;
+}FRAME_RING;
+
+
+typedef struct
+{
+	uint16_t AllowedWriteSize; /* WBUF of the last slave header, decremented by the bytes written since then */
+	uint8_t WriteSessionOpen;  /* The device is still selected after a write: AllowedWriteSize bytes can follow without a new header */
 	uint16_t SizeToRead;
-	uint32_t HoldTime;
-	uint32_t HoldCounter;
-	int8_t NumberOfFilledBuffers;
-	BUFFER_DESC* BufferHead; /* The head always points to the buffer to be transmitted first */
-	BUFFER_DESC* BufferTail; /* The tail always points to a free buffer */
-	BUFFER_DESC Buffer[SIZE_OF_FRAME_BUFFER];
+	volatile uint32_t HoldTimeUs; /* Nothing is sent to the device while not zero */
+	uint32_t HoldStartUs;
+	uint8_t HoldWokenUp; /* The IRQ already ended a hold since the last good slave header */
+	volatile uint8_t ReadStalled; /* A read waits for a free entry of the read callback queue */
+	FRAME_RING TransportRing; /* Slave headers and reads: they go before the writes */
+	FRAME_RING WriteRing;	  /* HCI packets from host to controller */
+	BUFFER_DESC TransportFrame[SIZE_OF_TRANSPORT_BUFFER];
+	BUFFER_DESC WriteFrame[SIZE_OF_FRAME_BUFFER];
+	WRITE_HEADER_STATISTICS WriteHeaderStatistics;
+	HOLD_STATISTICS HoldStatistics;
 }BUFFER_MANAGEMENT;
 
 
 typedef struct
 {
-	uint8_t Status; /* It indicates the BUFFER_STATUS */
+	volatile uint8_t Status; /* It indicates the BUFFER_STATUS. Only set to BUFFER_FULL after the callback is copied */
 	uint8_t TransferStatus; /* It indicates the TRANSFER_STATUS */
-	void* Next;
+	uint32_t EnqueueTimeUs; /* To measure the time the callback waits to be handled */
+	uint8_t References; /* Hold_Received_Packet() calls not yet released: the entry is not reused while not zero */
+	uint8_t LeakReported; /* The hold was already reported as a leak */
+	uint32_t HoldStartUs; /* Time of the first hold */
 	CB_TRANSFER_DESCRIPTOR TransferDesc;
 }CALLBACK_DESC;
 
 
 typedef struct
 {
-	int8_t NumberOfFilledBuffers;
-	CALLBACK_DESC* CallBackHead; /* The head always points to the callback to be handled first */
-	CALLBACK_DESC* CallBackTail; /* The tail always points to a free callback */
+	volatile uint8_t CallBackHead; /* Free running index of the callback to be handled first. Only moved by the main loop */
+	volatile uint8_t CallBackTail; /* Free running index of the next free callback. Only moved by the enqueuing side */
+	QUEUE_STATISTICS Statistics;
+	uint8_t Order[SIZE_OF_CALLBACK_BUFFER]; /* Entry of each queue position: the entries held by the application are skipped */
 	CALLBACK_DESC CallBack[SIZE_OF_CALLBACK_BUFFER];
 }CALLBACK_MANAGEMENT;
 
@@ -131,11 +167,35 @@ typedef struct
 
 typedef struct
 {
-	/* The Host shall be able to accept HCI Event packets with up to 255 octets of data excluding
-	the HCI Event packet header. The HCI Event packet header is the first 2 octets of the packet.
-	Location: 1896 Core_v5.2 */
-	uint8_t Bytes[ sizeof( ((DESC_DATA*)(NULL))->Size ) + sizeof(HCI_SERIAL_EVENT_PCKT) + 255 ];
-}__attribute__ ((packed)) EventMemBuffer;
+	uint8_t* Base; /* First byte of the pool */
+	uint8_t* End; /* First byte after the pool */
+	DESC_DATA** FreeStack; /* The top of the stack is the next buffer to be allocated */
+	uint8_t NumberOfFree;
+	MEMORY_POOL_STATISTICS Statistics;
+}MEMORY_POOL;
+
+
+typedef enum
+{
+	HCI_TRACE_SENT	   = 0, /* From host to controller. Values are the btsnoop direction flag */
+	HCI_TRACE_RECEIVED = 1  /* From controller to host */
+}HCI_TRACE_DIRECTION;
+
+
+typedef struct
+{
+	uint32_t TimeUs;	/* TimeBase_Get_Us() when the packet crossed the driver */
+	uint16_t Size;		/* Original size of the packet, packet type included */
+	uint8_t Direction;	/* It indicates the HCI_TRACE_DIRECTION */
+	uint8_t Bytes[HCI_TRACE_PAYLOAD_SIZE];
+}HCI_TRACE_RECORD;
+
+
+typedef struct
+{
+	volatile uint32_t Tail; /* Free running count of the packets traced since power up */
+	HCI_TRACE_RECORD Record[SIZE_OF_HCI_TRACE_BUFFER];
+}HCI_TRACE;
 
 
 /****************************************************************/
@@ -144,28 +204,45 @@ typedef struct
 static uint8_t Slave_Header_CallBack(TRANSFER_DESCRIPTOR* TransferDescPtr, SPI_TRANSFER_MODE HeaderMode);
 static uint8_t Transmitter_Multiplexer(TransferCallBack CallBack, uint8_t* DataPtr, uint16_t DataSize, TRANSFER_STATUS Status);
 static uint8_t Receiver_Multiplexer(uint8_t* DataPtr, uint16_t DataSize, TRANSFER_STATUS Status);
-static uint8_t Request_Slave_Header(SPI_TRANSFER_MODE HeaderMode, uint8_t Priority);
+static uint8_t Request_Slave_Header(SPI_TRANSFER_MODE HeaderMode);
 static void Init_Buffer_Manager(void);
+static void Init_Frame_Ring(FRAME_RING* RingPtr, BUFFER_DESC* FramePtr, uint8_t Size);
 static void Init_CallBack_Manager(CALLBACK_MANAGEMENT* ManagerPtr);
-inline static BUFFER_DESC* Search_For_Free_Frame(void) __attribute__((always_inline));
-inline static uint8_t Release_Frame( uint8_t ReleaseData, uint8_t ByPassFrameHead ) __attribute__((always_inline));
+inline static BUFFER_DESC* Frame_Ring_Head(FRAME_RING* RingPtr) __attribute__((always_inline));
+inline static BUFFER_DESC* Get_Frame_Head(void) __attribute__((always_inline));
+inline static uint8_t Release_Frame( BUFFER_DESC* FramePtr, uint8_t ReleaseData ) __attribute__((always_inline));
 static uint8_t Enqueue_CallBack(TRANSFER_DESCRIPTOR* TransferDescPtr, TRANSFER_STATUS TransferStatus,
 		CALLBACK_MANAGEMENT* ManagerPtr);
-inline static CALLBACK_DESC* Search_For_Free_CallBack(CALLBACK_MANAGEMENT* ManagerPtr) __attribute__((always_inline));
 inline static void Release_CallBack(CALLBACK_MANAGEMENT* ManagerPtr) __attribute__((always_inline));
-inline static uint8_t Add_Rx_Frame(uint16_t DataSize, int8_t buffer_index, uint8_t Priority) __attribute__((always_inline));
+static CALLBACK_DESC* Reserve_CallBack(CALLBACK_MANAGEMENT* ManagerPtr);
+static int8_t Find_Free_CallBack(CALLBACK_MANAGEMENT* ManagerPtr);
+static CALLBACK_DESC* Find_Received_Packet(void* DataPtr);
+static void Resume_Stalled_Read(void);
+static void Check_Received_Packet_Leaks(void);
+static void Publish_CallBack(CALLBACK_DESC* CallBackPtr, TRANSFER_DESCRIPTOR* TransferDescPtr, TRANSFER_STATUS TransferStatus);
+static void Cancel_CallBack(CALLBACK_MANAGEMENT* ManagerPtr, CALLBACK_DESC* CallBackPtr, TRANSFER_DESCRIPTOR* TransferDescPtr);
+inline static uint8_t Add_Rx_Frame(uint16_t DataSize) __attribute__((always_inline));
+inline static uint8_t Rx_Entry_Available(void) __attribute__((always_inline));
 inline static uint8_t Safe_Enqueue_CallBack( TRANSFER_DESCRIPTOR* TransferDescPtr, TRANSFER_STATUS TransferStatus,
 		CALLBACK_MANAGEMENT* ManagerPtr ) __attribute__((always_inline));
-static void Process_CallBack(CALLBACK_MANAGEMENT* ManagerPtr, SPI_TRANSFER_MODE TransferMode);
-inline static DESC_DATA* Search_For_Event_Memory_Buffer(void) __attribute__((always_inline));
+static void Process_CallBack(CALLBACK_MANAGEMENT* ManagerPtr, SPI_TRANSFER_MODE TransferMode, uint32_t StartTimeUs);
+static void Init_Memory_Pool(MEMORY_POOL* PoolPtr, uint16_t BufferSize);
+inline static DESC_DATA* Allocate_Memory_Buffer(MEMORY_POOL* PoolPtr) __attribute__((always_inline));
 inline static void Handle_Transmission_Failure( BUFFER_DESC* BufPtr ) __attribute__((always_inline));
+inline static uint8_t Keep_Write_Session( uint8_t FramesDone ) __attribute__((always_inline));
+static uint16_t Coalesce_Write_Frames( BUFFER_DESC* HeadPtr, uint8_t** TxDataPtr, uint16_t DataSize );
+static void Coalesced_Frames_Done( uint8_t Frames, TRANSFER_STATUS Status );
+static void Hold_Device( HOLD_REASON Reason, uint8_t Responses );
+static void End_Hold( uint8_t WokenUp );
+inline static void Trace_HCI_Packet( DESC_DATA* DataPtr, HCI_TRACE_DIRECTION Direction ) __attribute__((always_inline));
+static void Put_Big_Endian( uint8_t* DataPtr, uint32_t Value );
 
 
 /****************************************************************/
 /* extern functions declaration                                 */
 /****************************************************************/
-extern CMD_CALLBACK* Get_Command_CallBack( HCI_COMMAND_OPCODE OpCode );
-extern CMD_CALLBACK* Get_Command_Callback_From_Index( uint16_t Index );
+extern CMD_CALLBACK* Get_Expired_Command_Callback( uint32_t Now );
+extern void Retry_Command_Deadline( CMD_CALLBACK* CmdCallBack );
 
 
 /****************************************************************/
@@ -183,17 +260,24 @@ static CALLBACK_MANAGEMENT ReadCallBackManager;
 static CALLBACK_MANAGEMENT WriteCallBackManager;
 static CmdMemBuffer MemBufferCmd[SIZE_OF_CMD_MEM_BUFFER];
 static DataMemBuffer MemBufferData[SIZE_OF_DAT_MEM_BUFFER];
-static EventMemBuffer MemBufferEvent[SIZE_OF_EVT_MEM_BUFFER];
+static DESC_DATA* FreeCmdMemBuffer[SIZE_OF_CMD_MEM_BUFFER];
+static DESC_DATA* FreeDataMemBuffer[SIZE_OF_DAT_MEM_BUFFER];
+static MEMORY_POOL MemoryPool[] =
+{
+	[COMMAND_MEMORY_POOL] = { .Base = (uint8_t*)( &MemBufferCmd[0] ), .End = (uint8_t*)( &MemBufferCmd[SIZE_OF_CMD_MEM_BUFFER] ),
+			.FreeStack = &FreeCmdMemBuffer[0], .Statistics.NumberOfBuffers = SIZE_OF_CMD_MEM_BUFFER },
+	[DATA_MEMORY_POOL] = { .Base = (uint8_t*)( &MemBufferData[0] ), .End = (uint8_t*)( &MemBufferData[SIZE_OF_DAT_MEM_BUFFER] ),
+			.FreeStack = &FreeDataMemBuffer[0], .Statistics.NumberOfBuffers = SIZE_OF_DAT_MEM_BUFFER }
+};
 static uint8_t SPISlaveHeaderBytes[ sizeof( ((DESC_DATA*)(NULL))->Size ) + sizeof(SPI_SLAVE_HEADER) ];
 static uint8_t DummyByte;
 static uint32_t TimerResetActive = 0;
 static uint8_t ResetBluenrgRequest = TRUE;
 static uint8_t FirstBluenrgReset = TRUE;
-static volatile uint8_t BlockFrameHead = 0;
-static volatile uint8_t BlockRequestFrame = 0;
-static volatile uint8_t FrameHeadRelease = 0;
-static volatile uint8_t FrameHeadReleaseRequest = 0;
-static volatile uint8_t FrameEnqueueSignal = 0;
+static volatile uint8_t BufferManagerResets = 0;
+static HCI_TRACE HCITrace; /* Kept through the resets: the packets before a failure are the interesting ones */
+static uint8_t CoalesceBuffer[SIZE_OF_COALESCE_BUFFER];
+static RECEIVED_PACKET_STATISTICS ReceivedPacketStatistics; /* Kept through the resets, as the held packets */
 
 
 /****************************************************************/
@@ -225,6 +309,24 @@ void Reset_Bluenrg(uint8_t reset_mode)
 }
 
 
+/****************************************************************/
+/* Resume_Stalled_Read()     	   	  				           	*/
+/* Purpose: Restart a read postponed by Rx_Entry_Available()	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Called when an entry of the read callback queue	*/
+/* is freed, by the main loop or by Release_Received_Packet().	*/
+/****************************************************************/
+static void Resume_Stalled_Read(void)
+{
+	if( ( BufferManager.ReadStalled ) && ( Find_Free_CallBack( &ReadCallBackManager ) >= 0 ) )
+	{
+		BufferManager.ReadStalled = FALSE;
+		Request_Frame( 1 );
+	}
+}
+
+
 /****************************************************************/
 /* Run_Bluenrg()               	                            	*/
 /* Purpose: Continuous function call to run the Bluenrg  		*/
@@ -248,18 +350,15 @@ void Run_Bluenrg(void)
 		}
 	}else
 	{
-		Process_CallBack( &ReadCallBackManager, SPI_READ );
-		Process_CallBack( &WriteCallBackManager, SPI_WRITE );
+		uint32_t StartTimeUs = TimeBase_Get_Us();
 
-		/* If Hold time is active, no more messages can be sent for the duration of hold */
-		if( BufferManager.HoldTime )
-		{
-			if( TimeBase_DelayMs( &BufferManager.HoldCounter, BufferManager.HoldTime, TRUE) )
-			{
-				BufferManager.HoldTime = 0;
-				Request_Frame( 0 );
-			}
-		}
+		Process_CallBack( &ReadCallBackManager, SPI_READ, StartTimeUs );
+		Process_CallBack( &WriteCallBackManager, SPI_WRITE, StartTimeUs );
+
+		Check_Received_Packet_Leaks();
+
+		/* Also checked at every tick, for when the main loop is late */
+		Bluenrg_Hold_Timeout();
 	}
 }
 
@@ -273,72 +372,390 @@ void Run_Bluenrg(void)
 /****************************************************************/
 DESC_DATA* Search_For_Command_Memory_Buffer(void)
 {
-	/* TODO: improve performance */
+	return ( Allocate_Memory_Buffer( &MemoryPool[COMMAND_MEMORY_POOL] ) );
+}
+
+
+/****************************************************************/
+/* Search_For_Data_Memory_Buffer()          		         	*/
+/* Purpose: Find free buffer or return NULL						*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+DESC_DATA* Search_For_Data_Memory_Buffer(void)
+{
+	return ( Allocate_Memory_Buffer( &MemoryPool[DATA_MEMORY_POOL] ) );
+}
+
+
+/****************************************************************/
+/* Allocate_Memory_Buffer()          		         			*/
+/* Purpose: Take a free buffer of the pool						*/
+/* Parameters: PoolPtr: the command or the data pool			*/
+/* Return: The buffer, locked by a non-zero size, or NULL if	*/
+/* the pool has no free buffer.									*/
+/* Description: The free buffers of the pool are kept in its	*/
+/* FreeStack, filled by Init_Memory_Pool() and by				*/
+/* Release_Memory_Buffer(). The buffer on top is popped, so no	*/
+/* buffer is searched for and the time is constant. It is done	*/
+/* in a critical section, as the interrupts also allocate. 		*/
+/* Init_Memory_Pool() stacks all the buffers, also those still	*/
+/* used by their owner: one found on top with a non-zero size	*/
+/* is dropped from the stack, and is pushed again when its 		*/
+/* owner releases it. A failure is counted in the statistics.	*/
+/****************************************************************/
+static DESC_DATA* Allocate_Memory_Buffer(MEMORY_POOL* PoolPtr)
+{
 	DESC_DATA* DescDataPtr;
 
-	for ( uint16_t i = 0; i < SIZE_OF_CMD_MEM_BUFFER; i++ )
+	EnterCritical(); /* Critical section enter */
+
+	while( PoolPtr->NumberOfFree != 0 )
 	{
-		DescDataPtr = (typeof(DescDataPtr))( &MemBufferCmd[i].Bytes[0] );
+		PoolPtr->NumberOfFree--;
+		DescDataPtr = PoolPtr->FreeStack[PoolPtr->NumberOfFree];
 
 		if( DescDataPtr->Size == 0 )
 		{
 			DescDataPtr->Size = 1; /* Just to lock the buffer */
+
+			PoolPtr->Statistics.InUse++;
+			if( PoolPtr->Statistics.InUse > PoolPtr->Statistics.HighWaterMark )
+			{
+				PoolPtr->Statistics.HighWaterMark = PoolPtr->Statistics.InUse;
+			}
+
+			ExitCritical(); /* Critical section exit */
 			return ( DescDataPtr );
 		}
 	}
+
+	if( PoolPtr->Statistics.Failures != UINT16_MAX )
+	{
+		PoolPtr->Statistics.Failures++;
+	}
+
+	ExitCritical(); /* Critical section exit */
+
 	return ( NULL );
 }
 
 
 /****************************************************************/
-/* Search_For_Data_Memory_Buffer()          		         	*/
-/* Purpose: Find free buffer or return NULL						*/
+/* Release_Memory_Buffer()          		         			*/
+/* Purpose: Give the buffer back to its pool					*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Buffers that do not belong to any pool (as the 	*/
+/* slave header) only have the size cleared. Releasing an 		*/
+/* already free buffer (size zero) has no effect.				*/
+/****************************************************************/
+void Release_Memory_Buffer(DESC_DATA* DescDataPtr)
+{
+	uint8_t* BytePtr = (uint8_t*)DescDataPtr;
+
+	EnterCritical(); /* Critical section enter */
+
+	if( DescDataPtr->Size != 0 )
+	{
+		DescDataPtr->Size = 0;
+
+		for( uint8_t i = 0; i < ( sizeof(MemoryPool) / sizeof(MEMORY_POOL) ); i++ )
+		{
+			if( ( BytePtr >= MemoryPool[i].Base ) && ( BytePtr < MemoryPool[i].End ) )
+			{
+				if( MemoryPool[i].Statistics.InUse != 0 )
+				{
+					MemoryPool[i].Statistics.InUse--;
+				}
+				if( MemoryPool[i].NumberOfFree < MemoryPool[i].Statistics.NumberOfBuffers )
+				{
+					MemoryPool[i].FreeStack[MemoryPool[i].NumberOfFree] = DescDataPtr;
+					MemoryPool[i].NumberOfFree++;
+				}
+				break;
+			}
+		}
+	}
+
+	ExitCritical(); /* Critical section exit */
+}
+
+
+/****************************************************************/
+/* Get_Buffer_Manager_Resets()          		         		*/
+/* Purpose: Tell if the memory pools were initialized again		*/
+/* Parameters: none				         						*/
+/* Return: Number of initializations. It wraps around.			*/
+/* Description: A memory buffer reserved by a higher layer is	*/
+/* no longer valid after the count changes, since the pools 	*/
+/* were emptied by a reset of the driver.						*/
+/****************************************************************/
+uint8_t Get_Buffer_Manager_Resets(void)
+{
+	return ( BufferManagerResets );
+}
+
+
+/****************************************************************/
+/* Get_Memory_Pool_Statistics()          		         		*/
+/* Purpose: Return the usage of the memory pool					*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-DESC_DATA* Search_For_Data_Memory_Buffer(void)
+MEMORY_POOL_STATISTICS Get_Memory_Pool_Statistics(MEMORY_POOL_ID PoolId)
 {
-	/* TODO: improve performance */
-	DESC_DATA* DescDataPtr;
+	MEMORY_POOL_STATISTICS Statistics;
+
+	EnterCritical(); /* Critical section enter */
+
+	Statistics = MemoryPool[PoolId].Statistics;
+
+	ExitCritical(); /* Critical section exit */
+
+	return ( Statistics );
+}
+
+
+/****************************************************************/
+/* Get_Write_Header_Statistics()								*/
+/* Purpose: Return the slave headers read before the writes		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+WRITE_HEADER_STATISTICS Get_Write_Header_Statistics(void)
+{
+	return ( BufferManager.WriteHeaderStatistics );
+}
+
+
+/****************************************************************/
+/* Get_Hold_Statistics()										*/
+/* Purpose: Return the holds imposed by the slave headers		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The counters are kept across resets.			*/
+/****************************************************************/
+HOLD_STATISTICS Get_Hold_Statistics(void)
+{
+	HOLD_STATISTICS Statistics;
 
-	for ( uint16_t i = 0; i < SIZE_OF_DAT_MEM_BUFFER; i++ )
+	EnterCritical(); /* Critical section enter */
+
+	Statistics = BufferManager.HoldStatistics;
+
+	ExitCritical(); /* Critical section exit */
+
+	return ( Statistics );
+}
+
+
+/****************************************************************/
+/* Hold_Received_Packet()										*/
+/* Purpose: Keep a received packet after its callback returns	*/
+/* Parameters: DataPtr: any byte of the packet, as the pointers	*/
+/* given to the receive handlers.								*/
+/* Return: TRUE if the packet is held.							*/
+/* Description: The packet stays in its read callback entry,	*/
+/* so it is not copied, until Release_Received_Packet() is 		*/
+/* called for each hold. An entry held when the Bluenrg is		*/
+/* reset is kept as well. Holds lasting more than				*/
+/* RECEIVED_PACKET_LEAK_TIME_US are reported through 			*/
+/* Bluenrg_Received_Packet_Leak().								*/
+/****************************************************************/
+uint8_t Hold_Received_Packet(void* DataPtr)
+{
+	CALLBACK_DESC* CallBackPtr = Find_Received_Packet( DataPtr );
+	uint8_t Status = FALSE;
+
+	EnterCritical(); /* Critical section enter */
+
+	if( ( CallBackPtr != NULL ) && ( CallBackPtr->Status != BUFFER_FREE ) && ( CallBackPtr->References != UINT8_MAX ) )
 	{
-		DescDataPtr = (typeof(DescDataPtr))( &MemBufferData[i].Bytes[0] );
+		if( CallBackPtr->References == 0 )
+		{
+			CallBackPtr->HoldStartUs = TimeBase_Get_Us();
+			CallBackPtr->LeakReported = FALSE;
 
-		if( DescDataPtr->Size == 0 )
+			ReceivedPacketStatistics.Held++;
+			if( ReceivedPacketStatistics.Held > ReceivedPacketStatistics.HighWaterMark )
+			{
+				ReceivedPacketStatistics.HighWaterMark = ReceivedPacketStatistics.Held;
+			}
+		}
+
+		CallBackPtr->References++;
+		ReceivedPacketStatistics.Holds++;
+		Status = TRUE;
+	}
+
+	ExitCritical(); /* Critical section exit */
+
+	return (Status);
+}
+
+
+/****************************************************************/
+/* Release_Received_Packet()									*/
+/* Purpose: Give back a packet held by Hold_Received_Packet()	*/
+/* Parameters: DataPtr: any byte of the packet.					*/
+/* Return: none  												*/
+/* Description: The entry is reused after the last release. A	*/
+/* read postponed for the lack of entries starts again.			*/
+/****************************************************************/
+void Release_Received_Packet(void* DataPtr)
+{
+	CALLBACK_DESC* CallBackPtr = Find_Received_Packet( DataPtr );
+	uint8_t Freed = FALSE;
+
+	EnterCritical(); /* Critical section enter */
+
+	if( ( CallBackPtr != NULL ) && ( CallBackPtr->References != 0 ) )
+	{
+		CallBackPtr->References--;
+		ReceivedPacketStatistics.Releases++;
+
+		if( CallBackPtr->References == 0 )
 		{
-			DescDataPtr->Size = 1; /* Just to lock the buffer */
-			return ( DescDataPtr );
+			ReceivedPacketStatistics.Held--;
+
+			/* Still in the queue otherwise: Release_CallBack() frees it */
+			if( CallBackPtr->Status == BUFFER_HELD )
+			{
+				CallBackPtr->Status = BUFFER_FREE;
+				Freed = TRUE;
+			}
 		}
 	}
-	return ( NULL );
+
+	ExitCritical(); /* Critical section exit */
+
+	if( Freed )
+	{
+		Resume_Stalled_Read();
+	}
 }
 
 
 /****************************************************************/
-/* Search_For_Event_Memory_Buffer()          		         	*/
-/* Purpose: Find free buffer or return NULL						*/
+/* Get_Received_Packet_Statistics()								*/
+/* Purpose: Return the holds of received packets				*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
+/* Description: The counters are kept across resets.			*/
+/****************************************************************/
+RECEIVED_PACKET_STATISTICS Get_Received_Packet_Statistics(void)
+{
+	RECEIVED_PACKET_STATISTICS Statistics;
+
+	EnterCritical(); /* Critical section enter */
+
+	Statistics = ReceivedPacketStatistics;
+
+	ExitCritical(); /* Critical section exit */
+
+	return ( Statistics );
+}
+
+
+/****************************************************************/
+/* Find_Received_Packet()										*/
+/* Purpose: Return the read callback entry holding a byte		*/
+/* Parameters: none				         						*/
+/* Return: The entry or NULL if the byte is not in the read		*/
+/* callback queue.												*/
 /* Description:													*/
 /****************************************************************/
-static DESC_DATA* Search_For_Event_Memory_Buffer(void)
+static CALLBACK_DESC* Find_Received_Packet(void* DataPtr)
 {
-	/* TODO: improve performance */
-	DESC_DATA* DescDataPtr;
+	uint8_t* BytePtr = (uint8_t*)DataPtr;
+	uint8_t* BasePtr = (uint8_t*)( &ReadCallBackManager.CallBack[0] );
 
-	for ( uint16_t i = 0; i < SIZE_OF_EVT_MEM_BUFFER; i++ )
+	if( ( BytePtr < BasePtr ) || ( BytePtr >= (uint8_t*)( &ReadCallBackManager.CallBack[SIZE_OF_CALLBACK_BUFFER] ) ) )
 	{
-		DescDataPtr = (typeof(DescDataPtr))( &MemBufferEvent[i].Bytes[0] );
+		return (NULL);
+	}
 
-		if( DescDataPtr->Size == 0 )
+	return ( &ReadCallBackManager.CallBack[ ( BytePtr - BasePtr ) / sizeof(CALLBACK_DESC) ] );
+}
+
+
+/****************************************************************/
+/* Check_Received_Packet_Leaks()								*/
+/* Purpose: Report the packets held for too long				*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Called from the main loop. Each hold is 		*/
+/* reported once, when it passes RECEIVED_PACKET_LEAK_TIME_US.	*/
+/****************************************************************/
+static void Check_Received_Packet_Leaks(void)
+{
+	CALLBACK_DESC* CallBackPtr;
+	uint32_t HeldTimeUs;
+
+	if( ReceivedPacketStatistics.Held == 0 )
+	{
+		return;
+	}
+
+	for( uint8_t i = 0; i < SIZE_OF_CALLBACK_BUFFER; i++ )
+	{
+		CallBackPtr = &ReadCallBackManager.CallBack[i];
+		HeldTimeUs = TimeBase_Get_Us() - CallBackPtr->HoldStartUs;
+
+		if( ( CallBackPtr->References != 0 ) && ( !CallBackPtr->LeakReported ) && ( HeldTimeUs >= RECEIVED_PACKET_LEAK_TIME_US ) )
 		{
-			DescDataPtr->Size = 1; /* Just to lock the buffer */
-			return ( DescDataPtr );
+			CallBackPtr->LeakReported = TRUE;
+			ReceivedPacketStatistics.Leaks++;
+
+			Bluenrg_Received_Packet_Leak( &CallBackPtr->TransferDesc.Data.Bytes[0], HeldTimeUs );
 		}
 	}
-	return ( NULL );
+}
+
+
+/****************************************************************/
+/* Get_Queue_Statistics()          		         				*/
+/* Purpose: Return the usage of a frame or callback queue		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The counters are kept across resets.			*/
+/****************************************************************/
+QUEUE_STATISTICS Get_Queue_Statistics(QUEUE_ID QueueId)
+{
+	QUEUE_STATISTICS Statistics;
+
+	EnterCritical(); /* Critical section enter */
+
+	switch( QueueId )
+	{
+	case TRANSPORT_FRAME_QUEUE:
+		Statistics = BufferManager.TransportRing.Statistics;
+		Statistics.InUse = BufferManager.TransportRing.Tail - BufferManager.TransportRing.Head;
+		break;
+
+	case WRITE_FRAME_QUEUE:
+		Statistics = BufferManager.WriteRing.Statistics;
+		Statistics.InUse = BufferManager.WriteRing.Tail - BufferManager.WriteRing.Head;
+		break;
+
+	case READ_CALLBACK_QUEUE:
+		Statistics = ReadCallBackManager.Statistics;
+		Statistics.InUse = ReadCallBackManager.CallBackTail - ReadCallBackManager.CallBackHead;
+		break;
+
+	default:
+		Statistics = WriteCallBackManager.Statistics;
+		Statistics.InUse = WriteCallBackManager.CallBackTail - WriteCallBackManager.CallBackHead;
+		break;
+	}
+
+	ExitCritical(); /* Critical section exit */
+
+	return ( Statistics );
 }
 
 
@@ -347,24 +764,57 @@ static DESC_DATA* Search_For_Event_Memory_Buffer(void)
 /* Purpose: Dequeue and process callbacks				  		*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
-/****************************************************************/
-static void Process_CallBack(CALLBACK_MANAGEMENT* ManagerPtr, SPI_TRANSFER_MODE TransferMode)
+/* Description: Only called from the main loop, which is the	*/
+/* single consumer of the callback queues. The queue is drained	*/
+/* up to the callbacks present at the call, so that interrupts	*/
+/* enqueuing faster than the handlers cannot hold the main loop	*/
+/* here, or until CALLBACK_TIME_BUDGET_US has passed since		*/
+/* StartTimeUs. At least one callback is always handled.		*/
+/****************************************************************/
+static void Process_CallBack(CALLBACK_MANAGEMENT* ManagerPtr, SPI_TRANSFER_MODE TransferMode, uint32_t StartTimeUs)
 {
-	int8_t NumberOfCallbacksPerCall = SIZE_OF_CALLBACK_BUFFER/2; /* To avoid being blocked by too much callbacks to process */
+	uint8_t NumberOfCallbacks = ManagerPtr->CallBackTail - ManagerPtr->CallBackHead;
+	uint32_t DwellTimeUs;
 
+	CALLBACK_DESC* CallBackPtr;
 	CB_TRANSFER_DESCRIPTOR* TransferDescPtr;
 	TRANSFER_STATUS Status;
 
-	while( ( ManagerPtr->CallBackHead->Status == BUFFER_FULL ) && ( NumberOfCallbacksPerCall > 0 ) )
+	while( NumberOfCallbacks > 0 )
 	{
-		TransferDescPtr = &ManagerPtr->CallBackHead->TransferDesc;
-		Status = ManagerPtr->CallBackHead->TransferStatus;
+		CallBackPtr = &ManagerPtr->CallBack[ ManagerPtr->Order[ ManagerPtr->CallBackHead & ( SIZE_OF_CALLBACK_BUFFER - 1 ) ] ];
+
+		/* Empty queue or the interrupt enqueuing the callback did not finish copying it */
+		if( CallBackPtr->Status != BUFFER_FULL )
+		{
+			break;
+		}
+
+		CompilerBarrier(); /* The callback is only read after it was published */
+
+		DwellTimeUs = TimeBase_Get_Us() - CallBackPtr->EnqueueTimeUs;
+		if( (int32_t)DwellTimeUs < 0 )
+		{
+			DwellTimeUs = 0; /* Enqueued by an interrupt that blocked the SysTick update */
+		}
+		ManagerPtr->Statistics.Dequeues++;
+		ManagerPtr->Statistics.TotalDwellTimeUs += DwellTimeUs;
+		if( DwellTimeUs > ManagerPtr->Statistics.MaxDwellTimeUs )
+		{
+			ManagerPtr->Statistics.MaxDwellTimeUs = DwellTimeUs;
+		}
+
+		TransferDescPtr = &CallBackPtr->TransferDesc;
+		Status = CallBackPtr->TransferStatus;
 
 		/* Blocks until the resource is acquired */
 		if( TransferMode == SPI_READ )
 		{
-			while( Receiver_Multiplexer( &TransferDescPtr->Data.Bytes[0], TransferDescPtr->Data.Size, Status ) != TRUE );
+			/* Empty if the packet was handled by the SPI interrupt or could not be read */
+			if( TransferDescPtr->Data.Size != 0 )
+			{
+				while( Receiver_Multiplexer( &TransferDescPtr->Data.Bytes[0], TransferDescPtr->Data.Size, Status ) != TRUE );
+			}
 		}else
 		{
 			while( Transmitter_Multiplexer( TransferDescPtr->CallBack, &TransferDescPtr->Data.Bytes[0], TransferDescPtr->Data.Size, Status ) != TRUE );
@@ -372,74 +822,84 @@ static void Process_CallBack(CALLBACK_MANAGEMENT* ManagerPtr, SPI_TRANSFER_MODE
 
 		Release_CallBack( ManagerPtr );
 
-		NumberOfCallbacksPerCall--;
+		if( TransferMode == SPI_READ )
+		{
+			Resume_Stalled_Read();
+		}
+
+		NumberOfCallbacks--;
+
+		if( ( CALLBACK_TIME_BUDGET_US != 0 ) && ( ( TimeBase_Get_Us() - StartTimeUs ) >= CALLBACK_TIME_BUDGET_US ) )
+		{
+			break;
+		}
+	}
+}
+
+
+/****************************************************************/
+/* Bluenrg_Hold_Timeout()                      	            	*/
+/* Purpose: End the hold of the device when its time is over	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Called from the main loop and at every tick, so	*/
+/* a hold never lasts more than a tick beyond its time, however	*/
+/* long the main loop is busy. If both see the end of the hold,	*/
+/* the second End_Hold() does nothing and Request_Frame() is	*/
+/* already guarded against concurrent calls.					*/
+/****************************************************************/
+void Bluenrg_Hold_Timeout( void )
+{
+	/* If Hold time is active, no more messages can be sent for the duration of hold */
+	if( ( BufferManager.HoldTimeUs ) && ( ( TimeBase_Get_Us() - BufferManager.HoldStartUs ) >= BufferManager.HoldTimeUs ) )
+	{
+		End_Hold( FALSE );
+		Request_Frame( 0 );
 	}
 }
 
 
 /****************************************************************/
 /* Bluerng_Command_Timeout()                      	            */
-/* Purpose: Count time in active command callbacks		  		*/
+/* Purpose: Report the commands not answered in time	  		*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: Called at every tick. The transport layer keeps	*/
+/* the deadlines in a heap, so only the earliest one is 		*/
+/* compared with the tick while no command expired.				*/
 /****************************************************************/
 void Bluerng_Command_Timeout( void )
 {
 	/* This function must be called from a privileged function, like a timer interrupt */
-	static uint32_t Tcounter = 10;
-	static uint16_t NumberOfCallbacks;
-	static CMD_CALLBACK* CbPtr;
 	static TRANSFER_DESCRIPTOR TransferDesc;
 	static HCI_SERIAL_EVENT_PCKT* EventPacketPtr;
 	static uint8_t Comand_Status_Bytes[24];
+	CMD_CALLBACK* CbPtr;
 
-	/* At every 10 ms evaluate the timeout of callbacks */
-	if( Tcounter != 0 )
-	{
-		Tcounter--;
-	}
+	while( ( CbPtr = Get_Expired_Command_Callback( HAL_GetTick() ) ) != NULL )
 	{
-		Tcounter = 10;
-		NumberOfCallbacks = Get_Number_Of_Command_Callbacks( );
+		TransferDesc.CallBack = NULL;
+		TransferDesc.CallBackMode = CALL_BACK_BUFFERED;
+		TransferDesc.DataPtr = (typeof(TransferDesc.DataPtr))( &Comand_Status_Bytes[0] );
 
-		for( uint16_t i = 0; i < NumberOfCallbacks; i++ )
-		{
-			CbPtr = Get_Command_Callback_From_Index( i );
-			if( CbPtr->Status != FREE )
-			{
-				if( CbPtr->Timeout != 0 )
-				{
-					CbPtr->Timeout -= 10; /* Decreases 10 ms */
-					if( CbPtr->Timeout <= 0 )
-					{
-						CbPtr->Timeout = 0;
+		EventPacketPtr = (typeof(EventPacketPtr))( &TransferDesc.DataPtr->Bytes[0] );
 
-						TransferDesc.CallBack = NULL;
-						TransferDesc.CallBackMode = CALL_BACK_BUFFERED;
-						TransferDesc.DataPtr = (typeof(TransferDesc.DataPtr))( &Comand_Status_Bytes[0] );
-
-						EventPacketPtr = (typeof(EventPacketPtr))( &TransferDesc.DataPtr->Bytes[0] );
-
-						EventPacketPtr->PacketType = HCI_EVENT_PACKET;
-						EventPacketPtr->EventPacket.Event_Code = COMMAND_STATUS;
-						EventPacketPtr->EventPacket.Event_Parameter[0] = LMP_OR_LL_RESPONSE_TIMEOUT; /* Status */
-						EventPacketPtr->EventPacket.Event_Parameter[1] = 1; /* Num_HCI_Command_Packets */
-						EventPacketPtr->EventPacket.Event_Parameter[2] = CbPtr->OpCode.Val & 0xFF;
-						EventPacketPtr->EventPacket.Event_Parameter[3] = ( CbPtr->OpCode.Val >> 8 ) & 0xFF;
-						EventPacketPtr->EventPacket.Parameter_Total_Length = 4;
+		EventPacketPtr->PacketType = HCI_EVENT_PACKET;
+		EventPacketPtr->EventPacket.Event_Code = COMMAND_STATUS;
+		EventPacketPtr->EventPacket.Event_Parameter[0] = LMP_OR_LL_RESPONSE_TIMEOUT; /* Status */
+		EventPacketPtr->EventPacket.Event_Parameter[1] = 1; /* Num_HCI_Command_Packets */
+		EventPacketPtr->EventPacket.Event_Parameter[2] = CbPtr->OpCode.Val & 0xFF;
+		EventPacketPtr->EventPacket.Event_Parameter[3] = ( CbPtr->OpCode.Val >> 8 ) & 0xFF;
+		EventPacketPtr->EventPacket.Parameter_Total_Length = 4;
 
-						TransferDesc.DataPtr->Size = sizeof(HCI_SERIAL_EVENT_PCKT) + EventPacketPtr->EventPacket.Parameter_Total_Length;
+		TransferDesc.DataPtr->Size = sizeof(HCI_SERIAL_EVENT_PCKT) + EventPacketPtr->EventPacket.Parameter_Total_Length;
 
-						/* Search for a room in the reception callback queue */
-						if( !Safe_Enqueue_CallBack( &TransferDesc, TRANSFER_DONE, &ReadCallBackManager ) )
-						{
-							/* Gives another chance in the next cycle */
-							CbPtr->Timeout += 10;
-						}
-					}
-				}
-			}
+		/* Search for a room in the reception callback queue */
+		if( !Safe_Enqueue_CallBack( &TransferDesc, TRANSFER_DONE, &ReadCallBackManager ) )
+		{
+			/* Gives another chance later */
+			Retry_Command_Deadline( CbPtr );
+			break;
 		}
 	}
 }
@@ -458,6 +918,20 @@ __attribute__((weak)) void Bluenrg_Error(BLUENRG_ERROR_CODES Errorcode)
 }
 
 
+/****************************************************************/
+/* Bluenrg_Received_Packet_Leak()                               */
+/* Purpose: Called for a packet held for too long				*/
+/* Parameters: DataPtr: the packet, packet type first.			*/
+/* Return: none  												*/
+/* Description: The packet stays held: only its owner can 		*/
+/* release it.													*/
+/****************************************************************/
+__attribute__((weak)) void Bluenrg_Received_Packet_Leak(uint8_t* DataPtr, uint32_t HeldTimeUs)
+{
+	/* The user may implement at higher layers to log the owner of the packet */
+}
+
+
 /****************************************************************/
 /* Init_Buffer_Manager()                   			         	*/
 /* Purpose: Initialize manager structure				  		*/
@@ -467,47 +941,77 @@ __attribute__((weak)) void Bluenrg_Error(BLUENRG_ERROR_CODES Errorcode)
 /****************************************************************/
 static void Init_Buffer_Manager(void)
 {
-	for( int8_t i = 0; i < SIZE_OF_FRAME_BUFFER; i++ )
-	{
-		BufferManager.Buffer[i].Status = BUFFER_FREE; /* Buffer is free */
-	}
+	BufferManager.HoldTimeUs = 0;
+	BufferManager.HoldStartUs = 0;
+	BufferManager.HoldWokenUp = FALSE;
+	BufferManager.ReadStalled = FALSE;
 
-	BufferManager.HoldTime = 0;
-	BufferManager.HoldCounter = 0;
-	BufferManager.BufferHead = &BufferManager.Buffer[0]; /* The head always points to the buffer to be transmitted first */
-	BufferManager.BufferHead->Next = &BufferManager.Buffer[0]; /* Points to the next buffer for transmission */
-
-	BufferManager.BufferTail = &BufferManager.Buffer[0]; /* The tail always points to last filled buffer */
-	BufferManager.BufferTail->Next = &BufferManager.Buffer[0]; /* Points to the next free buffer */
+	Init_Frame_Ring( &BufferManager.TransportRing, &BufferManager.TransportFrame[0], SIZE_OF_TRANSPORT_BUFFER );
+	Init_Frame_Ring( &BufferManager.WriteRing, &BufferManager.WriteFrame[0], SIZE_OF_FRAME_BUFFER );
 
 	BufferManager.AllowedWriteSize = 0;
+	BufferManager.WriteSessionOpen = FALSE;
 	BufferManager.SizeToRead = 0;
-	BufferManager.NumberOfFilledBuffers = 0;
 
+	Init_Memory_Pool( &MemoryPool[COMMAND_MEMORY_POOL], sizeof(CmdMemBuffer) );
+	Init_Memory_Pool( &MemoryPool[DATA_MEMORY_POOL], sizeof(DataMemBuffer) );
+
+	Init_CallBack_Manager( &ReadCallBackManager );
+	Init_CallBack_Manager( &WriteCallBackManager );
+
+	FirstBluenrgReset = FALSE;
+	BufferManagerResets++;
+}
+
+
+/****************************************************************/
+/* Init_Memory_Pool()                                    		*/
+/* Purpose: Put all buffers of the pool in the free stack  		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The statistics counters, except InUse, are		*/
+/* kept across resets.											*/
+/****************************************************************/
+static void Init_Memory_Pool(MEMORY_POOL* PoolPtr, uint16_t BufferSize)
+{
 	DESC_DATA* DescDataPtr;
 
-	for ( uint16_t i = 0; i < SIZE_OF_CMD_MEM_BUFFER; i++ )
-	{
-		DescDataPtr = (typeof(DescDataPtr))( &MemBufferCmd[i].Bytes[0] );
-		DescDataPtr->Size = 0;
-	}
+	EnterCritical(); /* Critical section enter */
 
-	for ( uint16_t i = 0; i < SIZE_OF_DAT_MEM_BUFFER; i++ )
+	for ( uint8_t i = 0; i < PoolPtr->Statistics.NumberOfBuffers; i++ )
 	{
-		DescDataPtr = (typeof(DescDataPtr))( &MemBufferData[i].Bytes[0] );
+		DescDataPtr = (typeof(DescDataPtr))( &PoolPtr->Base[ i * BufferSize ] );
 		DescDataPtr->Size = 0;
+		PoolPtr->FreeStack[i] = DescDataPtr;
 	}
 
-	for ( uint16_t i = 0; i < SIZE_OF_EVT_MEM_BUFFER; i++ )
+	PoolPtr->NumberOfFree = PoolPtr->Statistics.NumberOfBuffers;
+	PoolPtr->Statistics.InUse = 0;
+
+	ExitCritical(); /* Critical section exit */
+}
+
+
+/****************************************************************/
+/* Init_Frame_Ring()                                    		*/
+/* Purpose: Empty a frame ring			    					*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The statistics counters, except Size, are kept	*/
+/* across resets.												*/
+/****************************************************************/
+static void Init_Frame_Ring(FRAME_RING* RingPtr, BUFFER_DESC* FramePtr, uint8_t Size)
+{
+	for( uint8_t i = 0; i < Size; i++ )
 	{
-		DescDataPtr = (typeof(DescDataPtr))( &MemBufferEvent[i].Bytes[0] );
-		DescDataPtr->Size = 0;
+		FramePtr[i].Status = BUFFER_FREE; /* Buffer is free */
 	}
 
-	Init_CallBack_Manager( &ReadCallBackManager );
-	Init_CallBack_Manager( &WriteCallBackManager );
-
-	FirstBluenrgReset = FALSE;
+	RingPtr->Frame = FramePtr;
+	RingPtr->Size = Size;
+	RingPtr->Head = 0;
+	RingPtr->Tail = 0;
+	RingPtr->Statistics.Size = Size;
 }
 
 
@@ -516,51 +1020,28 @@ static void Init_Buffer_Manager(void)
 /* Purpose: Initialize callback manager    						*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: The entries held by the application are not	*/
+/* freed: they come back when released.							*/
 /****************************************************************/
 static void Init_CallBack_Manager(CALLBACK_MANAGEMENT* ManagerPtr)
 {
-	/* This strange procedure is used to avoid losing context in the cases where the Bluenrg is issued while the system is serving a callback */
-	int8_t indexbuffhead = 0;
-	CALLBACK_DESC* FreeBuffer;
+	/* When the Bluenrg is reset while the main loop is serving the callback at the head, that callback
+	 * is kept so that Process_CallBack() can release it after returning from the handler */
+	uint8_t HeadIndex = ManagerPtr->Order[ ManagerPtr->CallBackHead & ( SIZE_OF_CALLBACK_BUFFER - 1 ) ];
+	uint8_t KeepHead = ( !FirstBluenrgReset ) && ( ManagerPtr->CallBack[HeadIndex].Status == BUFFER_FULL );
 
-	for( int8_t i = 0; i < SIZE_OF_CALLBACK_BUFFER; i++ )
+	for( uint8_t i = 0; i < SIZE_OF_CALLBACK_BUFFER; i++ )
 	{
-		if( FirstBluenrgReset )
-		{
-			ManagerPtr->CallBack[i].Status = BUFFER_FREE; /* Buffer is free */
-		}else if( &ManagerPtr->CallBack[i] == ManagerPtr->CallBackHead )
-		{
-			if( ManagerPtr->CallBackHead->Status == BUFFER_FULL ) /* The buffer is being or will be handled */
-			{
-				indexbuffhead = i;
-			}else
-			{
-				ManagerPtr->CallBack[i].Status = BUFFER_FREE; /* Buffer is free */
-			}
-		}else
+		if( ( i != HeadIndex ) || ( !KeepHead ) )
 		{
-			ManagerPtr->CallBack[i].Status = BUFFER_FREE; /* Buffer is free */
+			/* Buffer is free unless the application holds it */
+			ManagerPtr->CallBack[i].Status = ( ManagerPtr->CallBack[i].References != 0 ) ? BUFFER_HELD : BUFFER_FREE;
 		}
 	}
 
-	ManagerPtr->CallBackHead = &ManagerPtr->CallBack[indexbuffhead]; /* The head always points to the callback to be handled first */
+	ManagerPtr->CallBackTail = ManagerPtr->CallBackHead + ( KeepHead ? 1 : 0 );
 
-	if( ManagerPtr->CallBackHead->Status == BUFFER_FREE )
-	{
-		FreeBuffer = &ManagerPtr->CallBack[indexbuffhead];
-		ManagerPtr->NumberOfFilledBuffers = 0;
-	}else
-	{
-		FreeBuffer = Search_For_Free_CallBack( ManagerPtr );
-		ManagerPtr->NumberOfFilledBuffers = 1;
-	}
-
-	ManagerPtr->CallBackHead->Next = FreeBuffer; /* Points to the next callback for handling */
-
-	ManagerPtr->CallBackTail = &ManagerPtr->CallBack[indexbuffhead]; /* The tail always points to last filled callback */
-
-	ManagerPtr->CallBackTail->Next = FreeBuffer; /* Points to the next free callback */
+	ManagerPtr->Statistics.Size = SIZE_OF_CALLBACK_BUFFER;
 }
 
 
@@ -573,73 +1054,99 @@ static void Init_CallBack_Manager(CALLBACK_MANAGEMENT* ManagerPtr)
 /****************************************************************/
 void Bluenrg_IRQ(void)
 {
+	/* The device has something to say, so it is ready again: there is no reason to wait for the end of the hold */
+	End_Hold( TRUE );
+
 	Request_Frame( 1 );
 }
 
 
 /****************************************************************/
-/* Release_Frame()                        				    	*/
-/* Purpose: Release the transfer buffer head.					*/
+/* Frame_Ring_Head()                        				    */
+/* Purpose: Return the first frame of the ring or NULL if the	*/
+/* ring is empty.												*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-static uint8_t Release_Frame( uint8_t ReleaseData, uint8_t ByPassFrameHead )
+static BUFFER_DESC* Frame_Ring_Head(FRAME_RING* RingPtr)
 {
-	EnterCritical(); /* Critical section enter */
-
-	FrameHeadRelease++;
+	uint8_t Head = RingPtr->Head;
 
-	if( FrameHeadRelease != 1 )
+	if( Head == RingPtr->Tail )
 	{
-		ExitCritical(); /* Critical section exit */
-		return (FALSE);
+		return (NULL);
 	}
 
-	if( FrameEnqueueSignal ) /* Cannot release under frame enqueue */
-	{
-		FrameHeadReleaseRequest++;
-		FrameHeadRelease = 0;
-		ExitCritical(); /* Critical section exit */
-		return (FALSE);
-	}
+	CompilerBarrier(); /* The frame is only read after it was published */
+
+	return ( &RingPtr->Frame[ Head & ( RingPtr->Size - 1 ) ] );
+}
+
+
+/****************************************************************/
+/* Get_Frame_Head()                        				    	*/
+/* Purpose: Return the frame to be transmitted first or NULL	*/
+/* if there are no frames.										*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: A frame being transmitted keeps the bus until	*/
+/* its transfer ends. Otherwise, the slave headers and reads go	*/
+/* before the writes, since a paused write needs a new slave	*/
+/* header to proceed and a pending read keeps the device		*/
+/* selected.													*/
+/****************************************************************/
+static BUFFER_DESC* Get_Frame_Head(void)
+{
+	BUFFER_DESC* TransportPtr = Frame_Ring_Head( &BufferManager.TransportRing );
+	BUFFER_DESC* WritePtr = Frame_Ring_Head( &BufferManager.WriteRing );
 
-	if( ( BlockFrameHead ) && ( !ByPassFrameHead ) ) /* Cannot release the head that is blocked for transmission */
+	if( ( WritePtr != NULL ) && ( ( WritePtr->Status == BUFFER_TRANSMITTING ) || ( TransportPtr == NULL ) ) )
 	{
-		FrameHeadRelease = 0;
-		ExitCritical(); /* Critical section exit */
-		return (FALSE);
+		return (WritePtr);
 	}
 
-	ExitCritical(); /* Critical section exit */
+	return (TransportPtr);
+}
 
 
-	BufferManager.BufferHead->Status = BUFFER_FREE;
+/****************************************************************/
+/* Release_Frame()                        				    	*/
+/* Purpose: Release the first frame of its ring.				*/
+/* Parameters: none				         						*/
+/* Return: TRUE if the frame was released.						*/
+/* Description: Only called by the transmission side, which is	*/
+/* the single consumer of both frame rings. If the Bluenrg was	*/
+/* reset meanwhile, the frame is already free and nothing is 	*/
+/* done.														*/
+/****************************************************************/
+static uint8_t Release_Frame( BUFFER_DESC* FramePtr, uint8_t ReleaseData )
+{
+	FRAME_RING* RingPtr;
 
-	if( ReleaseData )
+	if( ( FramePtr >= &BufferManager.WriteFrame[0] ) && ( FramePtr < &BufferManager.WriteFrame[SIZE_OF_FRAME_BUFFER] ) )
 	{
-		BufferManager.BufferHead->TransferDesc.DataPtr->Size = 0; /* Free the memory */
+		RingPtr = &BufferManager.WriteRing;
+	}else
+	{
+		RingPtr = &BufferManager.TransportRing;
 	}
 
-	if( BufferManager.NumberOfFilledBuffers != 0 )
+	if( ( FramePtr->Status == BUFFER_FREE ) || ( FramePtr != Frame_Ring_Head( RingPtr ) ) )
 	{
-		BufferManager.NumberOfFilledBuffers--;
+		return (FALSE);
 	}
 
-	if( BufferManager.BufferTail->Next == NULL )
+	if( ReleaseData )
 	{
-		BufferManager.BufferTail->Next = BufferManager.BufferHead;
+		Release_Memory_Buffer( FramePtr->TransferDesc.DataPtr ); /* Free the memory */
 	}
 
-	BufferManager.BufferHead = BufferManager.BufferHead->Next;
+	FramePtr->Status = BUFFER_FREE;
 
+	CompilerBarrier(); /* The frame is done with before the producer can reuse it */
 
-	EnterCritical(); /* Critical section enter */
-
-	FrameHeadRelease = 0;
-	FrameHeadReleaseRequest = 0;
-
-	ExitCritical(); /* Critical section exit */
+	RingPtr->Head++;
 
 	return (TRUE);
 }
@@ -650,23 +1157,23 @@ static uint8_t Release_Frame( uint8_t ReleaseData, uint8_t ByPassFrameHead )
 /* Purpose: Release the callback head.							*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: An entry held by the application during the	*/
+/* callback leaves the queue but is only freed by				*/
+/* Release_Received_Packet().									*/
 /****************************************************************/
 static void Release_CallBack(CALLBACK_MANAGEMENT* ManagerPtr)
 {
-	ManagerPtr->CallBackHead->Status = BUFFER_FREE;
+	CALLBACK_DESC* CallBackPtr = &ManagerPtr->CallBack[ ManagerPtr->Order[ ManagerPtr->CallBackHead & ( SIZE_OF_CALLBACK_BUFFER - 1 ) ] ];
 
-	if( ManagerPtr->NumberOfFilledBuffers != 0 )
-	{
-		ManagerPtr->NumberOfFilledBuffers--;
-	}
+	EnterCritical(); /* Critical section enter */
 
-	if( ManagerPtr->CallBackTail->Next == NULL )
-	{
-		ManagerPtr->CallBackTail->Next = ManagerPtr->CallBackHead;
-	}
+	CallBackPtr->Status = ( CallBackPtr->References != 0 ) ? BUFFER_HELD : BUFFER_FREE;
+
+	ExitCritical(); /* Critical section exit */
+
+	CompilerBarrier(); /* The callback is done with before the producers can reuse it */
 
-	ManagerPtr->CallBackHead = ManagerPtr->CallBackHead->Next;
+	ManagerPtr->CallBackHead++;
 }
 
 
@@ -675,298 +1182,250 @@ static void Release_CallBack(CALLBACK_MANAGEMENT* ManagerPtr)
 /* Purpose: Enqueue a new callback for asynchronous handling	*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description:	The callbacks are enqueued from more than one 	*/
+/* interrupt (SPI DMA, timer and IRQ pin through Request_Frame),*/
+/* so the free callback is reserved with the interrupts 		*/
+/* disabled for a few instructions. The copy is done with the	*/
+/* interrupts enabled and the callback is published to the main */
+/* loop by its Status, which is written after the data.			*/
 /****************************************************************/
 static uint8_t Enqueue_CallBack(TRANSFER_DESCRIPTOR* TransferDescPtr, TRANSFER_STATUS TransferStatus, CALLBACK_MANAGEMENT* ManagerPtr)
 {
-	/* CallBackTail always represents the last filled callback.
-	 * CallBackHead always represents the first filled callback.
-	 * CallBackTail->Next points to a free callback, otherwise is NULL if free callback could not be found */
-	uint8_t Status = FALSE;
+	CALLBACK_DESC* CallBackPtr = Reserve_CallBack( ManagerPtr );
 
-	/* Check if the next callback after tail is available */
-	CALLBACK_DESC* CallBackPtr = ManagerPtr->CallBackTail->Next;
-
-	if( CallBackPtr != NULL )
+	if( CallBackPtr == NULL )
 	{
-		if( CallBackPtr->Status == BUFFER_FREE ) /* Check if buffer is free */
-		{
-
-			CallBackPtr->TransferDesc.CallBack = TransferDescPtr->CallBack; /* Occupy this buffer */
-			CallBackPtr->TransferDesc.CallBackMode = TransferDescPtr->CallBackMode;
-			CallBackPtr->TransferDesc.Data.Size = TransferDescPtr->DataPtr->Size;
-			memcpy( &CallBackPtr->TransferDesc.Data.Bytes[0], &TransferDescPtr->DataPtr->Bytes[0], CallBackPtr->TransferDesc.Data.Size );
-			CallBackPtr->Status = BUFFER_FULL;
-			CallBackPtr->Next = Search_For_Free_CallBack( ManagerPtr );
-
-			CallBackPtr->TransferStatus = TransferStatus;
-
-			ManagerPtr->NumberOfFilledBuffers++;
-
-			ManagerPtr->CallBackTail = CallBackPtr;
-
-			Status = TRUE;
-		}
+		ManagerPtr->Statistics.Drops++;
+		return (FALSE);
 	}
 
-	return (Status);
-}
+	CallBackPtr->TransferDesc.Data.Size = TransferDescPtr->DataPtr->Size;
+	memcpy( &CallBackPtr->TransferDesc.Data.Bytes[0], &TransferDescPtr->DataPtr->Bytes[0], CallBackPtr->TransferDesc.Data.Size );
 
+	Publish_CallBack( CallBackPtr, TransferDescPtr, TransferStatus );
 
-/****************************************************************/
-/* Search_For_Free_CallBack()           		                */
-/* Purpose: Find free callback or return NULL					*/
-/* Parameters: none				         						*/
-/* Return: none  												*/
-/* Description:													*/
-/****************************************************************/
-static CALLBACK_DESC* Search_For_Free_CallBack(CALLBACK_MANAGEMENT* ManagerPtr)
-{
-	/* Search for an available free callback. This function is not optimized
-	 * in the sense it could start from a speculative index based on current
-	 * callback usage to more quickly find a buffer. */
-	for ( int8_t i = 0; i < SIZE_OF_CALLBACK_BUFFER; i++ )
-	{
-		if( ManagerPtr->CallBack[i].Status == BUFFER_FREE )
-		{
-			return ( &ManagerPtr->CallBack[i] );
-		}
-	}
-	return ( NULL );
+	return (TRUE);
 }
 
 
 /****************************************************************/
-/* Enqueue_Frame()            	     			               	*/
-/* Purpose: Enqueue the new frame for transmission in the  		*/
-/* output buffer												*/
+/* Reserve_CallBack()            	   			                */
+/* Purpose: Take the next free callback of the queue			*/
 /* Parameters: none				         						*/
-/* Return: none  												*/
-/* Description:													*/
+/* Return: The callback or NULL if the queue is full			*/
+/* Description:	The callback is taken in the order of the queue	*/
+/* but the main loop only sees it after Publish_CallBack(). The	*/
+/* entries held by the application are skipped, so a held 		*/
+/* packet does not block the ones behind it.					*/
 /****************************************************************/
-FRAME_ENQUEUE_STATUS Enqueue_Frame(TRANSFER_DESCRIPTOR* TransferDescPtr, int8_t buffer_index, SPI_TRANSFER_MODE TransferMode, uint8_t Priority)
+static CALLBACK_DESC* Reserve_CallBack(CALLBACK_MANAGEMENT* ManagerPtr)
 {
-	/* BufferTail always represents the last filled buffer.
-	 * BufferHead always represents the first filled buffer.
-	 * BufferTail->Next points to a free buffer, otherwise is NULL if free buffers could not be found */
-	static volatile uint8_t Acquire = 0;
-
-	FRAME_ENQUEUE_STATUS Status;
-
-	Status.EnqueuedAtIndex = -1; /* Could not enqueue the frame */
-	Status.NumberOfEnqueuedFrames = BufferManager.NumberOfFilledBuffers;
-	Status.RequestTransmission = FALSE;
+	uint8_t Tail;
+	uint8_t NumberOfFilledBuffers;
+	int8_t Index;
 
 	EnterCritical(); /* Critical section enter */
 
-	Acquire++;
-
-	if( Acquire != 1 ) /* Cannot enqueue while a frame is being released */
-	{
-		ExitCritical(); /* Critical section exit */
-		return (Status); /* This function is already being handled and we are not going to mix it up */
-	}
+	Tail = ManagerPtr->CallBackTail;
+	NumberOfFilledBuffers = Tail - ManagerPtr->CallBackHead;
+	Index = Find_Free_CallBack( ManagerPtr );
 
-	if( FrameHeadRelease )
+	if( ( NumberOfFilledBuffers >= SIZE_OF_CALLBACK_BUFFER ) || ( Index < 0 ) )
 	{
-		Acquire = 0;
 		ExitCritical(); /* Critical section exit */
-		return (Status); /* This function is already being handled and we are not going to mix it up */
+		return (NULL);
 	}
 
-	ExitCritical();
+	ManagerPtr->Order[ Tail & ( SIZE_OF_CALLBACK_BUFFER - 1 ) ] = Index;
 
+	ManagerPtr->CallBackTail = Tail + 1;
 
-	/* Check if the next buffer after tail is available */
-	BUFFER_DESC* BufferPtr = BufferManager.BufferTail->Next;
-
-	if( BufferPtr != NULL )
+	ManagerPtr->Statistics.Enqueues++;
+	if( NumberOfFilledBuffers >= ManagerPtr->Statistics.HighWaterMark )
 	{
-		if( BufferPtr->Status == BUFFER_FREE ) /* Check if buffer is free */
-		{
-
-			EnterCritical(); /* A new frame will be enqueued, safely signal that to the rest of software. */
-
-			FrameEnqueueSignal++;
+		ManagerPtr->Statistics.HighWaterMark = NumberOfFilledBuffers + 1;
+	}
 
-			ExitCritical();
+	CALLBACK_DESC* CallBackPtr = &ManagerPtr->CallBack[Index];
 
-			BufferPtr->TransferDesc = *TransferDescPtr; /* Occupy this buffer */
-			BufferPtr->Status = BUFFER_FULL;
-			BufferPtr->TransferMode = TransferMode;
-			BufferPtr->RemainingBytes = TransferDescPtr->DataPtr->Size;
-			BufferPtr->Counter = 0;
-			BufferPtr->Next = Search_For_Free_Frame();
+	CallBackPtr->Status = BUFFER_TRANSMITTING; /* Occupy this buffer */
 
-			if( TransferMode == SPI_HEADER_READ )
-			{
-				BufferPtr->TxPtr = (uint8_t*)&SPIMasterHeaderRead.CTRL;
-				BufferPtr->RxPtr = &BufferPtr->TransferDesc.DataPtr->Bytes[0];
-			}else if( TransferMode == SPI_HEADER_WRITE )
-			{
-				BufferPtr->TxPtr = (uint8_t*)&SPIMasterHeaderWrite.CTRL;
-				BufferPtr->RxPtr = &BufferPtr->TransferDesc.DataPtr->Bytes[0];
-			}else if( TransferMode == SPI_WRITE )
-			{
-				BufferPtr->TxPtr = &BufferPtr->TransferDesc.DataPtr->Bytes[0];
-				BufferPtr->RxPtr = &DummyByte; /* Just to have a valid pointer */
-				BufferPtr->WriteAttempts = NUMBER_OF_WRITE_ATTEMPTS; /* Write attempts before giving up */
-			}else
-			{
-				/* The slave header always precede the read operation, so we don't need a full valid TX dummy buffer */
-				BufferPtr->TxPtr = &DummyByte; /* Just to have a valid pointer */
-				BufferPtr->RxPtr = &BufferPtr->TransferDesc.DataPtr->Bytes[0];
-			}
-
-			BufferManager.NumberOfFilledBuffers++;
-
-			/* Search for next free buffer */
-			BufferManager.BufferTail = BufferPtr;
+	ExitCritical(); /* Critical section exit */
 
-			if( BufferManager.NumberOfFilledBuffers > 1 ) /* When more than one buffer is loaded, it is possible to reorder */
-			{
-				/* Makes no sense to reorder if desired position is higher than actual buffer usage */
-				int8_t LastFilledPosition = BufferManager.NumberOfFilledBuffers - 1;
+	return (CallBackPtr);
+}
 
-				if( buffer_index < LastFilledPosition )
-				{
-					BUFFER_DESC* ParentBuffer = BufferManager.BufferHead;
-					BUFFER_DESC* DesiredBuffer = BufferManager.BufferHead;
-					BUFFER_DESC* BeforeDesired = BufferManager.BufferHead;
 
-					if( buffer_index < 0 ){ buffer_index = 0; }
-					else if( buffer_index > (SIZE_OF_FRAME_BUFFER - 1) ){ buffer_index = (SIZE_OF_FRAME_BUFFER - 1); }
+/****************************************************************/
+/* Find_Free_CallBack()            	   			                */
+/* Purpose: Search for a free entry of the callback queue		*/
+/* Parameters: none				         						*/
+/* Return: The index of the entry or -1 if none is free.		*/
+/* Description:	The search starts at the entry of the queue		*/
+/* tail, which is free unless the application holds packets.	*/
+/****************************************************************/
+static int8_t Find_Free_CallBack(CALLBACK_MANAGEMENT* ManagerPtr)
+{
+	uint8_t Index;
 
-					if( buffer_index == 0 ) /* The new transfer wants to be the head of the queue */
-					{
-						volatile uint8_t FrameHeadBlocked;
+	for( uint8_t i = 0; i < SIZE_OF_CALLBACK_BUFFER; i++ )
+	{
+		Index = ( ManagerPtr->CallBackTail + i ) & ( SIZE_OF_CALLBACK_BUFFER - 1 );
 
-						/* Critical: check if Request Frame is not being handled. */
-						EnterCritical();
+		if( ManagerPtr->CallBack[Index].Status == BUFFER_FREE )
+		{
+			return (Index);
+		}
+	}
 
-						if( Priority == 0 ) /* Depending the priority of whom call the function, it can bypass BlockFrameHead. */
-						{
-							FrameHeadBlocked = 0;
-						}else
-						{
-							FrameHeadBlocked = BlockFrameHead;
-						}
+	return (-1);
+}
 
-						ExitCritical();
 
-						if( ( BufferManager.BufferHead->Status == BUFFER_TRANSMITTING ) || ( FrameHeadBlocked != 0 ) )
-						{
-							/* Cannot be the head since a transfer/releasing is ongoing */
-							buffer_index = 1;
-						}else if( ( BufferManager.BufferHead->Status == BUFFER_PAUSED ) &&
-								( BufferPtr->TransferMode != SPI_HEADER_READ ) && ( BufferPtr->TransferMode != SPI_HEADER_WRITE ) )
-						{
-							/* The head is paused but the candidate transfer is not a header read/write to take over priority */
-							buffer_index = 1;
-						}
+/****************************************************************/
+/* Publish_CallBack()            	   			                */
+/* Purpose: Hand a reserved callback to the main loop			*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:	The data must already be in the callback.		*/
+/****************************************************************/
+static void Publish_CallBack(CALLBACK_DESC* CallBackPtr, TRANSFER_DESCRIPTOR* TransferDescPtr, TRANSFER_STATUS TransferStatus)
+{
+	CallBackPtr->TransferDesc.CallBack = TransferDescPtr->CallBack;
+	CallBackPtr->TransferDesc.CallBackMode = TransferDescPtr->CallBackMode;
+	CallBackPtr->TransferStatus = TransferStatus;
+	CallBackPtr->EnqueueTimeUs = TimeBase_Get_Us();
 
-						/* If a message is going to be enqueued in the fist position, avoid request frame transmission since the
-						 * buffer index 0 always refers to the buffer head and this one is sent first.  */
-						if( buffer_index == 0 )
-						{
-							EnterCritical();
+	CompilerBarrier(); /* The callback is complete before the main loop can see it */
 
-							BlockRequestFrame++; /* Safely signals buffer head must not be transmitted since is going to be updated now. */
+	CallBackPtr->Status = BUFFER_FULL;
+}
 
-							ExitCritical();
-						}
-					}
 
-					if( buffer_index < ( BufferManager.NumberOfFilledBuffers - 1 ) )
-					{
-						/* There exists positions filled in the buffer, trace the path */
-						for ( int8_t filled_index = 0; filled_index < SIZE_OF_FRAME_BUFFER; filled_index++ )
-						{
-							if( filled_index == buffer_index )
-							{
-								DesiredBuffer = ParentBuffer;
-							}else if( filled_index == ( buffer_index - 1 ) )
-							{
-								BeforeDesired = ParentBuffer;
-							}
-							if( ParentBuffer->Next == BufferManager.BufferTail )
-							{
-								break;
-							}else
-							{
-								ParentBuffer = ParentBuffer->Next;
-							}
-						}
+/****************************************************************/
+/* Cancel_CallBack()            	   			                */
+/* Purpose: Give back a reserved callback that will not be		*/
+/* filled														*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:	Nothing is left to do if a reset of the queue	*/
+/* already freed the callback. The last callback reserved 		*/
+/* leaves the queue, while one with others reserved behind it	*/
+/* goes to the main loop empty, which releases it in order.		*/
+/****************************************************************/
+static void Cancel_CallBack(CALLBACK_MANAGEMENT* ManagerPtr, CALLBACK_DESC* CallBackPtr, TRANSFER_DESCRIPTOR* TransferDescPtr)
+{
+	uint8_t Last;
 
-						/* The parent buffer do not point to Tail anymore, but to the "Tail.Next": */
-						ParentBuffer->Next = BufferManager.BufferTail->Next;
-						BufferManager.BufferTail->Next = DesiredBuffer;
+	EnterCritical(); /* Critical section enter */
 
-						if( BeforeDesired != DesiredBuffer )
-						{
-							BeforeDesired->Next = BufferManager.BufferTail;
-						}
+	if( CallBackPtr->Status != BUFFER_TRANSMITTING )
+	{
+		ExitCritical(); /* Critical section exit */
+		return;
+	}
 
-						if( buffer_index == 0 ) /* If the tails wants to become the head */
-						{
-							BufferManager.BufferHead = BufferManager.BufferTail;
-						}
+	Last = ManagerPtr->CallBackTail - 1;
 
-						BufferManager.BufferTail = ParentBuffer;
+	if( ( ManagerPtr->CallBackTail != ManagerPtr->CallBackHead ) &&
+			( &ManagerPtr->CallBack[ ManagerPtr->Order[ Last & ( SIZE_OF_CALLBACK_BUFFER - 1 ) ] ] == CallBackPtr ) )
+	{
+		ManagerPtr->CallBackTail = Last;
+		ManagerPtr->Statistics.Enqueues--;
+		CallBackPtr->Status = BUFFER_FREE;
 
-						Status.EnqueuedAtIndex = buffer_index;
-					}else
-					{
-						Status.EnqueuedAtIndex = LastFilledPosition;
-					}
-				}else
-				{
-					Status.EnqueuedAtIndex = LastFilledPosition;
-				}
-			}else
-			{
-				Status.EnqueuedAtIndex = 0;
-			}
+		ExitCritical(); /* Critical section exit */
+		return;
+	}
 
-			Status.NumberOfEnqueuedFrames = BufferManager.NumberOfFilledBuffers;
+	ExitCritical(); /* Critical section exit */
 
-			EnterCritical();
+	CallBackPtr->TransferDesc.Data.Size = 0;
+	Publish_CallBack( CallBackPtr, TransferDescPtr, TRANSFER_DEV_ERROR );
+}
 
-			FrameEnqueueSignal = 0;
 
-			if( FrameHeadReleaseRequest )
-			{
-				ExitCritical();
-				Release_Frame( TRUE, FALSE );
-				Status.RequestTransmission = TRUE;
-			}
-			EnterCritical();
+/****************************************************************/
+/* Enqueue_Frame()            	     			               	*/
+/* Purpose: Enqueue the new frame for transmission in the  		*/
+/* output buffer												*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The writes go to the write ring, whose single 	*/
+/* producer is the HCI transport layer (it serializes its own	*/
+/* callers). The slave headers and reads go to the transport 	*/
+/* ring, whose single producer is the transmission side itself.	*/
+/* Only the producer moves the Tail and only the transmission 	*/
+/* side moves the Head, so no locking is needed.				*/
+/****************************************************************/
+FRAME_ENQUEUE_STATUS Enqueue_Frame(TRANSFER_DESCRIPTOR* TransferDescPtr, SPI_TRANSFER_MODE TransferMode)
+{
+	FRAME_RING* RingPtr = ( TransferMode == SPI_WRITE ) ? &BufferManager.WriteRing : &BufferManager.TransportRing;
+	uint8_t Tail = RingPtr->Tail;
+	uint8_t NumberOfFilledBuffers = Tail - RingPtr->Head;
 
-			BlockRequestFrame = 0;
-			Acquire = 0;
+	FRAME_ENQUEUE_STATUS Status;
 
-			ExitCritical();
+	Status.EnqueuedAtIndex = -1; /* Could not enqueue the frame */
+	Status.NumberOfEnqueuedFrames = NumberOfFilledBuffers;
 
-			return (Status);
+	if( NumberOfFilledBuffers >= RingPtr->Size )
+	{
+		RingPtr->Statistics.Drops++;
 
-		}
+		Bluenrg_Error( QUEUE_IS_FULL );
+
+		return ( Status ); /* Could not enqueue the transfer */
 	}
 
-	Status.EnqueuedAtIndex = -1; /* Could not enqueue the frame */
-	Status.NumberOfEnqueuedFrames = BufferManager.NumberOfFilledBuffers;
+	BUFFER_DESC* BufferPtr = &RingPtr->Frame[ Tail & ( RingPtr->Size - 1 ) ];
+
+	BufferPtr->TransferDesc = *TransferDescPtr; /* Occupy this buffer */
+	BufferPtr->Status = BUFFER_FULL;
+	BufferPtr->TransferMode = TransferMode;
+	BufferPtr->RemainingBytes = TransferDescPtr->DataPtr->Size;
+	BufferPtr->Counter = 0;
+
+	if( TransferMode == SPI_HEADER_READ )
+	{
+		BufferPtr->TxPtr = (uint8_t*)&SPIMasterHeaderRead.CTRL;
+		BufferPtr->RxPtr = &BufferPtr->TransferDesc.DataPtr->Bytes[0];
+	}else if( TransferMode == SPI_HEADER_WRITE )
+	{
+		BufferPtr->TxPtr = (uint8_t*)&SPIMasterHeaderWrite.CTRL;
+		BufferPtr->RxPtr = &BufferPtr->TransferDesc.DataPtr->Bytes[0];
+	}else if( TransferMode == SPI_WRITE )
+	{
+		BufferPtr->TxPtr = &BufferPtr->TransferDesc.DataPtr->Bytes[0];
+		BufferPtr->RxPtr = &DummyByte; /* Just to have a valid pointer */
+		BufferPtr->WriteAttempts = NUMBER_OF_WRITE_ATTEMPTS; /* Write attempts before giving up */
+		BufferPtr->CoalescedFrames = 0;
+	}else
+	{
+		/* The slave header always precede the read operation, so we don't need a full valid TX dummy buffer */
+		BufferPtr->TxPtr = &DummyByte; /* Just to have a valid pointer */
+		BufferPtr->RxPtr = &BufferPtr->TransferDesc.DataPtr->Bytes[0];
+	}
 
-	Bluenrg_Error( QUEUE_IS_FULL );
+	if( TransferMode == SPI_WRITE )
+	{
+		Trace_HCI_Packet( TransferDescPtr->DataPtr, HCI_TRACE_SENT );
+	}
 
+	CompilerBarrier(); /* The frame is complete before the transmission side can see it */
 
-	EnterCritical();
+	RingPtr->Tail = Tail + 1;
 
-	BlockRequestFrame = 0;
-	Acquire = 0;
-	FrameEnqueueSignal = 0;
+	RingPtr->Statistics.Enqueues++;
+	if( NumberOfFilledBuffers >= RingPtr->Statistics.HighWaterMark )
+	{
+		RingPtr->Statistics.HighWaterMark = NumberOfFilledBuffers + 1;
+	}
 
-	ExitCritical();
+	Status.EnqueuedAtIndex = NumberOfFilledBuffers;
+	Status.NumberOfEnqueuedFrames = NumberOfFilledBuffers + 1;
 
-	return ( Status ); /* Could not enqueue the transfer */
+	return (Status);
 }
 
 
@@ -992,42 +1451,37 @@ void Request_Frame( uint8_t callsource )
 	{
 		ExitCritical(); /* Critical section exit */
 		/* The driver can only send a message at a time, so, while the function is being
-		 * handled, no other source can call it to push a new frame */
+		 * handled, no other source can call it to push a new frame. The request is not
+		 * lost: the running call checks the frames again before returning. */
 		return; /* This function is already being handled and we are not going to mix it up */
 	}
 
-	/* The Enqueue function blocked this function because it is putting a new frame onto the head. */
-	if( BlockRequestFrame )
-	{
-		Acquire = 0;
-		ExitCritical();
-		return;
-	}
-
-	BlockFrameHead++; /* Blocks the frame head to avoid changes by the Enqueue function */
-
 	ExitCritical(); /* Critical section exit */
 
 	uint16_t DataSize;
 	uint8_t* TXDataPtr;
+	BUFFER_DESC* HeadPtr;
 
 	CheckBufferHead:
 
-	if( !BufferManager.HoldTime ) /* We are not holding */
+	HeadPtr = Get_Frame_Head();
+
+	if( !BufferManager.HoldTimeUs ) /* We are not holding */
 	{
-		if( ( BufferManager.BufferHead->Status != BUFFER_FREE ) && ( BufferManager.BufferHead->Status != BUFFER_TRANSMITTING ) )
+		if( ( HeadPtr != NULL ) && ( HeadPtr->Status != BUFFER_TRANSMITTING ) )
 		{
-			switch( BufferManager.BufferHead->TransferMode )
+			switch( HeadPtr->TransferMode )
 			{
 
 			case SPI_WRITE:
-				/* When the write is called for the first time, the slave header read is requested to update AllowedWriteSize */
-				if( ( BufferManager.AllowedWriteSize == 0 ) || ( BufferManager.BufferHead->Status == BUFFER_FULL ) )
+				/* When the write is called for the first time, the slave header read is requested to update AllowedWriteSize,
+				 * unless the device is still selected by the previous write and the credit of its header is enough */
+				if( ( BufferManager.AllowedWriteSize == 0 ) || ( ( HeadPtr->Status == BUFFER_FULL ) && ( !BufferManager.WriteSessionOpen ) ) )
 				{
 					if( ( BufferManager.SizeToRead != 0 ) && ( Get_Bluenrg_IRQ_Pin() ) && (BluenrgIRQCall) )
 					{
-						/* Enqueue a read command at the first buffer position (index == 0) */
-						if( Add_Rx_Frame( BufferManager.SizeToRead, 0, 0 ) )
+						/* Enqueue a read command, it goes before the write */
+						if( Add_Rx_Frame( BufferManager.SizeToRead ) )
 						{
 							BluenrgIRQCall = 0;
 						}else
@@ -1037,24 +1491,24 @@ void Request_Frame( uint8_t callsource )
 						goto CheckBufferHead; /* I know, I know, ugly enough. But think of code savings and performance, OK? */
 					}else
 					{
-						SPI_Header_Write_Request:
-
-						if( BufferManager.BufferHead->WriteAttempts )
+						if( HeadPtr->WriteAttempts )
 						{
-							BufferManager.BufferHead->WriteAttempts--;
+							HeadPtr->WriteAttempts--;
 
-							BufferManager.BufferHead->Status = BUFFER_PAUSED;
+							HeadPtr->Status = BUFFER_PAUSED;
 
-							uint8_t Result = Request_Slave_Header( SPI_HEADER_WRITE, 0 );
+							uint8_t Result = Request_Slave_Header( SPI_HEADER_WRITE );
 
-							if( Result != TRUE )
+							if( Result == TRUE )
+							{
+								BufferManager.WriteHeaderStatistics.Headers++;
+							}else
 							{
 								EnterCritical(); /* Critical section enter */
 
-								BlockFrameHead = 0;
 								Acquire = 0;
-								BufferManager.BufferHead->Status = BUFFER_FULL; /* Back to previous state */
-								BufferManager.BufferHead->WriteAttempts++; /* Gives an additional chance */
+								HeadPtr->Status = BUFFER_FULL; /* Back to previous state */
+								HeadPtr->WriteAttempts++; /* Gives an additional chance */
 
 								ExitCritical(); /* Critical section exit */
 								return;
@@ -1063,45 +1517,54 @@ void Request_Frame( uint8_t callsource )
 							goto CheckBufferHead; /* I know, I know, ugly enough. But think of code savings and performance, OK? */
 						}else
 						{
-							BUFFER_DESC PreviousHeadBuff = *BufferManager.BufferHead;
-							if( Release_Frame( FALSE, TRUE ) )
+							BUFFER_DESC PreviousHeadBuff = *HeadPtr;
+							if( Release_Frame( HeadPtr, FALSE ) )
 							{
 								Handle_Transmission_Failure( &PreviousHeadBuff );
-
-								goto CheckBufferHead; /* I know, I know, ugly enough. But think of code savings and performance, OK? */
-							}else
-							{
-								BufferManager.BufferHead->WriteAttempts++; /* Gives an additional chance */
-								goto SPI_Header_Write_Request; /* We could not release the head */
 							}
+
+							goto CheckBufferHead; /* I know, I know, ugly enough. But think of code savings and performance, OK? */
 						}
 					}
 				}else
 				{
+					if( HeadPtr->Status == BUFFER_FULL )
+					{
+						BufferManager.WriteHeaderStatistics.HeadersAvoided++; /* Chained to the previous write */
+					}
+					BufferManager.WriteSessionOpen = FALSE;
+
 					/* We can write the data, but check if all bytes can be sent at once or not */
-					if( BufferManager.BufferHead->RemainingBytes > BufferManager.AllowedWriteSize )
+					if( HeadPtr->RemainingBytes > BufferManager.AllowedWriteSize )
 					{
 						DataSize = BufferManager.AllowedWriteSize;
 					}else
 					{
-						DataSize = BufferManager.BufferHead->RemainingBytes;
+						DataSize = HeadPtr->RemainingBytes;
 					}
 
-					BufferManager.BufferHead->TxPtr += BufferManager.BufferHead->Counter;
-					TXDataPtr = BufferManager.BufferHead->TxPtr;
+					HeadPtr->TxPtr += HeadPtr->Counter;
+					TXDataPtr = HeadPtr->TxPtr;
 
-					BufferManager.BufferHead->RemainingBytes -= DataSize;
-					BufferManager.BufferHead->Counter += DataSize;
+					HeadPtr->RemainingBytes -= DataSize;
+					HeadPtr->Counter += DataSize;
 
-					/* Force the reading of a new header before every new transfer just to make sure the module is ready
-					 * and has valid buffer space to accept data */
-					BufferManager.AllowedWriteSize = 0;
+					/* A packet sent whole can take the packets queued behind it in the same transfer */
+					if( ( HeadPtr->RemainingBytes == 0 ) && ( HeadPtr->Counter == DataSize ) )
+					{
+						DataSize = Coalesce_Write_Frames( HeadPtr, &TXDataPtr, DataSize );
+					}
+
+					/* What is left of the credit can only be used while the device is kept selected. Otherwise
+					 * it is cleared when the transfer ends, forcing a new header to make sure the module is
+					 * ready and has buffer space to accept data */
+					BufferManager.AllowedWriteSize -= DataSize;
 				}
 				break;
 
 			case SPI_READ:
-				DataSize = BufferManager.BufferHead->RemainingBytes;
-				TXDataPtr = BufferManager.BufferHead->TxPtr;
+				DataSize = HeadPtr->RemainingBytes;
+				TXDataPtr = HeadPtr->TxPtr;
 
 				if( ( BufferManager.SizeToRead == 0 ) || ( DataSize < BufferManager.SizeToRead ) )
 				{
@@ -1118,7 +1581,6 @@ void Request_Frame( uint8_t callsource )
 
 					EnterCritical(); /* Critical section enter */
 
-					BlockFrameHead = 0;
 					Acquire = 0;
 
 					ExitCritical(); /* Critical section exit */
@@ -1132,8 +1594,8 @@ void Request_Frame( uint8_t callsource )
 			case SPI_HEADER_READ:
 			case SPI_HEADER_WRITE:
 				/* No restrictions about SPI header read since it is used to get slave status */
-				DataSize = BufferManager.BufferHead->RemainingBytes;
-				TXDataPtr = BufferManager.BufferHead->TxPtr;
+				DataSize = HeadPtr->RemainingBytes;
+				TXDataPtr = HeadPtr->TxPtr;
 
 				break;
 
@@ -1143,7 +1605,6 @@ void Request_Frame( uint8_t callsource )
 
 				EnterCritical(); /* Critical section enter */
 
-				BlockFrameHead = 0;
 				Acquire = 0;
 
 				ExitCritical(); /* Critical section exit */
@@ -1151,45 +1612,34 @@ void Request_Frame( uint8_t callsource )
 				break;
 			}
 
-			BufferManager.BufferHead->Status = BUFFER_TRANSMITTING;
+			HeadPtr->Status = BUFFER_TRANSMITTING;
 
-			if( Bluenrg_Send_Frame( BufferManager.BufferHead->TransferMode, TXDataPtr,
-					BufferManager.BufferHead->RxPtr, DataSize ) == FALSE )
+			if( Bluenrg_Send_Frame( HeadPtr->TransferMode, TXDataPtr,
+					HeadPtr->RxPtr, DataSize ) == FALSE )
 			{
-				if( BufferManager.BufferHead->TransferMode == SPI_WRITE )
+				if( HeadPtr->TransferMode == SPI_WRITE )
 				{
-					/* Failed transmission */
-					BUFFER_DESC PreviousHeadBuff = *BufferManager.BufferHead;
+					/* Failed transmission, as the packets coalesced with it (if any) */
+					uint8_t Frames = HeadPtr->CoalescedFrames + 1;
 
-					if( Release_Frame( FALSE, TRUE ) )
+					while( ( Frames-- != 0 ) && ( ( HeadPtr = Frame_Ring_Head( &BufferManager.WriteRing ) ) != NULL ) )
 					{
-						Handle_Transmission_Failure( &PreviousHeadBuff );
-					}
-				}
-				/* TODO: Add logic for when the TransferMode is not SPI_WRITE */
-				Release_Bluenrg();
+						BUFFER_DESC PreviousHeadBuff = *HeadPtr;
 
-			}else if( BufferManager.BufferHead->TransferMode == SPI_WRITE )
-			{
-				HCI_SERIAL_COMMAND_PCKT* CmdPcktPtr = (typeof(CmdPcktPtr))( &BufferManager.BufferHead->TransferDesc.DataPtr->Bytes[0] );
-				if( CmdPcktPtr->PacketType == HCI_COMMAND_PACKET )
-				{
-					/* Search for the handler */
-					CMD_CALLBACK* CallBackPtr = Get_Command_CallBack( CmdPcktPtr->CmdPacket.OpCode );
-					if( CallBackPtr != NULL )
-					{
-						CallBackPtr->OpCode = CmdPcktPtr->CmdPacket.OpCode;
-						if( !CallBackPtr->Timeout )
+						if( Release_Frame( HeadPtr, FALSE ) )
 						{
-							CallBackPtr->Timeout = BufferManager.BufferHead->TransferDesc.Timeout;
+							Handle_Transmission_Failure( &PreviousHeadBuff );
 						}
 					}
 				}
+				/* TODO: Add logic for when the TransferMode is not SPI_WRITE */
+				Release_Bluenrg();
+
 			}
-		}else if( ( BufferManager.BufferHead->Status == BUFFER_FREE ) && ( Get_Bluenrg_IRQ_Pin() ) ) /* Check if the IRQ pin is set */
+		}else if( ( HeadPtr == NULL ) && ( Get_Bluenrg_IRQ_Pin() ) && ( Rx_Entry_Available() ) ) /* Check if the IRQ pin is set */
 		{
 			/* Enqueue a new slave header read to check if device is ready */
-			if( Request_Slave_Header( SPI_HEADER_READ, 1 ) )
+			if( Request_Slave_Header( SPI_HEADER_READ ) )
 			{
 				goto CheckBufferHead; /* I know, I know, ugly enough. But think of code savings and performance, OK? */
 			}
@@ -1198,7 +1648,13 @@ void Request_Frame( uint8_t callsource )
 
 	EnterCritical(); /* Critical section enter */
 
-	BlockFrameHead = 0;
+	if( Acquire != 1 ) /* Called again meanwhile by an interrupt */
+	{
+		Acquire = 1;
+		ExitCritical(); /* Critical section exit */
+		goto CheckBufferHead;
+	}
+
 	Acquire = 0;
 
 	ExitCritical(); /* Critical section exit */
@@ -1221,7 +1677,7 @@ static void Handle_Transmission_Failure( BUFFER_DESC* BufPtr )
 		if( !Safe_Enqueue_CallBack( &BufPtr->TransferDesc, TRANSFER_DEV_ERROR, &WriteCallBackManager ) )
 		{
 			/* Release the data */
-			BufPtr->TransferDesc.DataPtr->Size = 0;
+			Release_Memory_Buffer( BufPtr->TransferDesc.DataPtr );
 			Bluenrg_Error( UNKNOWN_ERROR );
 		}
 	}
@@ -1248,7 +1704,7 @@ static void Handle_Transmission_Failure( BUFFER_DESC* BufPtr )
 
 		if( !Safe_Enqueue_CallBack( &BufPtr->TransferDesc, TRANSFER_DONE, &ReadCallBackManager ) )
 		{
-			BufPtr->TransferDesc.DataPtr->Size = 0;
+			Release_Memory_Buffer( BufPtr->TransferDesc.DataPtr );
 			Bluenrg_Error( UNKNOWN_ERROR );
 		}
 	}else if( EventPacketPtr->PacketType == HCI_ACL_DATA_PACKET )
@@ -1267,13 +1723,13 @@ static void Handle_Transmission_Failure( BUFFER_DESC* BufPtr )
 
 		if( !Safe_Enqueue_CallBack( &BufPtr->TransferDesc, TRANSFER_DONE, &ReadCallBackManager ) )
 		{
-			BufPtr->TransferDesc.DataPtr->Size = 0;
+			Release_Memory_Buffer( BufPtr->TransferDesc.DataPtr );
 			Bluenrg_Error( UNKNOWN_ERROR );
 		}
 	}
 
 	/* Release the memory */
-	BufPtr->TransferDesc.DataPtr->Size = 0;
+	Release_Memory_Buffer( BufPtr->TransferDesc.DataPtr );
 }
 
 
@@ -1286,63 +1742,71 @@ static void Handle_Transmission_Failure( BUFFER_DESC* BufPtr )
 /****************************************************************/
 void Bluenrg_Frame_Status(TRANSFER_STATUS status)
 {
-	if( BufferManager.BufferHead->Status == BUFFER_TRANSMITTING )
+	BUFFER_DESC* HeadPtr = Get_Frame_Head();
+
+	if( ( HeadPtr != NULL ) && ( HeadPtr->Status == BUFFER_TRANSMITTING ) )
 	{
 		SPI_RELEASE ReleaseSPI = RELEASE_SPI;
 
-		BufferManager.BufferHead->TransferStatus = status;
+		HeadPtr->TransferStatus = status;
 
 		/* The write is the only operation that can take more than one transfer */
-		if( ( BufferManager.BufferHead->TransferMode == SPI_WRITE ) &&
-				( BufferManager.BufferHead->TransferStatus == TRANSFER_DONE ) &&
-				( BufferManager.BufferHead->RemainingBytes != 0 ) )
+		if( ( HeadPtr->TransferMode == SPI_WRITE ) &&
+				( HeadPtr->TransferStatus == TRANSFER_DONE ) &&
+				( HeadPtr->RemainingBytes != 0 ) )
 		{
 
 			/* The operation is write, the last transfer was OK but we still have remaining bytes */
-			BufferManager.BufferHead->Status = BUFFER_PAUSED;
+			HeadPtr->Status = BUFFER_PAUSED;
 			Release_Bluenrg();
 
 		}else
 		{
-			TRANSFER_DESCRIPTOR* TransferDescPtr = &BufferManager.BufferHead->TransferDesc;
+			TRANSFER_DESCRIPTOR* TransferDescPtr = &HeadPtr->TransferDesc;
+
+			/* The read packet is only known after the transfer, Add_Rx_Frame() just reserves its buffer */
+			if( ( HeadPtr->TransferMode == SPI_READ ) && ( status == TRANSFER_DONE ) )
+			{
+				Trace_HCI_Packet( TransferDescPtr->DataPtr, HCI_TRACE_RECEIVED );
+			}
 
 			if( TransferDescPtr->CallBack != NULL ) /* We have callback */
 			{
 				if( TransferDescPtr->CallBackMode == CALL_BACK_AFTER_TRANSFER )
 				{
-					if( ( BufferManager.BufferHead->TransferMode == SPI_HEADER_READ ) || ( BufferManager.BufferHead->TransferMode == SPI_HEADER_WRITE ) )
+					if( ( HeadPtr->TransferMode == SPI_HEADER_READ ) || ( HeadPtr->TransferMode == SPI_HEADER_WRITE ) )
 					{
-						ReleaseSPI = Slave_Header_CallBack( TransferDescPtr, BufferManager.BufferHead->TransferMode );
+						ReleaseSPI = Slave_Header_CallBack( TransferDescPtr, HeadPtr->TransferMode );
 
-					}else if( BufferManager.BufferHead->TransferMode == SPI_WRITE )
+					}else if( HeadPtr->TransferMode == SPI_WRITE )
 					{
-						if( Transmitter_Multiplexer( TransferDescPtr->CallBack, &TransferDescPtr->DataPtr->Bytes[0], TransferDescPtr->DataPtr->Size, BufferManager.BufferHead->TransferStatus ) != TRUE )
+						if( Transmitter_Multiplexer( TransferDescPtr->CallBack, &TransferDescPtr->DataPtr->Bytes[0], TransferDescPtr->DataPtr->Size, HeadPtr->TransferStatus ) != TRUE )
 						{
 							/* The handler is blocked by some other process. Put the callback in the queue to be processed later. */
 							Safe_Enqueue_CallBack( TransferDescPtr, status, &WriteCallBackManager );
 						}
 					}else /* SPI_READ */
 					{
+						/* The packet was read into its entry of the read callback queue (see Add_Rx_Frame()) */
+						CALLBACK_DESC* CallBackPtr = (CALLBACK_DESC*)( (uint8_t*)TransferDescPtr->DataPtr - offsetof( CALLBACK_DESC, TransferDesc.Data ) );
+
 						/* Call application to check what to do with the data */
 						Bluenrg_CallBack_Config( &(TransferDescPtr->CallBackMode), (HCI_PACKET_TYPE)(TransferDescPtr->DataPtr->Bytes[0]), (&TransferDescPtr->DataPtr->Bytes[1]) );
 
-						/* The SPI read enqueues the multiplexer function */
-						if( TransferDescPtr->CallBackMode == CALL_BACK_AFTER_TRANSFER )
-						{
-							if( Receiver_Multiplexer( &TransferDescPtr->DataPtr->Bytes[0], TransferDescPtr->DataPtr->Size, BufferManager.BufferHead->TransferStatus ) != TRUE )
-							{
-								Safe_Enqueue_CallBack( TransferDescPtr, status, &ReadCallBackManager );
-							}
-						}else
+						/* The SPI read calls the multiplexer function if it can, otherwise the main loop does it */
+						if( ( TransferDescPtr->CallBackMode == CALL_BACK_AFTER_TRANSFER ) &&
+								( Receiver_Multiplexer( &TransferDescPtr->DataPtr->Bytes[0], TransferDescPtr->DataPtr->Size, HeadPtr->TransferStatus ) == TRUE ) )
 						{
-							Safe_Enqueue_CallBack( TransferDescPtr, status, &ReadCallBackManager );
+							TransferDescPtr->DataPtr->Size = 0; /* Already handled: the entry goes to the main loop empty */
 						}
+
+						Publish_CallBack( CallBackPtr, TransferDescPtr, status );
 					}
 				}else
 				{
 					CALLBACK_MANAGEMENT* ManagerPtr;
 
-					if( BufferManager.BufferHead->TransferMode == SPI_WRITE )
+					if( HeadPtr->TransferMode == SPI_WRITE )
 					{
 						ManagerPtr = &WriteCallBackManager;
 					}else
@@ -1364,7 +1828,20 @@ void Bluenrg_Frame_Status(TRANSFER_STATUS status)
 			 * keep it selected if the next operation is a read. In general, after a header read done due to IRQ pin,
 			 * the host should keep SPI selected to read the data (if module is ready, of course).
 			 */
-			if( ( BufferManager.BufferHead->TransferMode == SPI_WRITE ) || ( BufferManager.BufferHead->TransferMode == SPI_READ ) )
+			uint8_t CoalescedFrames = 0;
+
+			if( HeadPtr->TransferMode == SPI_WRITE )
+			{
+				CoalescedFrames = HeadPtr->CoalescedFrames;
+
+				/* Unless the next write can follow right away in the same session */
+				if( ( HeadPtr->TransferStatus != TRANSFER_DONE ) || ( !Keep_Write_Session( CoalescedFrames + 1 ) ) )
+				{
+					BufferManager.AllowedWriteSize = 0;
+					Release_Bluenrg();
+				}
+
+			}else if( HeadPtr->TransferMode == SPI_READ )
 			{
 				Release_Bluenrg();
 
@@ -1373,7 +1850,11 @@ void Bluenrg_Frame_Status(TRANSFER_STATUS status)
 				Release_Bluenrg();
 			}
 
-			Release_Frame( TRUE, FALSE );
+			/* The read data belongs to the read callback queue from now on */
+			if( Release_Frame( HeadPtr, ( HeadPtr->TransferMode != SPI_READ ) ) )
+			{
+				Coalesced_Frames_Done( CoalescedFrames, status );
+			}
 		}
 
 		Request_Frame( 0 );
@@ -1382,66 +1863,161 @@ void Bluenrg_Frame_Status(TRANSFER_STATUS status)
 
 
 /****************************************************************/
-/* Safe_Enqueue_CallBack()                  		         	*/
-/* Purpose:	Enqueue the callback and free the memory if not.	*/
-/* Parameters: none				         						*/
-/* Return: none  												*/
-/* Description:													*/
+/* Keep_Write_Session()         	     						*/
+/* Purpose: Check if the next write can be sent without a new	*/
+/* slave header.												*/
+/* Parameters: FramesDone: frames sent by the write, the 		*/
+/* coalesced ones included										*/
+/* Return: TRUE if the device must be kept selected.			*/
+/* Description: Called when the write at the head of the ring	*/
+/* is done. The bytes written after a header are a stream for 	*/
+/* the device, so the next packet can follow in the same chip	*/
+/* select if it is already enqueued and fits entirely in what	*/
+/* is left of the WBUF credit. The session is not kept when the	*/
+/* device has something to be read or while holding.			*/
 /****************************************************************/
-static uint8_t Safe_Enqueue_CallBack( TRANSFER_DESCRIPTOR* TransferDescPtr, TRANSFER_STATUS TransferStatus, CALLBACK_MANAGEMENT* ManagerPtr )
+static uint8_t Keep_Write_Session( uint8_t FramesDone )
 {
-	/* The multiplex function will be called asynchronously */
-	/* Put in the callback queue: the transfer and data must be copied in order to release the transfer buffer */
-	static volatile uint8_t Acquire = 0;
+	FRAME_RING* RingPtr = &BufferManager.WriteRing;
+	BUFFER_DESC* NextPtr = &RingPtr->Frame[ ( RingPtr->Head + FramesDone ) & ( RingPtr->Size - 1 ) ];
 
-	EnterCritical(); /* Critical section enter */
+	BufferManager.WriteSessionOpen = ( (uint8_t)( RingPtr->Tail - RingPtr->Head ) > FramesDone ) &&
+			( NextPtr->Status == BUFFER_FULL ) && ( NextPtr->RemainingBytes <= BufferManager.AllowedWriteSize ) &&
+			( Frame_Ring_Head( &BufferManager.TransportRing ) == NULL ) && ( BufferManager.SizeToRead == 0 ) &&
+			( !BufferManager.HoldTimeUs ) && ( !Get_Bluenrg_IRQ_Pin() );
 
-	Acquire++;
+	return ( BufferManager.WriteSessionOpen );
+}
 
-	if( Acquire != 1 )
+
+/****************************************************************/
+/* Coalesce_Write_Frames()         	     						*/
+/* Purpose: Join the ACL data packets queued behind the head of	*/
+/* the write ring in a single transfer.							*/
+/* Parameters: HeadPtr: write frame about to be sent whole		*/
+/* TxDataPtr: start of the transfer, changed to CoalesceBuffer	*/
+/* if packets were joined										*/
+/* DataSize: bytes of the head frame							*/
+/* Return: Bytes of the transfer								*/
+/* Description: The packets are taken in order while they fit	*/
+/* in the WBUF credit, so the device sees the same stream of 	*/
+/* bytes but a single DMA transfer and a single completion are	*/
+/* needed for all of them. The joined frames stay in the ring	*/
+/* as BUFFER_TRANSMITTING until the transfer ends. Commands are	*/
+/* not coalesced: they are paced by the command credits and a	*/
+/* failed transfer would fail all of them.						*/
+/****************************************************************/
+static uint16_t Coalesce_Write_Frames( BUFFER_DESC* HeadPtr, uint8_t** TxDataPtr, uint16_t DataSize )
+{
+	FRAME_RING* RingPtr = &BufferManager.WriteRing;
+	uint8_t Head = RingPtr->Head;
+	uint8_t Frames = RingPtr->Tail - Head;
+	uint16_t MaxSize = MIN( BufferManager.AllowedWriteSize, SIZE_OF_COALESCE_BUFFER );
+	uint16_t Size = DataSize;
+	uint8_t Coalesced = 0;
+	BUFFER_DESC* FramePtr;
+
+	if( HeadPtr->TransferDesc.DataPtr->Bytes[0] != HCI_ACL_DATA_PACKET )
 	{
-		ExitCritical(); /* Critical section exit */
-		return (FALSE);
+		return ( DataSize );
 	}
 
-	ExitCritical(); /* Critical section exit */
+	CompilerBarrier(); /* The frames are only read after they were published */
 
-	if( Enqueue_CallBack( TransferDescPtr, TransferStatus, ManagerPtr ) != TRUE )
+	while( ( Coalesced + 1 ) < Frames )
 	{
-		Bluenrg_Error( QUEUE_IS_FULL );
-		return (FALSE);
+		FramePtr = &RingPtr->Frame[ ( Head + Coalesced + 1 ) & ( RingPtr->Size - 1 ) ];
+
+		if( ( FramePtr->Status != BUFFER_FULL ) || ( FramePtr->TransferDesc.DataPtr->Bytes[0] != HCI_ACL_DATA_PACKET ) ||
+				( ( Size + FramePtr->RemainingBytes ) > MaxSize ) )
+		{
+			break;
+		}
+
+		Size += FramePtr->RemainingBytes;
+		Coalesced++;
 	}
 
-	EnterCritical(); /* Critical section enter */
+	if( Coalesced == 0 )
+	{
+		return ( DataSize );
+	}
 
-	Acquire = 0;
+	memcpy( &CoalesceBuffer[0], *TxDataPtr, DataSize );
+	Size = DataSize;
 
-	ExitCritical(); /* Critical section exit */
+	for( uint8_t Frame = 1; Frame <= Coalesced; Frame++ )
+	{
+		FramePtr = &RingPtr->Frame[ ( Head + Frame ) & ( RingPtr->Size - 1 ) ];
 
-	return (TRUE);
+		memcpy( &CoalesceBuffer[Size], FramePtr->TxPtr, FramePtr->RemainingBytes );
+		Size += FramePtr->RemainingBytes;
+
+		FramePtr->Counter = FramePtr->RemainingBytes;
+		FramePtr->RemainingBytes = 0;
+		FramePtr->Status = BUFFER_TRANSMITTING;
+	}
+
+	HeadPtr->CoalescedFrames = Coalesced;
+	BufferManager.WriteHeaderStatistics.PacketsCoalesced += Coalesced;
+
+	*TxDataPtr = &CoalesceBuffer[0];
+
+	return ( Size );
 }
 
 
 /****************************************************************/
-/* Search_For_Free_Frame()                  		         	*/
-/* Purpose: Find free buffer or return NULL						*/
-/* Parameters: none				         						*/
+/* Coalesced_Frames_Done()         	     						*/
+/* Purpose: Finish the write frames sent with the previous head	*/
+/* Parameters: Frames: number of coalesced frames				*/
+/* Status: status of the transfer								*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: Called after the head frame was released, so	*/
+/* the coalesced frames are at the head of the write ring.		*/
 /****************************************************************/
-static BUFFER_DESC* Search_For_Free_Frame(void)
+static void Coalesced_Frames_Done( uint8_t Frames, TRANSFER_STATUS Status )
 {
-	/* Search for an available free buffer. This function is not optimized
-	 * in the sense it could start from a speculative index based on current
-	 * buffer usage to more quickly find a buffer. */
-	for ( int8_t i = 0; i < SIZE_OF_FRAME_BUFFER; i++ )
+	BUFFER_DESC* FramePtr;
+
+	while( ( Frames-- != 0 ) && ( ( FramePtr = Frame_Ring_Head( &BufferManager.WriteRing ) ) != NULL ) )
 	{
-		if( BufferManager.Buffer[i].Status == BUFFER_FREE )
+		TRANSFER_DESCRIPTOR* TransferDescPtr = &FramePtr->TransferDesc;
+
+		FramePtr->TransferStatus = Status;
+
+		if( TransferDescPtr->CallBack != NULL ) /* We have callback */
 		{
-			return ( &BufferManager.Buffer[i] );
+			if( ( TransferDescPtr->CallBackMode != CALL_BACK_AFTER_TRANSFER ) ||
+					( Transmitter_Multiplexer( TransferDescPtr->CallBack, &TransferDescPtr->DataPtr->Bytes[0], TransferDescPtr->DataPtr->Size, Status ) != TRUE ) )
+			{
+				Safe_Enqueue_CallBack( TransferDescPtr, Status, &WriteCallBackManager );
+			}
 		}
+
+		Release_Frame( FramePtr, TRUE );
 	}
-	return ( NULL );
+}
+
+
+/****************************************************************/
+/* Safe_Enqueue_CallBack()                  		         	*/
+/* Purpose:	Enqueue the callback and free the memory if not.	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static uint8_t Safe_Enqueue_CallBack( TRANSFER_DESCRIPTOR* TransferDescPtr, TRANSFER_STATUS TransferStatus, CALLBACK_MANAGEMENT* ManagerPtr )
+{
+	/* The multiplex function will be called asynchronously */
+	/* Put in the callback queue: the transfer and data must be copied in order to release the transfer buffer */
+	if( Enqueue_CallBack( TransferDescPtr, TransferStatus, ManagerPtr ) != TRUE )
+	{
+		Bluenrg_Error( QUEUE_IS_FULL );
+		return (FALSE);
+	}
+
+	return (TRUE);
 }
 
 
@@ -1474,37 +2050,34 @@ static uint8_t Slave_Header_CallBack(TRANSFER_DESCRIPTOR* TransferDescPtr, SPI_T
 			/* The write has higher priority because is is done using a sequence of SPI_HEADER_WRITE and SPI_WRITE */
 			ErroneousResponseCounter = 0;
 			NoAllowedWriteCounter = 0;
+			BufferManager.HoldWokenUp = FALSE;
 			return (DO_NOT_RELEASE_SPI); /* For the write operation, keeps device asserted to send payload bytes */
 
-		}else if( BufferManager.SizeToRead != 0 )
+		}else if( ( BufferManager.SizeToRead != 0 ) && ( Add_Rx_Frame( BufferManager.SizeToRead ) ) )
 		{
-
+			/* A read command was enqueued just after this header, so do not release the SPI */
 			ErroneousResponseCounter = 0;
 			NoAllowedWriteCounter = 0;
-
-			/* Enqueue a read command at the second buffer position (index == 1) and do not release the SPI */
-			Add_Rx_Frame( BufferManager.SizeToRead, 1, 1 );
+			BufferManager.HoldWokenUp = FALSE;
 
 			return (DO_NOT_RELEASE_SPI); /* For the read operation, keeps device asserted and send dummy bytes MOSI */
 
 		}else if( ( HeaderMode == SPI_HEADER_WRITE ) && ( BufferManager.AllowedWriteSize == 0 ) )
 		{
 			ErroneousResponseCounter = 0;
-			NoAllowedWriteCounter++;
+			if( NoAllowedWriteCounter < UINT8_MAX ){ NoAllowedWriteCounter++; }
 			if( NoAllowedWriteCounter >= NO_ALLOWED_WRITE_THRESHOLD )
 			{
-				BufferManager.HoldTime = DEVICE_HOLD_TIME; /* hold time */
-				BufferManager.HoldCounter = 0;	/* From now */
+				Hold_Device( HOLD_NO_ALLOWED_WRITE, NoAllowedWriteCounter - NO_ALLOWED_WRITE_THRESHOLD );
 			}
-		}else
+		}else if( BufferManager.SizeToRead == 0 ) /* Otherwise the read was postponed, see Add_Rx_Frame() */
 		{
 			NoAllowedWriteCounter = 0;
 
-			ErroneousResponseCounter++;
+			if( ErroneousResponseCounter < UINT8_MAX ){ ErroneousResponseCounter++; }
 			if( ErroneousResponseCounter >= ERRONEOUS_RESPONSE_THRESHOLD )
 			{
-				BufferManager.HoldTime = DEVICE_HOLD_TIME; /* hold time */
-				BufferManager.HoldCounter = 0;	/* From now */
+				Hold_Device( HOLD_ERRONEOUS_RESPONSE, ErroneousResponseCounter - ERRONEOUS_RESPONSE_THRESHOLD );
 			}
 		}
 	}else
@@ -1520,11 +2093,10 @@ static uint8_t Slave_Header_CallBack(TRANSFER_DESCRIPTOR* TransferDescPtr, SPI_T
 		BufferManager.AllowedWriteSize = 0;
 		BufferManager.SizeToRead = 0;
 
-		DeviceNotReadyCounter++;
+		if( DeviceNotReadyCounter < UINT8_MAX ){ DeviceNotReadyCounter++; }
 		if( DeviceNotReadyCounter >= DEVICE_NOT_READY_THRESHOLD )
 		{
-			BufferManager.HoldTime = DEVICE_HOLD_TIME; /* hold time */
-			BufferManager.HoldCounter = 0;	/* From now */
+			Hold_Device( HOLD_DEVICE_NOT_READY, DeviceNotReadyCounter - DEVICE_NOT_READY_THRESHOLD );
 		}
 	}
 
@@ -1532,6 +2104,74 @@ static uint8_t Slave_Header_CallBack(TRANSFER_DESCRIPTOR* TransferDescPtr, SPI_T
 }
 
 
+/****************************************************************/
+/* Hold_Device()               									*/
+/* Purpose: Stop sending frames to the device for a while		*/
+/* Parameters: Reason: slave header that caused the hold		*/
+/* Responses: responses of the same reason after the threshold	*/
+/* Return: none  												*/
+/* Description: The hold starts at DEVICE_MIN_HOLD_TIME_US and	*/
+/* doubles for each response in sequence up to DEVICE_HOLD_TIME,*/
+/* so a short busy period of the device costs a fraction of a	*/
+/* millisecond while a device that stays busy is not polled		*/
+/* more than needed. Bluenrg_IRQ() ends the hold earlier, but 	*/
+/* only once until a good slave header: the IRQ line also rises	*/
+/* while the device has events but is still not ready, and the	*/
+/* backoff must not turn into polling.							*/
+/****************************************************************/
+static void Hold_Device( HOLD_REASON Reason, uint8_t Responses )
+{
+	uint32_t HoldTimeUs = DEVICE_MIN_HOLD_TIME_US;
+
+	while( ( Responses != 0 ) && ( HoldTimeUs < ( DEVICE_HOLD_TIME * 1000UL ) ) )
+	{
+		HoldTimeUs <<= 1;
+		Responses--;
+	}
+
+	HoldTimeUs = MIN( HoldTimeUs, DEVICE_HOLD_TIME * 1000UL );
+
+	EnterCritical(); /* Critical section enter */
+
+	BufferManager.HoldStartUs = TimeBase_Get_Us(); /* From now */
+	BufferManager.HoldTimeUs = HoldTimeUs;
+
+	BufferManager.HoldStatistics.Holds[Reason]++;
+	if( HoldTimeUs > BufferManager.HoldStatistics.MaxHoldTimeUs )
+	{
+		BufferManager.HoldStatistics.MaxHoldTimeUs = HoldTimeUs;
+	}
+
+	ExitCritical(); /* Critical section exit */
+}
+
+
+/****************************************************************/
+/* End_Hold()               									*/
+/* Purpose: Allow the frames to be sent to the device again		*/
+/* Parameters: WokenUp: TRUE if called by the device IRQ		*/
+/* Return: none  												*/
+/* Description: See Hold_Device().								*/
+/****************************************************************/
+static void End_Hold( uint8_t WokenUp )
+{
+	EnterCritical(); /* Critical section enter */
+
+	if( ( BufferManager.HoldTimeUs ) && ( !( WokenUp && BufferManager.HoldWokenUp ) ) )
+	{
+		BufferManager.HoldStatistics.TotalHoldTimeUs += TimeBase_Get_Us() - BufferManager.HoldStartUs;
+		if( WokenUp )
+		{
+			BufferManager.HoldStatistics.WakeUps++;
+			BufferManager.HoldWokenUp = TRUE;
+		}
+		BufferManager.HoldTimeUs = 0;
+	}
+
+	ExitCritical(); /* Critical section exit */
+}
+
+
 /****************************************************************/
 /* Bluenrg_CallBack_Config()   	       				         	*/
 /* Purpose: Configure the way callback is called				*/
@@ -1559,7 +2199,7 @@ __attribute__((weak)) void Bluenrg_CallBack_Config(TRANSFER_CALL_BACK_MODE* Call
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-static uint8_t Request_Slave_Header(SPI_TRANSFER_MODE HeaderMode, uint8_t Priority)
+static uint8_t Request_Slave_Header(SPI_TRANSFER_MODE HeaderMode)
 {
 	TRANSFER_DESCRIPTOR TransferDesc;
 
@@ -1571,9 +2211,8 @@ static uint8_t Request_Slave_Header(SPI_TRANSFER_MODE HeaderMode, uint8_t Priori
 	/* The callback function MUST be configured, although not used in this case */
 	TransferDesc.CallBack = (TransferCallBack)(&Slave_Header_CallBack);
 
-	/* We need to know if we have to read or how much we can write, so put the command in the first position of the queue */
-	/* Acho que no deve empilhar em posio diferente de zero se for um request para slave */
-	if( Enqueue_Frame( &TransferDesc, 0, HeaderMode, Priority ).EnqueuedAtIndex != 0 )
+	/* We need to know if we have to read or how much we can write, so the header goes before the writes */
+	if( Enqueue_Frame( &TransferDesc, HeaderMode ).EnqueuedAtIndex < 0 )
 	{
 		return (FALSE);
 	}
@@ -1586,17 +2225,23 @@ static uint8_t Request_Slave_Header(SPI_TRANSFER_MODE HeaderMode, uint8_t Priori
 /* Add_Rx_Frame()     	   	  				              	    */
 /* Purpose: Add RX handler to the transmitting queue			*/
 /* Parameters: none				         						*/
-/* Return: none  												*/
-/* Description:													*/
-/****************************************************************/
-static uint8_t Add_Rx_Frame(uint16_t DataSize, int8_t buffer_index, uint8_t Priority)
+/* Return: TRUE if the read was enqueued						*/
+/* Description: The packet is read straight into the next entry	*/
+/* of the read callback queue, so the DMA fills one entry while	*/
+/* the main loop handles the ones before it and nothing is		*/
+/* copied when the transfer ends. If the queue is full, the read	*/
+/* is postponed: the controller keeps the packet and the IRQ pin	*/
+/* set until Process_CallBack() frees an entry. The entry is	*/
+/* given back by Cancel_CallBack() if the read is not enqueued.	*/
+/****************************************************************/
+static uint8_t Add_Rx_Frame(uint16_t DataSize)
 {
 	TRANSFER_DESCRIPTOR TransferDesc;
+	CALLBACK_DESC* CallBackPtr = Rx_Entry_Available() ? Reserve_CallBack( &ReadCallBackManager ) : NULL;
 
-	TransferDesc.DataPtr = Search_For_Event_Memory_Buffer(  );
-
-	if( TransferDesc.DataPtr != NULL )
+	if( CallBackPtr != NULL )
 	{
+		TransferDesc.DataPtr = (DESC_DATA*)( &CallBackPtr->TransferDesc.Data );
 		TransferDesc.DataPtr->Size = DataSize;
 		TransferDesc.CallBackMode = CALL_BACK_AFTER_TRANSFER;
 
@@ -1604,13 +2249,37 @@ static uint8_t Add_Rx_Frame(uint16_t DataSize, int8_t buffer_index, uint8_t Prio
 		TransferDesc.CallBack = (TransferCallBack)(&Bluenrg_CallBack_Config);
 
 		/* Read calls are triggered by IRQ pin. */
-		if( Enqueue_Frame( &TransferDesc, buffer_index, SPI_READ, Priority ).EnqueuedAtIndex >= 0 )
+		if( Enqueue_Frame( &TransferDesc, SPI_READ ).EnqueuedAtIndex >= 0 )
 		{
 			return (TRUE);
 		}
-	}else
+
+		Cancel_CallBack( &ReadCallBackManager, CallBackPtr, &TransferDesc );
+	}
+
+	return (FALSE);
+}
+
+
+/****************************************************************/
+/* Rx_Entry_Available()     	   	  				           	*/
+/* Purpose: Check if a read can be enqueued						*/
+/* Parameters: none				         						*/
+/* Return: TRUE if the read callback queue has a free entry		*/
+/* Description: Otherwise the read is marked as postponed. 		*/
+/****************************************************************/
+static uint8_t Rx_Entry_Available(void)
+{
+	if( ( (uint8_t)( ReadCallBackManager.CallBackTail - ReadCallBackManager.CallBackHead ) < SIZE_OF_CALLBACK_BUFFER ) &&
+			( Find_Free_CallBack( &ReadCallBackManager ) >= 0 ) )
+	{
+		return (TRUE);
+	}
+
+	if( !BufferManager.ReadStalled )
 	{
-		Bluenrg_Error( NO_MEMORY_AVAILABLE );
+		ReadCallBackManager.Statistics.Stalls++;
+		BufferManager.ReadStalled = TRUE;
 	}
 
 	return (FALSE);
@@ -1690,6 +2359,123 @@ static uint8_t Transmitter_Multiplexer(TransferCallBack CallBack, uint8_t* DataP
 }
 
 
+/****************************************************************/
+/* Trace_HCI_Packet()     	  		               	    		*/
+/* Purpose: Record the packet in the HCI trace ring				*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Called from the main loop (writes) and from the */
+/* SPI interrupt (reads), so only the slot reservation is done	*/
+/* in critical section. The oldest record is overwritten when 	*/
+/* the ring is full and the packet is truncated to 				*/
+/* HCI_TRACE_PAYLOAD_SIZE bytes.								*/
+/****************************************************************/
+static void Trace_HCI_Packet( DESC_DATA* DataPtr, HCI_TRACE_DIRECTION Direction )
+{
+	EnterCritical(); /* Critical section enter */
+
+	HCI_TRACE_RECORD* RecordPtr = &HCITrace.Record[ HCITrace.Tail & ( SIZE_OF_HCI_TRACE_BUFFER - 1 ) ];
+	HCITrace.Tail++;
+
+	ExitCritical(); /* Critical section exit */
+
+	uint16_t Size = DataPtr->Size;
+
+	RecordPtr->TimeUs = TimeBase_Get_Us();
+	RecordPtr->Size = Size;
+	RecordPtr->Direction = Direction;
+	memcpy( &RecordPtr->Bytes[0], &DataPtr->Bytes[0], ( Size < HCI_TRACE_PAYLOAD_SIZE ) ? Size : HCI_TRACE_PAYLOAD_SIZE );
+}
+
+
+/****************************************************************/
+/* Bluenrg_Dump_HCI_Trace()     	  		               	    */
+/* Purpose: Output the HCI trace in btsnoop format				*/
+/* Parameters: Output: called with each piece of the file		*/
+/* Return: Number of packets output								*/
+/* Description: The output is a complete btsnoop file (H4 		*/
+/* datalink) with the packets still in the ring, oldest first,	*/
+/* so it opens in the usual HCI analyzers. The timestamps count	*/
+/* from power up since there is no wall clock, and the drop 	*/
+/* counter of each record tells how many packets were traced	*/
+/* before it but are no longer in the ring. Must be called from */
+/* the main loop: the reads keep being traced during the dump	*/
+/* and the records overwritten meanwhile are skipped.			*/
+/****************************************************************/
+uint16_t Bluenrg_Dump_HCI_Trace( TraceOutputCallBack Output )
+{
+	static const uint8_t FileHeader[16] = { 'b', 't', 's', 'n', 'o', 'o', 'p', '\0', 0, 0, 0, 1,
+			( BTSNOOP_DATALINK_H4 >> 24 ) & 0xFF, ( BTSNOOP_DATALINK_H4 >> 16 ) & 0xFF,
+			( BTSNOOP_DATALINK_H4 >> 8 ) & 0xFF, BTSNOOP_DATALINK_H4 & 0xFF };
+	uint8_t RecordHeader[24];
+	HCI_TRACE_RECORD Record;
+	uint64_t TimeStampUs = BTSNOOP_EPOCH_US;
+	uint32_t LastTimeUs = 0;
+	uint16_t NumberOfPackets = 0;
+
+	Output( (uint8_t*)&FileHeader[0], sizeof(FileHeader) );
+
+	uint32_t End = HCITrace.Tail;
+	uint32_t Index = ( End > SIZE_OF_HCI_TRACE_BUFFER ) ? ( End - SIZE_OF_HCI_TRACE_BUFFER ) : 0;
+	uint32_t Drops = Index; /* Packets overwritten in the ring before the dump */
+
+	for( ; Index != End; Index++ )
+	{
+		EnterCritical(); /* Critical section enter */
+
+		if( ( HCITrace.Tail - Index ) > SIZE_OF_HCI_TRACE_BUFFER )
+		{
+			ExitCritical(); /* Critical section exit */
+			Drops++; /* Overwritten by a read during the dump */
+			continue;
+		}
+
+		Record = HCITrace.Record[ Index & ( SIZE_OF_HCI_TRACE_BUFFER - 1 ) ];
+
+		ExitCritical(); /* Critical section exit */
+
+		/* The microsecond counter wraps in about 71 minutes, the records are far closer than that */
+		TimeStampUs += (uint32_t)( Record.TimeUs - LastTimeUs );
+		LastTimeUs = Record.TimeUs;
+
+		uint16_t IncludedSize = ( Record.Size < HCI_TRACE_PAYLOAD_SIZE ) ? Record.Size : HCI_TRACE_PAYLOAD_SIZE;
+
+		/* Bit 0 is the direction and bit 1 is set for commands and events */
+		uint32_t Flags = Record.Direction | ( ( Record.Bytes[0] == HCI_ACL_DATA_PACKET ) ? 0 : 2 );
+
+		Put_Big_Endian( &RecordHeader[0], Record.Size );
+		Put_Big_Endian( &RecordHeader[4], IncludedSize );
+		Put_Big_Endian( &RecordHeader[8], Flags );
+		Put_Big_Endian( &RecordHeader[12], Drops ); /* Cumulative drops */
+		Put_Big_Endian( &RecordHeader[16], TimeStampUs >> 32 );
+		Put_Big_Endian( &RecordHeader[20], TimeStampUs & 0xFFFFFFFF );
+
+		Output( &RecordHeader[0], sizeof(RecordHeader) );
+		Output( &Record.Bytes[0], IncludedSize );
+
+		NumberOfPackets++;
+	}
+
+	return (NumberOfPackets);
+}
+
+
+/****************************************************************/
+/* Put_Big_Endian()     	  		               	    		*/
+/* Purpose: Write the 32-bit value most significant byte first	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Put_Big_Endian( uint8_t* DataPtr, uint32_t Value )
+{
+	DataPtr[0] = ( Value >> 24 ) & 0xFF;
+	DataPtr[1] = ( Value >> 16 ) & 0xFF;
+	DataPtr[2] = ( Value >> 8 ) & 0xFF;
+	DataPtr[3] = Value & 0xFF;
+}
+
+
 /****************************************************************/
 /* Bluenrg_Get_Max_Transfer_Queue_Size()     	       	    	*/
 /* Purpose: Return the transfer queue size					 	*/
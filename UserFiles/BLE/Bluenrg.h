@@ -41,6 +41,85 @@ typedef enum
 }SPI_TRANSFER_MODE;
 
 
+typedef enum
+{
+	COMMAND_MEMORY_POOL = 0, /* HCI command packets from host to controller */
+	DATA_MEMORY_POOL 	= 1  /* HCI ACL data packets from host to controller */
+}MEMORY_POOL_ID;
+
+
+typedef struct
+{
+	uint8_t NumberOfBuffers; /* Total buffers of the pool */
+	uint8_t InUse;			 /* Buffers currently allocated */
+	uint8_t HighWaterMark;	 /* Largest number of buffers allocated at the same time since power up */
+	uint16_t Failures;		 /* Allocations that found the pool empty */
+}MEMORY_POOL_STATISTICS;
+
+
+typedef enum
+{
+	TRANSPORT_FRAME_QUEUE = 0, /* Slave header and read frames */
+	WRITE_FRAME_QUEUE 	  = 1, /* HCI packets from host to controller */
+	READ_CALLBACK_QUEUE   = 2, /* Packets read from the controller waiting for the main loop */
+	WRITE_CALLBACK_QUEUE  = 3  /* Transmission callbacks waiting for the main loop */
+}QUEUE_ID;
+
+
+typedef struct
+{
+	uint8_t Size;		   	   /* Total entries of the queue */
+	uint8_t InUse;		   	   /* Entries in the queue when the statistics were read */
+	uint8_t HighWaterMark; 	   /* Largest number of entries in use at the same time since power up */
+	uint32_t Enqueues;	   	   /* Successful enqueues */
+	uint32_t Drops;		   	   /* Enqueues refused because the queue was full */
+	/* Callback queues only: */
+	uint32_t Dequeues;		   /* Callbacks handled by the main loop */
+	uint32_t TotalDwellTimeUs; /* Sum of the time the handled callbacks waited in the queue */
+	uint32_t MaxDwellTimeUs;   /* Longest time a callback waited in the queue */
+	uint32_t Stalls;		   /* Read callback queue only: reads postponed because no entry was free */
+}QUEUE_STATISTICS;
+
+
+typedef struct
+{
+	uint32_t Headers;		 /* Slave headers requested before a write */
+	uint32_t HeadersAvoided; /* Writes sent in the chip select of the previous write, without a slave header */
+	uint32_t PacketsCoalesced; /* ACL data packets sent in the transfer of the packet before them */
+}WRITE_HEADER_STATISTICS;
+
+
+typedef enum
+{
+	HOLD_DEVICE_NOT_READY	= 0, /* The slave header READY byte was not DEVICE_READY */
+	HOLD_NO_ALLOWED_WRITE	= 1, /* WBUF was zero for a write */
+	HOLD_ERRONEOUS_RESPONSE = 2, /* Nothing to write nor to read */
+	NUMBER_OF_HOLD_REASONS	= 3
+}HOLD_REASON;
+
+
+typedef struct
+{
+	uint32_t Holds[NUMBER_OF_HOLD_REASONS]; /* Holds started for each reason */
+	uint32_t WakeUps;		  /* Holds ended earlier by the device IRQ */
+	uint32_t TotalHoldTimeUs; /* Sum of the time the device was held */
+	uint32_t MaxHoldTimeUs;	  /* Longest hold started */
+}HOLD_STATISTICS;
+
+
+typedef struct
+{
+	uint32_t Holds;		   /* Hold_Received_Packet() calls accepted */
+	uint32_t Releases;	   /* Release_Received_Packet() calls accepted */
+	uint8_t Held;		   /* Packets held when the statistics were read */
+	uint8_t HighWaterMark; /* Largest number of packets held at the same time since power up */
+	uint32_t Leaks;		   /* Packets reported through Bluenrg_Received_Packet_Leak() */
+}RECEIVED_PACKET_STATISTICS;
+
+
+typedef void (*TraceOutputCallBack)(uint8_t* DataPtr, uint16_t DataSize);
+
+
 /****************************************************************/
 /* External functions declaration (Interface functions)         */
 /****************************************************************/
@@ -54,15 +133,27 @@ void Bluenrg_Frame_Status(TRANSFER_STATUS status);
 void Bluenrg_Error(BLUENRG_ERROR_CODES Errorcode);
 void Bluenrg_CallBack_Config(TRANSFER_CALL_BACK_MODE* CallBackMode, HCI_PACKET_TYPE PacketType, uint8_t* DataPtr);
 void Bluerng_Command_Timeout( void );
+void Bluenrg_Hold_Timeout( void );
 DESC_DATA* Search_For_Command_Memory_Buffer(void);
 DESC_DATA* Search_For_Data_Memory_Buffer(void);
-FRAME_ENQUEUE_STATUS Enqueue_Frame(TRANSFER_DESCRIPTOR* TransferDescPtr, int8_t buffer_index, SPI_TRANSFER_MODE TransferMode, uint8_t Priority);
+void Release_Memory_Buffer(DESC_DATA* DescDataPtr);
+uint8_t Get_Buffer_Manager_Resets(void);
+MEMORY_POOL_STATISTICS Get_Memory_Pool_Statistics(MEMORY_POOL_ID PoolId);
+QUEUE_STATISTICS Get_Queue_Statistics(QUEUE_ID QueueId);
+WRITE_HEADER_STATISTICS Get_Write_Header_Statistics(void);
+HOLD_STATISTICS Get_Hold_Statistics(void);
+uint8_t Hold_Received_Packet(void* DataPtr);
+void Release_Received_Packet(void* DataPtr);
+RECEIVED_PACKET_STATISTICS Get_Received_Packet_Statistics(void);
+void Bluenrg_Received_Packet_Leak(uint8_t* DataPtr, uint32_t HeldTimeUs);
+FRAME_ENQUEUE_STATUS Enqueue_Frame(TRANSFER_DESCRIPTOR* TransferDescPtr, SPI_TRANSFER_MODE TransferMode);
 void Request_Frame( uint8_t callsource );
 void Clr_Bluenrg_Reset_Pin(void);
 void Set_Bluenrg_Reset_Pin(void);
 uint8_t Get_Bluenrg_IRQ_Pin(void);
 int8_t Bluenrg_Get_Max_Transfer_Queue_Size(void);
 int8_t Bluenrg_Get_Max_CallBack_Queue_Size(void);
+uint16_t Bluenrg_Dump_HCI_Trace( TraceOutputCallBack Output );
 
 
 /****************************************************************/
@@ -17,6 +17,7 @@
 /****************************************************************/
 /* Static functions declaration                                 */
 /****************************************************************/
+static uint8_t AD_Index_Entry( uint8_t AD_Type );
 
 
 /****************************************************************/
@@ -410,18 +411,24 @@ uint8_t Load_Manufacturer_Specific_Data( Manufacturer_Specific_Data_Type* Ptr, i
 /* Location: 													*/
 /* Purpose: Get the pointer of the AD_Type passed.				*/
 /* Parameters: none				         						*/
-/* Return: 														*/
-/* Description:													*/
+/* Return: NULL if the type is absent.							*/
+/* Description: The search follows the same rules as			*/
+/* Index_AD_Structures(): a zero length ends the significant	*/
+/* part of the payload and nothing is read past a structure 	*/
+/* that does not fit in SizeOfData.								*/
 /****************************************************************/
 void* Get_AD_Type_Ptr( uint8_t AD_Type, uint8_t Ad_or_Scan_Ptr[], int16_t SizeOfData )
 {
 	uint8_t length;
 	int16_t i = 0;
 
-	while( i < SizeOfData )
+	while( ( i < SizeOfData ) && ( Ad_or_Scan_Ptr[i] != 0 ) )
 	{
 		length = Ad_or_Scan_Ptr[i];
-		if( ( Ad_or_Scan_Ptr[i + 1] ) == AD_Type )
+		if( ( i + 1 + length ) > SizeOfData )
+		{
+			break;
+		}else if( ( Ad_or_Scan_Ptr[i + 1] ) == AD_Type )
 		{
 			return ( &Ad_or_Scan_Ptr[i] );
 		}else
@@ -434,6 +441,103 @@ void* Get_AD_Type_Ptr( uint8_t AD_Type, uint8_t Ad_or_Scan_Ptr[], int16_t SizeOf
 }
 
 
+/****************************************************************/
+/* Index_AD_Structures()        								*/
+/* Location: 1408 Core_v5.2										*/
+/* Purpose: Index the AD structures of an advertising or scan 	*/
+/* response payload.											*/
+/* Parameters: none				         						*/
+/* Return: TRUE if the payload is well formed.					*/
+/* Description: The lengths are checked once here, so the 		*/
+/* lookups with Get_Indexed_AD_Type_Ptr() can trust them. A		*/
+/* zero length ends the significant part of the payload. The	*/
+/* structures before a malformed one are still indexed.			*/
+/****************************************************************/
+uint8_t Index_AD_Structures( AD_INDEX* IndexPtr, uint8_t Ad_or_Scan_Ptr[], int16_t SizeOfData )
+{
+	int16_t i = 0;
+
+	IndexPtr->DataPtr = &Ad_or_Scan_Ptr[0];
+	IndexPtr->Count = 0;
+	memset( &IndexPtr->Present[0], 0, sizeof(IndexPtr->Present) );
+
+	while( ( i < SizeOfData ) && ( Ad_or_Scan_Ptr[i] != 0 ) )
+	{
+		uint8_t length = Ad_or_Scan_Ptr[i];
+
+		if( ( ( i + 1 + length ) > SizeOfData ) || ( i > UINT8_MAX ) || ( IndexPtr->Count >= AD_INDEX_MAX_STRUCTURES ) )
+		{
+			return (FALSE);
+		}
+
+		uint8_t Entry = AD_Index_Entry( Ad_or_Scan_Ptr[i + 1] );
+
+		if( ( Entry < AD_INDEX_TYPES ) && !( IndexPtr->Present[Entry >> 5] & ( 1UL << ( Entry & 0x1F ) ) ) )
+		{
+			IndexPtr->Present[Entry >> 5] |= ( 1UL << ( Entry & 0x1F ) );
+			IndexPtr->First[Entry] = i;
+		}
+		IndexPtr->Offset[IndexPtr->Count++] = i;
+
+		i += ( length + 1 );
+	}
+
+	return (TRUE);
+}
+
+
+/****************************************************************/
+/* Get_Indexed_AD_Type_Ptr()        							*/
+/* Location: 													*/
+/* Purpose: Get the pointer of the first AD structure of a type	*/
+/* in a payload indexed by Index_AD_Structures().				*/
+/* Parameters: none				         						*/
+/* Return: NULL if the type is absent.							*/
+/* Description: The types out of First[] are searched in the	*/
+/* index, without reading the payload lengths.					*/
+/****************************************************************/
+void* Get_Indexed_AD_Type_Ptr( AD_INDEX* IndexPtr, uint8_t AD_Type )
+{
+	uint8_t Entry = AD_Index_Entry( AD_Type );
+
+	if( Entry < AD_INDEX_TYPES )
+	{
+		return ( ( IndexPtr->Present[Entry >> 5] & ( 1UL << ( Entry & 0x1F ) ) ) ? &IndexPtr->DataPtr[IndexPtr->First[Entry]] : NULL );
+	}
+
+	for( uint8_t i = 0; i < IndexPtr->Count; i++ )
+	{
+		if( IndexPtr->DataPtr[IndexPtr->Offset[i] + 1] == AD_Type )
+		{
+			return ( &IndexPtr->DataPtr[IndexPtr->Offset[i]] );
+		}
+	}
+
+	return (NULL);
+}
+
+
+/****************************************************************/
+/* AD_Index_Entry()        										*/
+/* Location: 													*/
+/* Purpose: Get the entry of First[] of an AD type				*/
+/* Parameters: none				         						*/
+/* Return: AD_INDEX_TYPES if the type has no direct entry.		*/
+/* Description: The reserved type 0x00 gives its entry to 		*/
+/* MANUFACTURER_SPECIFIC_DATA_TYPE, so it is searched in the	*/
+/* index like the types out of First[].							*/
+/****************************************************************/
+static uint8_t AD_Index_Entry( uint8_t AD_Type )
+{
+	if( AD_Type == MANUFACTURER_SPECIFIC_DATA_TYPE )
+	{
+		return (0);
+	}
+
+	return ( ( AD_Type != 0 ) ? AD_Type : AD_INDEX_TYPES );
+}
+
+
 /****************************************************************/
 /* End of file	                                                */
 /****************************************************************/
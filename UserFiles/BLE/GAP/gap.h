@@ -69,6 +69,11 @@
 #define MANUFACTURER_SPECIFIC_DATA_TYPE 				0xFF /* Manufacturer Specific Data */
 
 
+/* AD structures index */
+#define AD_INDEX_MAX_STRUCTURES	16	 /* A legacy payload of 31 bytes holds at most 15 AD structures */
+#define AD_INDEX_TYPES			0x40 /* Types with a direct entry in First[], plus MANUFACTURER_SPECIFIC_DATA_TYPE in the entry of the reserved 0x00 */
+
+
 /* GAP TIMERS AND CONSTANTS (Page 1410 Core_v5.2) */
 #define TGAP_PRIVATE_ADDR_INT ( 60000 /* 60 seg. */ * 15 ) /* 15 min */
 
@@ -186,6 +191,18 @@ typedef struct
 }__attribute__((packed)) Manufacturer_Specific_Data_Type;
 
 
+/* The AD structures of a payload, found in a single pass, so looking up
+ * a type does not walk the payload again. */
+typedef struct
+{
+	uint8_t* DataPtr;						 /* Payload indexed */
+	uint8_t Count;							 /* AD structures indexed, in payload order */
+	uint8_t Offset[AD_INDEX_MAX_STRUCTURES]; /* Of the length field of each AD structure */
+	uint32_t Present[AD_INDEX_TYPES / 32];	 /* Bit set for each type of First[] found, so First[] is never cleared */
+	uint8_t First[AD_INDEX_TYPES];			 /* Offset of the first AD structure of each type */
+}AD_INDEX;
+
+
 /****************************************************************/
 /* External functions declaration (Interface functions)         */
 /****************************************************************/
@@ -204,6 +221,8 @@ uint8_t Load_LE_Bluetooth_Device_Address( LE_BD_Address_Type* Ptr, int16_t Array
 uint8_t Load_Manufacturer_Specific_Data( Manufacturer_Specific_Data_Type* Ptr, int16_t ArraySize,
 		uint8_t DataPtr[], uint8_t DataSize );
 void* Get_AD_Type_Ptr( uint8_t AD_Type, uint8_t Ad_or_Scan_Ptr[], int16_t SizeOfData );
+uint8_t Index_AD_Structures( AD_INDEX* IndexPtr, uint8_t Ad_or_Scan_Ptr[], int16_t SizeOfData );
+void* Get_Indexed_AD_Type_Ptr( AD_INDEX* IndexPtr, uint8_t AD_Type );
 
 
 /****************************************************************/
@@ -2777,11 +2777,13 @@ __attribute__((weak)) void HCI_LE_Long_Term_Key_Request( uint16_t Connection_Han
 /* link are affected by the automatic flush timer.				*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: Refused while the controller buffers are taken,	*/
+/* or while this link holds its share of them and another link	*/
+/* waits: the caller should try again later.					*/
 /****************************************************************/
 uint8_t HCI_Host_ACL_Data( HCI_ACL_DATA_PCKT_HEADER* ACLDataPacketHeader, uint8_t Data[] )
 {
-	if( ACLDataPacketHeader->Data_Total_Length <= 27 )
+	if( ( ACLDataPacketHeader->Data_Total_Length <= 27 ) && ( HCI_Data_Credit_Available( ACLDataPacketHeader->Handle ) ) )
 	{
 		TRANSFER_DESCRIPTOR TxDesc;
 
@@ -2834,7 +2836,10 @@ uint8_t HCI_Host_ACL_Data( HCI_ACL_DATA_PCKT_HEADER* ACLDataPacketHeader, uint8_
 /* link are affected by the automatic flush timer.				*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: The packet is only valid during the call. To 	*/
+/* use it later without a copy, hold it with 					*/
+/* Hold_Received_Packet( ACLDataPacketHeader ) and give it back	*/
+/* with Release_Received_Packet().								*/
 /****************************************************************/
 __attribute__((weak)) void 	HCI_Controller_ACL_Data( HCI_ACL_DATA_PCKT_HEADER* ACLDataPacketHeader, uint8_t Data[] )
 {
@@ -12,28 +12,59 @@
 /****************************************************************/
 /* Type Defines                                                 */
 /****************************************************************/
+typedef struct
+{
+	CMD_CALLBACK CallBack;
+	TRANSFER_DESCRIPTOR TxDesc; /* The command packet while it is QUEUED */
+	uint8_t Sequence;			/* Issue order, used to transmit and to match the responses in FIFO order */
+	uint8_t BufferResets;		/* Get_Buffer_Manager_Resets() when the command was issued */
+	uint8_t HeapPosition;		/* Position in the DeadlineHeap or NOT_IN_DEADLINE_HEAP */
+}PENDING_COMMAND;
+
+
+typedef struct
+{
+	HCI_LINK_CREDITS Credits;
+	uint8_t Used;
+	uint8_t Waiting;		/* Refused a credit and not served yet */
+	uint32_t WaitStartUs;	/* TimeBase_Get_Us() at the first refusal */
+	uint32_t LastRequestUs; /* TimeBase_Get_Us() at the last refusal */
+}DATA_LINK;
 
 
 /****************************************************************/
 /* Static functions declaration                                 */
 /****************************************************************/
 CMD_CALLBACK* Get_Command_CallBack( HCI_COMMAND_OPCODE OpCode );
-static CMD_CALLBACK* LINK_CTRL_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode);
-static CMD_CALLBACK* LINK_POLICY_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode);
-static CMD_CALLBACK* CTRL_AND_BASEBAND_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode);
-static CMD_CALLBACK* INFO_PARAMETERS_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode);
-static CMD_CALLBACK* STATUS_PARAMETERS_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode);
-static CMD_CALLBACK* TESTING_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode);
-static CMD_CALLBACK* LE_CONTROLLER_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode);
+CMD_CALLBACK* Get_Transmitted_Command( HCI_COMMAND_OPCODE OpCode, uint8_t Position );
+static const CMD_CALLBACK* Get_Command_Template( HCI_COMMAND_OPCODE OpCode );
+static const CMD_CALLBACK* LINK_CTRL_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode);
+static const CMD_CALLBACK* LINK_POLICY_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode);
+static const CMD_CALLBACK* CTRL_AND_BASEBAND_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode);
+static const CMD_CALLBACK* INFO_PARAMETERS_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode);
+static const CMD_CALLBACK* STATUS_PARAMETERS_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode);
+static const CMD_CALLBACK* TESTING_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode);
+static const CMD_CALLBACK* LE_CONTROLLER_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode);
 static uint8_t Check_Data_Packets_Available( void );
 static void Decrement_HCI_Data_Packets( void );
 static void Increment_HCI_Data_Packets( uint16_t Num_Cplt_Packets );
+static DATA_LINK* Get_Data_Link( uint16_t Connection_Handle, uint8_t Allocate );
+static void End_Credit_Wait( DATA_LINK* LinkPtr, uint32_t EndUs );
+static void Charge_Data_Link( uint16_t Connection_Handle );
+static void Credit_Data_Links( uint8_t Num_Handles, uint8_t Parameters[] );
+static void Open_Data_Link( uint8_t LE_Meta_Parameters[] );
+static void Release_Data_Link( uint16_t Connection_Handle );
 static void Set_Number_Of_HCI_Command_Packets( uint8_t Num_HCI_Cmd_Packets );
 static uint8_t Check_Command_Packets_Available( void );
 static void Decrement_HCI_Command_Packets( void );
 
-static uint8_t Verify_Command_Availability( TRANSFER_DESCRIPTOR* TxDescPtr, uint16_t OpCodeVal,
-		uint8_t Operation, void* CmdComplete, void* CmdStatus );
+static uint8_t Enqueue_Command( TRANSFER_DESCRIPTOR* TxDescPtr, HCI_COMMAND_OPCODE OpCode,
+		void* CmdComplete, void* CmdStatus );
+static PENDING_COMMAND* Search_For_Free_Command( void );
+static void Release_Command( CMD_CALLBACK* CmdCallBack );
+static void Insert_Command_Deadline( PENDING_COMMAND* CommandPtr, uint32_t Deadline );
+static void Remove_Command_Deadline( PENDING_COMMAND* CommandPtr );
+static void Place_Command_Deadline( uint8_t Position, uint8_t CommandIndex );
 static uint8_t Verify_Data_Availability( TRANSFER_DESCRIPTOR* TxDescPtr, uint8_t Operation );
 
 static void Finish_Status( TRANSFER_STATUS Status, HCI_COMMAND_OPCODE OpCode,
@@ -93,6 +124,11 @@ extern void Enter_Connection_Mode( CONTROLLER_ERROR_CODES Status );
  * This amount of time is also dependent on the number of commands
  * unprocessed in the command queue. Location: 1892 Core_v5.2 page 1886 */
 #define DEFAULT_HCI_RESPONSE_TIMEOUT 1000U /* Time in milliseconds */
+#define SIZE_OF_COMMAND_PIPELINE	 8 /* Commands issued and not yet answered by the controller */
+#define NOT_IN_DEADLINE_HEAP		 0xFF
+#define COMMAND_TIMEOUT_RETRY_TIME	 10U /* Time in milliseconds to report a timeout again when the callback queue is full */
+#define MAX_NUMBER_OF_DATA_LINKS	 MAX_NUMBER_OF_CONNECTIONS
+#define CREDIT_WAIT_EXPIRY_US		 100000UL /* A link refused a credit that does not ask again within this time stops waiting */
 
 
 /****************************************************************/
@@ -110,11 +146,30 @@ static uint8_t Num_HCI_Command_Packets = 1;
 static uint16_t Num_LE_ACL_Data_Packets = 0;
 
 
-/* Command callback (not all commands have callback). At least one
- * callback per command is available. That means only one command
- * type can be sent at any given time. That is generally OK, but
- * if more than one command of the same type wants to be enqueued,
- * the command callback must be modified to become and array */
+/* Credit ledger of each connection. Num_LE_ACL_Data_Packets is shared by
+ * all the links, so while a link waits for a credit the others are held
+ * to an even share of the controller buffers. */
+static DATA_LINK DataLinks[MAX_NUMBER_OF_DATA_LINKS];
+
+
+/* Commands issued by the host, transmitted in the issue order as the
+ * controller gives Num_HCI_Command_Packets credits. Any number of
+ * commands of the same type can be pending: the responses are matched
+ * to the oldest pending command with the same opcode. */
+static PENDING_COMMAND CommandPipeline[SIZE_OF_COMMAND_PIPELINE];
+static uint8_t NextCommandToIssue = 0;
+static uint8_t NextCommandToTransmit = 0;
+
+
+/* Binary min-heap of the transmitted commands waiting for a response,
+ * keyed on their deadline. The root is the next command to time out,
+ * so the tick interrupt only compares it with the current tick. */
+static uint8_t DeadlineHeap[SIZE_OF_COMMAND_PIPELINE]; /* CommandPipeline indexes */
+static volatile uint8_t DeadlineHeapSize = 0;
+
+
+/* Command callback template (not all commands have callback). The
+ * pending command copies the handler of its opcode from here. */
 #define CMD_CALLBACK_NAME(OpcodeVal) OpcodeVal ## _CMD_CALLBACK
 #define CMD_CALLBACK_NAME_HANDLER(OpcodeVal, handler) OpcodeVal ## _CMD_CALLBACK = { .CmdCompleteHandler = handler }
 
@@ -186,7 +241,7 @@ typedef union
 }CMD_CALLBACK_STRUCT;
 
 
-static CMD_CALLBACK_STRUCT CB_DESC =
+static const CMD_CALLBACK_STRUCT CB_DESC =
 {
 		.CB.CMD_CALLBACK_NAME_HANDLER(	HCI_DISCONNECT, 								NULL), /* There is no Command_Complete handler because DISCONNECTION_COMPLETE_EVT can occur without a command, so the handler should be fixed */
 		.CB.CMD_CALLBACK_NAME_HANDLER(	HCI_READ_REMOTE_VERSION_INFORMATION, 			&Read_Remote_Version_Information_Complete),
@@ -250,34 +305,48 @@ static CMD_CALLBACK_STRUCT CB_DESC =
 
 
 /****************************************************************/
-/* Get_Number_Of_Callbacks()         							*/
+/* Get_Expired_Command_Callback()  								*/
 /* Location: 					 								*/
-/* Purpose: Check how many command call backs are available		*/
-/* Parameters: none				         						*/
-/* Return: none  												*/
-/* Description:													*/
-/****************************************************************/
-uint16_t Get_Number_Of_Command_Callbacks( void )
+/* Purpose: Take the command whose response deadline expired	*/
+/* Parameters: Now: current HAL_GetTick()						*/
+/* Return: NULL if no deadline expired.							*/
+/* Description: Called from the tick interrupt. Only the 		*/
+/* earliest deadline is compared. The expired command leaves 	*/
+/* the heap, so its timeout is reported once: the caller puts 	*/
+/* it back with Retry_Command_Deadline() if it could not report	*/
+/* it.															*/
+/****************************************************************/
+CMD_CALLBACK* Get_Expired_Command_Callback( uint32_t Now )
 {
-	return ( sizeof( CB_DESC.CB ) / sizeof( CMD_CALLBACK ) );
+	if( ( DeadlineHeapSize == 0 ) || ( (int32_t)( Now - CommandPipeline[ DeadlineHeap[0] ].CallBack.Deadline ) < 0 ) )
+	{
+		return ( NULL );
+	}
+
+	PENDING_COMMAND* CommandPtr = &CommandPipeline[ DeadlineHeap[0] ];
+
+	Remove_Command_Deadline( CommandPtr );
+
+	return ( &CommandPtr->CallBack );
 }
 
 
 /****************************************************************/
-/* Get_Command_Callback_From_Index()  							*/
+/* Retry_Command_Deadline()  									*/
 /* Location: 					 								*/
-/* Purpose: Get the pointer of a call back from the index		*/
+/* Purpose: Report the timeout of the command again later		*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-CMD_CALLBACK* Get_Command_Callback_From_Index( uint16_t Index )
+void Retry_Command_Deadline( CMD_CALLBACK* CmdCallBack )
 {
-	if( Index < ( sizeof( CB_DESC.CB ) / sizeof( CMD_CALLBACK ) ) )
+	PENDING_COMMAND* CommandPtr = (PENDING_COMMAND*)CmdCallBack; /* The callback is the first member */
+
+	if( ( CmdCallBack->Status != FREE ) && ( CmdCallBack->Status != QUEUED ) )
 	{
-		return ( &CB_DESC.List[Index] );
+		Insert_Command_Deadline( CommandPtr, HAL_GetTick() + COMMAND_TIMEOUT_RETRY_TIME );
 	}
-	return ( NULL );
 }
 
 
@@ -295,31 +364,16 @@ void HCI_Reset_Transport_Layer( void )
 	Reset_Bluenrg( FALSE ); /* software reset mode */
 	Set_Number_Of_HCI_Command_Packets( 1 );
 	Set_Default_Number_Of_HCI_Data_Packets(  );
+	memset( &DataLinks[0], 0, sizeof(DataLinks) ); /* The controller reset drops the links */
 
-	HCI_COMMAND_OPCODE OpCode;
-	CMD_CALLBACK* CmdCallback;
-
-	/* Reset bluetooth standard command call backs */
-	for( uint16_t i = HCI_DISCONNECT; i <= HCI_LE_SET_RESOLVABLE_PRIVATE_ADDRESS_TIMEOUT; i++ )
+	/* Cancel the transmitted commands. The queued ones are kept: their packet
+	 * buffers were given back to the memory pool by the driver reset, so they
+	 * are reported to the application as not answered when dispatched. */
+	for( uint8_t i = 0; i < SIZE_OF_COMMAND_PIPELINE; i++ )
 	{
-		OpCode.Val = i;
-		CmdCallback = Get_Command_CallBack( OpCode );
-		if( CmdCallback != NULL )
+		if( CommandPipeline[i].CallBack.Status != QUEUED )
 		{
-			CmdCallback->Timeout = 0;
-			CmdCallback->Status = FREE;
-		}
-	}
-
-	/* Reset bluetooth vendor specific command call backs */
-	for( uint16_t i = VS_ACI_HAL_GET_FW_BUILD_NUMBER; i <= VS_ACI_HAL_GET_ANCHOR_PERIOD; i++ )
-	{
-		OpCode.Val = i;
-		CmdCallback = Get_Command_CallBack( OpCode );
-		if( CmdCallback != NULL )
-		{
-			CmdCallback->Timeout = 0;
-			CmdCallback->Status = FREE;
+			Release_Command( &CommandPipeline[i].CallBack );
 		}
 	}
 }
@@ -331,7 +385,8 @@ void HCI_Reset_Transport_Layer( void )
 /* Purpose: 													*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: The links are considered to have no packets in	*/
+/* the controller anymore.										*/
 /****************************************************************/
 void Set_Default_Number_Of_HCI_Data_Packets( void )
 {
@@ -340,6 +395,12 @@ void Set_Default_Number_Of_HCI_Data_Packets( void )
 
 	Num_LE_ACL_Data_Packets = Default_Num_LE_ACL_Data_Packets;
 
+	for( uint8_t i = 0; i < MAX_NUMBER_OF_DATA_LINKS; i++ )
+	{
+		DataLinks[i].Credits.InFlight = 0;
+		DataLinks[i].Waiting = FALSE;
+	}
+
 	ExitCritical();
 }
 
@@ -406,6 +467,269 @@ static void Increment_HCI_Data_Packets( uint16_t Num_Cplt_Packets )
 }
 
 
+/****************************************************************/
+/* HCI_Data_Credit_Available()         							*/
+/* Location: 					 								*/
+/* Purpose: Tell if a link may give an ACL data packet to the	*/
+/* controller now.												*/
+/* Parameters: none				         						*/
+/* Return: TRUE if a credit is available to the link.			*/
+/* Description: A free credit goes to the waiting link with the	*/
+/* fewest packets in the controller, the one waiting for longer	*/
+/* on a tie, so a busy link cannot starve the others. A link	*/
+/* refused starts waiting until it is served. A handle without	*/
+/* a ledger entry, not connected or already disconnected, is	*/
+/* always refused.												*/
+/****************************************************************/
+uint8_t HCI_Data_Credit_Available( uint16_t Connection_Handle )
+{
+	uint32_t NowUs = TimeBase_Get_Us();
+	uint8_t Available;
+
+	EnterCritical();
+
+	DATA_LINK* LinkPtr = Get_Data_Link( Connection_Handle, FALSE );
+
+	Available = ( Num_LE_ACL_Data_Packets && ( LinkPtr != NULL ) ) ? TRUE : FALSE;
+
+	if( LinkPtr != NULL )
+	{
+		uint32_t WaitStartUs = LinkPtr->Waiting ? LinkPtr->WaitStartUs : NowUs;
+
+		for( uint8_t i = 0; i < MAX_NUMBER_OF_DATA_LINKS; i++ )
+		{
+			DATA_LINK* OtherPtr = &DataLinks[i];
+
+			if( ( !OtherPtr->Used ) || ( !OtherPtr->Waiting ) || ( OtherPtr == LinkPtr ) )
+			{
+				continue;
+			}
+
+			if( ( NowUs - OtherPtr->LastRequestUs ) >= CREDIT_WAIT_EXPIRY_US )
+			{
+				End_Credit_Wait( OtherPtr, OtherPtr->LastRequestUs ); /* The link gave up sending */
+			}else if( ( OtherPtr->Credits.InFlight < LinkPtr->Credits.InFlight ) ||
+					( ( OtherPtr->Credits.InFlight == LinkPtr->Credits.InFlight ) && ( (int32_t)( OtherPtr->WaitStartUs - WaitStartUs ) < 0 ) ) )
+			{
+				Available = FALSE; /* The credit is kept for the other link */
+			}
+		}
+
+		if( !Available )
+		{
+			if( !LinkPtr->Waiting )
+			{
+				LinkPtr->Waiting = TRUE;
+				LinkPtr->WaitStartUs = NowUs;
+				LinkPtr->Credits.CreditWaits++;
+			}
+			LinkPtr->LastRequestUs = NowUs;
+		}
+	}
+
+	ExitCritical();
+
+	return (Available);
+}
+
+
+/****************************************************************/
+/* HCI_Get_Link_Credits()         								*/
+/* Location: 					 								*/
+/* Purpose: Return the credit ledger of a link					*/
+/* Parameters: Index: from 0 to MAX_NUMBER_OF_DATA_LINKS - 1	*/
+/* Return: TRUE if a link uses this entry.						*/
+/* Description:													*/
+/****************************************************************/
+uint8_t HCI_Get_Link_Credits( uint8_t Index, HCI_LINK_CREDITS* CreditsPtr )
+{
+	uint8_t status = FALSE;
+
+	EnterCritical();
+
+	if( ( Index < MAX_NUMBER_OF_DATA_LINKS ) && ( DataLinks[Index].Used ) )
+	{
+		*CreditsPtr = DataLinks[Index].Credits;
+		status = TRUE;
+	}
+
+	ExitCritical();
+
+	return (status);
+}
+
+
+/****************************************************************/
+/* Get_Data_Link()         										*/
+/* Location: 					 								*/
+/* Purpose: Search the ledger entry of a link					*/
+/* Parameters: Allocate: take a free entry if not found			*/
+/* Return: NULL if not found or if all entries are used.		*/
+/* Description: Called inside a critical section.				*/
+/****************************************************************/
+static DATA_LINK* Get_Data_Link( uint16_t Connection_Handle, uint8_t Allocate )
+{
+	DATA_LINK* FreePtr = NULL;
+
+	for( uint8_t i = 0; i < MAX_NUMBER_OF_DATA_LINKS; i++ )
+	{
+		if( !DataLinks[i].Used )
+		{
+			FreePtr = ( FreePtr == NULL ) ? &DataLinks[i] : FreePtr;
+		}else if( DataLinks[i].Credits.Connection_Handle == Connection_Handle )
+		{
+			return ( &DataLinks[i] );
+		}
+	}
+
+	if( ( Allocate ) && ( FreePtr != NULL ) )
+	{
+		memset( FreePtr, 0, sizeof(DATA_LINK) );
+		FreePtr->Used = TRUE;
+		FreePtr->Credits.Connection_Handle = Connection_Handle;
+		return ( FreePtr );
+	}
+
+	return (NULL);
+}
+
+
+/****************************************************************/
+/* End_Credit_Wait()         									*/
+/* Location: 					 								*/
+/* Purpose: Account the time a link waited for a credit			*/
+/* Parameters: EndUs: TimeBase_Get_Us() at the end of the wait	*/
+/* Return: none  												*/
+/* Description: Called inside a critical section.				*/
+/****************************************************************/
+static void End_Credit_Wait( DATA_LINK* LinkPtr, uint32_t EndUs )
+{
+	if( LinkPtr->Waiting )
+	{
+		uint32_t WaitTimeUs = EndUs - LinkPtr->WaitStartUs;
+
+		LinkPtr->Credits.WaitTimeUs += WaitTimeUs;
+		LinkPtr->Credits.MaxWaitTimeUs = MAX( LinkPtr->Credits.MaxWaitTimeUs, WaitTimeUs );
+		LinkPtr->Waiting = FALSE;
+	}
+}
+
+
+/****************************************************************/
+/* Charge_Data_Link()         									*/
+/* Location: 					 								*/
+/* Purpose: A packet of the link was given to the controller	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Charge_Data_Link( uint16_t Connection_Handle )
+{
+	EnterCritical();
+
+	DATA_LINK* LinkPtr = Get_Data_Link( Connection_Handle, FALSE );
+
+	if( LinkPtr != NULL )
+	{
+		End_Credit_Wait( LinkPtr, TimeBase_Get_Us() );
+		LinkPtr->Credits.InFlight++;
+		LinkPtr->Credits.MaxInFlight = MAX( LinkPtr->Credits.MaxInFlight, LinkPtr->Credits.InFlight );
+		LinkPtr->Credits.PacketsSent++;
+	}
+
+	ExitCritical();
+}
+
+
+/****************************************************************/
+/* Credit_Data_Links()         									*/
+/* Location: 					 								*/
+/* Purpose: Attribute the completed packets to their links		*/
+/* Parameters: Parameters: the Connection_Handle and 			*/
+/* Num_Completed_Packets arrays of the event					*/
+/* Return: none  												*/
+/* Description: Read byte by byte, since the arrays are not		*/
+/* aligned.														*/
+/****************************************************************/
+static void Credit_Data_Links( uint8_t Num_Handles, uint8_t Parameters[] )
+{
+	EnterCritical();
+
+	for( uint8_t i = 0; i < Num_Handles; i++ )
+	{
+		uint16_t Handle = ( Parameters[2 * i] | ( Parameters[2 * i + 1] << 8 ) ) & 0x0FFF;
+		uint16_t Completed = Parameters[2 * ( Num_Handles + i )] | ( Parameters[2 * ( Num_Handles + i ) + 1] << 8 );
+		DATA_LINK* LinkPtr = Get_Data_Link( Handle, FALSE );
+
+		if( LinkPtr != NULL )
+		{
+			LinkPtr->Credits.InFlight -= MIN( LinkPtr->Credits.InFlight, Completed );
+			LinkPtr->Credits.PacketsCompleted += Completed;
+		}
+	}
+
+	ExitCritical();
+}
+
+
+/****************************************************************/
+/* Open_Data_Link()         									*/
+/* Location: 2382 Core_v5.2		 								*/
+/* Purpose: Take the ledger entry of a new link					*/
+/* Parameters: LE_Meta_Parameters: the parameters of the		*/
+/* LE_Connection_Complete or LE_Enhanced_Connection_Complete	*/
+/* event, subevent code included								*/
+/* Return: none  												*/
+/* Description: Both events start with the Status and the		*/
+/* Connection_Handle. Only a successful connection gets an entry.*/
+/****************************************************************/
+static void Open_Data_Link( uint8_t LE_Meta_Parameters[] )
+{
+	if( LE_Meta_Parameters[1] == COMMAND_SUCCESS )
+	{
+		EnterCritical();
+
+		Get_Data_Link( ( LE_Meta_Parameters[2] | ( LE_Meta_Parameters[3] << 8 ) ) & 0x0FFF, TRUE );
+
+		ExitCritical();
+	}
+}
+
+
+/****************************************************************/
+/* Release_Data_Link()         									*/
+/* Location: 2296 Core_v5.2		 								*/
+/* Purpose: Free the ledger entry of a disconnected link		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: After the HCI_Disconnection_Complete event the	*/
+/* host shall assume that the packets sent to the controller	*/
+/* for the handle were flushed and their buffers freed, so		*/
+/* their credits are given back.								*/
+/****************************************************************/
+static void Release_Data_Link( uint16_t Connection_Handle )
+{
+	uint16_t InFlight = 0;
+
+	EnterCritical();
+
+	DATA_LINK* LinkPtr = Get_Data_Link( Connection_Handle, FALSE );
+
+	if( LinkPtr != NULL )
+	{
+		InFlight = LinkPtr->Credits.InFlight;
+		LinkPtr->Used = FALSE;
+	}
+
+	ExitCritical();
+
+	if( InFlight )
+	{
+		Increment_HCI_Data_Packets( InFlight );
+	}
+}
+
+
 /****************************************************************/
 /* Set_Number_Of_HCI_Command_Packets()         					*/
 /* Location: 					 								*/
@@ -426,6 +750,47 @@ static void Set_Number_Of_HCI_Command_Packets( uint8_t Num_HCI_Cmd_Packets )
 }
 
 
+/****************************************************************/
+/* HCI_Command_Credits_Available()         						*/
+/* Location: 					 								*/
+/* Purpose: Verify if a command issued now is transmitted 		*/
+/* without waiting.												*/
+/* Parameters: none				         						*/
+/* Return: TRUE if the controller has a free command credit and	*/
+/* no other command is waiting for one.							*/
+/* Description:													*/
+/****************************************************************/
+uint8_t HCI_Command_Credits_Available( void )
+{
+	return ( ( NextCommandToTransmit == NextCommandToIssue ) && Check_Command_Packets_Available(  ) ) ? TRUE : FALSE;
+}
+
+
+/****************************************************************/
+/* HCI_Hold_Command()         									*/
+/* Location: 					 								*/
+/* Purpose: Keep a command the host answers itself apart from	*/
+/* the controller's responses.									*/
+/* Parameters: CmdCallBack: command whose Command Complete the	*/
+/* host synthesizes later.										*/
+/* Return: none  												*/
+/* Description: The command leaves the deadline heap and the	*/
+/* responses of the same opcode are no longer matched to it.	*/
+/* The Command_Complete_Handler() called by the host releases	*/
+/* it.															*/
+/****************************************************************/
+void HCI_Hold_Command( CMD_CALLBACK* CmdCallBack )
+{
+	if( CmdCallBack != NULL )
+	{
+		/* First, so that no response or timeout reported meanwhile is matched to it anymore */
+		CmdCallBack->Status = ON_GOING;
+
+		Remove_Command_Deadline( (PENDING_COMMAND*)CmdCallBack ); /* The callback is the first member */
+	}
+}
+
+
 /****************************************************************/
 /* Check_Command_Packets_Available()         					*/
 /* Location: 					 								*/
@@ -478,24 +843,25 @@ static void Decrement_HCI_Command_Packets( void )
 /* destination	    											*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: The command is put in the pipeline and is		*/
+/* transmitted as soon as the controller can handle it, so the	*/
+/* caller does not need to wait for the response of the 		*/
+/* previous commands.											*/
 /****************************************************************/
 uint8_t HCI_Transmit_Command( TRANSFER_DESCRIPTOR* TxDescPtr, void* CmdComplete, void* CmdStatus )
 {
 	if( TxDescPtr->DataPtr != NULL )
 	{
-		int8_t Ntries = 3;
-
 		HCI_SERIAL_COMMAND_PCKT* PcktPtr = (typeof(PcktPtr))( &TxDescPtr->DataPtr->Bytes[0] );
 
-		do
+		if( Enqueue_Command( TxDescPtr, PcktPtr->CmdPacket.OpCode, CmdComplete, CmdStatus ) )
 		{
-			if( Verify_Command_Availability( TxDescPtr, PcktPtr->CmdPacket.OpCode.Val, 1, CmdComplete, CmdStatus ) )
-			{
-				return (TRUE);
-			}
-			Ntries--;
-		}while( ( TxDescPtr->DataPtr->Size != 0 ) &&  ( Ntries > 0 ) );
+			HCI_Transmit_Pending_Commands(  );
+
+			return (TRUE);
+		}
+
+		Release_Memory_Buffer( TxDescPtr->DataPtr ); /* Release the allocated buffer since no room in the pipeline was found */
 	}
 
 	return (FALSE);
@@ -507,37 +873,34 @@ uint8_t HCI_Transmit_Command( TRANSFER_DESCRIPTOR* TxDescPtr, void* CmdComplete,
 /* Purpose: Higher layers get free buffer position here.		*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: The buffer is only given when the pipeline has	*/
+/* room for the command. Commands of the same opcode do not 	*/
+/* need to wait for each other anymore, so OpCodeVal is not		*/
+/* used.														*/
 /****************************************************************/
 DESC_DATA* HCI_Get_Command_Transmit_Buffer_Free( uint16_t OpCodeVal )
 {
-	TRANSFER_DESCRIPTOR TransferDesc;
-	int8_t Ntries = 3;
+	(void)OpCodeVal; /* Kept so the callers of every command still compile */
 
-	do
+	if( Search_For_Free_Command(  ) != NULL )
 	{
-		if( Verify_Command_Availability( &TransferDesc, OpCodeVal, 0, NULL, NULL ) )
-		{
-			return (TransferDesc.DataPtr);
-		}
-		Ntries--;
-	}while( Ntries > 0 );
-
-	TransferDesc.DataPtr = NULL;
+		return ( Search_For_Command_Memory_Buffer(  ) );
+	}
 
-	return (TransferDesc.DataPtr);
+	return (NULL);
 }
 
 
 /****************************************************************/
-/* Verify_Command_Availability()        			            */
-/* Purpose: Thread safe command is available.					*/
+/* Enqueue_Command()        			           		 		*/
+/* Purpose: Put a command in the pipeline						*/
 /* Parameters: none				         						*/
-/* Return: none  												*/
-/* Description:													*/
+/* Return: TRUE if the command was enqueued.					*/
+/* Description:	The command is QUEUED until it is transmitted 	*/
+/* by HCI_Transmit_Pending_Commands().							*/
 /****************************************************************/
-static uint8_t Verify_Command_Availability( TRANSFER_DESCRIPTOR* TxDescPtr, uint16_t OpCodeVal,
-		uint8_t Operation, void* CmdComplete, void* CmdStatus )
+static uint8_t Enqueue_Command( TRANSFER_DESCRIPTOR* TxDescPtr, HCI_COMMAND_OPCODE OpCode,
+		void* CmdComplete, void* CmdStatus )
 {
 	static volatile uint8_t Acquire = 0;
 
@@ -545,109 +908,298 @@ static uint8_t Verify_Command_Availability( TRANSFER_DESCRIPTOR* TxDescPtr, uint
 
 	Acquire++;
 
-	if( Acquire != 1 ) /* Cannot enqueue while a frame is being released */
+	if( Acquire != 1 )
 	{
 		ExitCritical(); /* Critical section exit */
 		return (FALSE); /* This function is already being handled and we are not going to mix it up */
 	}
 
-	ExitCritical();
+	ExitCritical(); /* Critical section exit */
 
-	CMD_CALLBACK* CallBackPtr = NULL;
-	uint8_t CmdAvailable = FALSE;
+	PENDING_COMMAND* CommandPtr = Search_For_Free_Command(  );
 
-	if( Check_Command_Packets_Available() )
+	if( CommandPtr != NULL )
 	{
-		CmdAvailable = TRUE;
-		HCI_COMMAND_OPCODE OpCode;
-		OpCode.Val = OpCodeVal;
-		CallBackPtr = Get_Command_CallBack( OpCode );
-		if( CallBackPtr != NULL )
-		{
-			if( CallBackPtr->Status )
-			{
-				CmdAvailable = FALSE; /* This command was already loaded and is waiting for conclusion */
-			}
-		}
+		const CMD_CALLBACK* TemplatePtr = Get_Command_Template( OpCode );
+
+		CommandPtr->HeapPosition = NOT_IN_DEADLINE_HEAP; /* The deadline is set at the moment the command is transmitted */
+		CommandPtr->CallBack.OpCode = OpCode;
+		CommandPtr->CallBack.CmdCompleteCallBack = CmdComplete;
+		CommandPtr->CallBack.CmdStatusCallBack = CmdStatus;
+		CommandPtr->CallBack.CmdCompleteHandler = ( TemplatePtr != NULL ) ? TemplatePtr->CmdCompleteHandler : NULL;
+		CommandPtr->TxDesc = *TxDescPtr;
+		CommandPtr->TxDesc.Timeout = DEFAULT_HCI_RESPONSE_TIMEOUT; /* Default timeout response */
+		CommandPtr->Sequence = NextCommandToIssue++;
+		CommandPtr->BufferResets = Get_Buffer_Manager_Resets(  );
+		CommandPtr->CallBack.Status = QUEUED;
 	}
 
-	if( Operation == 0 ) /* This is for buffer reservation only */
-	{
+	EnterCritical(); /* Critical section enter */
 
-		TxDescPtr->DataPtr = CmdAvailable ? Search_For_Command_Memory_Buffer() : NULL;
+	Acquire = 0;
 
-		EnterCritical(); /* Critical section enter */
+	ExitCritical(); /* Critical section exit */
+
+	return ( ( CommandPtr != NULL ) ? TRUE : FALSE );
+}
 
-		Acquire = 0;
 
+/****************************************************************/
+/* HCI_Transmit_Pending_Commands()        			            */
+/* Purpose: Transmit the QUEUED commands in the issue order		*/
+/* while the controller has Num_HCI_Command_Packets credits.	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Called when a command is issued and from the	*/
+/* main loop (Run_BLE), where the credits returned by the 		*/
+/* controller are used.											*/
+/****************************************************************/
+void HCI_Transmit_Pending_Commands( void )
+{
+	static volatile uint8_t Acquire = 0;
+
+	EnterCritical(); /* Critical section enter */
+
+	Acquire++;
+
+	if( Acquire != 1 )
+	{
 		ExitCritical(); /* Critical section exit */
+		return; /* This function is already being handled and we are not going to mix it up */
+	}
 
-		return (TRUE);
+	ExitCritical(); /* Critical section exit */
 
-	}else if( ( TxDescPtr->DataPtr != NULL ) && ( CmdAvailable ) )
+	while( NextCommandToTransmit != NextCommandToIssue )
 	{
-		TxDescPtr->Timeout = DEFAULT_HCI_RESPONSE_TIMEOUT; /* Default timeout response */
-		/* Here we have already reserved buffer, we need to enqueued the command in
-		 * the transmit buffer */
-		int8_t Ntries = 3;
-		FRAME_ENQUEUE_STATUS Status;
+		PENDING_COMMAND* CommandPtr = NULL;
 
-		do
+		for( uint8_t i = 0; i < SIZE_OF_COMMAND_PIPELINE; i++ )
 		{
-			/* As the buffer could be blocked awaiting another operation, you should try some times. */
-			Status = Enqueue_Frame( TxDescPtr, 7, SPI_WRITE, 1 );
+			if( ( CommandPipeline[i].CallBack.Status == QUEUED ) && ( CommandPipeline[i].Sequence == NextCommandToTransmit ) )
+			{
+				CommandPtr = &CommandPipeline[i];
+				break;
+			}
+		}
 
-			Ntries--;
-		}while( ( Status.EnqueuedAtIndex < 0 ) &&  ( Ntries > 0 ) );
+		if( CommandPtr == NULL )
+		{
+			NextCommandToTransmit++; /* Not expected: skip the missing command */
+			continue;
+		}
 
-		if( Status.EnqueuedAtIndex >= 0 ) /* Successfully enqueued */
+		uint16_t Timeout = CommandPtr->TxDesc.Timeout;
+
+		if( CommandPtr->BufferResets == Get_Buffer_Manager_Resets(  ) )
 		{
-			Decrement_HCI_Command_Packets(  );
+			if( !Check_Command_Packets_Available(  ) )
+			{
+				break; /* Wait for the controller to return credits */
+			}
 
-			if( CallBackPtr != NULL )
+			FRAME_ENQUEUE_STATUS Status = Enqueue_Frame( &CommandPtr->TxDesc, SPI_WRITE );
+
+			if( Status.EnqueuedAtIndex < 0 )
 			{
-				CallBackPtr->CmdCompleteCallBack = CmdComplete;
-				CallBackPtr->CmdStatusCallBack = CmdStatus;
-				CallBackPtr->Timeout = 0; /* The timeout will be loaded at the moment the command is transmitted */
-				CallBackPtr->Status = BUSY;
+				break; /* Try again later */
 			}
 
+			Decrement_HCI_Command_Packets(  );
+
 			/* This is the first successfully enqueued write message, so, request transmission */
-			if( ( ( Status.EnqueuedAtIndex == 0 ) && ( Status.NumberOfEnqueuedFrames == 1 ) ) || ( Status.RequestTransmission ) )
+			if( Status.EnqueuedAtIndex == 0 )
 			{
 				/* Request transmission */
 				Request_Frame( 0 );
 			}
+		}else
+		{
+			/* The driver was reset and the packet buffer was lost: the command is not
+			 * transmitted and the next timeout evaluation reports it was not answered */
+			Timeout = 1;
+		}
 
-			EnterCritical(); /* Critical section enter */
+		NextCommandToTransmit++;
 
-			Acquire = 0;
+		if( Get_Command_Template( CommandPtr->CallBack.OpCode ) != NULL )
+		{
+			CommandPtr->CallBack.Status = BUSY;
+			Insert_Command_Deadline( CommandPtr, HAL_GetTick() + Timeout );
+		}else
+		{
+			/* No callback for this command: the responses go to the generic handlers */
+			CommandPtr->CallBack.Status = FREE;
+		}
+	}
 
-			ExitCritical(); /* Critical section exit */
+	EnterCritical(); /* Critical section enter */
 
-			return (TRUE);
+	Acquire = 0;
 
-		}else
+	ExitCritical(); /* Critical section exit */
+}
+
+
+/****************************************************************/
+/* Search_For_Free_Command()        			           		*/
+/* Purpose: Find a free command of the pipeline					*/
+/* Parameters: none				         						*/
+/* Return: NULL if the pipeline is full.						*/
+/* Description:													*/
+/****************************************************************/
+static PENDING_COMMAND* Search_For_Free_Command( void )
+{
+	for( uint8_t i = 0; i < SIZE_OF_COMMAND_PIPELINE; i++ )
+	{
+		if( CommandPipeline[i].CallBack.Status == FREE )
 		{
-			TxDescPtr->DataPtr->Size = 0; /* Release the allocated buffer since no available TX buffer was found */
-			if( Status.RequestTransmission )
+			return ( &CommandPipeline[i] );
+		}
+	}
+
+	return (NULL);
+}
+
+
+/****************************************************************/
+/* Release_Command()        			           				*/
+/* Purpose: Free the command of the pipeline					*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The hosted functions drop the parameters they	*/
+/* kept for the command, if it was not delegated to them.		*/
+/****************************************************************/
+static void Release_Command( CMD_CALLBACK* CmdCallBack )
+{
+	Hosted_Command_Released( CmdCallBack );
+	Remove_Command_Deadline( (PENDING_COMMAND*)CmdCallBack ); /* The callback is the first member */
+	CmdCallBack->Status = FREE;
+}
+
+
+/****************************************************************/
+/* Insert_Command_Deadline()        			           		*/
+/* Purpose: Put the command in the deadline heap				*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Does nothing if the command is already there.	*/
+/****************************************************************/
+static void Insert_Command_Deadline( PENDING_COMMAND* CommandPtr, uint32_t Deadline )
+{
+	uint8_t CommandIndex = CommandPtr - &CommandPipeline[0];
+
+	EnterCritical(); /* Critical section enter */
+
+	uint8_t Position = CommandPtr->HeapPosition;
+
+	if( ( Position >= DeadlineHeapSize ) || ( DeadlineHeap[Position] != CommandIndex ) ) /* Not in the heap yet */
+	{
+		Position = DeadlineHeapSize++;
+
+		CommandPtr->CallBack.Deadline = Deadline;
+
+		/* Sift up: the parents with later deadlines move down */
+		while( Position != 0 )
+		{
+			uint8_t Parent = ( Position - 1 ) >> 1;
+
+			if( (int32_t)( Deadline - CommandPipeline[ DeadlineHeap[Parent] ].CallBack.Deadline ) >= 0 )
 			{
-				/* Request transmission */
-				Request_Frame( 0 );
+				break;
 			}
+
+			Place_Command_Deadline( Position, DeadlineHeap[Parent] );
+			Position = Parent;
 		}
-	}else if( TxDescPtr->DataPtr != NULL )
-	{
-		TxDescPtr->DataPtr->Size = 0; /* Release the allocated buffer since no available command room was found */
+
+		Place_Command_Deadline( Position, CommandIndex );
 	}
 
+	ExitCritical(); /* Critical section exit */
+}
+
+
+/****************************************************************/
+/* Remove_Command_Deadline()        			           		*/
+/* Purpose: Take the command out of the deadline heap			*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The last entry of the heap takes the place of	*/
+/* the removed one and is moved up or down to keep the order.	*/
+/* Does nothing if the command is not in the heap.				*/
+/****************************************************************/
+static void Remove_Command_Deadline( PENDING_COMMAND* CommandPtr )
+{
+	uint8_t CommandIndex = CommandPtr - &CommandPipeline[0];
+
 	EnterCritical(); /* Critical section enter */
 
-	Acquire = 0;
+	uint8_t Position = CommandPtr->HeapPosition;
+
+	if( ( Position < DeadlineHeapSize ) && ( DeadlineHeap[Position] == CommandIndex ) )
+	{
+		CommandPtr->HeapPosition = NOT_IN_DEADLINE_HEAP;
+
+		uint8_t LastIndex = DeadlineHeap[ --DeadlineHeapSize ];
+
+		if( Position != DeadlineHeapSize )
+		{
+			uint32_t Deadline = CommandPipeline[LastIndex].CallBack.Deadline;
+
+			/* Sift up */
+			while( Position != 0 )
+			{
+				uint8_t Parent = ( Position - 1 ) >> 1;
+
+				if( (int32_t)( Deadline - CommandPipeline[ DeadlineHeap[Parent] ].CallBack.Deadline ) >= 0 )
+				{
+					break;
+				}
+
+				Place_Command_Deadline( Position, DeadlineHeap[Parent] );
+				Position = Parent;
+			}
+
+			/* Sift down */
+			while( ( ( Position << 1 ) + 1 ) < DeadlineHeapSize )
+			{
+				uint8_t Child = ( Position << 1 ) + 1;
+
+				if( ( ( Child + 1 ) < DeadlineHeapSize ) && ( (int32_t)( CommandPipeline[ DeadlineHeap[Child + 1] ].CallBack.Deadline -
+						CommandPipeline[ DeadlineHeap[Child] ].CallBack.Deadline ) < 0 ) )
+				{
+					Child++;
+				}
+
+				if( (int32_t)( CommandPipeline[ DeadlineHeap[Child] ].CallBack.Deadline - Deadline ) >= 0 )
+				{
+					break;
+				}
+
+				Place_Command_Deadline( Position, DeadlineHeap[Child] );
+				Position = Child;
+			}
+
+			Place_Command_Deadline( Position, LastIndex );
+		}
+	}
 
 	ExitCritical(); /* Critical section exit */
+}
 
-	return (FALSE);
+
+/****************************************************************/
+/* Place_Command_Deadline()        			           			*/
+/* Purpose: Store the command at the heap position				*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Place_Command_Deadline( uint8_t Position, uint8_t CommandIndex )
+{
+	DeadlineHeap[Position] = CommandIndex;
+	CommandPipeline[CommandIndex].HeapPosition = Position;
 }
 
 
@@ -752,25 +1304,20 @@ static uint8_t Verify_Data_Availability( TRANSFER_DESCRIPTOR* TxDescPtr, uint8_t
 
 	}else if( ( TxDescPtr->DataPtr != NULL ) && ( DataAvailable ) )
 	{
+		/* Taken before the enqueue, since the buffer may be released once transmitted */
+		uint16_t Handle = ( (HCI_SERIAL_ACL_DATA_PCKT*)( &TxDescPtr->DataPtr->Bytes[0] ) )->ACLDataPacket.Header.Handle;
+
 		/* Here we have already reserved buffer, we need to enqueued the command in
 		 * the transmit buffer */
-		int8_t Ntries = 3;
-		FRAME_ENQUEUE_STATUS Status;
-
-		do
-		{
-			/* As the buffer could be blocked awaiting another operation, you should try some times. */
-			Status = Enqueue_Frame( TxDescPtr, 7, SPI_WRITE, 1 );
-
-			Ntries--;
-		}while( ( Status.EnqueuedAtIndex < 0 ) &&  ( Ntries > 0 ) );
+		FRAME_ENQUEUE_STATUS Status = Enqueue_Frame( TxDescPtr, SPI_WRITE );
 
 		if( Status.EnqueuedAtIndex >= 0 ) /* Successfully enqueued */
 		{
 			Decrement_HCI_Data_Packets(  );
+			Charge_Data_Link( Handle );
 
 			/* This is the first successfully enqueued write message, so, request transmission */
-			if( ( ( Status.EnqueuedAtIndex == 0 ) && ( Status.NumberOfEnqueuedFrames == 1 ) ) || ( Status.RequestTransmission ) )
+			if( Status.EnqueuedAtIndex == 0 )
 			{
 				/* Request transmission */
 				Request_Frame( 0 );
@@ -786,16 +1333,11 @@ static uint8_t Verify_Data_Availability( TRANSFER_DESCRIPTOR* TxDescPtr, uint8_t
 
 		}else
 		{
-			TxDescPtr->DataPtr->Size = 0; /* Release the allocated buffer since no available TX buffer was found */
-			if( Status.RequestTransmission )
-			{
-				/* Request transmission */
-				Request_Frame( 0 );
-			}
+			Release_Memory_Buffer( TxDescPtr->DataPtr ); /* Release the allocated buffer since no available TX buffer was found */
 		}
 	}else if( TxDescPtr->DataPtr != NULL )
 	{
-		TxDescPtr->DataPtr->Size = 0; /* Release the allocated buffer since no available command room was found */
+		Release_Memory_Buffer( TxDescPtr->DataPtr ); /* Release the allocated buffer since no available command room was found */
 	}
 
 	EnterCritical(); /* Critical section enter */
@@ -849,6 +1391,10 @@ void HCI_Receive(uint8_t* DataPtr, uint16_t DataSize, TRANSFER_STATUS Status)
 		/*---------- DISCONNECTION_COMPLETE_EVT ------------*//* Page 2296 Core_v5.2 */
 		case DISCONNECTION_COMPLETE:
 			RETURN_ON_FAULT(Status);
+			if( EventPacketPtr->Event_Parameter[0] == COMMAND_SUCCESS )
+			{
+				Release_Data_Link( ( (DisconnectionComplete*)( &EventPacketPtr->Event_Parameter[0] ) )->Connection_Handle );
+			}
 			HCI_Disconnection_Complete( (DisconnectionComplete*)( &EventPacketPtr->Event_Parameter[0] ) );
 			break;
 
@@ -901,6 +1447,7 @@ void HCI_Receive(uint8_t* DataPtr, uint16_t DataSize, TRANSFER_STATUS Status)
 
 				/* Here we assume the controller uses a single buffer for all connection_handles. So, the
 				 * number of completed packets is, in fact, the number of free positions in the buffer. */
+				Credit_Data_Links( EventPacketPtr->Event_Parameter[0], &EventPacketPtr->Event_Parameter[1] );
 				Increment_HCI_Data_Packets( Num_Completed_Packets_Total );
 
 				HCI_Number_Of_Completed_Packets( EventPacketPtr->Event_Parameter[0], (uint16_t*)( &EventPacketPtr->Event_Parameter[1] ), Num_Completed_Packets_Ptr );
@@ -925,6 +1472,7 @@ void HCI_Receive(uint8_t* DataPtr, uint16_t DataSize, TRANSFER_STATUS Status)
 			{
 			case LE_CONNECTION_COMPLETE:
 				RETURN_ON_FAULT(Status);
+				Open_Data_Link( &EventPacketPtr->Event_Parameter[0] );
 				if( Get_Local_Version_Information()->HCI_Version <= CORE_SPEC_4_1 )
 				{
 					/* As we have unmasked the LE_Enhanced_Connection_Complete_event, no higher than 4.1
@@ -975,6 +1523,7 @@ void HCI_Receive(uint8_t* DataPtr, uint16_t DataSize, TRANSFER_STATUS Status)
 
 			case LE_ENHANCED_CONNECTION_COMPLETE:
 				RETURN_ON_FAULT(Status);
+				Open_Data_Link( &EventPacketPtr->Event_Parameter[0] );
 				Enter_Connection_Mode( EventPacketPtr->Event_Parameter[1] );
 				HCI_LE_Enhanced_Connection_Complete( (LEEnhancedConnectionComplete*)( &EventPacketPtr->Event_Parameter[1] ) );
 				break;
@@ -1037,8 +1586,7 @@ static void Finish_Command( TRANSFER_STATUS Status, HCI_COMMAND_OPCODE OpCode,
 		/* Message reception failed: clear callback functions */
 		CmdCallBack->CmdCompleteCallBack = NULL;
 		CmdCallBack->CmdStatusCallBack = NULL;
-		CmdCallBack->Timeout = 0;
-		CmdCallBack->Status = FREE;
+		Release_Command( CmdCallBack );
 		return;
 	}else
 	{
@@ -1087,8 +1635,7 @@ void Command_Complete_Handler( HCI_COMMAND_OPCODE OpCode, CMD_CALLBACK* CmdCallB
 		{
 			ExitCritical();
 		}
-		CmdCallBack->Timeout = 0;
-		CmdCallBack->Status = FREE;
+		Release_Command( CmdCallBack );
 	}else
 	{
 		/* Treat unknown command */
@@ -1554,7 +2101,13 @@ void Command_Status_Handler( HCI_COMMAND_OPCODE OpCode, CMD_CALLBACK* CmdCallBac
 			ExitCritical();
 		}
 
-		CmdCallBack->Status = ( CmdCallBack->CmdCompleteCallBack != NULL ) ? BUSY : FREE;
+		if( CmdCallBack->CmdCompleteCallBack != NULL )
+		{
+			CmdCallBack->Status = BUSY; /* The deadline also covers the Command Complete */
+		}else
+		{
+			Release_Command( CmdCallBack );
+		}
 
 	}else if( CmdCallBack == NULL )
 	{
@@ -1562,8 +2115,7 @@ void Command_Status_Handler( HCI_COMMAND_OPCODE OpCode, CMD_CALLBACK* CmdCallBac
 		HCI_Command_Status( EventPacketPtr->Event_Parameter[0], EventPacketPtr->Event_Parameter[1], OpCode );
 	}else
 	{
-		CmdCallBack->Timeout = 0;
-		CmdCallBack->Status = FREE;
+		Release_Command( CmdCallBack );
 	}
 }
 
@@ -1626,14 +2178,73 @@ static void Fault_Data_Event_Handler( HCI_EVENT_PCKT* EventPacketPtr )
 /* Get_Command_CallBack()                    		            */
 /* Purpose: Get the command callback pointer from the Opcode.	*/
 /* Parameters: none				         						*/
+/* Return: NULL if no command with this opcode is waiting for	*/
+/* the controller's response.									*/
+/* Description: The controller answers the commands of the same	*/
+/* opcode in the order they were transmitted, so the oldest		*/
+/* transmitted command is returned.								*/
+/****************************************************************/
+CMD_CALLBACK* Get_Command_CallBack( HCI_COMMAND_OPCODE OpCode )
+{
+	return ( Get_Transmitted_Command( OpCode, 0 ) );
+}
+
+
+/****************************************************************/
+/* Get_Transmitted_Command()                    		        */
+/* Purpose: Get a command waiting for the controller's response	*/
+/* by its transmission order.									*/
+/* Parameters: Position: 0 for the oldest transmitted command	*/
+/* of this opcode, 1 for the next one and so on.				*/
+/* Return: NULL if there are not so many commands with this		*/
+/* opcode waiting for the response.								*/
+/* Description:													*/
+/****************************************************************/
+CMD_CALLBACK* Get_Transmitted_Command( HCI_COMMAND_OPCODE OpCode, uint8_t Position )
+{
+	CMD_CALLBACK* CallBackPtr;
+	uint16_t YoungerThan = UINT8_MAX + 1; /* The ages of all commands are below it */
+	uint8_t Age;
+	uint8_t OldestAge;
+
+	do
+	{
+		CallBackPtr = NULL;
+		OldestAge = 0;
+
+		for( uint8_t i = 0; i < SIZE_OF_COMMAND_PIPELINE; i++ )
+		{
+			if( ( CommandPipeline[i].CallBack.Status == BUSY ) && ( CommandPipeline[i].CallBack.OpCode.Val == OpCode.Val ) )
+			{
+				Age = NextCommandToTransmit - CommandPipeline[i].Sequence;
+				if( ( Age > OldestAge ) && ( Age < YoungerThan ) )
+				{
+					OldestAge = Age;
+					CallBackPtr = &CommandPipeline[i].CallBack;
+				}
+			}
+		}
+
+		YoungerThan = OldestAge;
+
+	}while( ( CallBackPtr != NULL ) && ( Position-- != 0 ) );
+
+	return ( CallBackPtr );
+}
+
+
+/****************************************************************/
+/* Get_Command_Template()                    		            */
+/* Purpose: Get the command callback template from the Opcode.	*/
+/* Parameters: none				         						*/
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-CMD_CALLBACK* Get_Command_CallBack( HCI_COMMAND_OPCODE OpCode )
+static const CMD_CALLBACK* Get_Command_Template( HCI_COMMAND_OPCODE OpCode )
 {
 	/* It would have been easier to just use a switch case to test every
 	 * OpCode as they arrive. However, using tables we can speed-up the testing */
-	typedef CMD_CALLBACK* (*OpCodeHandler)(HCI_COMMAND_OPCODE OpCode);
+	typedef const CMD_CALLBACK* (*OpCodeHandler)(HCI_COMMAND_OPCODE OpCode);
 
 	const OpCodeHandler OGF_HANDLERS_TABLE[] = /* Each index maps directly to all OGF values, except VENDOR_SPECIFIC_CMD */
 	{
@@ -1827,7 +2438,7 @@ CMD_CALLBACK* Get_Command_CallBack( HCI_COMMAND_OPCODE OpCode )
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-static CMD_CALLBACK* LINK_CTRL_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
+static const CMD_CALLBACK* LINK_CTRL_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 {
 	switch ( OpCode.Val )
 	{
@@ -1847,7 +2458,7 @@ static CMD_CALLBACK* LINK_CTRL_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-static CMD_CALLBACK* LINK_POLICY_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
+static const CMD_CALLBACK* LINK_POLICY_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 {
 	return (NULL);
 }
@@ -1860,7 +2471,7 @@ static CMD_CALLBACK* LINK_POLICY_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-static CMD_CALLBACK* CTRL_AND_BASEBAND_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
+static const CMD_CALLBACK* CTRL_AND_BASEBAND_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 {
 	switch( OpCode.Val )
 	{
@@ -1882,7 +2493,7 @@ static CMD_CALLBACK* CTRL_AND_BASEBAND_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-static CMD_CALLBACK* INFO_PARAMETERS_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
+static const CMD_CALLBACK* INFO_PARAMETERS_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 {
 	const CMD_CALLBACK* OCF_INFO_PARAMETERS_CMD_TABLE[] =
 	{
@@ -1900,7 +2511,7 @@ static CMD_CALLBACK* INFO_PARAMETERS_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 
 	if( OpCode.OCF < ( sizeof(OCF_INFO_PARAMETERS_CMD_TABLE)/sizeof(CMD_CALLBACK*) ) )
 	{
-		return ( (CMD_CALLBACK*)( OCF_INFO_PARAMETERS_CMD_TABLE[OpCode.OCF] ) );
+		return ( OCF_INFO_PARAMETERS_CMD_TABLE[OpCode.OCF] );
 	}else
 	{
 		return (NULL);
@@ -1915,7 +2526,7 @@ static CMD_CALLBACK* INFO_PARAMETERS_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-static CMD_CALLBACK* STATUS_PARAMETERS_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
+static const CMD_CALLBACK* STATUS_PARAMETERS_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 {
 	switch ( OpCode.Val )
 	{
@@ -1933,7 +2544,7 @@ static CMD_CALLBACK* STATUS_PARAMETERS_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-static CMD_CALLBACK* TESTING_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
+static const CMD_CALLBACK* TESTING_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 {
 	return (NULL);
 }
@@ -1946,7 +2557,7 @@ static CMD_CALLBACK* TESTING_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-static CMD_CALLBACK* LE_CONTROLLER_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
+static const CMD_CALLBACK* LE_CONTROLLER_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 {
 	const CMD_CALLBACK* OCF_LE_CONTROLLER_CMD_TABLE[] =
 	{
@@ -2001,7 +2612,7 @@ static CMD_CALLBACK* LE_CONTROLLER_CMD_HANDLER(HCI_COMMAND_OPCODE OpCode)
 
 	if( OpCode.OCF < ( sizeof(OCF_LE_CONTROLLER_CMD_TABLE)/sizeof(CMD_CALLBACK*) ) )
 	{
-		return ( (CMD_CALLBACK*)( OCF_LE_CONTROLLER_CMD_TABLE[OpCode.OCF] ) );
+		return ( OCF_LE_CONTROLLER_CMD_TABLE[OpCode.OCF] );
 	}else
 	{
 		return (NULL);
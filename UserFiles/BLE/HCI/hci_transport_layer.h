@@ -118,24 +118,24 @@ typedef struct
 
 typedef struct
 {
-	int8_t EnqueuedAtIndex; /* If negative, means that frame was not enqueued */
+	int8_t EnqueuedAtIndex; /* If negative, means that frame was not enqueued. If zero, the higher layers should request its transmission */
 	int8_t NumberOfEnqueuedFrames;
-	uint8_t RequestTransmission; /* If TRUE, the higher layers can request transmission of newly enqueued frame */
 }FRAME_ENQUEUE_STATUS;
 
 
 typedef enum
 {
 	FREE 	 = 0,
-	BUSY	 = 1,
-	ON_GOING = 2
+	BUSY	 = 1, /* Transmitted and waiting for the controller's response */
+	ON_GOING = 2, /* Its response is being handled, or the host answers it itself (HCI_Hold_Command) */
+	QUEUED	 = 3  /* Waiting for a Num_HCI_Command_Packets credit to be transmitted */
 }CMD_CB_STATUS;
 
 
 typedef struct
 {
-	CMD_CB_STATUS Status: 8; /* CB_FREE/CB_BUSY/CB_ON_GOING */
-	int32_t Timeout; /* Timeout (in milliseconds) to detect loss of controller's response */
+	CMD_CB_STATUS Status: 8; /* FREE/BUSY/ON_GOING/QUEUED */
+	uint32_t Deadline; /* HAL_GetTick() at which the controller's response is considered lost */
 	HCI_COMMAND_OPCODE OpCode;
 	void* CmdCompleteCallBack; /* Function pointer */
 	void* CmdStatusCallBack; /* Function pointer */
@@ -143,18 +143,35 @@ typedef struct
 }CMD_CALLBACK;
 
 
+typedef struct
+{
+	uint16_t Connection_Handle;
+	uint16_t InFlight;		 /* ACL data packets given to the controller and not completed yet */
+	uint16_t MaxInFlight;	 /* Highest InFlight */
+	uint32_t PacketsSent;
+	uint32_t PacketsCompleted;
+	uint32_t CreditWaits;	 /* Times the link started waiting for a credit */
+	uint32_t WaitTimeUs;	 /* Total time spent waiting for credits */
+	uint32_t MaxWaitTimeUs;	 /* Longest wait for a credit */
+}HCI_LINK_CREDITS;
+
+
 /****************************************************************/
 /* External functions declaration (Interface functions)         */
 /****************************************************************/
-uint16_t Get_Number_Of_Command_Callbacks( void );
 void HCI_Reset_Transport_Layer( void );
 DESC_DATA* HCI_Get_Command_Transmit_Buffer_Free( uint16_t OpCodeVal );
 uint8_t HCI_Transmit_Command( TRANSFER_DESCRIPTOR* TxDescPtr,
 		void* CmdComplete, void* CmdStatus );
+void HCI_Transmit_Pending_Commands( void );
+uint8_t HCI_Command_Credits_Available( void );
+void HCI_Hold_Command( CMD_CALLBACK* CmdCallBack );
+uint8_t HCI_Data_Credit_Available( uint16_t Connection_Handle );
 DESC_DATA* HCI_Get_Data_Transmit_Buffer_Free( void );
 uint8_t HCI_Transmit_Data( TRANSFER_DESCRIPTOR* TxDescPtr );
 void HCI_Receive(uint8_t* DataPtr, uint16_t DataSize, TRANSFER_STATUS Status);
 void Set_Default_Number_Of_HCI_Data_Packets( void );
+uint8_t HCI_Get_Link_Credits( uint8_t Index, HCI_LINK_CREDITS* CreditsPtr );
 void Command_Status_Handler( HCI_COMMAND_OPCODE OpCode, CMD_CALLBACK* CmdCallBack,
 		HCI_EVENT_PCKT* EventPacketPtr );
 void Command_Complete_Handler( HCI_COMMAND_OPCODE OpCode, CMD_CALLBACK* CmdCallBack,
@@ -14,6 +14,11 @@
 /* Defines		                                                */
 /****************************************************************/
 #define HOSTED_RESOLVING_LIST_SIZE ( sizeof( Hosted_Resolving_List.Entry ) / sizeof( RESOLVABLE_DESCRIPTOR ) )
+#define RPA_CACHE_SIZE				8 /* Resolvable private addresses remembered after their resolution */
+#define DELEGATED_QUEUE_SIZE		8 /* Resolving list commands waiting for the hosted functions, as many as the command pipeline holds */
+#ifndef HOSTED_RESOLUTION_DEPTH
+#define HOSTED_RESOLUTION_DEPTH		4 /* HCI_LE_Encrypt commands in flight to resolve one address. One resolves entry by entry */
+#endif
 
 
 /****************************************************************/
@@ -36,6 +41,45 @@ typedef struct
 }HOSTED_RESOLVING_LIST;
 
 
+typedef struct
+{
+	BD_ADDR_TYPE RPA;		/* Resolvable private address of the peer */
+	IDENTITY_ADDRESS Id;	/* Peer identity the address was resolved to */
+	uint8_t Index;			/* Resolving list entry whose IRK resolved the address */
+	uint8_t Valid	 :1;
+	uint8_t LocalIRK :1;	/* Resolved with the local IRK (ADV_DIRECT_IND) */
+	uint32_t Resolved;		/* HAL_GetTick() of the resolution, the entry expires RPA_Timeout after it */
+	uint32_t LastUsed;		/* HAL_GetTick() of the last lookup, the least recently used entry is replaced */
+}RPA_CACHE_ENTRY;
+
+
+typedef struct
+{
+	BD_ADDR_TYPE Address;					/* Resolvable private address being resolved */
+	uint8_t Index[HOSTED_RESOLUTION_DEPTH]; /* Resolving list entry of each HCI_LE_Encrypt in flight, in issue order */
+	uint8_t Batch[HOSTED_RESOLUTION_DEPTH]; /* Batch of each HCI_LE_Encrypt in flight */
+	uint8_t Head;							/* Oldest HCI_LE_Encrypt in flight */
+	uint8_t InFlight;
+	uint8_t CurrentBatch;					/* The answers of the other batches are ignored */
+	uint8_t Pending;						/* HCI_LE_Encrypt of the current batch not answered yet */
+	uint8_t Match;							/* Resolving list index + 1 of the entry that resolved the address, zero if none */
+}RESOLUTION_PIPELINE;
+
+
+typedef struct
+{
+	HCI_COMMAND_OPCODE OpCode;
+	CMD_CALLBACK* CmdCallBack;
+	union /* Parameters caught by the intercepter */
+	{
+		DEVICE_IDENTITY Device;		/* HCI_LE_Add_Device_To_Resolving_List */
+		IDENTITY_ADDRESS Address;	/* HCI_LE_Remove_Device_From_Resolving_List and the resolvable address reads */
+		uint8_t Enable;				/* HCI_LE_Set_Address_Resolution_Enable */
+		uint16_t Timeout;			/* HCI_LE_Set_Resolvable_Private_Address_Timeout */
+	}Param;
+}DELEGATED_COMMAND;
+
+
 #define EVENT_BYTES_SIZE ( sizeof(((HCI_EVENT_PCKT*)NULL)->Event_Code) + \
 		sizeof(((HCI_EVENT_PCKT*)NULL)->Parameter_Total_Length) + UINT8_MAX )
 typedef struct
@@ -59,6 +103,16 @@ typedef struct
 /* Static functions declaration                                 */
 /****************************************************************/
 static void Transform_Status_To_Command_Event( HCI_EVENT_PCKT* EventPacketPtr );
+static void Execute_Delegated_Command( HCI_COMMAND_OPCODE OpCode, CMD_CALLBACK* CmdCallBack,
+		HCI_EVENT_PCKT* EventPacketPtr );
+static uint8_t Queue_Delegated_Command( DELEGATED_COMMAND* CmdPtr );
+static void Run_Delegated_Commands( void );
+static void Catch_Delegated_Parameters( uint16_t OpCodeVal );
+static uint8_t Take_Delegated_Parameters( DELEGATED_COMMAND* CmdPtr );
+static void Reject_Delegated_Command( HCI_COMMAND_OPCODE OpCode, CMD_CALLBACK* CmdCallBack,
+		HCI_EVENT_PCKT* EventPacketPtr );
+static void Save_Delegated_Parameters( DELEGATED_COMMAND* CmdPtr );
+static void Load_Delegated_Parameters( DELEGATED_COMMAND* CmdPtr );
 static CONTROLLER_ERROR_CODES Add_To_Resolving_List( void );
 static CONTROLLER_ERROR_CODES Remove_From_Resolving_List( void );
 static RESOLVABLE_DESCRIPTOR* Get_Resolvable_Descriptor( IDENTITY_ADDRESS* PtrId );
@@ -66,6 +120,16 @@ static RESOLVABLE_DESCRIPTOR* Get_Resolvable_Descriptor_From_Index( uint8_t Inde
 static BD_ADDR_TYPE* Get_Peer_Resolvable_Address( IDENTITY_ADDRESS* PtrId );
 static BD_ADDR_TYPE* Get_Local_Resolvable_Address( IDENTITY_ADDRESS* PtrId );
 static void Check_Private_Addr(uint8_t resolvstatus, CONTROLLER_ERROR_CODES status);
+static RESOLVABLE_DESCRIPTOR* Get_Cached_RPA( BD_ADDR_TYPE* RPA, uint8_t LocalIRK );
+static void Cache_RPA( BD_ADDR_TYPE* RPA, uint8_t LocalIRK, RESOLVABLE_DESCRIPTOR* Desc );
+static void Clear_RPA_Cache( void );
+static uint8_t Pipelined_Resolution( void );
+static uint8_t Issue_Resolution_Batch( BD_ADDR_TYPE* Address, uint8_t LocalIRK, uint8_t* RecordCounter );
+static void Abandon_Resolution_Batch( void );
+#ifndef SOFTWARE_AES_128
+static void Resolution_Encrypt_Complete( CONTROLLER_ERROR_CODES Status, uint8_t Encrypted_Data[16] );
+static void Resolution_Encrypt_Status( CONTROLLER_ERROR_CODES Status );
+#endif
 
 
 /****************************************************************/
@@ -73,6 +137,7 @@ static void Check_Private_Addr(uint8_t resolvstatus, CONTROLLER_ERROR_CODES stat
 /****************************************************************/
 extern void LE_Advertising_Report_Handler( HCI_EVENT_PCKT* EventPacketPtr );
 extern void Enter_Connection_Mode( CONTROLLER_ERROR_CODES Status );
+extern CMD_CALLBACK* Get_Transmitted_Command( HCI_COMMAND_OPCODE OpCode, uint8_t Position );
 
 
 /****************************************************************/
@@ -90,6 +155,15 @@ static uint16_t RPA_Timeout_Cmd;
 static uint16_t RPA_Timeout = 900; /* Default value is 900 seconds (15 minutes) */
 static ASYNC_COMMAND CommandToProcess;
 static uint32_t TimeCounter = 0;
+static RPA_CACHE_ENTRY RPA_Cache[RPA_CACHE_SIZE];
+static RPA_CACHE_STATISTICS RPA_Cache_Stats;
+static RESOLUTION_PIPELINE Resolution;
+static DELEGATED_COMMAND DelegatedQueue[DELEGATED_QUEUE_SIZE];
+static uint8_t DelegatedHead = 0;
+static uint8_t DelegatedCount = 0;
+static DELEGATED_COMMAND Caught[DELEGATED_QUEUE_SIZE]; /* Parameters of the commands transmitted and not answered, by their CmdCallBack */
+static uint8_t CaughtCount = 0;
+static DELEGATED_COMMAND_STATISTICS DelegatedStats;
 
 
 /****************************************************************/
@@ -111,6 +185,7 @@ uint8_t Hosted_LE_Add_Device_To_Resolving_List(void* DataPtr, uint16_t DataSize,
 		memcpy( &Add_Device.Peer_Identity_Address.Address.Bytes[0], &Packet->CmdPacket.Parameter[1], sizeof(BD_ADDR_TYPE) );
 		memcpy( &Add_Device.Peer_IRK.Bytes[0], &Packet->CmdPacket.Parameter[sizeof(BD_ADDR_TYPE) + 1], sizeof(IRK_TYPE) );
 		memcpy( &Add_Device.Local_IRK.Bytes[0], &Packet->CmdPacket.Parameter[sizeof(IRK_TYPE) + sizeof(BD_ADDR_TYPE) + 1], sizeof(IRK_TYPE) );
+		Catch_Delegated_Parameters( HCI_LE_ADD_DEVICE_TO_RESOLVING_LIST );
 
 		return (TRUE);
 	}
@@ -135,6 +210,7 @@ uint8_t Hosted_LE_Remove_Device_From_Resolving_List(void* DataPtr, uint16_t Data
 
 		Remove_Device.Type = Packet->CmdPacket.Parameter[0];
 		memcpy( &Remove_Device.Address.Bytes[0], &Packet->CmdPacket.Parameter[1], sizeof(BD_ADDR_TYPE) );
+		Catch_Delegated_Parameters( HCI_LE_REMOVE_DEVICE_FROM_RESOLVING_LIST );
 
 		return (TRUE);
 	}
@@ -159,6 +235,7 @@ uint8_t Hosted_LE_Read_Peer_Resolvable_Address(void* DataPtr, uint16_t DataSize,
 
 		Read_Peer_Resolvable_Device.Type = Packet->CmdPacket.Parameter[0];
 		memcpy( &Read_Peer_Resolvable_Device.Address.Bytes[0], &Packet->CmdPacket.Parameter[1], sizeof(BD_ADDR_TYPE) );
+		Catch_Delegated_Parameters( HCI_LE_READ_PEER_RESOLVABLE_ADDRESS );
 
 		return (TRUE);
 	}
@@ -183,6 +260,7 @@ uint8_t Hosted_LE_Read_Local_Resolvable_Address(void* DataPtr, uint16_t DataSize
 
 		Read_Local_Resolvable_Device.Type = Packet->CmdPacket.Parameter[0];
 		memcpy( &Read_Local_Resolvable_Device.Address.Bytes[0], &Packet->CmdPacket.Parameter[1], sizeof(BD_ADDR_TYPE) );
+		Catch_Delegated_Parameters( HCI_LE_READ_LOCAL_RESOLVABLE_ADDRESS );
 
 		return (TRUE);
 	}
@@ -205,6 +283,7 @@ uint8_t Hosted_LE_Set_Address_Resolution_Enable(void* DataPtr, uint16_t DataSize
 	{
 		/* The command parameters are catch in the very request. */
 		Address_Resol_Controller_Cmd = ( (HCI_SERIAL_COMMAND_PCKT*)DataPtr )->CmdPacket.Parameter[0];
+		Catch_Delegated_Parameters( HCI_LE_SET_ADDRESS_RESOLUTION_ENABLE );
 		return (TRUE);
 	}
 	return (FALSE);
@@ -227,6 +306,7 @@ uint8_t Hosted_LE_Set_Resolvable_Private_Address_Timeout(void* DataPtr, uint16_t
 
 		/* The command parameters are catch in the very request. */
 		RPA_Timeout_Cmd = ( Packet->CmdPacket.Parameter[1] << 8 ) | ( Packet->CmdPacket.Parameter[0] );
+		Catch_Delegated_Parameters( HCI_LE_SET_RESOLVABLE_PRIVATE_ADDRESS_TIMEOUT );
 		return (TRUE);
 	}
 	return (FALSE);
@@ -319,6 +399,66 @@ void Delegate_Function_To_Host( HCI_COMMAND_OPCODE OpCode, CMD_CALLBACK* CmdCall
 	}
 	break;
 
+	case HCI_LE_ADD_DEVICE_TO_RESOLVING_LIST:
+	case HCI_LE_REMOVE_DEVICE_FROM_RESOLVING_LIST:
+	case HCI_LE_CLEAR_RESOLVING_LIST:
+	case HCI_LE_READ_RESOLVING_LIST_SIZE:
+	case HCI_LE_READ_PEER_RESOLVABLE_ADDRESS:
+	case HCI_LE_READ_LOCAL_RESOLVABLE_ADDRESS:
+	case HCI_LE_SET_ADDRESS_RESOLUTION_ENABLE:
+	case HCI_LE_SET_RESOLVABLE_PRIVATE_ADDRESS_TIMEOUT:
+		/* The commands are answered in the issue order: while another command or a resolution
+		 * is being processed, they wait in the queue. When it is full, the command runs at once
+		 * and is answered as busy if it needs the hosted functions. */
+	{
+		DELEGATED_COMMAND Cmd = { .OpCode = OpCode, .CmdCallBack = CmdCallBack };
+
+		if( !Take_Delegated_Parameters( &Cmd ) )
+		{
+			DelegatedStats.Lost++;
+			Reject_Delegated_Command( OpCode, CmdCallBack, EventPacketPtr );
+			break;
+		}
+
+		if( ( DelegatedCount ) || ( CommandToProcess.OpCode.Val ) )
+		{
+			if( Queue_Delegated_Command( &Cmd ) )
+			{
+				break;
+			}
+			DelegatedStats.Full++;
+		}
+
+		Load_Delegated_Parameters( &Cmd );
+		Execute_Delegated_Command( OpCode, CmdCallBack, EventPacketPtr );
+	}
+	break;
+
+	default: /* Host cannot perform this function */
+		Command_Status_Handler( OpCode, CmdCallBack, EventPacketPtr );
+		break;
+	}
+}
+
+
+/****************************************************************/
+/* Execute_Delegated_Command()            		   	            */
+/* Purpose: Run a resolving list command not supported by the	*/
+/* controller.													*/
+/* Parameters: EventPacketPtr: the Command Status of the		*/
+/* controller, turned into the Command Complete.				*/
+/* Return: none  												*/
+/* Description: The parameters are the ones caught by the		*/
+/* intercepters. HCI_LE_Add_Device_To_Resolving_List completes	*/
+/* once the resolvable addresses of the device are generated.	*/
+/****************************************************************/
+static void Execute_Delegated_Command( HCI_COMMAND_OPCODE OpCode, CMD_CALLBACK* CmdCallBack,
+		HCI_EVENT_PCKT* EventPacketPtr )
+{
+	BLE_STATES state = Get_BLE_State();
+
+	switch ( OpCode.Val )
+	{
 	case HCI_LE_ADD_DEVICE_TO_RESOLVING_LIST:
 		EventPacketPtr->Parameter_Total_Length = 4;
 		Transform_Status_To_Command_Event( EventPacketPtr );
@@ -359,6 +499,7 @@ void Delegate_Function_To_Host( HCI_COMMAND_OPCODE OpCode, CMD_CALLBACK* CmdCall
 		if( EventPacketPtr->Event_Parameter[3] == COMMAND_SUCCESS )
 		{
 			/* This requires additional processing. So enqueue the parameters. */
+			HCI_Hold_Command( CmdCallBack );
 			CommandToProcess.OpCode.Val = HCI_LE_ADD_DEVICE_TO_RESOLVING_LIST;
 			CommandToProcess.CmdCallBack = CmdCallBack;
 			CommandToProcess.ProcessSteps = 0;
@@ -430,6 +571,7 @@ void Delegate_Function_To_Host( HCI_COMMAND_OPCODE OpCode, CMD_CALLBACK* CmdCall
 		}else if( !CommandToProcess.OpCode.Val )
 		{
 			Hosted_Resolving_List.NumberOfEntries = 0;
+			Clear_RPA_Cache();
 			EventPacketPtr->Event_Parameter[3] = COMMAND_SUCCESS;
 		}else
 		{
@@ -597,8 +739,265 @@ void Delegate_Function_To_Host( HCI_COMMAND_OPCODE OpCode, CMD_CALLBACK* CmdCall
 
 		break;
 
-	default: /* Host cannot perform this function */
-		Command_Status_Handler( OpCode, CmdCallBack, EventPacketPtr );
+	default:
+		break;
+	}
+}
+
+
+/****************************************************************/
+/* Queue_Delegated_Command()            		   	            */
+/* Purpose: Keep a resolving list command for when the hosted	*/
+/* functions are free.											*/
+/* Parameters: none				         						*/
+/* Return: FALSE if the queue is full.							*/
+/* Description: The transport no longer waits for the			*/
+/* controller's answer: the Command Complete is synthesized		*/
+/* when the command is run.										*/
+/****************************************************************/
+static uint8_t Queue_Delegated_Command( DELEGATED_COMMAND* CmdPtr )
+{
+	if( DelegatedCount >= DELEGATED_QUEUE_SIZE )
+	{
+		return (FALSE);
+	}
+
+	DelegatedQueue[ ( DelegatedHead + DelegatedCount ) % DELEGATED_QUEUE_SIZE ] = *CmdPtr;
+
+	HCI_Hold_Command( CmdPtr->CmdCallBack );
+
+	DelegatedCount++;
+	DelegatedStats.Queued++;
+	DelegatedStats.MaxQueued = MAX( DelegatedStats.MaxQueued, DelegatedCount );
+
+	return (TRUE);
+}
+
+
+/****************************************************************/
+/* Run_Delegated_Commands()            			   	            */
+/* Purpose: Run the queued resolving list commands in order.	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Stops at the first command that needs further	*/
+/* processing (HCI_LE_Add_Device_To_Resolving_List), the next	*/
+/* ones run once it completes.									*/
+/****************************************************************/
+static void Run_Delegated_Commands( void )
+{
+	union
+	{
+		HCI_EVENT_PCKT EventPacket;
+		uint8_t EventBytes[2 + 4 + sizeof(BD_ADDR_TYPE)]; /* Largest Command Complete of these commands */
+	}__attribute__((packed)) Event;
+
+	while( ( DelegatedCount ) && ( !CommandToProcess.OpCode.Val ) )
+	{
+		DELEGATED_COMMAND Cmd = DelegatedQueue[DelegatedHead];
+
+		DelegatedHead = ( DelegatedHead + 1 ) % DELEGATED_QUEUE_SIZE;
+		DelegatedCount--;
+
+		Load_Delegated_Parameters( &Cmd );
+
+		/* The Command Status the controller answered with */
+		Event.EventPacket.Event_Code = COMMAND_STATUS;
+		Event.EventPacket.Parameter_Total_Length = 4;
+		Event.EventPacket.Event_Parameter[0] = UNKNOWN_HCI_COMMAND;
+		Event.EventPacket.Event_Parameter[1] = 1; /* Num_HCI_Command_Packets */
+		Event.EventPacket.Event_Parameter[2] = Cmd.OpCode.Val & 0xFF;
+		Event.EventPacket.Event_Parameter[3] = Cmd.OpCode.Val >> 8;
+
+		Execute_Delegated_Command( Cmd.OpCode, Cmd.CmdCallBack, &Event.EventPacket );
+	}
+}
+
+
+/****************************************************************/
+/* Catch_Delegated_Parameters()            		   	            */
+/* Purpose: Keep the parameters of a resolving list command		*/
+/* just transmitted.											*/
+/* Parameters: OpCodeVal: command whose intercepter loaded the	*/
+/* parameters.													*/
+/* Return: none  												*/
+/* Description: With more than one command credit, the next		*/
+/* command of the same kind may be transmitted, and its			*/
+/* parameters caught, before the first one is answered. The		*/
+/* intercepters run in transmission order, so the parameters	*/
+/* belong to the oldest command of the kind not caught yet.		*/
+/* They are kept with its CmdCallBack until it is answered or	*/
+/* released. The oldest parameters are dropped when there is	*/
+/* no room.														*/
+/****************************************************************/
+static void Catch_Delegated_Parameters( uint16_t OpCodeVal )
+{
+	HCI_COMMAND_OPCODE OpCode = { .Val = OpCodeVal };
+	uint8_t Position = 0;
+
+	for( uint8_t i = 0; i < CaughtCount; i++ )
+	{
+		Position += ( Caught[i].OpCode.Val == OpCodeVal ) ? 1 : 0;
+	}
+
+	CMD_CALLBACK* CmdCallBack = Get_Transmitted_Command( OpCode, Position );
+
+	if( CmdCallBack == NULL )
+	{
+		return; /* Already answered or released: nobody takes the parameters */
+	}
+
+	if( CaughtCount >= DELEGATED_QUEUE_SIZE )
+	{
+		memmove( &Caught[0], &Caught[1], sizeof(Caught) - sizeof(Caught[0]) );
+		CaughtCount--;
+	}
+
+	Caught[CaughtCount].OpCode = OpCode;
+	Caught[CaughtCount].CmdCallBack = CmdCallBack;
+	Save_Delegated_Parameters( &Caught[CaughtCount] );
+	CaughtCount++;
+}
+
+
+/****************************************************************/
+/* Take_Delegated_Parameters()            		   	            */
+/* Purpose: Get the parameters of the command the controller	*/
+/* answered.													*/
+/* Parameters: CmdPtr: command with its OpCode and CmdCallBack,	*/
+/* whose parameters are loaded.									*/
+/* Return: FALSE if the parameters of the command were dropped.	*/
+/* Description: The parameters last caught by the intercepters	*/
+/* may belong to another command, so they are never used		*/
+/* instead.														*/
+/****************************************************************/
+static uint8_t Take_Delegated_Parameters( DELEGATED_COMMAND* CmdPtr )
+{
+	if( ( CmdPtr->OpCode.Val == HCI_LE_CLEAR_RESOLVING_LIST ) || ( CmdPtr->OpCode.Val == HCI_LE_READ_RESOLVING_LIST_SIZE ) )
+	{
+		return (TRUE); /* Parameterless */
+	}
+
+	for( uint8_t i = 0; i < CaughtCount; i++ )
+	{
+		if( ( Caught[i].CmdCallBack == CmdPtr->CmdCallBack ) && ( Caught[i].OpCode.Val == CmdPtr->OpCode.Val ) )
+		{
+			CmdPtr->Param = Caught[i].Param;
+			CaughtCount--;
+			memmove( &Caught[i], &Caught[i + 1], ( CaughtCount - i ) * sizeof(Caught[0]) );
+			return (TRUE);
+		}
+	}
+
+	return (FALSE);
+}
+
+
+/****************************************************************/
+/* Reject_Delegated_Command()            		   	            */
+/* Purpose: Answer a resolving list command that cannot be run	*/
+/* Parameters: EventPacketPtr: the Command Status of the		*/
+/* controller, turned into the Command Complete.				*/
+/* Return: none  												*/
+/* Description: The return parameters other than the status		*/
+/* are zeroed.													*/
+/****************************************************************/
+static void Reject_Delegated_Command( HCI_COMMAND_OPCODE OpCode, CMD_CALLBACK* CmdCallBack,
+		HCI_EVENT_PCKT* EventPacketPtr )
+{
+	if( ( OpCode.Val == HCI_LE_READ_PEER_RESOLVABLE_ADDRESS ) || ( OpCode.Val == HCI_LE_READ_LOCAL_RESOLVABLE_ADDRESS ) )
+	{
+		EventPacketPtr->Parameter_Total_Length = 4 + sizeof( BD_ADDR_TYPE );
+		memset( &EventPacketPtr->Event_Parameter[4], 0, sizeof( BD_ADDR_TYPE ) );
+	}else
+	{
+		EventPacketPtr->Parameter_Total_Length = 4;
+	}
+	Transform_Status_To_Command_Event( EventPacketPtr );
+	EventPacketPtr->Event_Parameter[3] = UNSPECIFIED_ERROR;
+
+	Command_Complete_Handler( OpCode, CmdCallBack, EventPacketPtr );
+}
+
+
+/****************************************************************/
+/* Save_Delegated_Parameters()            		   	            */
+/* Purpose: Copy the parameters last caught by the intercepter	*/
+/* of the command.												*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Save_Delegated_Parameters( DELEGATED_COMMAND* CmdPtr )
+{
+	switch ( CmdPtr->OpCode.Val )
+	{
+	case HCI_LE_ADD_DEVICE_TO_RESOLVING_LIST:
+		CmdPtr->Param.Device = Add_Device;
+		break;
+
+	case HCI_LE_REMOVE_DEVICE_FROM_RESOLVING_LIST:
+		CmdPtr->Param.Address = Remove_Device;
+		break;
+
+	case HCI_LE_READ_PEER_RESOLVABLE_ADDRESS:
+		CmdPtr->Param.Address = Read_Peer_Resolvable_Device;
+		break;
+
+	case HCI_LE_READ_LOCAL_RESOLVABLE_ADDRESS:
+		CmdPtr->Param.Address = Read_Local_Resolvable_Device;
+		break;
+
+	case HCI_LE_SET_ADDRESS_RESOLUTION_ENABLE:
+		CmdPtr->Param.Enable = Address_Resol_Controller_Cmd;
+		break;
+
+	case HCI_LE_SET_RESOLVABLE_PRIVATE_ADDRESS_TIMEOUT:
+		CmdPtr->Param.Timeout = RPA_Timeout_Cmd;
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+/****************************************************************/
+/* Load_Delegated_Parameters()            		   	            */
+/* Purpose: Put back the parameters of the command where the	*/
+/* intercepter loaded them.										*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Load_Delegated_Parameters( DELEGATED_COMMAND* CmdPtr )
+{
+	switch ( CmdPtr->OpCode.Val )
+	{
+	case HCI_LE_ADD_DEVICE_TO_RESOLVING_LIST:
+		Add_Device = CmdPtr->Param.Device;
+		break;
+
+	case HCI_LE_REMOVE_DEVICE_FROM_RESOLVING_LIST:
+		Remove_Device = CmdPtr->Param.Address;
+		break;
+
+	case HCI_LE_READ_PEER_RESOLVABLE_ADDRESS:
+		Read_Peer_Resolvable_Device = CmdPtr->Param.Address;
+		break;
+
+	case HCI_LE_READ_LOCAL_RESOLVABLE_ADDRESS:
+		Read_Local_Resolvable_Device = CmdPtr->Param.Address;
+		break;
+
+	case HCI_LE_SET_ADDRESS_RESOLUTION_ENABLE:
+		Address_Resol_Controller_Cmd = CmdPtr->Param.Enable;
+		break;
+
+	case HCI_LE_SET_RESOLVABLE_PRIVATE_ADDRESS_TIMEOUT:
+		RPA_Timeout_Cmd = CmdPtr->Param.Timeout;
+		break;
+
+	default:
 		break;
 	}
 }
@@ -643,6 +1042,7 @@ static CONTROLLER_ERROR_CODES Add_To_Resolving_List( void )
 	Hosted_Resolving_List.Entry[ Hosted_Resolving_List.NumberOfEntries ].LocalAddrValid = FALSE;
 	Hosted_Resolving_List.Entry[ Hosted_Resolving_List.NumberOfEntries ].PeerAddrValid = FALSE;
 	Hosted_Resolving_List.NumberOfEntries++;
+	Clear_RPA_Cache();
 
 	return ( COMMAND_SUCCESS );
 }
@@ -670,6 +1070,7 @@ static CONTROLLER_ERROR_CODES Remove_From_Resolving_List( void )
 				Hosted_Resolving_List.Entry[a] = Hosted_Resolving_List.Entry[ a + 1 ];
 			}
 			Hosted_Resolving_List.NumberOfEntries--;
+			Clear_RPA_Cache();
 			return ( COMMAND_SUCCESS );
 		}
 	}
@@ -807,6 +1208,291 @@ static void Check_Private_Addr(uint8_t resolvstatus, CONTROLLER_ERROR_CODES stat
 }
 
 
+/****************************************************************/
+/* Get_Cached_RPA()      										*/
+/* Location: 					 								*/
+/* Purpose: Look for a resolvable private address resolved		*/
+/* recently.													*/
+/* Parameters: LocalIRK: TRUE if it would be resolved with the	*/
+/* local IRK.													*/
+/* Return: The resolving list entry that resolved it, NULL if	*/
+/* it must be resolved.											*/
+/* Description: A peer keeps its address for up to the RPA		*/
+/* timeout, so the entries older than RPA_Timeout expire.		*/
+/****************************************************************/
+static RESOLVABLE_DESCRIPTOR* Get_Cached_RPA( BD_ADDR_TYPE* RPA, uint8_t LocalIRK )
+{
+	uint32_t Now = HAL_GetTick();
+
+	for( uint8_t i = 0; i < RPA_CACHE_SIZE; i++ )
+	{
+		RPA_CACHE_ENTRY* Entry = &RPA_Cache[i];
+
+		if( ( Entry->Valid ) && ( Entry->LocalIRK == LocalIRK ) && ( memcmp( &Entry->RPA, RPA, sizeof(BD_ADDR_TYPE) ) == 0 ) )
+		{
+			RESOLVABLE_DESCRIPTOR* Desc = Get_Resolvable_Descriptor_From_Index( Entry->Index );
+
+			if( ( ( Now - Entry->Resolved ) >= ( (uint32_t)RPA_Timeout * 1000 ) ) || ( Desc == NULL ) ||
+					( memcmp( &Desc->Id.Peer_Identity_Address, &Entry->Id, sizeof(IDENTITY_ADDRESS) ) != 0 ) )
+			{
+				Entry->Valid = FALSE;
+				RPA_Cache_Stats.Expired++;
+				break;
+			}
+
+			Entry->LastUsed = Now;
+			RPA_Cache_Stats.Hits++;
+			return (Desc);
+		}
+	}
+
+	RPA_Cache_Stats.Misses++;
+	return (NULL);
+}
+
+
+/****************************************************************/
+/* Cache_RPA()      											*/
+/* Location: 					 								*/
+/* Purpose: Remember a resolvable private address just resolved.*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: A free or expired entry is taken first, then	*/
+/* the least recently used one. An address already cached keeps	*/
+/* its resolution time, so it still expires on time.			*/
+/****************************************************************/
+static void Cache_RPA( BD_ADDR_TYPE* RPA, uint8_t LocalIRK, RESOLVABLE_DESCRIPTOR* Desc )
+{
+	uint32_t Now = HAL_GetTick();
+	RPA_CACHE_ENTRY* Victim = &RPA_Cache[0];
+	uint8_t Free = FALSE;
+
+	for( uint8_t i = 0; i < RPA_CACHE_SIZE; i++ )
+	{
+		RPA_CACHE_ENTRY* Entry = &RPA_Cache[i];
+
+		if( ( Entry->Valid ) && ( Entry->LocalIRK == LocalIRK ) && ( memcmp( &Entry->RPA, RPA, sizeof(BD_ADDR_TYPE) ) == 0 ) )
+		{
+			Entry->LastUsed = Now;
+			return;
+		}
+
+		if( ( !Entry->Valid ) || ( ( Now - Entry->Resolved ) >= ( (uint32_t)RPA_Timeout * 1000 ) ) )
+		{
+			Victim = Entry;
+			Free = TRUE;
+		}else if( ( !Free ) && ( ( Now - Entry->LastUsed ) > ( Now - Victim->LastUsed ) ) )
+		{
+			Victim = Entry;
+		}
+	}
+
+	if( !Free )
+	{
+		RPA_Cache_Stats.Evictions++;
+	}
+
+	Victim->RPA = *RPA;
+	Victim->Id = Desc->Id.Peer_Identity_Address;
+	Victim->Index = Desc - &Hosted_Resolving_List.Entry[0];
+	Victim->LocalIRK = LocalIRK;
+	Victim->Valid = TRUE;
+	Victim->Resolved = Now;
+	Victim->LastUsed = Now;
+}
+
+
+/****************************************************************/
+/* Clear_RPA_Cache()      										*/
+/* Location: 					 								*/
+/* Purpose: Forget the resolvable private addresses resolved.	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Called when the resolving list changes, since	*/
+/* the entries refer to it by index.							*/
+/****************************************************************/
+static void Clear_RPA_Cache( void )
+{
+	for( uint8_t i = 0; i < RPA_CACHE_SIZE; i++ )
+	{
+		RPA_Cache[i].Valid = FALSE;
+	}
+}
+
+
+/****************************************************************/
+/* Pipelined_Resolution()      									*/
+/* Location: 					 								*/
+/* Purpose: Check if the addresses are resolved with several	*/
+/* HCI_LE_Encrypt in flight.									*/
+/* Parameters: none				         						*/
+/* Return: TRUE if the controller encrypts.						*/
+/* Description: The local AES-128 answers before returning, so	*/
+/* it gains nothing from the batches.							*/
+/****************************************************************/
+static uint8_t Pipelined_Resolution( void )
+{
+#ifndef SOFTWARE_AES_128
+	return ( Get_Supported_Commands()->Bits.HCI_LE_Encrypt );
+#else
+	return (FALSE);
+#endif
+}
+
+
+/****************************************************************/
+/* Issue_Resolution_Batch()      								*/
+/* Location: Page 3105 Core_v5.2								*/
+/* Purpose: Issue the HCI_LE_Encrypt of the resolving records	*/
+/* that may resolve an address, up to HOSTED_RESOLUTION_DEPTH.	*/
+/* Parameters: RecordCounter: next resolving record to try,		*/
+/* moved past the records issued.								*/
+/* Return: TRUE if a batch is in flight.						*/
+/* Description: The records with a null IRK cannot resolve the	*/
+/* address and are skipped. An address equal to the identity of	*/
+/* a record needs no resolution, so the search ends there. A	*/
+/* record is added to the batch only while the controller has	*/
+/* a free command credit: a command waiting for a credit would	*/
+/* not overlap and would delay the end of the search when an	*/
+/* earlier record resolves the address.							*/
+/****************************************************************/
+static uint8_t Issue_Resolution_Batch( BD_ADDR_TYPE* Address, uint8_t LocalIRK, uint8_t* RecordCounter )
+{
+#ifndef SOFTWARE_AES_128
+	uint8_t Plaintext[16];
+
+	memset( &Plaintext[0], 0, sizeof(Plaintext) );
+	Plaintext[15] = Address->Bytes[3];
+	Plaintext[14] = Address->Bytes[4];
+	Plaintext[13] = Address->Bytes[5];
+
+	Resolution.Address = *Address;
+	Resolution.CurrentBatch++;
+	Resolution.Pending = 0;
+	Resolution.Match = 0;
+
+	while( ( *RecordCounter < Hosted_Resolving_List.NumberOfEntries ) && ( Resolution.InFlight < HOSTED_RESOLUTION_DEPTH ) )
+	{
+		RESOLVABLE_DESCRIPTOR* Desc = &Hosted_Resolving_List.Entry[*RecordCounter];
+		IRK_TYPE* IRK_Ptr = LocalIRK ? &Desc->Id.Local_IRK : &Desc->Id.Peer_IRK;
+
+		if( memcmp( &Address->Bytes[0], &Desc->Id.Peer_Identity_Address.Address.Bytes[0], sizeof(BD_ADDR_TYPE) ) == 0 )
+		{
+			if( !Resolution.Pending )
+			{
+				*RecordCounter = Hosted_Resolving_List.NumberOfEntries;
+			}
+			break;
+		}
+
+		if( !Check_NULL_IRK( IRK_Ptr ) )
+		{
+			if( Resolution.Pending && !HCI_Command_Credits_Available() )
+			{
+				break; /* The remaining records go in the next batch */
+			}else if( !HCI_LE_Encrypt( &IRK_Ptr->Bytes[0], &Plaintext[0], &Resolution_Encrypt_Complete, &Resolution_Encrypt_Status ) )
+			{
+				break; /* The command pipeline is full, the remaining records go in the next batch */
+			}
+
+			uint8_t Slot = ( Resolution.Head + Resolution.InFlight ) % HOSTED_RESOLUTION_DEPTH;
+
+			Resolution.Index[Slot] = *RecordCounter;
+			Resolution.Batch[Slot] = Resolution.CurrentBatch;
+			Resolution.InFlight++;
+			Resolution.Pending++;
+		}
+
+		(*RecordCounter)++;
+	}
+
+	return ( Resolution.Pending ? TRUE : FALSE );
+#else
+	return (FALSE);
+#endif
+}
+
+
+/****************************************************************/
+/* Abandon_Resolution_Batch()      								*/
+/* Location: 					 								*/
+/* Purpose: Stop waiting for the answers of the current batch.	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The commands stay in flight and their answers	*/
+/* are ignored when they arrive.								*/
+/****************************************************************/
+static void Abandon_Resolution_Batch( void )
+{
+	Resolution.CurrentBatch++;
+	Resolution.Pending = 0;
+	Resolution.Match = 0;
+}
+
+
+#ifndef SOFTWARE_AES_128
+/****************************************************************/
+/* Resolution_Encrypt_Complete()      							*/
+/* Location: Page 3105 Core_v5.2								*/
+/* Purpose: Compare the hash of a resolving record with the		*/
+/* address being resolved.										*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The answers come in issue order, so each one	*/
+/* belongs to the oldest HCI_LE_Encrypt in flight. When more	*/
+/* than one record resolves the address, the first in the list	*/
+/* is taken, as the sequential resolution does.					*/
+/****************************************************************/
+static void Resolution_Encrypt_Complete( CONTROLLER_ERROR_CODES Status, uint8_t Encrypted_Data[16] )
+{
+	if( !Resolution.InFlight )
+	{
+		return; /* Answer of a command issued before a transport reset */
+	}
+
+	uint8_t Index = Resolution.Index[Resolution.Head];
+	uint8_t Batch = Resolution.Batch[Resolution.Head];
+
+	Resolution.Head = ( Resolution.Head + 1 ) % HOSTED_RESOLUTION_DEPTH;
+	Resolution.InFlight--;
+
+	if( ( Batch != Resolution.CurrentBatch ) || ( !Resolution.Pending ) )
+	{
+		return;
+	}
+
+	Resolution.Pending--;
+
+	if( ( Status == COMMAND_SUCCESS ) && ( Encrypted_Data != NULL ) && ( ( !Resolution.Match ) || ( Index < ( Resolution.Match - 1 ) ) ) )
+	{
+		for( uint8_t i = 0; i < 3; i++ )
+		{
+			if( Resolution.Address.Bytes[i] != Encrypted_Data[15 - i] )
+			{
+				return;
+			}
+		}
+		Resolution.Match = Index + 1;
+	}
+}
+
+
+/****************************************************************/
+/* Resolution_Encrypt_Status()      							*/
+/* Location: 					 								*/
+/* Purpose: HCI_LE_Encrypt failed or was not answered.			*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The record is taken as not resolving the		*/
+/* address.														*/
+/****************************************************************/
+static void Resolution_Encrypt_Status( CONTROLLER_ERROR_CODES Status )
+{
+	Resolution_Encrypt_Complete( Status, NULL );
+}
+#endif
+
+
 /****************************************************************/
 /* Hosted_Functions_Process()            		   	            */
 /* Purpose: Process hosted functions.							*/
@@ -829,6 +1515,9 @@ void Hosted_Functions_Process( void )
 
 	BLE_STATES state = Get_BLE_State();
 
+	/* The commands of the application go before the renewal of the addresses */
+	Run_Delegated_Commands();
+
 	/* Generates/resolve device addresses */
 	if( ( Hosted_Resolving_List.NumberOfEntries ) && ( state > STANDBY_STATE ) )
 	{
@@ -900,9 +1589,11 @@ void Hosted_Functions_Process( void )
 				{
 					if( ( Address_Ptr[Num_Reports - 1].Bytes[sizeof(BD_ADDR_TYPE) - 1] & 0xC0 ) == 0x40 )
 					{
-						/* This is a resolvable private address, we should try to resolve it */
+						/* This is a resolvable private address, we should try to resolve it
+						 * unless it was resolved recently */
+						Desc = Get_Cached_RPA( &Address_Ptr[Num_Reports - 1], Event_Type_Ptr[Num_Reports - 1] == ADV_DIRECT_IND_EVT );
 						RecordCounter = 0;
-						CommandToProcess.ProcessSteps = 2;
+						CommandToProcess.ProcessSteps = ( Desc != NULL ) ? 5 : ( Pipelined_Resolution() ? 7 : 2 );
 					}else
 					{
 						/* This is not RPA, so we will not try to resolve it */
@@ -1010,6 +1701,7 @@ void Hosted_Functions_Process( void )
 			break;
 
 		case 5: /* Successful address resolution */
+			Cache_RPA( &Address_Ptr[Num_Reports - 1], Event_Type_Ptr[Num_Reports - 1] == ADV_DIRECT_IND_EVT, Desc );
 			/* Load the type of identity just resolved */
 			Address_Type_Ptr[Num_Reports - 1] = ( Desc->Id.Peer_Identity_Address.Type == PEER_PUBLIC_DEV_ADDR ) ? PUBLIC_IDENTITY_ADDR : RANDOM_IDENTITY_ADDR;
 			/* Load the identity into the address itself since we have resolved it */
@@ -1024,6 +1716,39 @@ void Hosted_Functions_Process( void )
 			/* End resolution for this resolving record */
 			CommandToProcess.ProcessSteps = 2;
 			break;
+
+		case 7: /* Issue the HCI_LE_Encrypt of the next resolving records at once */
+			if( state != SCANNING_STATE )
+			{
+				CommandToProcess.OpCode.Val = 0;
+			}else if( Issue_Resolution_Batch( &Address_Ptr[Num_Reports - 1], Event_Type_Ptr[Num_Reports - 1] == ADV_DIRECT_IND_EVT, &RecordCounter ) )
+			{
+				TimeCounter = 0;
+				CommandToProcess.ProcessSteps = 8;
+			}else if( RecordCounter >= Hosted_Resolving_List.NumberOfEntries )
+			{
+				/* Resolving list ended: Load the next address from the advertising report */
+				Num_Reports--;
+				CommandToProcess.ProcessSteps = 1;
+			}
+			break;
+
+		case 8: /* Wait for the answers of the batch */
+			if( state != SCANNING_STATE )
+			{
+				Abandon_Resolution_Batch();
+				CommandToProcess.OpCode.Val = 0;
+			}else if( !Resolution.Pending )
+			{
+				Desc = Get_Resolvable_Descriptor_From_Index( Resolution.Match - 1 );
+				CommandToProcess.ProcessSteps = ( Resolution.Match && ( Desc != NULL ) ) ? 5 : 7;
+			}else if( TimeBase_DelayMs( &TimeCounter, 250, TRUE ) )
+			{
+				/* End resolution for the resolving records of this batch */
+				Abandon_Resolution_Batch();
+				CommandToProcess.ProcessSteps = 7;
+			}
+			break;
 		}
 	}
 	break;
@@ -1035,7 +1760,9 @@ void Hosted_Functions_Process( void )
 		case 0:
 			Address_Ptr = (BD_ADDR_TYPE*)( &(CommandToProcess.EventPacket.Event_Parameter[6]) );
 			RecordCounter = 0;
-			CommandToProcess.ProcessSteps = 1;
+			/* The peer may be connecting with the address of its last advertising reports */
+			Desc = ( ( Address_Ptr->Bytes[sizeof(BD_ADDR_TYPE) - 1] & 0xC0 ) == 0x40 ) ? Get_Cached_RPA( Address_Ptr, FALSE ) : NULL;
+			CommandToProcess.ProcessSteps = ( Desc != NULL ) ? 5 : 1;
 			break;
 
 		case 1:
@@ -1101,6 +1828,7 @@ void Hosted_Functions_Process( void )
 			break;
 
 		case 5: /* Successful address resolution */
+			Cache_RPA( Address_Ptr, FALSE, Desc );
 			/* Load the type of identity just resolved */
 			CommandToProcess.EventPacket.Event_Parameter[5] = ( Desc->Id.Peer_Identity_Address.Type == PEER_PUBLIC_DEV_ADDR ) ? PUBLIC_IDENTITY_ADDR : RANDOM_IDENTITY_ADDR;
 
@@ -1241,6 +1969,37 @@ void Hosted_Functions_Enter_Standby( void )
 	CommandToProcess.OpCode.Val = 0;
 	CommandToProcess.ProcessSteps = 0;
 	Cancel_Device_Address_Generation();
+	Abandon_Resolution_Batch();
+	/* The transport reset that follows drops the commands in flight without answer */
+	Resolution.InFlight = 0;
+	DelegatedHead = 0;
+	DelegatedCount = 0;
+	CaughtCount = 0;
+}
+
+
+/****************************************************************/
+/* Hosted_Command_Released()            			       		*/
+/* Purpose: Drop the parameters caught for a command that is	*/
+/* released by the transport layer.								*/
+/* Parameters: CmdCallBack: the released command				*/
+/* Return: none  												*/
+/* Description: A command answered by the controller itself or	*/
+/* not answered in time is never delegated, so its parameters	*/
+/* would be left behind. Nothing is found for a delegated 		*/
+/* command, since its parameters were already taken.			*/
+/****************************************************************/
+void Hosted_Command_Released( CMD_CALLBACK* CmdCallBack )
+{
+	for( uint8_t i = 0; i < CaughtCount; i++ )
+	{
+		if( Caught[i].CmdCallBack == CmdCallBack )
+		{
+			CaughtCount--;
+			memmove( &Caught[i], &Caught[i + 1], ( CaughtCount - i ) * sizeof(Caught[0]) );
+			return;
+		}
+	}
 }
 
 
@@ -1257,6 +2016,34 @@ HCI_COMMAND_OPCODE Get_Hosted_Function( void )
 }
 
 
+/****************************************************************/
+/* Get_RPA_Cache_Statistics()         		   	       		 	*/
+/* Purpose: Get the counters of the resolvable private address	*/
+/* cache.														*/
+/* Parameters: none				         						*/
+/* Return: The counters since reset.							*/
+/* Description:													*/
+/****************************************************************/
+RPA_CACHE_STATISTICS Get_RPA_Cache_Statistics( void )
+{
+	return (RPA_Cache_Stats);
+}
+
+
+/****************************************************************/
+/* Get_Delegated_Command_Statistics()         		   	 	    */
+/* Purpose: Get the counters of the queue of resolving list		*/
+/* commands run by the host.									*/
+/* Parameters: none				         						*/
+/* Return: The counters since reset.							*/
+/* Description:													*/
+/****************************************************************/
+DELEGATED_COMMAND_STATISTICS Get_Delegated_Command_Statistics( void )
+{
+	return (DelegatedStats);
+}
+
+
 /****************************************************************/
 /* Hosted_Address_Resolution_Status()         		   	        */
 /* Purpose: Check if resolution is enabled.						*/
@@ -14,6 +14,22 @@
 /****************************************************************/
 /* Type Defines 						                        */
 /****************************************************************/
+typedef struct
+{
+	uint32_t Hits;		/* Addresses of reports or connections found resolved */
+	uint32_t Misses;	/* Resolvable private addresses that had to be resolved */
+	uint32_t Expired;	/* Addresses found older than the RPA timeout */
+	uint32_t Evictions; /* Addresses forgotten to make room before expiring */
+}RPA_CACHE_STATISTICS;
+
+
+typedef struct
+{
+	uint32_t Queued;	/* Resolving list commands that waited for the hosted functions */
+	uint32_t Full;		/* Commands answered at once, as busy, because the queue was full */
+	uint32_t Lost;		/* Commands answered with an error because their parameters were dropped */
+	uint8_t MaxQueued;	/* Most commands waiting at the same time */
+}DELEGATED_COMMAND_STATISTICS;
 
 
 /****************************************************************/
@@ -45,8 +61,11 @@ void Delegate_Function_To_Host( HCI_COMMAND_OPCODE OpCode, CMD_CALLBACK* CmdCall
 		HCI_EVENT_PCKT* EventPacketPtr );
 void Hosted_Functions_Process( void );
 void Hosted_Functions_Enter_Standby( void );
+void Hosted_Command_Released( CMD_CALLBACK* CmdCallBack );
 HCI_COMMAND_OPCODE Get_Hosted_Function( void );
 uint8_t Hosted_Address_Resolution_Status( void );
+RPA_CACHE_STATISTICS Get_RPA_Cache_Statistics( void );
+DELEGATED_COMMAND_STATISTICS Get_Delegated_Command_Statistics( void );
 
 
 #endif /* HOSTED_FUNCTIONS_H_ */
@@ -0,0 +1,432 @@
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include "hci.h"
+#include "ble_connection.h"
+#include "l2cap.h"
+
+
+/****************************************************************/
+/* Type Defines                                                 */
+/****************************************************************/
+typedef enum
+{
+	FIRST_NON_FLUSHABLE_FRAGMENT = 0x0, /* Start of a PDU from host to controller */
+	CONTINUING_FRAGMENT 		 = 0x1, /* Continuation of a PDU in both directions */
+	FIRST_FLUSHABLE_FRAGMENT 	 = 0x2  /* Start of a PDU from controller to host */
+}PACKET_BOUNDARY_FLAG;
+
+
+typedef struct
+{
+	uint16_t Connection_Handle;
+	uint16_t Size; /* PDU bytes, basic header included. Zero if there is no PDU */
+	uint16_t Done; /* PDU bytes already sent or received */
+	uint8_t Bytes[ sizeof(L2CAP_BASIC_HEADER) + L2CAP_MTU ];
+}L2CAP_PDU;
+
+
+/****************************************************************/
+/* Static functions declaration                                 */
+/****************************************************************/
+static L2CAP_PDU* Get_Tx_PDU( uint16_t Connection_Handle );
+static L2CAP_PDU* Get_Rx_PDU( uint16_t Connection_Handle, uint8_t Allocate );
+static uint16_t Send_Fragments( L2CAP_PDU* PDUPtr, uint16_t MaxFragments );
+static uint16_t Get_Fragment_Size( void );
+
+
+/****************************************************************/
+/* extern functions declaration                                 */
+/****************************************************************/
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define L2CAP_MAX_FRAGMENT_SIZE	27 /* HCI_Host_ACL_Data() takes up to 27 bytes, the smallest LE_ACL_Data_Packet_Length */
+#define L2CAP_MAX_LINKS			MAX_NUMBER_OF_CONNECTIONS
+
+
+/****************************************************************/
+/* Global variables definition                                  */
+/****************************************************************/
+extern uint16_t Default_LE_ACL_Data_Packet_Length;
+
+
+/****************************************************************/
+/* Local variables definition                                   */
+/****************************************************************/
+static L2CAP_PDU TxPDU[L2CAP_MAX_LINKS]; /* One SDU being sent per link */
+static uint8_t NextTxPDU = 0; /* First TxPDU served by Run_L2CAP() */
+static L2CAP_PDU RxPDU[L2CAP_MAX_LINKS]; /* One B-frame being reassembled per link */
+static L2CAP_STATISTICS Statistics;
+
+
+/****************************************************************/
+/* L2CAP_Send()						      						*/
+/* Location: 1034 Core_v5.2		 								*/
+/* Purpose: Send an SDU in a basic mode B-frame					*/
+/* Parameters: none				         						*/
+/* Return: TRUE if the SDU was taken.							*/
+/* Description: The SDU is copied, so the caller can reuse its	*/
+/* buffer. The B-frame is cut into ACL data packets of the 		*/
+/* LE_ACL_Data_Packet_Length read at init: the ones refused for	*/
+/* the lack of controller buffers are sent by Run_L2CAP(). Only	*/
+/* one SDU per link is sent at a time: FALSE is returned while 	*/
+/* the previous one of the link is pending.						*/
+/****************************************************************/
+uint8_t L2CAP_Send( uint16_t Connection_Handle, uint16_t CID, uint8_t Data[], uint16_t Length )
+{
+	L2CAP_PDU* PDUPtr = Get_Tx_PDU( Connection_Handle );
+
+	if( ( PDUPtr == NULL ) || ( PDUPtr->Size != 0 ) || ( Length > L2CAP_MTU ) )
+	{
+		return (FALSE);
+	}
+
+	L2CAP_BASIC_HEADER* HeaderPtr = (L2CAP_BASIC_HEADER*)( &PDUPtr->Bytes[0] );
+
+	HeaderPtr->Length = Length;
+	HeaderPtr->CID = CID;
+	memcpy( &PDUPtr->Bytes[sizeof(L2CAP_BASIC_HEADER)], &Data[0], Length );
+
+	PDUPtr->Connection_Handle = Connection_Handle;
+	PDUPtr->Done = 0;
+	PDUPtr->Size = sizeof(L2CAP_BASIC_HEADER) + Length;
+
+	Send_Fragments( PDUPtr, UINT16_MAX );
+
+	return (TRUE);
+}
+
+
+/****************************************************************/
+/* L2CAP_Send_Pending()					      					*/
+/* Location: 					 								*/
+/* Purpose: Tell if an SDU of the link is still being sent		*/
+/* Parameters: none				         						*/
+/* Return: TRUE if L2CAP_Send() would refuse a new SDU.			*/
+/* Description:													*/
+/****************************************************************/
+uint8_t L2CAP_Send_Pending( uint16_t Connection_Handle )
+{
+	L2CAP_PDU* PDUPtr = Get_Tx_PDU( Connection_Handle );
+
+	return ( ( ( PDUPtr == NULL ) || ( PDUPtr->Size != 0 ) ) ? TRUE : FALSE );
+}
+
+
+/****************************************************************/
+/* Run_L2CAP()						      						*/
+/* Location: 					 								*/
+/* Purpose: Send the fragments that were refused earlier		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Called from the main loop. The links take turns	*/
+/* of one fragment, and the first link of the turns rotates, so	*/
+/* a long SDU does not delay the SDUs of the other links.		*/
+/****************************************************************/
+void Run_L2CAP( void )
+{
+	uint16_t Sent;
+
+	do
+	{
+		Sent = 0;
+
+		for( uint8_t i = 0; i < L2CAP_MAX_LINKS; i++ )
+		{
+			L2CAP_PDU* PDUPtr = &TxPDU[( NextTxPDU + i ) % L2CAP_MAX_LINKS];
+
+			if( PDUPtr->Size != 0 )
+			{
+				Sent += Send_Fragments( PDUPtr, 1 );
+			}
+		}
+
+		NextTxPDU = ( NextTxPDU + 1 ) % L2CAP_MAX_LINKS;
+	}while( Sent != 0 );
+}
+
+
+/****************************************************************/
+/* Reset_L2CAP()					      						*/
+/* Location: 					 								*/
+/* Purpose: Drop the PDUs being sent and reassembled			*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Called when the links are gone.					*/
+/****************************************************************/
+void Reset_L2CAP( void )
+{
+	for( uint8_t i = 0; i < L2CAP_MAX_LINKS; i++ )
+	{
+		TxPDU[i].Size = 0;
+		RxPDU[i].Size = 0;
+	}
+}
+
+
+/****************************************************************/
+/* Release_L2CAP_Link()				      						*/
+/* Location: 					 								*/
+/* Purpose: Drop the PDUs being sent and reassembled on a link	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Called when the link is disconnected, so that	*/
+/* Run_L2CAP() stops sending to the handle and its PDUs can be	*/
+/* taken by other links.										*/
+/****************************************************************/
+void Release_L2CAP_Link( uint16_t Connection_Handle )
+{
+	for( uint8_t i = 0; i < L2CAP_MAX_LINKS; i++ )
+	{
+		if( TxPDU[i].Connection_Handle == Connection_Handle )
+		{
+			TxPDU[i].Size = 0;
+		}
+
+		if( RxPDU[i].Connection_Handle == Connection_Handle )
+		{
+			RxPDU[i].Size = 0;
+		}
+	}
+}
+
+
+/****************************************************************/
+/* Get_L2CAP_Statistics()				      					*/
+/* Location: 					 								*/
+/* Purpose: Return the fragmentation counters					*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+L2CAP_STATISTICS Get_L2CAP_Statistics( void )
+{
+	return ( Statistics );
+}
+
+
+/****************************************************************/
+/* HCI_Controller_ACL_Data()                					*/
+/* Location: 1037 Core_v5.2		 								*/
+/* Purpose: Reassemble the B-frames received from the controller*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: A B-frame held in a single ACL data packet is	*/
+/* given to L2CAP_Received() where it is, without a copy. The	*/
+/* others are copied fragment by fragment until complete, each	*/
+/* link in its own RxPDU. A new start fragment drops the B-frame	*/
+/* being reassembled on the same link.							*/
+/****************************************************************/
+void HCI_Controller_ACL_Data( HCI_ACL_DATA_PCKT_HEADER* ACLDataPacketHeader, uint8_t Data[] )
+{
+	uint16_t Size = ACLDataPacketHeader->Data_Total_Length;
+	L2CAP_BASIC_HEADER* HeaderPtr;
+	L2CAP_PDU* PDUPtr;
+	CONNECTION* ConnPtr = Get_Connection( ACLDataPacketHeader->Handle );
+
+	Statistics.FragmentsReceived++;
+
+	if( ConnPtr != NULL )
+	{
+		ConnPtr->ACL_Packets_Received++;
+		ConnPtr->ACL_Bytes_Received += Size;
+	}
+
+	if( ACLDataPacketHeader->PB_Flag != CONTINUING_FRAGMENT )
+	{
+		HeaderPtr = (L2CAP_BASIC_HEADER*)( &Data[0] );
+		PDUPtr = Get_Rx_PDU( ACLDataPacketHeader->Handle, TRUE );
+
+		if( ( PDUPtr != NULL ) && ( PDUPtr->Size != 0 ) )
+		{
+			Statistics.FragmentsDropped++;
+			PDUPtr->Size = 0;
+		}
+
+		if( ( Size < sizeof(L2CAP_BASIC_HEADER) ) || ( ( sizeof(L2CAP_BASIC_HEADER) + HeaderPtr->Length ) > sizeof(PDUPtr->Bytes) ) )
+		{
+			Statistics.FragmentsDropped++;
+		}else if( Size >= ( sizeof(L2CAP_BASIC_HEADER) + HeaderPtr->Length ) )
+		{
+			Statistics.SDUsReceived++;
+			L2CAP_Received( ACLDataPacketHeader->Handle, HeaderPtr->CID, &Data[sizeof(L2CAP_BASIC_HEADER)], HeaderPtr->Length );
+		}else if( PDUPtr == NULL )
+		{
+			/* Every RxPDU is taken by another link */
+			Statistics.FragmentsDropped++;
+		}else
+		{
+			PDUPtr->Connection_Handle = ACLDataPacketHeader->Handle;
+			PDUPtr->Size = sizeof(L2CAP_BASIC_HEADER) + HeaderPtr->Length;
+			PDUPtr->Done = Size;
+			memcpy( &PDUPtr->Bytes[0], &Data[0], Size );
+		}
+	}else if( ( ( PDUPtr = Get_Rx_PDU( ACLDataPacketHeader->Handle, FALSE ) ) == NULL ) || ( ( PDUPtr->Done + Size ) > PDUPtr->Size ) )
+	{
+		Statistics.FragmentsDropped++;
+
+		/* The B-frame of this link cannot be completed anymore */
+		if( PDUPtr != NULL )
+		{
+			PDUPtr->Size = 0;
+		}
+	}else
+	{
+		memcpy( &PDUPtr->Bytes[PDUPtr->Done], &Data[0], Size );
+		PDUPtr->Done += Size;
+
+		if( PDUPtr->Done == PDUPtr->Size )
+		{
+			HeaderPtr = (L2CAP_BASIC_HEADER*)( &PDUPtr->Bytes[0] );
+			PDUPtr->Size = 0;
+
+			Statistics.SDUsReceived++;
+			L2CAP_Received( PDUPtr->Connection_Handle, HeaderPtr->CID, &PDUPtr->Bytes[sizeof(L2CAP_BASIC_HEADER)], HeaderPtr->Length );
+		}
+	}
+}
+
+
+/****************************************************************/
+/* L2CAP_Received()                								*/
+/* Location: 					 								*/
+/* Purpose: An SDU was received on a channel					*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The data is only valid during the call. An SDU	*/
+/* received in a single ACL data packet can be kept with 		*/
+/* Hold_Received_Packet().										*/
+/****************************************************************/
+__attribute__((weak)) void L2CAP_Received( uint16_t Connection_Handle, uint16_t CID, uint8_t Data[], uint16_t Length )
+{
+	/* The user should implement at higher layers since it is weak. */
+}
+
+
+/****************************************************************/
+/* Get_Tx_PDU()							      					*/
+/* Location: 					 								*/
+/* Purpose: Find the TxPDU of a link							*/
+/* Parameters: none				         						*/
+/* Return: The PDU being sent on the link, else a free one, 	*/
+/* else NULL.													*/
+/* Description:													*/
+/****************************************************************/
+static L2CAP_PDU* Get_Tx_PDU( uint16_t Connection_Handle )
+{
+	L2CAP_PDU* FreePtr = NULL;
+
+	for( uint8_t i = 0; i < L2CAP_MAX_LINKS; i++ )
+	{
+		if( TxPDU[i].Size == 0 )
+		{
+			FreePtr = ( FreePtr == NULL ) ? &TxPDU[i] : FreePtr;
+		}else if( TxPDU[i].Connection_Handle == Connection_Handle )
+		{
+			return ( &TxPDU[i] );
+		}
+	}
+
+	return ( FreePtr );
+}
+
+
+/****************************************************************/
+/* Get_Rx_PDU()							      					*/
+/* Location: 					 								*/
+/* Purpose: Find the RxPDU of a link							*/
+/* Parameters: Allocate: take a free RxPDU if the link has none	*/
+/* Return: The PDU being reassembled on the link, else a free	*/
+/* one if allowed, else NULL.									*/
+/* Description:													*/
+/****************************************************************/
+static L2CAP_PDU* Get_Rx_PDU( uint16_t Connection_Handle, uint8_t Allocate )
+{
+	L2CAP_PDU* FreePtr = NULL;
+
+	for( uint8_t i = 0; i < L2CAP_MAX_LINKS; i++ )
+	{
+		if( RxPDU[i].Size == 0 )
+		{
+			FreePtr = ( FreePtr == NULL ) ? &RxPDU[i] : FreePtr;
+		}else if( RxPDU[i].Connection_Handle == Connection_Handle )
+		{
+			return ( &RxPDU[i] );
+		}
+	}
+
+	return ( Allocate ? FreePtr : NULL );
+}
+
+
+/****************************************************************/
+/* Send_Fragments()						      					*/
+/* Location: 					 								*/
+/* Purpose: Give the B-frame to the controller, one ACL data	*/
+/* packet at a time												*/
+/* Parameters: MaxFragments: ACL data packets to send at most	*/
+/* Return: The number of ACL data packets sent.					*/
+/* Description: Stops at the first packet refused. The first	*/
+/* packet is marked as a start, the others as continuations.	*/
+/****************************************************************/
+static uint16_t Send_Fragments( L2CAP_PDU* PDUPtr, uint16_t MaxFragments )
+{
+	HCI_ACL_DATA_PCKT_HEADER Header;
+	uint16_t FragmentSize = Get_Fragment_Size( );
+	uint16_t Sent = 0;
+
+	Header.Handle = PDUPtr->Connection_Handle;
+	Header.BC_Flag = 0x0;
+
+	while( ( PDUPtr->Done < PDUPtr->Size ) && ( Sent < MaxFragments ) )
+	{
+		Header.PB_Flag = ( PDUPtr->Done == 0 ) ? FIRST_NON_FLUSHABLE_FRAGMENT : CONTINUING_FRAGMENT;
+		Header.Data_Total_Length = MIN( PDUPtr->Size - PDUPtr->Done, FragmentSize );
+
+		if( !HCI_Host_ACL_Data( &Header, &PDUPtr->Bytes[PDUPtr->Done] ) )
+		{
+			return (Sent);
+		}
+
+		PDUPtr->Done += Header.Data_Total_Length;
+		Statistics.FragmentsSent++;
+		Sent++;
+	}
+
+	if( PDUPtr->Done == PDUPtr->Size )
+	{
+		Statistics.SDUsSent++;
+		PDUPtr->Size = 0;
+	}
+
+	return (Sent);
+}
+
+
+/****************************************************************/
+/* Get_Fragment_Size()						      				*/
+/* Location: 					 								*/
+/* Purpose: Largest ACL data packet to be sent					*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static uint16_t Get_Fragment_Size( void )
+{
+	if( ( Default_LE_ACL_Data_Packet_Length != 0 ) && ( Default_LE_ACL_Data_Packet_Length < L2CAP_MAX_FRAGMENT_SIZE ) )
+	{
+		return ( Default_LE_ACL_Data_Packet_Length );
+	}
+
+	return ( L2CAP_MAX_FRAGMENT_SIZE );
+}
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
@@ -0,0 +1,69 @@
+
+
+#ifndef L2CAP_H_
+#define L2CAP_H_
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include "Types.h"
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define L2CAP_MTU	247 /* Largest SDU sent or received. The ATT_MTU of a data length extended LE link */
+
+
+/****************************************************************/
+/* Type Defines 				               		            */
+/****************************************************************/
+typedef enum
+{
+	L2CAP_ATT_CID 			= 0x0004, /* Attribute protocol */
+	L2CAP_LE_SIGNALING_CID 	= 0x0005, /* LE signaling channel */
+	L2CAP_SMP_CID 			= 0x0006  /* Security manager protocol */
+}L2CAP_FIXED_CID;
+
+
+typedef struct
+{
+	uint16_t Length; /* Information payload length, header excluded */
+	uint16_t CID;	 /* Destination channel */
+}__attribute__((packed)) L2CAP_BASIC_HEADER;
+
+
+typedef struct
+{
+	uint32_t SDUsSent;		   /* SDUs completely given to the controller */
+	uint32_t FragmentsSent;	   /* ACL data packets of the SDUs sent */
+	uint32_t SDUsReceived;	   /* SDUs completely reassembled */
+	uint32_t FragmentsReceived; /* ACL data packets received */
+	uint32_t FragmentsDropped; /* ACL data packets discarded, or partial B-frames cut by a new start */
+}L2CAP_STATISTICS;
+
+
+/****************************************************************/
+/* External functions declaration (Interface functions)         */
+/****************************************************************/
+uint8_t L2CAP_Send( uint16_t Connection_Handle, uint16_t CID, uint8_t Data[], uint16_t Length );
+uint8_t L2CAP_Send_Pending( uint16_t Connection_Handle );
+void L2CAP_Received( uint16_t Connection_Handle, uint16_t CID, uint8_t Data[], uint16_t Length );
+void Run_L2CAP( void );
+void Reset_L2CAP( void );
+void Release_L2CAP_Link( uint16_t Connection_Handle );
+L2CAP_STATISTICS Get_L2CAP_Statistics( void );
+
+
+/****************************************************************/
+/* External variables declaration                               */
+/****************************************************************/
+
+
+#endif /* L2CAP_H_ */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
@@ -14,29 +14,30 @@
 /****************************************************************/
 /* Type Defines                                                 */
 /****************************************************************/
-typedef struct
-{
-	uint32_t Initialized;
-	uint16_t NumberOfEntries;
-}__attribute__((packed)) RESOLVING_LIST_FLAGS;
-
-
-typedef struct
-{
-	RESOLVING_LIST_FLAGS Flags;
-	RESOLVING_RECORD Entry[];
-}__attribute__((packed)) RESOLVING_LIST;
 
 
 /****************************************************************/
 /* Static functions declaration                                 */
 /****************************************************************/
+static void Load_Resolving_Records( void );
+static uint8_t Identity_Hash( IDENTITY_ADDRESS* Identity );
+static void Index_Record( uint16_t Index );
+static void Rebuild_Identity_Index( void );
+static int16_t Find_Controller_Device( IDENTITY_ADDRESS* Peer_Identity_Address );
 
 
 /****************************************************************/
 /* Defines                                                      */
 /****************************************************************/
-#define RESOLVING_LIST_FILLED 0x35892541
+#define RESOLVING_LIST_SIZE_UNKNOWN 0xFFFF
+#ifndef IDENTITY_INDEX_SIZE
+#define IDENTITY_INDEX_SIZE			16 /* Power of two up to 256, at least twice the resolving list size so probes stay short */
+#endif
+#define IDENTITY_INDEX_EMPTY		0xFF
+
+#if ( IDENTITY_INDEX_SIZE & ( IDENTITY_INDEX_SIZE - 1 ) ) || ( IDENTITY_INDEX_SIZE > 256 ) || ( IDENTITY_INDEX_SIZE < ( 2 * MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES ) )
+#error "IDENTITY_INDEX_SIZE must be a power of two up to 256 and at least twice MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES"
+#endif
 
 
 /****************************************************************/
@@ -47,6 +48,16 @@ typedef struct
 /****************************************************************/
 /* Local variables definition                                   */
 /****************************************************************/
+static uint16_t NumberOfResolvingRecords = RESOLVING_LIST_SIZE_UNKNOWN;
+/* RAM copy of the records saved on flash, flash is only accessed to load and to write */
+static RESOLVING_RECORD ResolvingRecords[MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES];
+/* Open addressing table of record indexes hashed by peer identity address */
+static uint8_t IdentityIndex[IDENTITY_INDEX_SIZE];
+/* Devices the controller's resolving list holds, as added by the host */
+static DEVICE_IDENTITY ControllerDevices[MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES];
+static uint16_t NumberOfControllerDevices = 0;
+static uint8_t ControllerListKnown = FALSE;
+static ADDRESS_RESOLUTION_STATE ControllerAddressResolution = ADDRESS_RESOLUTION_UNKNOWN;
 
 
 /****************************************************************/
@@ -56,33 +67,105 @@ typedef struct
 /* on Non-volatile memory.										*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: The records are loaded to RAM on the first call.*/
 /****************************************************************/
 uint16_t Get_Number_Of_Resolving_Records( void )
 {
-	uint16_t ListSize = 0;
-	uint32_t ListAddress = GET_LE_RESOLVING_LIST_BASE_ADDRESS();
+	if( NumberOfResolvingRecords == RESOLVING_LIST_SIZE_UNKNOWN )
+	{
+		Load_Resolving_Records();
+	}
+
+	return ( NumberOfResolvingRecords );
+}
+
 
-	RESOLVING_LIST* ListPtr = (RESOLVING_LIST*)( ListAddress );
+/****************************************************************/
+/* Load_Resolving_Records()		      							*/
+/* Location: 					 								*/
+/* Purpose: Copy the records saved on Non-volatile memory to RAM.*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Each record is saved under its own key and the	*/
+/* list has no holes, so loading stops at the first missing key.*/
+/****************************************************************/
+static void Load_Resolving_Records( void )
+{
+	RESOLVING_RECORD* RecordPtr;
 
-	if ( ListPtr->Flags.Initialized != RESOLVING_LIST_FILLED )
+	NumberOfResolvingRecords = 0;
+	while( ( NumberOfResolvingRecords < MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES ) &&
+			( ( RecordPtr = (RESOLVING_RECORD*)FLASH_Read( FLASH_KEY_RESOLVING_RECORD + NumberOfResolvingRecords, NULL ) ) != NULL ) )
 	{
-		/* Initialize the list */
-		RESOLVING_LIST_FLAGS ListFlags;
-		ListFlags.Initialized = RESOLVING_LIST_FILLED;
-		ListFlags.NumberOfEntries = 0;
+		ResolvingRecords[NumberOfResolvingRecords] = *RecordPtr;
+		NumberOfResolvingRecords++;
+	}
 
-		FLASH_Program( ListAddress, (uint8_t*)( &ListFlags ), sizeof(ListFlags) );
-		if ( ListPtr->Flags.Initialized == RESOLVING_LIST_FILLED )
-		{
-			ListSize = ListPtr->Flags.NumberOfEntries;
-		}
-	}else
+	Rebuild_Identity_Index();
+}
+
+
+/****************************************************************/
+/* Identity_Hash()		      									*/
+/* Location: 					 								*/
+/* Purpose: Hash an identity address into the index table.		*/
+/* Parameters: none				         						*/
+/* Return: First slot to probe.									*/
+/* Description:													*/
+/****************************************************************/
+static uint8_t Identity_Hash( IDENTITY_ADDRESS* Identity )
+{
+	uint8_t* Bytes = (uint8_t*)Identity;
+	uint8_t Hash = 0;
+
+	for( uint8_t i = 0; i < sizeof(IDENTITY_ADDRESS); i++ )
 	{
-		ListSize = ListPtr->Flags.NumberOfEntries;
+		Hash = ( Hash * 31 ) + Bytes[i];
 	}
 
-	return ( ListSize );
+	return ( Hash & ( IDENTITY_INDEX_SIZE - 1 ) );
+}
+
+
+/****************************************************************/
+/* Index_Record()		      									*/
+/* Location: 					 								*/
+/* Purpose: Add a RAM record to the identity index.				*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Linear probing, the table never fills since it	*/
+/* is twice the list size.										*/
+/****************************************************************/
+static void Index_Record( uint16_t Index )
+{
+	uint8_t Slot = Identity_Hash( &( ResolvingRecords[Index].Peer.Peer_Identity_Address ) );
+
+	while( IdentityIndex[Slot] != IDENTITY_INDEX_EMPTY )
+	{
+		Slot = ( Slot + 1 ) & ( IDENTITY_INDEX_SIZE - 1 );
+	}
+
+	IdentityIndex[Slot] = Index;
+}
+
+
+/****************************************************************/
+/* Rebuild_Identity_Index()		      							*/
+/* Location: 					 								*/
+/* Purpose: Index all RAM records again.						*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Used when records are removed or moved, since	*/
+/* linear probing does not allow clearing a single slot.		*/
+/****************************************************************/
+static void Rebuild_Identity_Index( void )
+{
+	memset( IdentityIndex, IDENTITY_INDEX_EMPTY, sizeof(IdentityIndex) );
+
+	for( uint16_t i = 0; i < NumberOfResolvingRecords; i++ )
+	{
+		Index_Record( i );
+	}
 }
 
 
@@ -96,32 +179,22 @@ uint16_t Get_Number_Of_Resolving_Records( void )
 /****************************************************************/
 uint8_t Add_Record_To_Resolving_List( RESOLVING_RECORD* Record )
 {
-	uint32_t ListAddress = GET_LE_RESOLVING_LIST_BASE_ADDRESS();
-
-	RESOLVING_LIST* ListPtr = (RESOLVING_LIST*)( ListAddress );
 	uint16_t NumberOfEntries = Get_Number_Of_Resolving_Records();
 
 	if( NumberOfEntries < MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES )
 	{
 		/* Check if there is no similar device identity already allocated. */
-		for ( uint16_t i = 0; i < NumberOfEntries; i++ )
+		if ( Get_Record_From_Peer_Identity( &(Record->Peer.Peer_Identity_Address) ) != NULL )
 		{
-			RESOLVING_RECORD* LocalRecord = Get_Record_From_Index( i );
-			if ( memcmp( &( LocalRecord->Peer.Peer_Identity_Address ), &(Record->Peer.Peer_Identity_Address), sizeof(IDENTITY_ADDRESS) ) == 0 )
-			{
-				return (FALSE);
-			}
+			return (FALSE);
 		}
 
 		/* Program device identity */
-		FLASH_Program( ListAddress + offsetof(RESOLVING_LIST,Entry[NumberOfEntries]), (uint8_t*)( Record ), sizeof(RESOLVING_RECORD) );
-
-		/* Update number of entries */
-		NumberOfEntries++;
-		FLASH_Program( ListAddress + offsetof(RESOLVING_LIST,Flags.NumberOfEntries), (uint8_t*)( &NumberOfEntries ), sizeof(ListPtr->Flags.NumberOfEntries) );
-
-		if( ListPtr->Flags.NumberOfEntries == NumberOfEntries )
+		if( FLASH_Write( FLASH_KEY_RESOLVING_RECORD + NumberOfEntries, Record, sizeof(RESOLVING_RECORD) ) )
 		{
+			ResolvingRecords[NumberOfEntries] = *Record;
+			NumberOfResolvingRecords++;
+			Index_Record( NumberOfEntries );
 			return (TRUE);
 		}
 	}
@@ -136,36 +209,38 @@ uint8_t Add_Record_To_Resolving_List( RESOLVING_RECORD* Record )
 /* Purpose: Remove item from resolving list.					*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: The last record takes the place of the removed	*/
+/* one, so the list order is not kept.							*/
 /****************************************************************/
 uint8_t Remove_Record_From_Resolving_List( IDENTITY_ADDRESS* Peer_Identity_Address )
 {
-	uint32_t ListAddress = GET_LE_RESOLVING_LIST_BASE_ADDRESS();
-
-	RESOLVING_LIST* ListPtr = (RESOLVING_LIST*)( ListAddress );
-	RESOLVING_RECORD Record;
 	uint16_t NumberOfEntries = Get_Number_Of_Resolving_Records();
+	RESOLVING_RECORD* LocalRecord = Get_Record_From_Peer_Identity( Peer_Identity_Address );
 
-	/* TODO: this code is not optimized for performance. A better implementation
-	 * is encouraged. */
-	for ( uint16_t i = 0; i < NumberOfEntries; i++ )
+	if( LocalRecord != NULL )
 	{
-		RESOLVING_RECORD* LocalRecord = Get_Record_From_Index( i );
-		if ( memcmp( &( LocalRecord->Peer.Peer_Identity_Address ), Peer_Identity_Address, sizeof(IDENTITY_ADDRESS) ) == 0 )
+		uint16_t i = LocalRecord - &ResolvingRecords[0];
+
+		if( i != ( NumberOfEntries - 1 ) )
 		{
-			for ( uint16_t a = i; a < (NumberOfEntries - 1); a++ )
+			if( !FLASH_Write( FLASH_KEY_RESOLVING_RECORD + i, &ResolvingRecords[NumberOfEntries - 1], sizeof(RESOLVING_RECORD) ) )
 			{
-				LocalRecord = Get_Record_From_Index( a + 1 );
-				Record = *LocalRecord;
-				FLASH_Program( ListAddress + offsetof(RESOLVING_LIST,Entry[a]), (uint8_t*)( &Record ), sizeof(RESOLVING_RECORD) );
+				return (FALSE);
 			}
+			ResolvingRecords[i] = ResolvingRecords[NumberOfEntries - 1];
+		}
 
-			/* Update number of entries */
-			NumberOfEntries--;
-			FLASH_Program( ListAddress + offsetof(RESOLVING_LIST,Flags.NumberOfEntries), (uint8_t*)( &NumberOfEntries ), sizeof(ListPtr->Flags.NumberOfEntries) );
-
-			return (TRUE);
+		/* Update number of entries */
+		if( !FLASH_Delete( FLASH_KEY_RESOLVING_RECORD + NumberOfEntries - 1 ) )
+		{
+			/* Flash still holds the last record in both places */
+			Rebuild_Identity_Index();
+			return (FALSE);
 		}
+
+		NumberOfResolvingRecords--;
+		Rebuild_Identity_Index();
+		return (TRUE);
 	}
 
 	return (FALSE);
@@ -182,21 +257,24 @@ uint8_t Remove_Record_From_Resolving_List( IDENTITY_ADDRESS* Peer_Identity_Addre
 /****************************************************************/
 uint8_t Clear_Resolving_List( void )
 {
-	uint32_t ListAddress = GET_LE_RESOLVING_LIST_BASE_ADDRESS();
-
-	RESOLVING_LIST* ListPtr = (RESOLVING_LIST*)( ListAddress );
 	uint16_t NumberOfEntries = Get_Number_Of_Resolving_Records();
 
-	/* Update number of entries */
-	NumberOfEntries = 0;
-	FLASH_Program( ListAddress + offsetof(RESOLVING_LIST,Flags.NumberOfEntries), (uint8_t*)( &NumberOfEntries ), sizeof(ListPtr->Flags.NumberOfEntries) );
-
-	if( ListPtr->Flags.NumberOfEntries == NumberOfEntries )
+	/* Remove from the end so that the list has no holes if interrupted */
+	while( NumberOfEntries )
 	{
-		return (TRUE);
+		if( !FLASH_Delete( FLASH_KEY_RESOLVING_RECORD + NumberOfEntries - 1 ) )
+		{
+			Rebuild_Identity_Index();
+			return (FALSE);
+		}
+
+		NumberOfEntries--;
+		NumberOfResolvingRecords = NumberOfEntries;
 	}
 
-	return (FALSE);
+	Rebuild_Identity_Index();
+
+	return (TRUE);
 }
 
 
@@ -206,21 +284,25 @@ uint8_t Clear_Resolving_List( void )
 /* Purpose: Return the record from peer identity.				*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: Probes the identity index until an empty slot.	*/
 /****************************************************************/
 RESOLVING_RECORD* Get_Record_From_Peer_Identity( IDENTITY_ADDRESS* Peer_Identity_Address )
 {
-	RESOLVING_LIST* ListPtr = (RESOLVING_LIST*)( GET_LE_RESOLVING_LIST_BASE_ADDRESS() );
-	uint16_t NumberOfEntries = Get_Number_Of_Resolving_Records();
+	uint8_t Slot;
+
+	Get_Number_Of_Resolving_Records();
 
-	for ( uint16_t i = 0; i < NumberOfEntries; i++ )
+	Slot = Identity_Hash( Peer_Identity_Address );
+	while( IdentityIndex[Slot] != IDENTITY_INDEX_EMPTY )
 	{
-		RESOLVING_RECORD* LocalRecord = &( ListPtr->Entry[i] );
+		RESOLVING_RECORD* LocalRecord = &ResolvingRecords[ IdentityIndex[Slot] ];
 
 		if ( memcmp( &( LocalRecord->Peer.Peer_Identity_Address ), Peer_Identity_Address, sizeof(IDENTITY_ADDRESS) ) == 0 )
 		{
 			return ( LocalRecord );
 		}
+
+		Slot = ( Slot + 1 ) & ( IDENTITY_INDEX_SIZE - 1 );
 	}
 
 	return (NULL);
@@ -237,18 +319,231 @@ RESOLVING_RECORD* Get_Record_From_Peer_Identity( IDENTITY_ADDRESS* Peer_Identity
 /****************************************************************/
 RESOLVING_RECORD* Get_Record_From_Index( uint16_t Index )
 {
-	RESOLVING_LIST* ListPtr = (RESOLVING_LIST*)( GET_LE_RESOLVING_LIST_BASE_ADDRESS() );
 	uint16_t NumberOfEntries = Get_Number_Of_Resolving_Records();
 
 	if( Index < NumberOfEntries )
 	{
-		return ( &ListPtr->Entry[Index] );
+		return ( &ResolvingRecords[Index] );
+	}
+
+	return (NULL);
+}
+
+
+/****************************************************************/
+/* Set_Controller_Resolving_List_Unknown()	  					*/
+/* Location: 					 								*/
+/* Purpose: Forget the contents of the controller's resolving	*/
+/* list.														*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Used when a list command fails or the			*/
+/* controller is reset. The list is cleared before the next		*/
+/* synchronization.												*/
+/****************************************************************/
+void Set_Controller_Resolving_List_Unknown( void )
+{
+	ControllerListKnown = FALSE;
+	NumberOfControllerDevices = 0;
+}
+
+
+/****************************************************************/
+/* Controller_Resolving_List_Cleared()	  						*/
+/* Location: 					 								*/
+/* Purpose: Register a successful HCI_LE_Clear_Resolving_List.	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Controller_Resolving_List_Cleared( void )
+{
+	ControllerListKnown = TRUE;
+	NumberOfControllerDevices = 0;
+}
+
+
+/****************************************************************/
+/* Controller_Resolving_List_Added()	  						*/
+/* Location: 					 								*/
+/* Purpose: Register a successful								*/
+/* HCI_LE_Add_Device_To_Resolving_List.							*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Controller_Resolving_List_Added( DEVICE_IDENTITY* Device )
+{
+	int16_t Index = Find_Controller_Device( &Device->Peer_Identity_Address );
+
+	if( Index >= 0 )
+	{
+		ControllerDevices[Index] = *Device;
+	}else if( NumberOfControllerDevices < MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES )
+	{
+		ControllerDevices[NumberOfControllerDevices++] = *Device;
+	}else
+	{
+		/* The controller holds more devices than tracked */
+		Set_Controller_Resolving_List_Unknown();
+	}
+}
+
+
+/****************************************************************/
+/* Controller_Resolving_List_Removed()	  						*/
+/* Location: 					 								*/
+/* Purpose: Register a successful								*/
+/* HCI_LE_Remove_Device_From_Resolving_List.					*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Controller_Resolving_List_Removed( IDENTITY_ADDRESS* Peer_Identity_Address )
+{
+	int16_t Index = Find_Controller_Device( Peer_Identity_Address );
+
+	if( Index >= 0 )
+	{
+		ControllerDevices[Index] = ControllerDevices[--NumberOfControllerDevices];
+	}
+}
+
+
+/****************************************************************/
+/* Controller_Resolving_List_Known()	  						*/
+/* Location: 					 								*/
+/* Purpose: Tell if the controller's resolving list is tracked.	*/
+/* Parameters: none				         						*/
+/* Return: TRUE if the contents of the list are known.			*/
+/* Description:													*/
+/****************************************************************/
+uint8_t Controller_Resolving_List_Known( void )
+{
+	return (ControllerListKnown);
+}
+
+
+/****************************************************************/
+/* Controller_Resolving_List_Synchronized()	  					*/
+/* Location: 					 								*/
+/* Purpose: Tell if the controller's resolving list matches the	*/
+/* host's one.													*/
+/* Parameters: none				         						*/
+/* Return: TRUE if no device has to be removed or added.		*/
+/* Description:													*/
+/****************************************************************/
+uint8_t Controller_Resolving_List_Synchronized( void )
+{
+	return ( ( ControllerListKnown ) && ( Get_Device_To_Remove_From_Controller() == NULL ) &&
+			( Get_Device_To_Add_To_Controller() == NULL ) ) ? TRUE : FALSE;
+}
+
+
+/****************************************************************/
+/* Get_Device_To_Remove_From_Controller()	  					*/
+/* Location: 					 								*/
+/* Purpose: Get a device the controller holds that is not in	*/
+/* the host's list.												*/
+/* Parameters: none				         						*/
+/* Return: NULL if there is none or the controller's list is	*/
+/* not known.													*/
+/* Description: A device whose IRKs changed on the host is		*/
+/* removed and added again.										*/
+/****************************************************************/
+DEVICE_IDENTITY* Get_Device_To_Remove_From_Controller( void )
+{
+	for( uint16_t i = 0; ( ControllerListKnown ) && ( i < NumberOfControllerDevices ); i++ )
+	{
+		RESOLVING_RECORD* RecordPtr = Get_Record_From_Peer_Identity( &ControllerDevices[i].Peer_Identity_Address );
+
+		if( ( RecordPtr == NULL ) || ( memcmp( &RecordPtr->Peer, &ControllerDevices[i], sizeof(DEVICE_IDENTITY) ) != 0 ) )
+		{
+			return ( &ControllerDevices[i] );
+		}
 	}
 
 	return (NULL);
 }
 
 
+/****************************************************************/
+/* Get_Device_To_Add_To_Controller()	  						*/
+/* Location: 					 								*/
+/* Purpose: Get a device of the host's list that the controller	*/
+/* does not hold.												*/
+/* Parameters: none				         						*/
+/* Return: NULL if there is none or the controller's list is	*/
+/* not known.													*/
+/* Description: Devices are given in the host's list order.		*/
+/****************************************************************/
+DEVICE_IDENTITY* Get_Device_To_Add_To_Controller( void )
+{
+	uint16_t NumberOfEntries = Get_Number_Of_Resolving_Records();
+
+	for( uint16_t i = 0; ( ControllerListKnown ) && ( i < NumberOfEntries ); i++ )
+	{
+		if( Find_Controller_Device( &ResolvingRecords[i].Peer.Peer_Identity_Address ) < 0 )
+		{
+			return ( &ResolvingRecords[i].Peer );
+		}
+	}
+
+	return (NULL);
+}
+
+
+/****************************************************************/
+/* Find_Controller_Device()	  									*/
+/* Location: 					 								*/
+/* Purpose: Look a peer identity up on the controller's list.	*/
+/* Parameters: none				         						*/
+/* Return: Index of the device or -1 if not found.				*/
+/* Description:													*/
+/****************************************************************/
+static int16_t Find_Controller_Device( IDENTITY_ADDRESS* Peer_Identity_Address )
+{
+	for( uint16_t i = 0; i < NumberOfControllerDevices; i++ )
+	{
+		if( memcmp( &ControllerDevices[i].Peer_Identity_Address, Peer_Identity_Address, sizeof(IDENTITY_ADDRESS) ) == 0 )
+		{
+			return (i);
+		}
+	}
+
+	return (-1);
+}
+
+
+/****************************************************************/
+/* Set_Controller_Address_Resolution()	  						*/
+/* Location: 					 								*/
+/* Purpose: Register the address resolution state of the		*/
+/* controller.													*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Set_Controller_Address_Resolution( ADDRESS_RESOLUTION_STATE State )
+{
+	ControllerAddressResolution = State;
+}
+
+
+/****************************************************************/
+/* Get_Controller_Address_Resolution()	  						*/
+/* Location: 					 								*/
+/* Purpose: Get the address resolution state of the controller.	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+ADDRESS_RESOLUTION_STATE Get_Controller_Address_Resolution( void )
+{
+	return (ControllerAddressResolution);
+}
+
+
 /****************************************************************/
 /* End of file	                                                */
 /****************************************************************/
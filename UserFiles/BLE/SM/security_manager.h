@@ -13,7 +13,9 @@
 /****************************************************************/
 /* Defines                                                      */
 /****************************************************************/
+#ifndef MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES
 #define MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES	4
+#endif
 
 
 /****************************************************************/
@@ -42,6 +44,14 @@ typedef struct
 }__attribute__((packed)) RESOLVING_RECORD;
 
 
+typedef enum
+{
+	ADDRESS_RESOLUTION_DISABLED = 0,
+	ADDRESS_RESOLUTION_ENABLED	= 1,
+	ADDRESS_RESOLUTION_UNKNOWN	= 2 /* Not set since the controller reset, or the last command failed */
+}ADDRESS_RESOLUTION_STATE;
+
+
 /****************************************************************/
 /* External functions declaration (Interface functions)         */
 /****************************************************************/
@@ -51,6 +61,16 @@ uint8_t Remove_Record_From_Resolving_List( IDENTITY_ADDRESS* Peer_Identity_Addre
 RESOLVING_RECORD* Get_Record_From_Peer_Identity( IDENTITY_ADDRESS* Peer_Identity_Address );
 RESOLVING_RECORD* Get_Record_From_Index( uint16_t Index );
 uint8_t Clear_Resolving_List( void );
+void Set_Controller_Resolving_List_Unknown( void );
+void Controller_Resolving_List_Cleared( void );
+void Controller_Resolving_List_Added( DEVICE_IDENTITY* Device );
+void Controller_Resolving_List_Removed( IDENTITY_ADDRESS* Peer_Identity_Address );
+uint8_t Controller_Resolving_List_Known( void );
+uint8_t Controller_Resolving_List_Synchronized( void );
+DEVICE_IDENTITY* Get_Device_To_Remove_From_Controller( void );
+DEVICE_IDENTITY* Get_Device_To_Add_To_Controller( void );
+void Set_Controller_Address_Resolution( ADDRESS_RESOLUTION_STATE State );
+ADDRESS_RESOLUTION_STATE Get_Controller_Address_Resolution( void );
 
 
 /****************************************************************/
@@ -0,0 +1,1050 @@
+
+
+/* Software stand-in of the BlueNRG-MS used by the host (Linux) build. It replaces
+ * BLE_HAL.c when BLE_HAL_SIMULATION is defined: the SPI header protocol, the IRQ
+ * pin and the DMA completion interrupts are emulated so that Bluenrg.c and the
+ * upper layers run unchanged. The main loop must call Bluenrg_Sim_Run() once per
+ * pass, which advances the simulated time and delivers the "interrupts". */
+#ifdef BLE_HAL_SIMULATION
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include "BLE_HAL_Sim.h"
+#include "main.h"
+#include "aes_128.h"
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define CTRL_WRITE 	  	  0x0A
+#define CTRL_READ  	  	  0x0B
+#define DEVICE_READY  	  0x02
+#define DEVICE_NOT_READY  0x00
+
+#ifndef BLUENRG_SIM_SPI_CLOCK_HZ
+#define BLUENRG_SIM_SPI_CLOCK_HZ	  187500UL /* 48 MHz with SPI_BAUDRATEPRESCALER_256, as in spi.c */
+#endif
+
+#ifndef BLUENRG_SIM_MAIN_LOOP_TIME_US
+#define BLUENRG_SIM_MAIN_LOOP_TIME_US 20UL	 /* Time taken by one pass of the main loop */
+#endif
+
+#ifndef BLUENRG_SIM_CMD_LATENCY_US
+#define BLUENRG_SIM_CMD_LATENCY_US	  200UL	 /* Time the controller takes to answer an HCI command */
+#endif
+
+#ifndef BLUENRG_SIM_ACL_LATENCY_US
+#define BLUENRG_SIM_ACL_LATENCY_US	  1250UL /* Time until an ACL packet is reported in Number_Of_Completed_Packets */
+#endif
+
+#define SIM_BOOT_TIME_US			  5000UL /* Time from reset release to EVT_BLUE_INITIALIZED */
+#define SIM_TICK_PERIOD_US			  1000UL /* SysTick period */
+#define SIM_MAX_WBUF				  127	 /* Largest WBUF reported in the slave header */
+#define SIM_MAX_PACKET_SIZE			  ( 1 + 2 + 255 ) /* Packet type + HCI event header + parameters */
+#define SIM_INPUT_BUFFER_SIZE		  ( 2 * SIM_MAX_PACKET_SIZE )
+#define SIM_OUTPUT_QUEUE_SIZE		  16
+#define SIM_CONFIG_DATA_SIZE		  256
+
+#define SIM_NUM_HCI_COMMAND_PACKETS	  1 /* Default Num_HCI_Command_Packets, as the BlueNRG-MS */
+#define SIM_LE_ACL_DATA_PACKET_LENGTH 27
+#define SIM_TOTAL_NUM_LE_ACL_PACKETS  4
+
+
+/****************************************************************/
+/* Type Defines                                                 */
+/****************************************************************/
+typedef enum
+{
+	SIM_IN_RESET = 0, /* Reset pin is low */
+	SIM_BOOTING	 = 1, /* Reset released, firmware is starting */
+	SIM_RUNNING	 = 2  /* EVT_BLUE_INITIALIZED was queued */
+}SIM_CONTROLLER_STATE;
+
+
+typedef struct
+{
+	uint32_t DueTime; /* Time (us) the packet becomes available to the host */
+	uint16_t Size;
+	uint16_t ReadOffset;
+	uint8_t Bytes[SIM_MAX_PACKET_SIZE];
+}SIM_PACKET;
+
+
+typedef struct
+{
+	uint8_t Pending;
+	SPI_TRANSFER_MODE Mode;
+	uint8_t* TxPtr;
+	uint8_t* RxPtr;
+	uint16_t DataSize;
+	uint32_t DoneTime;
+}SIM_SPI_TRANSFER;
+
+
+typedef struct
+{
+	SIM_CONTROLLER_STATE State;
+	uint32_t BootTime;
+	uint32_t BusyEndTime; /* Headers are answered not ready until this time (us) */
+	uint8_t Selected; /* Chip select asserted by a master header */
+	uint8_t IRQPin;
+	SIM_SPI_TRANSFER Transfer;
+	uint16_t InputSize;
+	uint8_t Input[SIM_INPUT_BUFFER_SIZE];
+	uint8_t OutputHead;
+	uint8_t OutputCount;
+	SIM_PACKET Output[SIM_OUTPUT_QUEUE_SIZE];
+	uint8_t ConfigData[SIM_CONFIG_DATA_SIZE];
+}SIM_CONTROLLER;
+
+
+/****************************************************************/
+/* Static functions declaration                                 */
+/****************************************************************/
+static void Sim_Slave_Header( uint8_t* RxPtr, uint16_t DataSize );
+static void Sim_Transfer_Complete( void );
+static void Sim_Update_IRQ_Pin( void );
+static void Sim_Parse_Input( void );
+static void Sim_Command( HCI_COMMAND_PCKT* CmdPacketPtr );
+static void Sim_ACL_Data( HCI_ACL_DATA_PCKT* DataPacketPtr );
+static void Sim_Command_Complete( uint16_t OpCode, uint8_t* ReturnPtr, uint8_t ReturnSize );
+static void Sim_Command_Status( uint16_t OpCode, CONTROLLER_ERROR_CODES Status );
+static uint8_t Sim_Push_Event( EVENT_CODE EventCode, uint8_t* ParamPtr, uint8_t ParamSize, uint32_t DelayUs );
+static SIM_PACKET* Sim_Get_Available_Packet( void );
+static void Sim_Supported_Commands( SUPPORTED_COMMANDS* CmdsPtr );
+
+
+/****************************************************************/
+/* Global variables definition                                  */
+/****************************************************************/
+GPIO_TypeDef Sim_GPIO_Ports[4];
+SysTick_Type Sim_SysTick = { .LOAD = ( 48000000UL / ( 1000000UL / SIM_TICK_PERIOD_US ) ) - 1 }; /* As HAL_InitTick() */
+SCB_Type Sim_SCB; /* The SysTick interrupt runs as soon as it is due, it is never pending */
+__IO uint32_t uwTick;
+HAL_TickFreqTypeDef uwTickFreq = HAL_TICK_FREQ_DEFAULT;
+
+
+/****************************************************************/
+/* Local variables definition                                   */
+/****************************************************************/
+static SIM_CONTROLLER Controller;
+static BLUENRG_SIM_STATISTICS Statistics;
+static uint32_t SimTimeUs = 0;
+static uint32_t NextTickUs = SIM_TICK_PERIOD_US;
+static uint8_t CommandCredits = SIM_NUM_HCI_COMMAND_PACKETS;
+static uint32_t BusyTimeUs = 0;
+static uint8_t ACLLoopback = FALSE; /* The ACL data packets written by the host are sent back */
+
+
+/****************************************************************/
+/* Clr_Bluenrg_Reset_Pin()                                    	*/
+/* Purpose: Put the simulated controller in reset state	    	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Clr_Bluenrg_Reset_Pin(void)
+{
+	Controller.State = SIM_IN_RESET;
+	Controller.Selected = FALSE;
+	Controller.IRQPin = FALSE;
+	Controller.InputSize = 0;
+	Controller.OutputHead = 0;
+	Controller.OutputCount = 0;
+}
+
+
+/****************************************************************/
+/* Set_Bluenrg_Reset_Pin()                                    	*/
+/* Purpose: Release the simulated controller from reset   		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Set_Bluenrg_Reset_Pin(void)
+{
+	if( Controller.State == SIM_IN_RESET )
+	{
+		Controller.State = SIM_BOOTING;
+		Controller.BootTime = SimTimeUs + SIM_BOOT_TIME_US;
+	}
+}
+
+
+/****************************************************************/
+/* Get_Bluenrg_IRQ_Pin()         	                            */
+/* Purpose: Get IRQ pin state				    		    	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+uint8_t Get_Bluenrg_IRQ_Pin(void)
+{
+	return ( Controller.IRQPin );
+}
+
+
+/****************************************************************/
+/* Release_Bluenrg()        	    		                    */
+/* Purpose: Release (unselect) Bluenrg SPI port.	    		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Release_Bluenrg(void)
+{
+	Controller.Selected = FALSE;
+}
+
+
+/****************************************************************/
+/* Bluenrg_Abort_Transfer()        	    		                */
+/* Purpose: Abort any ongoing SPI transfer.			    		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Bluenrg_Abort_Transfer(void)
+{
+	Controller.Transfer.Pending = FALSE;
+}
+
+
+/****************************************************************/
+/* Bluenrg_Send_Frame()            					        	*/
+/* Purpose: Start a simulated SPI DMA transfer.	    			*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The transfer completes from Bluenrg_Sim_Run() 	*/
+/* after the time the bytes take on the bus, like the DMA 		*/
+/* complete interrupt does on the target.						*/
+/****************************************************************/
+uint8_t Bluenrg_Send_Frame(SPI_TRANSFER_MODE Mode, uint8_t* TxPtr, uint8_t* RxPtr, uint16_t DataSize)
+{
+	if( ( Controller.Transfer.Pending ) || ( DataSize == 0 ) )
+	{
+		return (FALSE); /* HAL_BUSY */
+	}
+
+	uint32_t BusTime = ( ( (uint64_t)DataSize * 8UL * 1000000UL ) + BLUENRG_SIM_SPI_CLOCK_HZ - 1 ) / BLUENRG_SIM_SPI_CLOCK_HZ;
+
+	if( ( Mode == SPI_HEADER_READ ) || ( Mode == SPI_HEADER_WRITE ) )
+	{
+		/* The master header asserts the chip select and the slave header is clocked back */
+		Controller.Selected = TRUE;
+
+		if( TxPtr[0] == CTRL_WRITE )
+		{
+			Statistics.HeaderWrites++;
+		}else
+		{
+			Statistics.HeaderReads++;
+		}
+
+		Sim_Slave_Header( RxPtr, DataSize );
+	}
+
+	Controller.Transfer.Mode = Mode;
+	Controller.Transfer.TxPtr = TxPtr;
+	Controller.Transfer.RxPtr = RxPtr;
+	Controller.Transfer.DataSize = DataSize;
+	Controller.Transfer.DoneTime = SimTimeUs + BusTime;
+	Controller.Transfer.Pending = TRUE;
+
+	Statistics.BusTimeUs += BusTime;
+
+	return (TRUE);
+}
+
+
+/****************************************************************/
+/* Bluenrg_Error()               	                            */
+/* Purpose: Called whenever the device has a problem	  		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Bluenrg_Error(BLUENRG_ERROR_CODES Errorcode)
+{
+	Statistics.DriverErrors++;
+	Reset_Bluenrg( TRUE );
+}
+
+
+/****************************************************************/
+/* Bluenrg_Sim_Run()               	                            */
+/* Purpose: Advance the simulation by one main loop pass		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Runs, in this order, the SysTick, the controller*/
+/* firmware, the DMA complete and the EXTI "interrupts".		*/
+/****************************************************************/
+void Bluenrg_Sim_Run( void )
+{
+	SimTimeUs += BLUENRG_SIM_MAIN_LOOP_TIME_US;
+
+	while( (int32_t)( SimTimeUs - NextTickUs ) >= 0 )
+	{
+		NextTickUs += SIM_TICK_PERIOD_US;
+		/* Reloaded before the interrupt, which also reads the time */
+		Sim_SysTick.VAL = ( NextTickUs - SimTimeUs ) * ( HAL_RCC_GetHCLKFreq() / 1000000UL ) - 1;
+		HAL_IncTick();
+	}
+
+	/* The down counter holds the cycles left until the next tick */
+	Sim_SysTick.VAL = ( NextTickUs - SimTimeUs ) * ( HAL_RCC_GetHCLKFreq() / 1000000UL ) - 1;
+
+	if( ( Controller.State == SIM_BOOTING ) && ( (int32_t)( SimTimeUs - Controller.BootTime ) >= 0 ) )
+	{
+		uint8_t Param[3] = { EVT_BLUE_INITIALIZED_EVENT_CODE & 0xFF, EVT_BLUE_INITIALIZED_EVENT_CODE >> 8, FIRMWARE_STARTED_PROPERLY };
+
+		Controller.State = SIM_RUNNING;
+		Sim_Push_Event( VENDOR_SPECIFIC, &Param[0], sizeof(Param), 0 );
+	}
+
+	if( ( Controller.Transfer.Pending ) && ( (int32_t)( SimTimeUs - Controller.Transfer.DoneTime ) >= 0 ) )
+	{
+		Sim_Transfer_Complete();
+	}
+
+	Sim_Update_IRQ_Pin();
+}
+
+
+/****************************************************************/
+/* Bluenrg_Sim_Get_Time_Us()                                    */
+/* Purpose: Return the simulated time in microseconds			*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+uint32_t Bluenrg_Sim_Get_Time_Us( void )
+{
+	return ( SimTimeUs );
+}
+
+
+/****************************************************************/
+/* Bluenrg_Sim_Push_Packet()                                    */
+/* Purpose: Inject a packet (packet type byte included) to be	*/
+/* read by the host after DelayUs.								*/
+/* Parameters: none				         						*/
+/* Return: TRUE if the packet was queued.						*/
+/* Description: Used to emulate remote activity, like bursts of */
+/* advertising reports or incoming ACL data.					*/
+/****************************************************************/
+uint8_t Bluenrg_Sim_Push_Packet( uint8_t* PacketPtr, uint16_t Size, uint32_t DelayUs )
+{
+	if( ( Size == 0 ) || ( Size > SIM_MAX_PACKET_SIZE ) || ( Controller.OutputCount >= SIM_OUTPUT_QUEUE_SIZE ) )
+	{
+		return (FALSE);
+	}
+
+	SIM_PACKET* PacketDescPtr = &Controller.Output[ ( Controller.OutputHead + Controller.OutputCount ) % SIM_OUTPUT_QUEUE_SIZE ];
+
+	PacketDescPtr->DueTime = SimTimeUs + DelayUs;
+	PacketDescPtr->Size = Size;
+	PacketDescPtr->ReadOffset = 0;
+	memcpy( &PacketDescPtr->Bytes[0], PacketPtr, Size );
+
+	Controller.OutputCount++;
+
+	return (TRUE);
+}
+
+
+/****************************************************************/
+/* Bluenrg_Sim_Get_Statistics()                                 */
+/* Purpose: Return the simulation counters						*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+BLUENRG_SIM_STATISTICS* Bluenrg_Sim_Get_Statistics( void )
+{
+	return ( &Statistics );
+}
+
+
+/****************************************************************/
+/* Bluenrg_Sim_Clear_Statistics()                               */
+/* Purpose: Clear the simulation counters						*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Bluenrg_Sim_Clear_Statistics( void )
+{
+	memset( &Statistics, 0, sizeof(Statistics) );
+}
+
+
+/****************************************************************/
+/* Bluenrg_Sim_Set_Command_Credits()                            */
+/* Purpose: Set the Num_HCI_Command_Packets of the responses	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Every command is answered after the same 		*/
+/* latency whatever the number of commands being processed, so	*/
+/* this is the number of commands the controller works on at 	*/
+/* the same time.												*/
+/****************************************************************/
+void Bluenrg_Sim_Set_Command_Credits( uint8_t Credits )
+{
+	CommandCredits = Credits;
+}
+
+
+/****************************************************************/
+/* Bluenrg_Sim_Set_Busy_Time()		                            */
+/* Purpose: Set the time the controller is not ready after		*/
+/* each packet written by the host								*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Bluenrg_Sim_Set_Busy_Time( uint32_t TimeUs )
+{
+	BusyTimeUs = TimeUs;
+}
+
+
+/****************************************************************/
+/* Bluenrg_Sim_Set_ACL_Loopback()	                            */
+/* Purpose: Send back each ACL data packet written by the host	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The packet comes back as if sent by the peer,	*/
+/* so a start fragment is flagged as automatically flushable.	*/
+/****************************************************************/
+void Bluenrg_Sim_Set_ACL_Loopback( uint8_t Loopback )
+{
+	ACLLoopback = Loopback;
+}
+
+
+/****************************************************************/
+/* Sim_Slave_Header()               	                        */
+/* Purpose: Build the slave header answered to a master header	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Sim_Slave_Header( uint8_t* RxPtr, uint16_t DataSize )
+{
+	uint8_t Header[5] = { DEVICE_NOT_READY, 0, 0, 0, 0 };
+
+	if( ( Controller.State == SIM_RUNNING ) && ( (int32_t)( SimTimeUs - Controller.BusyEndTime ) >= 0 ) )
+	{
+		SIM_PACKET* PacketDescPtr = Sim_Get_Available_Packet();
+		uint16_t Free = SIM_INPUT_BUFFER_SIZE - Controller.InputSize;
+
+		Header[0] = DEVICE_READY;
+		Header[1] = MIN( Free, SIM_MAX_WBUF ); /* WBUF */
+		Header[3] = ( PacketDescPtr != NULL ) ? MIN( PacketDescPtr->Size - PacketDescPtr->ReadOffset, 255 ) : 0; /* RBUF */
+	}else
+	{
+		Statistics.NotReadyHeaders++;
+	}
+
+	memcpy( RxPtr, &Header[0], MIN( DataSize, sizeof(Header) ) );
+}
+
+
+/****************************************************************/
+/* Sim_Transfer_Complete()               	                    */
+/* Purpose: Finish the ongoing transfer, like the DMA complete	*/
+/* callbacks in BLE_HAL.c.										*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Sim_Transfer_Complete( void )
+{
+	SIM_SPI_TRANSFER* TransferPtr = &Controller.Transfer;
+
+	TransferPtr->Pending = FALSE;
+
+	switch( TransferPtr->Mode )
+	{
+	case SPI_WRITE:
+		Statistics.PayloadWrites++;
+		Statistics.BytesWritten += TransferPtr->DataSize;
+
+		if( ( !Controller.Selected ) || ( Controller.State != SIM_RUNNING ) ||
+				( TransferPtr->DataSize > ( SIM_INPUT_BUFFER_SIZE - Controller.InputSize ) ) )
+		{
+			/* Bytes clocked without a valid header or above WBUF are lost */
+			Statistics.ProtocolErrors++;
+		}else
+		{
+			memcpy( &Controller.Input[Controller.InputSize], TransferPtr->TxPtr, TransferPtr->DataSize );
+			Controller.InputSize += TransferPtr->DataSize;
+			Sim_Parse_Input();
+		}
+		break;
+
+	case SPI_READ:
+	{
+		SIM_PACKET* PacketDescPtr = Sim_Get_Available_Packet();
+		uint16_t Size = 0;
+
+		Statistics.PayloadReads++;
+		Statistics.BytesRead += TransferPtr->DataSize;
+
+		if( ( !Controller.Selected ) || ( PacketDescPtr == NULL ) )
+		{
+			Statistics.ProtocolErrors++;
+		}else
+		{
+			Size = MIN( TransferPtr->DataSize, PacketDescPtr->Size - PacketDescPtr->ReadOffset );
+			memcpy( TransferPtr->RxPtr, &PacketDescPtr->Bytes[PacketDescPtr->ReadOffset], Size );
+			PacketDescPtr->ReadOffset += Size;
+
+			if( PacketDescPtr->ReadOffset >= PacketDescPtr->Size )
+			{
+				Controller.OutputHead = ( Controller.OutputHead + 1 ) % SIM_OUTPUT_QUEUE_SIZE;
+				Controller.OutputCount--;
+				Statistics.PacketsSent++;
+			}
+		}
+
+		/* Bytes read beyond RBUF are clocked as zeros */
+		memset( &TransferPtr->RxPtr[Size], 0, TransferPtr->DataSize - Size );
+	}
+	break;
+
+	default:
+		break;
+	}
+
+	/* HAL_SPI_TxCpltCallback() and HAL_SPI_TxRxCpltCallback() */
+	Bluenrg_Frame_Status( TRANSFER_DONE );
+}
+
+
+/****************************************************************/
+/* Sim_Update_IRQ_Pin()               	                        */
+/* Purpose: Update the IRQ pin and raise the EXTI interrupt		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The pin is set while a packet is waiting to be 	*/
+/* read and the SPI is not selected. Only the rising edge 		*/
+/* triggers the interrupt, like the EXTI line configuration.	*/
+/****************************************************************/
+static void Sim_Update_IRQ_Pin( void )
+{
+	uint8_t PinState = ( !Controller.Selected ) && ( Sim_Get_Available_Packet() != NULL );
+
+	if( ( PinState ) && ( !Controller.IRQPin ) )
+	{
+		Controller.IRQPin = TRUE;
+		Statistics.IRQEdges++;
+		HAL_GPIO_EXTI_Callback( BLE_IRQ_Pin );
+	}else
+	{
+		Controller.IRQPin = PinState;
+	}
+}
+
+
+/****************************************************************/
+/* Sim_Get_Available_Packet()               	                */
+/* Purpose: Return the packet the host can read now, if any		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static SIM_PACKET* Sim_Get_Available_Packet( void )
+{
+	if( ( Controller.State == SIM_RUNNING ) && ( Controller.OutputCount != 0 ) )
+	{
+		SIM_PACKET* PacketDescPtr = &Controller.Output[Controller.OutputHead];
+
+		if( (int32_t)( SimTimeUs - PacketDescPtr->DueTime ) >= 0 )
+		{
+			return ( PacketDescPtr );
+		}
+	}
+
+	return ( NULL );
+}
+
+
+/****************************************************************/
+/* Sim_Parse_Input()               	          		            */
+/* Purpose: Consume complete packets written by the host		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Sim_Parse_Input( void )
+{
+	uint16_t PacketSize;
+
+	while( Controller.InputSize != 0 )
+	{
+		switch( Controller.Input[0] )
+		{
+		case HCI_COMMAND_PACKET:
+			if( Controller.InputSize < sizeof(HCI_SERIAL_COMMAND_PCKT) )
+			{
+				return;
+			}
+			PacketSize = sizeof(HCI_SERIAL_COMMAND_PCKT) + Controller.Input[3];
+			break;
+
+		case HCI_ACL_DATA_PACKET:
+			if( Controller.InputSize < sizeof(HCI_SERIAL_ACL_DATA_PCKT) )
+			{
+				return;
+			}
+			PacketSize = sizeof(HCI_SERIAL_ACL_DATA_PCKT) + ( ( Controller.Input[4] << 8 ) | Controller.Input[3] );
+			break;
+
+		default:
+			/* Unknown packet type: the stream is lost */
+			Statistics.ProtocolErrors++;
+			Controller.InputSize = 0;
+			return;
+		}
+
+		if( Controller.InputSize < PacketSize )
+		{
+			return; /* Wait for the remaining bytes */
+		}
+
+		if( Controller.Input[0] == HCI_COMMAND_PACKET )
+		{
+			Statistics.CommandsReceived++;
+			Sim_Command( (HCI_COMMAND_PCKT*)( &Controller.Input[1] ) );
+		}else
+		{
+			Statistics.ACLPacketsReceived++;
+			Sim_ACL_Data( (HCI_ACL_DATA_PCKT*)( &Controller.Input[1] ) );
+		}
+
+		Controller.BusyEndTime = SimTimeUs + BusyTimeUs;
+
+		Controller.InputSize -= PacketSize;
+		memmove( &Controller.Input[0], &Controller.Input[PacketSize], Controller.InputSize );
+	}
+}
+
+
+/****************************************************************/
+/* Sim_Command()               	          		             	*/
+/* Purpose: Answer an HCI command as a BlueNRG-MS (version 4.1)	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Commands not known by a 4.1 controller (as the	*/
+/* resolving list ones) are answered with UNKNOWN_HCI_COMMAND, 	*/
+/* which makes the host emulate them (hosted_functions.c).		*/
+/****************************************************************/
+static void Sim_Command( HCI_COMMAND_PCKT* CmdPacketPtr )
+{
+	uint8_t Return[1 + 64]; /* Status + largest return parameters */
+	uint8_t* Param = &CmdPacketPtr->Parameter[0];
+	uint16_t OpCode = CmdPacketPtr->OpCode.Val;
+
+	memset( &Return[0], 0, sizeof(Return) );
+	Return[0] = COMMAND_SUCCESS;
+
+	switch( OpCode )
+	{
+	case HCI_RESET:
+	{
+		/* The BlueNRG-MS restarts its firmware and signals it again */
+		uint8_t Initialized[3] = { EVT_BLUE_INITIALIZED_EVENT_CODE & 0xFF, EVT_BLUE_INITIALIZED_EVENT_CODE >> 8, FIRMWARE_STARTED_PROPERLY };
+		Sim_Command_Complete( OpCode, &Return[0], 1 );
+		Sim_Push_Event( VENDOR_SPECIFIC, &Initialized[0], sizeof(Initialized), BLUENRG_SIM_CMD_LATENCY_US );
+	}
+	break;
+
+	case HCI_READ_LOCAL_SUPPORTED_COMMANDS:
+		Sim_Supported_Commands( (SUPPORTED_COMMANDS*)( &Return[1] ) );
+		Sim_Command_Complete( OpCode, &Return[0], 1 + 64 );
+		break;
+
+	case HCI_READ_LOCAL_SUPPORTED_FEATURES:
+		Return[1 + 4] = 0x60; /* BR/EDR Not Supported and LE Supported (Controller) */
+		Sim_Command_Complete( OpCode, &Return[0], 1 + 8 );
+		break;
+
+	case HCI_READ_LOCAL_VERSION_INFORMATION:
+	{
+		LOCAL_VERSION_INFORMATION* InfoPtr = (LOCAL_VERSION_INFORMATION*)( &Return[1] );
+		InfoPtr->HCI_Version = CORE_SPEC_4_1;
+		InfoPtr->HCI_Revision = 0x3110;
+		InfoPtr->LMP_PAL_Version = CORE_SPEC_4_1;
+		InfoPtr->Manufacturer_Name = 0x0030; /* STMicroelectronics */
+		InfoPtr->LMP_PAL_Subversion = 0x7315;
+		Sim_Command_Complete( OpCode, &Return[0], 1 + sizeof(LOCAL_VERSION_INFORMATION) );
+	}
+	break;
+
+	case HCI_READ_BD_ADDR:
+		memcpy( &Return[1], &Controller.ConfigData[0], sizeof(BD_ADDR_TYPE) ); /* Public address is at offset 0x00 */
+		Sim_Command_Complete( OpCode, &Return[0], 1 + sizeof(BD_ADDR_TYPE) );
+		break;
+
+	case HCI_READ_RSSI:
+	case HCI_READ_TRANSMIT_POWER_LEVEL:
+		memcpy( &Return[1], Param, 2 ); /* Connection_Handle */
+		Return[3] = (uint8_t)( -60 );
+		Sim_Command_Complete( OpCode, &Return[0], 1 + 3 );
+		break;
+
+	case HCI_LE_READ_BUFFER_SIZE:
+		Return[1] = SIM_LE_ACL_DATA_PACKET_LENGTH & 0xFF;
+		Return[2] = SIM_LE_ACL_DATA_PACKET_LENGTH >> 8;
+		Return[3] = SIM_TOTAL_NUM_LE_ACL_PACKETS;
+		Sim_Command_Complete( OpCode, &Return[0], 1 + 3 );
+		break;
+
+	case HCI_LE_READ_LOCAL_SUPPORTED_FEATURES:
+		Return[1] = 0x01; /* LE Encryption */
+		Sim_Command_Complete( OpCode, &Return[0], 1 + 8 );
+		break;
+
+	case HCI_LE_READ_SUPPORTED_STATES:
+		memset( &Return[1], 0xFF, 5 );
+		Sim_Command_Complete( OpCode, &Return[0], 1 + 8 );
+		break;
+
+	case HCI_LE_READ_ADV_PHY_CHANNEL_TX_POWER:
+		Return[1] = 8; /* dBm */
+		Sim_Command_Complete( OpCode, &Return[0], 1 + 1 );
+		break;
+
+	case HCI_LE_READ_WHITE_LIST_SIZE:
+		Return[1] = 8;
+		Sim_Command_Complete( OpCode, &Return[0], 1 + 1 );
+		break;
+
+	case HCI_LE_READ_CHANNEL_MAP:
+		memcpy( &Return[1], Param, 2 ); /* Connection_Handle */
+		memset( &Return[3], 0xFF, 4 );
+		Return[7] = 0x1F;
+		Sim_Command_Complete( OpCode, &Return[0], 1 + 7 );
+		break;
+
+	case HCI_LE_LONG_TERM_KEY_REQUEST_REPLY:
+	case HCI_LE_LONG_TERM_KEY_RQT_NEG_REPLY:
+		memcpy( &Return[1], Param, 2 ); /* Connection_Handle */
+		Sim_Command_Complete( OpCode, &Return[0], 1 + 2 );
+		break;
+
+	case HCI_LE_RAND:
+		for( uint8_t i = 1; i <= 8; i++ )
+		{
+			Return[i] = rand() & 0xFF;
+		}
+		Sim_Command_Complete( OpCode, &Return[0], 1 + 8 );
+		break;
+
+	case HCI_LE_ENCRYPT:
+		/* Same byte order used by the host: Key followed by Plaintext_Data */
+		AES_128_Encrypt_Block( &Param[0], &Param[16], &Return[1] );
+		Sim_Command_Complete( OpCode, &Return[0], 1 + 16 );
+		break;
+
+	case HCI_LE_TEST_END:
+		Sim_Command_Complete( OpCode, &Return[0], 1 + 2 );
+		break;
+
+	case HCI_DISCONNECT:
+	{
+		uint8_t Disconnection[4] = { COMMAND_SUCCESS, Param[0], Param[1], CONNECTION_TERMINATED_BY_LOCAL_HOST };
+		Sim_Command_Status( OpCode, COMMAND_SUCCESS );
+		Sim_Push_Event( DISCONNECTION_COMPLETE, &Disconnection[0], sizeof(Disconnection), BLUENRG_SIM_ACL_LATENCY_US );
+	}
+	break;
+
+	case HCI_READ_REMOTE_VERSION_INFORMATION:
+	case HCI_LE_CREATE_CONNECTION:
+	case HCI_LE_CONNECTION_UPDATE:
+	case HCI_LE_READ_REMOTE_FEATURES:
+	case HCI_LE_ENABLE_ENCRYPTION:
+		Sim_Command_Status( OpCode, COMMAND_SUCCESS );
+		break;
+
+	case VS_ACI_HAL_WRITE_CONFIG_DATA:
+		if( ( (uint16_t)Param[0] + Param[1] ) <= SIM_CONFIG_DATA_SIZE )
+		{
+			memcpy( &Controller.ConfigData[Param[0]], &Param[2], Param[1] );
+		}else
+		{
+			Return[0] = INVALID_HCI_COMMAND_PARAMETERS;
+		}
+		Sim_Command_Complete( OpCode, &Return[0], 1 );
+		break;
+
+	case VS_ACI_HAL_READ_CONFIG_DATA:
+	{
+		uint8_t Size;
+
+		switch( Param[0] )
+		{
+		case 0x00: Size = 6;  break; /* Public address */
+		case 0x06: Size = 2;  break; /* DIV */
+		case 0x08: Size = 16; break; /* ER */
+		case 0x18: Size = 16; break; /* IR */
+		default:   Size = 1;  break; /* LLWITHOUTHOST and ROLE */
+		}
+
+		memcpy( &Return[1], &Controller.ConfigData[Param[0]], MIN( Size, SIM_CONFIG_DATA_SIZE - Param[0] ) );
+		Sim_Command_Complete( OpCode, &Return[0], 1 + Size );
+	}
+	break;
+
+	case VS_ACI_HAL_GET_FW_BUILD_NUMBER:
+		Return[1] = 0x07;
+		Return[2] = 0x02;
+		Sim_Command_Complete( OpCode, &Return[0], 1 + 2 );
+		break;
+
+	case HCI_LE_ADD_DEVICE_TO_RESOLVING_LIST:
+	case HCI_LE_REMOVE_DEVICE_FROM_RESOLVING_LIST:
+	case HCI_LE_CLEAR_RESOLVING_LIST:
+	case HCI_LE_READ_RESOLVING_LIST_SIZE:
+	case HCI_LE_READ_PEER_RESOLVABLE_ADDRESS:
+	case HCI_LE_READ_LOCAL_RESOLVABLE_ADDRESS:
+	case HCI_LE_SET_ADDRESS_RESOLUTION_ENABLE:
+	case HCI_LE_SET_RESOLVABLE_PRIVATE_ADDRESS_TIMEOUT:
+		Sim_Command_Status( OpCode, UNKNOWN_HCI_COMMAND );
+		break;
+
+	default:
+		/* All remaining commands only return the status */
+		Sim_Command_Complete( OpCode, &Return[0], 1 );
+		break;
+	}
+}
+
+
+/****************************************************************/
+/* Sim_ACL_Data()               	          		            */
+/* Purpose: Consume an ACL data packet sent by the host			*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The packet is reported as transmitted after		*/
+/* BLUENRG_SIM_ACL_LATENCY_US.									*/
+/****************************************************************/
+static void Sim_ACL_Data( HCI_ACL_DATA_PCKT* DataPacketPtr )
+{
+	uint8_t Param[5];
+	uint16_t Handle = DataPacketPtr->Header.Handle;
+	uint8_t Packet[1 + sizeof(HCI_ACL_DATA_PCKT_HEADER) + SIM_LE_ACL_DATA_PACKET_LENGTH];
+
+	if( ( ACLLoopback ) && ( DataPacketPtr->Header.Data_Total_Length <= SIM_LE_ACL_DATA_PACKET_LENGTH ) )
+	{
+		Packet[0] = HCI_ACL_DATA_PACKET;
+		memcpy( &Packet[1], DataPacketPtr, sizeof(HCI_ACL_DATA_PCKT_HEADER) + DataPacketPtr->Header.Data_Total_Length );
+		( (HCI_ACL_DATA_PCKT*)( &Packet[1] ) )->Header.PB_Flag = ( DataPacketPtr->Header.PB_Flag == 0x1 ) ? 0x1 : 0x2;
+		Bluenrg_Sim_Push_Packet( &Packet[0], 1 + sizeof(HCI_ACL_DATA_PCKT_HEADER) + DataPacketPtr->Header.Data_Total_Length,
+				BLUENRG_SIM_ACL_LATENCY_US );
+	}
+
+	Param[0] = 1; /* Num_Handles */
+	Param[1] = Handle & 0xFF;
+	Param[2] = Handle >> 8;
+	Param[3] = 1; /* Num_Completed_Packets */
+	Param[4] = 0;
+
+	Sim_Push_Event( NUMBER_OF_COMPLETED_PACKETS, &Param[0], sizeof(Param), BLUENRG_SIM_ACL_LATENCY_US );
+}
+
+
+/****************************************************************/
+/* Sim_Command_Complete()               	          	        */
+/* Purpose: Queue an HCI_Command_Complete event					*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Sim_Command_Complete( uint16_t OpCode, uint8_t* ReturnPtr, uint8_t ReturnSize )
+{
+	uint8_t Param[3 + sizeof( ((SUPPORTED_COMMANDS*)(NULL))->Bytes ) + 1];
+
+	Param[0] = CommandCredits;
+	Param[1] = OpCode & 0xFF;
+	Param[2] = OpCode >> 8;
+	memcpy( &Param[3], ReturnPtr, ReturnSize );
+
+	Sim_Push_Event( COMMAND_COMPLETE, &Param[0], 3 + ReturnSize, BLUENRG_SIM_CMD_LATENCY_US );
+}
+
+
+/****************************************************************/
+/* Sim_Command_Status()               	          	      		*/
+/* Purpose: Queue an HCI_Command_Status event					*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Sim_Command_Status( uint16_t OpCode, CONTROLLER_ERROR_CODES Status )
+{
+	uint8_t Param[4];
+
+	Param[0] = Status;
+	Param[1] = CommandCredits;
+	Param[2] = OpCode & 0xFF;
+	Param[3] = OpCode >> 8;
+
+	Sim_Push_Event( COMMAND_STATUS, &Param[0], sizeof(Param), BLUENRG_SIM_CMD_LATENCY_US );
+}
+
+
+/****************************************************************/
+/* Sim_Push_Event()               	          	      			*/
+/* Purpose: Queue an HCI event packet for the host				*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static uint8_t Sim_Push_Event( EVENT_CODE EventCode, uint8_t* ParamPtr, uint8_t ParamSize, uint32_t DelayUs )
+{
+	uint8_t Packet[SIM_MAX_PACKET_SIZE];
+
+	Packet[0] = HCI_EVENT_PACKET;
+	Packet[1] = EventCode;
+	Packet[2] = ParamSize;
+	memcpy( &Packet[3], ParamPtr, ParamSize );
+
+	return ( Bluenrg_Sim_Push_Packet( &Packet[0], 3 + ParamSize, DelayUs ) );
+}
+
+
+/****************************************************************/
+/* Sim_Supported_Commands()               	          	      	*/
+/* Purpose: Fill the supported commands of the BlueNRG-MS		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Sim_Supported_Commands( SUPPORTED_COMMANDS* CmdsPtr )
+{
+	memset( CmdsPtr, 0, sizeof(SUPPORTED_COMMANDS) );
+
+	CmdsPtr->Bits.HCI_Disconnect = 1;
+	CmdsPtr->Bits.HCI_Read_Remote_Version_Information = 1;
+	CmdsPtr->Bits.HCI_Set_Event_Mask = 1;
+	CmdsPtr->Bits.HCI_Reset = 1;
+	CmdsPtr->Bits.HCI_Read_Transmit_Power_Level = 1;
+	CmdsPtr->Bits.HCI_Read_Local_Version_Information = 1;
+	CmdsPtr->Bits.HCI_Read_Local_Supported_Features = 1;
+	CmdsPtr->Bits.HCI_Read_BD_ADDR = 1;
+	CmdsPtr->Bits.HCI_Read_RSSI = 1;
+	CmdsPtr->Bits.HCI_LE_Set_Event_Mask = 1;
+	CmdsPtr->Bits.HCI_LE_Read_Buffer_Size_v1 = 1;
+	CmdsPtr->Bits.HCI_LE_Read_Local_Supported_Features = 1;
+	CmdsPtr->Bits.HCI_LE_Set_Random_Address = 1;
+	CmdsPtr->Bits.HCI_LE_Set_Advertising_Parameters = 1;
+	CmdsPtr->Bits.HCI_LE_Read_Advertising_Physical_Channel_Tx_Power = 1;
+	CmdsPtr->Bits.HCI_LE_Set_Advertising_Data = 1;
+	CmdsPtr->Bits.HCI_LE_Set_Scan_Response_Data = 1;
+	CmdsPtr->Bits.HCI_LE_Set_Advertising_Enable = 1;
+	CmdsPtr->Bits.HCI_LE_Set_Scan_Parameters = 1;
+	CmdsPtr->Bits.HCI_LE_Set_Scan_Enable = 1;
+	CmdsPtr->Bits.HCI_LE_Create_Connection = 1;
+	CmdsPtr->Bits.HCI_LE_Create_Connection_Cancel = 1;
+	CmdsPtr->Bits.HCI_LE_Read_White_List_Size = 1;
+	CmdsPtr->Bits.HCI_LE_Clear_White_List = 1;
+	CmdsPtr->Bits.HCI_LE_Add_Device_To_White_List = 1;
+	CmdsPtr->Bits.HCI_LE_Remove_Device_From_White_List = 1;
+	CmdsPtr->Bits.HCI_LE_Connection_Update = 1;
+	CmdsPtr->Bits.HCI_LE_Set_Host_Channel_Classification = 1;
+	CmdsPtr->Bits.HCI_LE_Read_Channel_Map = 1;
+	CmdsPtr->Bits.HCI_LE_Read_Remote_Features = 1;
+	CmdsPtr->Bits.HCI_LE_Encrypt = 1;
+	CmdsPtr->Bits.HCI_LE_Rand = 1;
+	CmdsPtr->Bits.HCI_LE_Enable_Encryption = 1;
+	CmdsPtr->Bits.HCI_LE_Long_Term_Key_Request_Reply = 1;
+	CmdsPtr->Bits.HCI_LE_Long_Term_Key_Request_Negative_Reply = 1;
+	CmdsPtr->Bits.HCI_LE_Read_Supported_States = 1;
+	CmdsPtr->Bits.HCI_LE_Receiver_Test_v1 = 1;
+	CmdsPtr->Bits.HCI_LE_Transmitter_Test_v1 = 1;
+	CmdsPtr->Bits.HCI_LE_Test_End = 1;
+}
+
+
+/****************************************************************/
+/* HAL_GPIO_WritePin()               	          	      		*/
+/* Purpose: Set or clear an output pin							*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Only the output latch is kept (heart beat LED).	*/
+/****************************************************************/
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+	if( PinState != GPIO_PIN_RESET )
+	{
+		GPIOx->ODR |= GPIO_Pin;
+	}else
+	{
+		GPIOx->ODR &= ~GPIO_Pin;
+	}
+}
+
+
+/****************************************************************/
+/* HAL_GPIO_TogglePin()               	          	      		*/
+/* Purpose: Toggle an output pin								*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void HAL_GPIO_TogglePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+	GPIOx->ODR ^= GPIO_Pin;
+}
+
+
+/****************************************************************/
+/* HAL_GetTick()               	          	      				*/
+/* Purpose: SysTick counter										*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+uint32_t HAL_GetTick(void)
+{
+	return ( uwTick );
+}
+
+
+/****************************************************************/
+/* HAL_RCC_GetHCLKFreq()               	          	      		*/
+/* Purpose: Core clock frequency								*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+uint32_t HAL_RCC_GetHCLKFreq(void)
+{
+	return ( 48000000UL );
+}
+
+
+/****************************************************************/
+/* SystemCoreClockUpdate()               	          	      	*/
+/* Purpose: Nothing to update on the host						*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void SystemCoreClockUpdate(void)
+{
+}
+
+
+#endif /* BLE_HAL_SIMULATION */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
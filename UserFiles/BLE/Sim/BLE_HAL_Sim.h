@@ -0,0 +1,63 @@
+
+
+#ifndef BLE_HAL_SIM_H_
+#define BLE_HAL_SIM_H_
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include "BLE_HAL.h"
+
+
+/****************************************************************/
+/* Type Defines                                                 */
+/****************************************************************/
+typedef struct
+{
+	uint32_t HeaderReads;		 /* CTRL_READ master headers received */
+	uint32_t HeaderWrites;		 /* CTRL_WRITE master headers received */
+	uint32_t NotReadyHeaders;	 /* Headers answered while the controller was not ready */
+	uint32_t PayloadWrites;		 /* SPI_WRITE transfers */
+	uint32_t PayloadReads;		 /* SPI_READ transfers */
+	uint32_t BytesWritten;		 /* Payload bytes from host to controller */
+	uint32_t BytesRead;			 /* Payload bytes from controller to host */
+	uint32_t BusTimeUs;			 /* Time the SPI bus was clocking, in microseconds */
+	uint32_t CommandsReceived;	 /* HCI command packets parsed by the controller */
+	uint32_t ACLPacketsReceived; /* HCI ACL data packets parsed by the controller */
+	uint32_t PacketsSent;		 /* Packets fully read by the host */
+	uint32_t IRQEdges;			 /* Rising edges of the IRQ pin */
+	uint32_t ProtocolErrors;	 /* Transfers that did not respect the header protocol */
+	uint32_t DriverErrors;		 /* Calls to Bluenrg_Error() */
+}BLUENRG_SIM_STATISTICS;
+
+
+/****************************************************************/
+/* External functions declaration (Interface functions)         */
+/****************************************************************/
+void Bluenrg_Sim_Run( void );
+uint32_t Bluenrg_Sim_Get_Time_Us( void );
+uint8_t Bluenrg_Sim_Push_Packet( uint8_t* PacketPtr, uint16_t Size, uint32_t DelayUs );
+BLUENRG_SIM_STATISTICS* Bluenrg_Sim_Get_Statistics( void );
+void Bluenrg_Sim_Clear_Statistics( void );
+void Bluenrg_Sim_Set_Command_Credits( uint8_t Credits );
+void Bluenrg_Sim_Set_Busy_Time( uint32_t TimeUs );
+void Bluenrg_Sim_Set_ACL_Loopback( uint8_t Loopback );
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+
+
+/****************************************************************/
+/* External variables declaration                               */
+/****************************************************************/
+
+
+#endif /* BLE_HAL_SIM_H_ */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
@@ -0,0 +1,449 @@
+
+
+/* Host entry point used when building with BLE_HAL_SIMULATION. It runs the same
+ * main loop as Core/Src/main.c against the simulated BlueNRG-MS:
+ *
+ *   blesim [SECONDS [SCENARIO [ARGUMENTS...]]]
+ *
+ * The stack runs for the simulated seconds given (default 5). A scenario of the
+ * Tests[] table runs at its stage of the run and checks the expected behaviour of
+ * its module, so the exit status is nonzero when a check failed, when the stage
+ * was not reached or when the initial setup was not done. The figures printed by
+ * the scenarios are for the reader, the checks do not depend on them. With "all"
+ * as scenario, every scenario of the table runs with its default arguments in a
+ * process of its own, and the failed ones are listed. */
+#ifdef BLE_HAL_SIMULATION
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include <unistd.h>
+#include <sys/wait.h>
+#include "BLE_Sim_Test.h"
+#include "TimeFunctions.h"
+#include "Bluenrg.h"
+#include "App.h"
+#include "BLE_HAL_Sim.h"
+#include "hosted_functions.h"
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define SIM_DEFAULT_RUN_TIME_S	 5
+#define SIM_LINK_OPEN_TIMEOUT_US 100000UL /* Time given to the connection complete events of the links */
+
+
+/****************************************************************/
+/* Static functions declaration                                 */
+/****************************************************************/
+static uint8_t Run_Test( const SIM_TEST* TestPtr, SIM_ARGS* ArgsPtr, uint32_t RunTimeUs );
+static uint8_t Run_All_Tests( uint32_t RunTimeUs );
+static const SIM_TEST* Find_Test( const char* Name );
+static void Print_Run_Statistics( void );
+static void Print_Usage( void );
+
+
+/****************************************************************/
+/* Local variables definition                                   */
+/****************************************************************/
+static const SIM_TEST Tests[] =
+{
+	/* Bluenrg driver and HCI transport layer */
+	{ "startup", SIM_SETUP_DONE, &Startup_Prepare, &Startup_Test, "[CREDITS=1]: time of BLE_Init() with that many command credits" },
+	{ "queue", SIM_SETUP_DONE, NULL, &Queue_Test, ": flood of advertising reports with the firmware slower and slower, no queue may drop" },
+	{ "trace", SIM_RUN_END, NULL, &Trace_Test, "[FILE=hci_trace.btsnoop]: HCI trace of the run written in btsnoop format" },
+	{ "acl", SIM_STANDBY, &ACL_Prepare, &ACL_Test, "[PACKETS=100 [BUSY_US=0]]: burst of ACL packets, the controller not ready BUSY_US after each one" },
+	{ "rx", SIM_STANDBY, NULL, &RX_Test, "[PACKETS=100 [HOLD_US=1000]]: ACL packets received and held without a copy, the last one leaked" },
+	{ "links", SIM_STANDBY, NULL, &Links_Test, "[LINKS=3]: links always sending, the first one four times as often, must share the credits" },
+	/* L2CAP */
+	{ "l2cap", SIM_STANDBY, NULL, &L2CAP_Test, "[SDUS=100 [SIZE=247]]: SDUs segmented, looped back by the controller and reassembled" },
+	/* GAP */
+	{ "scan", SIM_STANDBY, NULL, &Scan_Test, "[ADVERTISERS=16]: reports filtered by the advertising cache, no data change may be suppressed" },
+	{ "ad", SIM_NO_STACK, NULL, &AD_Test, "[LOOKUPS=4]: AD types looked up with a scan of the payload and with a single index" },
+	{ "adv", SIM_STANDBY, NULL, &Adv_Test, "[ENTRIES=max [RESTARTS=10]]: advertising with privacy started again and again" },
+	/* Privacy */
+	{ "aes", SIM_STANDBY, NULL, &AES_Test, ": HCI_LE_Encrypt results against the software AES-128, and their rates" },
+	{ "sm", SIM_NO_STACK, NULL, &SM_Test, "[ENTRIES=max]: resolving list lookups on flash and on the RAM index" },
+	{ "rpa", SIM_STANDBY, &RPA_Prepare, &RPA_Test, "[ENTRIES=max [ROTATION=0 [CREDITS=1]]]: reports of resolvable private addresses resolved by the host" },
+	{ "list", SIM_STANDBY, &List_Prepare, &List_Test, "[DEVICES=max [CREDITS=1]]: burst of resolving list commands run by the host" },
+	/* Storage */
+	{ "flash", SIM_NO_STACK, NULL, &Flash_Test, ": flash record log with random updates and power losses" },
+};
+static SIM_SETUP Setup;
+static uint8_t AppPaused = FALSE;
+
+
+/****************************************************************/
+/* main()               	          	      					*/
+/* Purpose: Host main loop										*/
+/* Parameters: none				         						*/
+/* Return: EXIT_FAILURE if the scenario did not pass.			*/
+/* Description:													*/
+/****************************************************************/
+int main( int argc, char* argv[] )
+{
+	uint32_t RunTimeUs = ( ( argc > 1 ) ? strtoul( argv[1], NULL, 10 ) : SIM_DEFAULT_RUN_TIME_S ) * 1000000UL;
+	SIM_ARGS Args = { .Count = ( argc > 3 ) ? ( argc - 3 ) : 0, .Values = &argv[3] };
+	const SIM_TEST* TestPtr = NULL;
+
+	if( argc > 2 )
+	{
+		if( strcmp( argv[2], "all" ) == 0 )
+		{
+			return ( Run_All_Tests( RunTimeUs ) ? EXIT_SUCCESS : EXIT_FAILURE );
+		}
+
+		TestPtr = Find_Test( argv[2] );
+		if( TestPtr == NULL )
+		{
+			Print_Usage();
+			return (EXIT_FAILURE);
+		}
+	}
+
+	return ( Run_Test( TestPtr, &Args, RunTimeUs ) ? EXIT_SUCCESS : EXIT_FAILURE );
+}
+
+
+/****************************************************************/
+/* Run_Test()               	          	      				*/
+/* Purpose: Run the stack and a scenario at its stage			*/
+/* Parameters: TestPtr: scenario, NULL to only run the stack	*/
+/* Return: TRUE if the scenario passed.							*/
+/* Description: Every run must complete the initial setup and	*/
+/* keep the SPI header protocol.								*/
+/****************************************************************/
+static uint8_t Run_Test( const SIM_TEST* TestPtr, SIM_ARGS* ArgsPtr, uint32_t RunTimeUs )
+{
+	BLUENRG_SIM_STATISTICS* StatsPtr = Bluenrg_Sim_Get_Statistics();
+	SIM_TEST_STAGE Stage = ( TestPtr != NULL ) ? TestPtr->Stage : SIM_RUN_END;
+	uint8_t Ran = FALSE;
+	uint8_t Passed = TRUE;
+
+	if( Stage == SIM_NO_STACK )
+	{
+		Passed = TestPtr->Run( ArgsPtr );
+		printf( "%s: %s\n", TestPtr->Name, Passed ? "passed" : "FAILED" );
+		return (Passed);
+	}
+
+	if( ( TestPtr != NULL ) && ( TestPtr->Prepare != NULL ) )
+	{
+		TestPtr->Prepare( ArgsPtr );
+	}
+
+	TimeFunctions_Init();
+	Reset_Bluenrg( TRUE );
+	App_Init();
+
+	while( Bluenrg_Sim_Get_Time_Us() < RunTimeUs )
+	{
+		Run_Main_Loop();
+
+		if( ( !Setup.InitStartUs ) && ( Get_BLE_State() == BLE_INITIAL_SETUP ) )
+		{
+			Setup.InitStartUs = Bluenrg_Sim_Get_Time_Us();
+			Setup.InitCommands = StatsPtr->CommandsReceived;
+		}
+
+		if( ( !Setup.SetupDoneUs ) && ( Get_BLE_State() >= BLE_INITIAL_SETUP_DONE ) )
+		{
+			Setup.SetupDoneUs = Bluenrg_Sim_Get_Time_Us();
+			Setup.InitCommands = StatsPtr->CommandsReceived - Setup.InitCommands;
+			printf( "BLE initial setup done at %lu us\n", (unsigned long)Setup.SetupDoneUs );
+		}
+
+		if( ( !Ran ) && ( ( ( Stage == SIM_SETUP_DONE ) && Setup.SetupDoneUs ) || ( ( Stage == SIM_STANDBY ) && ( Get_BLE_State() == STANDBY_STATE ) ) ) )
+		{
+			Ran = TRUE;
+			Passed = TestPtr->Run( ArgsPtr );
+		}
+	}
+
+	printf( "Final state: %u\n", Get_BLE_State() );
+	Print_Run_Statistics();
+
+	if( ( !Ran ) && ( Stage == SIM_RUN_END ) )
+	{
+		Ran = TRUE;
+		Passed = ( TestPtr != NULL ) ? TestPtr->Run( ArgsPtr ) : TRUE;
+	}
+
+	Passed &= SIM_CHECK( Setup.SetupDoneUs != 0 );
+	Passed &= SIM_CHECK( StatsPtr->ProtocolErrors == 0 );
+	Passed &= SIM_CHECK( Ran ); /* The stage of the scenario was reached */
+
+	printf( "%s: %s\n", ( TestPtr != NULL ) ? TestPtr->Name : "run", Passed ? "passed" : "FAILED" );
+
+	return (Passed);
+}
+
+
+/****************************************************************/
+/* Run_All_Tests()               	          	      			*/
+/* Purpose: Run every scenario with its default arguments		*/
+/* Parameters: none				         						*/
+/* Return: TRUE if all passed.									*/
+/* Description: Each scenario runs in a child process, so it	*/
+/* starts from the power up state of the firmware and of the	*/
+/* simulated controller.										*/
+/****************************************************************/
+static uint8_t Run_All_Tests( uint32_t RunTimeUs )
+{
+	SIM_ARGS Args = { .Count = 0, .Values = NULL };
+	uint8_t Failed = 0;
+	uint8_t Count = sizeof(Tests) / sizeof(Tests[0]);
+
+	for( uint8_t i = 0; i < Count; i++ )
+	{
+		int Status = -1;
+
+		printf( "=== %s\n", Tests[i].Name );
+		fflush( stdout ); /* Not to be printed again by the child */
+
+		pid_t Child = fork();
+		if( Child == 0 )
+		{
+			exit( Run_Test( &Tests[i], &Args, RunTimeUs ) ? EXIT_SUCCESS : EXIT_FAILURE );
+		}
+
+		if( ( Child < 0 ) || ( waitpid( Child, &Status, 0 ) != Child ) || !WIFEXITED( Status ) || ( WEXITSTATUS( Status ) != EXIT_SUCCESS ) )
+		{
+			printf( "=== %s FAILED\n", Tests[i].Name );
+			Failed++;
+		}
+	}
+
+	printf( "%u of %u scenarios passed\n", Count - Failed, Count );
+
+	return ( ( Failed == 0 ) ? TRUE : FALSE );
+}
+
+
+/****************************************************************/
+/* Find_Test()               	          	      				*/
+/* Purpose: Look a scenario up by name							*/
+/* Parameters: none				         						*/
+/* Return: NULL if there is no such scenario.					*/
+/* Description:													*/
+/****************************************************************/
+static const SIM_TEST* Find_Test( const char* Name )
+{
+	for( uint8_t i = 0; i < ( sizeof(Tests) / sizeof(Tests[0]) ); i++ )
+	{
+		if( strcmp( Tests[i].Name, Name ) == 0 )
+		{
+			return ( &Tests[i] );
+		}
+	}
+
+	return (NULL);
+}
+
+
+/****************************************************************/
+/* Print_Run_Statistics()               	          	      	*/
+/* Purpose: Print the figures of the controller and the driver	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Print_Run_Statistics( void )
+{
+	BLUENRG_SIM_STATISTICS* StatsPtr = Bluenrg_Sim_Get_Statistics();
+
+	printf( "Headers: %lu read, %lu write, %lu not ready\n", (unsigned long)StatsPtr->HeaderReads,
+			(unsigned long)StatsPtr->HeaderWrites, (unsigned long)StatsPtr->NotReadyHeaders );
+	printf( "Payloads: %lu writes (%lu bytes), %lu reads (%lu bytes)\n", (unsigned long)StatsPtr->PayloadWrites,
+			(unsigned long)StatsPtr->BytesWritten, (unsigned long)StatsPtr->PayloadReads, (unsigned long)StatsPtr->BytesRead );
+	printf( "Bus time: %lu us\n", (unsigned long)StatsPtr->BusTimeUs );
+	printf( "Commands: %lu, ACL packets: %lu, packets sent: %lu\n", (unsigned long)StatsPtr->CommandsReceived,
+			(unsigned long)StatsPtr->ACLPacketsReceived, (unsigned long)StatsPtr->PacketsSent );
+	printf( "IRQ edges: %lu, protocol errors: %lu\n", (unsigned long)StatsPtr->IRQEdges, (unsigned long)StatsPtr->ProtocolErrors );
+
+	for( MEMORY_POOL_ID PoolId = COMMAND_MEMORY_POOL; PoolId <= DATA_MEMORY_POOL; PoolId++ )
+	{
+		MEMORY_POOL_STATISTICS Pool = Get_Memory_Pool_Statistics( PoolId );
+		printf( "Pool %u: %u buffers, %u in use, high water mark %u, %u failures\n", PoolId,
+				Pool.NumberOfBuffers, Pool.InUse, Pool.HighWaterMark, Pool.Failures );
+	}
+
+	for( QUEUE_ID QueueId = TRANSPORT_FRAME_QUEUE; QueueId <= WRITE_CALLBACK_QUEUE; QueueId++ )
+	{
+		QUEUE_STATISTICS Queue = Get_Queue_Statistics( QueueId );
+		printf( "Queue %u: %u entries, %u in use, high water mark %u, %lu enqueues, %lu drops", QueueId,
+				Queue.Size, Queue.InUse, Queue.HighWaterMark, (unsigned long)Queue.Enqueues, (unsigned long)Queue.Drops );
+		if( Queue.Dequeues )
+		{
+			printf( ", dwell time mean %lu us max %lu us", (unsigned long)( Queue.TotalDwellTimeUs / Queue.Dequeues ),
+					(unsigned long)Queue.MaxDwellTimeUs );
+		}
+		printf( "\n" );
+	}
+}
+
+
+/****************************************************************/
+/* Print_Usage()               	          	      				*/
+/* Purpose: List the scenarios									*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Print_Usage( void )
+{
+	printf( "Usage: blesim [SECONDS [SCENARIO [ARGUMENTS...]]]\n" );
+	printf( "  all: every scenario with its default arguments\n" );
+
+	for( uint8_t i = 0; i < ( sizeof(Tests) / sizeof(Tests[0]) ); i++ )
+	{
+		printf( "  %s %s\n", Tests[i].Name, Tests[i].Usage );
+	}
+}
+
+
+/****************************************************************/
+/* Run_Main_Loop()               	          	      			*/
+/* Purpose: One pass of the firmware main loop					*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Run_Main_Loop( void )
+{
+	Run_Bluenrg();
+	Run_BLE();
+	if( !AppPaused )
+	{
+		App_Run();
+	}
+	Bluenrg_Sim_Run();
+}
+
+
+/****************************************************************/
+/* Wait_BLE_State()               	          	      			*/
+/* Purpose: Run the main loop until the BLE state is reached	*/
+/* Parameters: none				         						*/
+/* Return: TRUE if reached before the timeout.					*/
+/* Description: The hosted functions must be idle as well.		*/
+/****************************************************************/
+uint8_t Wait_BLE_State( BLE_STATES State )
+{
+	uint32_t StartUs = Bluenrg_Sim_Get_Time_Us();
+
+	while( ( ( Get_BLE_State() != State ) || ( Get_Hosted_Function().Val ) ) && ( ( Bluenrg_Sim_Get_Time_Us() - StartUs ) < SIM_STATE_TIMEOUT_US ) )
+	{
+		Run_Main_Loop();
+	}
+
+	return ( ( Get_BLE_State() == State ) ? TRUE : FALSE );
+}
+
+
+/****************************************************************/
+/* Open_Sim_Links()               	          	      			*/
+/* Purpose: Connect the links used by the data scenarios		*/
+/* Parameters: Links: number of links, from handle 				*/
+/* SIM_ACL_HANDLE on											*/
+/* Return: TRUE if every link has a data credit ledger entry.	*/
+/* Description: The transport layer only gives data credits to	*/
+/* a handle announced by a connection complete event, so one	*/
+/* is sent for each link as a slave.							*/
+/****************************************************************/
+uint8_t Open_Sim_Links( uint8_t Links )
+{
+	uint8_t Event[] = { HCI_EVENT_PACKET, LE_META, 31, LE_ENHANCED_CONNECTION_COMPLETE, COMMAND_SUCCESS,
+			0x00, 0x00, SLAVE, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0xC0, /* Handle, role, public peer address */
+			0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* No resolvable private addresses */
+			0x18, 0x00, 0x00, 0x00, 0xC8, 0x00, 0x00 }; /* 30 ms interval, no latency, 2 s timeout */
+	uint32_t StartUs = Bluenrg_Sim_Get_Time_Us();
+	uint8_t Pushed = 0;
+	uint8_t Opened = 0;
+
+	while( ( Opened < Links ) && ( ( Bluenrg_Sim_Get_Time_Us() - StartUs ) < SIM_LINK_OPEN_TIMEOUT_US ) )
+	{
+		if( Pushed < Links )
+		{
+			Event[5] = ( SIM_ACL_HANDLE + Pushed ) & 0xFF;
+			Event[6] = ( SIM_ACL_HANDLE + Pushed ) >> 8;
+			Event[9] = Pushed;
+			Pushed += Bluenrg_Sim_Push_Packet( &Event[0], sizeof(Event), 0 ) ? 1 : 0;
+		}
+		Run_Main_Loop();
+
+		HCI_LINK_CREDITS Credits;
+
+		for( Opened = 0; ( Opened < Links ) && HCI_Get_Link_Credits( Opened, &Credits ); Opened++ );
+	}
+
+	return ( ( Opened == Links ) ? TRUE : FALSE );
+}
+
+
+/****************************************************************/
+/* Sim_Pause_App()               	          	      			*/
+/* Purpose: Stop or resume the application in the main loop		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Its state machine would otherwise take the		*/
+/* stack back to its own states during a scenario.				*/
+/****************************************************************/
+void Sim_Pause_App( uint8_t Pause )
+{
+	AppPaused = Pause;
+}
+
+
+/****************************************************************/
+/* Sim_Get_Setup()               	          	      			*/
+/* Purpose: Times of the initial setup of the run				*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Zero while not reached.							*/
+/****************************************************************/
+SIM_SETUP* Sim_Get_Setup( void )
+{
+	return ( &Setup );
+}
+
+
+/****************************************************************/
+/* Sim_Get_Arg()               	          	      				*/
+/* Purpose: Numeric argument of the scenario					*/
+/* Parameters: Index: from zero, after the scenario name		*/
+/* Return: Default if the argument was not given.				*/
+/* Description:													*/
+/****************************************************************/
+uint32_t Sim_Get_Arg( SIM_ARGS* ArgsPtr, uint8_t Index, uint32_t Default )
+{
+	return ( ( Index < ArgsPtr->Count ) ? strtoul( ArgsPtr->Values[Index], NULL, 10 ) : Default );
+}
+
+
+/****************************************************************/
+/* Sim_Check()               	          	      				*/
+/* Purpose: Report an expected behaviour not seen				*/
+/* Parameters: none				         						*/
+/* Return: Passed												*/
+/* Description: Called through SIM_CHECK().						*/
+/****************************************************************/
+uint8_t Sim_Check( uint8_t Passed, const char* Condition, const char* File, int Line )
+{
+	if( !Passed )
+	{
+		printf( "Check failed at %s:%d: %s\n", File, Line, Condition );
+	}
+
+	return (Passed);
+}
+
+
+#endif /* BLE_HAL_SIMULATION */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
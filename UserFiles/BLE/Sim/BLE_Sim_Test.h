@@ -0,0 +1,118 @@
+
+
+#ifndef BLE_SIM_TEST_H_
+#define BLE_SIM_TEST_H_
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Types.h"
+#include "ble_states.h"
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define SIM_ACL_HANDLE			0x0001	  /* Handle of the first link opened by Open_Sim_Links() */
+#define SIM_STATE_TIMEOUT_US	2000000UL /* Time given by Wait_BLE_State() to each state change */
+
+/* Checks an expected behaviour: reports it when not seen and evaluates to its result */
+#define SIM_CHECK( Condition ) Sim_Check( ( Condition ) ? TRUE : FALSE, #Condition, __FILE__, __LINE__ )
+
+
+/****************************************************************/
+/* Type Defines                                                 */
+/****************************************************************/
+typedef enum
+{
+	SIM_NO_STACK   = 0, /* Runs alone, the BLE stack is not started */
+	SIM_SETUP_DONE = 1, /* Runs once BLE_Init() is done */
+	SIM_STANDBY	   = 2, /* Runs once the application configured the standby state, which resets the transport layer */
+	SIM_RUN_END	   = 3  /* Runs once the simulated run time is over */
+}SIM_TEST_STAGE;
+
+
+typedef struct
+{
+	uint8_t Count;	/* Arguments given after the scenario name */
+	char** Values;
+}SIM_ARGS;
+
+
+typedef struct
+{
+	const char* Name;
+	SIM_TEST_STAGE Stage;
+	void (*Prepare)( SIM_ARGS* ArgsPtr ); /* Called before the stack starts, NULL if not needed */
+	uint8_t (*Run)( SIM_ARGS* ArgsPtr );  /* TRUE if the expected behaviour was seen */
+	const char* Usage;
+}SIM_TEST;
+
+
+typedef struct
+{
+	uint32_t InitStartUs;	/* BLE_INITIAL_SETUP entered */
+	uint32_t SetupDoneUs;	/* BLE_INITIAL_SETUP_DONE entered */
+	uint32_t InitCommands;	/* Commands received by the controller in between */
+}SIM_SETUP;
+
+
+/****************************************************************/
+/* External functions declaration (Interface functions)         */
+/****************************************************************/
+
+/* BLE_Sim_Main.c: fixture shared by the scenarios */
+void Run_Main_Loop( void );
+uint8_t Wait_BLE_State( BLE_STATES State );
+uint8_t Open_Sim_Links( uint8_t Links );
+void Sim_Pause_App( uint8_t Pause );
+SIM_SETUP* Sim_Get_Setup( void );
+uint32_t Sim_Get_Arg( SIM_ARGS* ArgsPtr, uint8_t Index, uint32_t Default );
+uint8_t Sim_Check( uint8_t Passed, const char* Condition, const char* File, int Line );
+
+/* BLE_Sim_Test_Transport.c: Bluenrg driver and HCI transport layer */
+void Startup_Prepare( SIM_ARGS* ArgsPtr );
+uint8_t Startup_Test( SIM_ARGS* ArgsPtr );
+uint8_t Queue_Test( SIM_ARGS* ArgsPtr );
+uint8_t Trace_Test( SIM_ARGS* ArgsPtr );
+void ACL_Prepare( SIM_ARGS* ArgsPtr );
+uint8_t ACL_Test( SIM_ARGS* ArgsPtr );
+uint8_t RX_Test( SIM_ARGS* ArgsPtr );
+uint8_t Links_Test( SIM_ARGS* ArgsPtr );
+
+/* BLE_Sim_Test_L2CAP.c */
+uint8_t L2CAP_Test( SIM_ARGS* ArgsPtr );
+
+/* BLE_Sim_Test_GAP.c: advertising, scanning and AD structures */
+uint8_t Scan_Test( SIM_ARGS* ArgsPtr );
+uint8_t AD_Test( SIM_ARGS* ArgsPtr );
+uint8_t Adv_Test( SIM_ARGS* ArgsPtr );
+
+/* BLE_Sim_Test_Privacy.c: AES-128, resolving list and hosted resolution */
+uint8_t AES_Test( SIM_ARGS* ArgsPtr );
+uint8_t SM_Test( SIM_ARGS* ArgsPtr );
+void RPA_Prepare( SIM_ARGS* ArgsPtr );
+uint8_t RPA_Test( SIM_ARGS* ArgsPtr );
+void List_Prepare( SIM_ARGS* ArgsPtr );
+uint8_t List_Test( SIM_ARGS* ArgsPtr );
+
+/* BLE_Sim_Test_Storage.c: flash record log */
+uint8_t Flash_Test( SIM_ARGS* ArgsPtr );
+
+
+/****************************************************************/
+/* External variables declaration                               */
+/****************************************************************/
+
+
+#endif /* BLE_SIM_TEST_H_ */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
@@ -0,0 +1,321 @@
+
+
+/* Scenarios of advertising, scanning and AD structures, run by the host build
+ * against the simulated BlueNRG-MS (see BLE_Sim_Main.c). */
+#ifdef BLE_HAL_SIMULATION
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include "BLE_Sim_Test.h"
+#include "Bluenrg.h"
+#include "App.h"
+#include "BLE_HAL_Sim.h"
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define SIM_SCAN_ADVERTISERS	16		  /* Default advertisers of the scan scenario */
+#define SIM_SCAN_TIME_US		1000000UL /* Simulated time of the scan scenario */
+#define SIM_SCAN_DATA_CHANGE	100		  /* Reports of an advertiser between data changes */
+#define SIM_AD_RUNS				1000000	  /* Payloads parsed by each method of the AD scenario */
+#define SIM_AD_LOOKUPS			4		  /* Default AD types looked up in each payload */
+#define SIM_ADV_RESTARTS		10		  /* Default advertising restarts of the advertising scenario */
+
+
+/****************************************************************/
+/* Local variables definition                                   */
+/****************************************************************/
+static uint8_t Payloads[][31] =
+{
+	/* Flags, incomplete list of 16-bit UUIDs, TX power level, complete local name */
+	{ 0x02, FLAGS_TYPE, 0x06, 0x05, INCOMPLT_LIST_16_BIT_SVC_CLASS_UUIDS_TYPE, 0x0D, 0x18, 0x0F, 0x18,
+	  0x02, TX_POWER_LEVEL_TYPE, 0x00, 0x0E, COMPLETE_LOCAL_NAME_TYPE, 'H', 'e', 'a', 'r', 't', ' ', 'R', 'a', 't', 'e', ' ', 'M', 'o',
+	  0x00, 0x00, 0x00 },
+	/* Flags, manufacturer specific data (beacon) */
+	{ 0x02, FLAGS_TYPE, 0x06, 0x1A, MANUFACTURER_SPECIFIC_DATA_TYPE, 0x4C, 0x00, 0x02, 0x15, 0xE2, 0xC5, 0x6D, 0xB5,
+	  0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60, 0xD0, 0xF5, 0xA7, 0x10, 0x96, 0xE0, 0x00, 0x01, 0x00, 0x02, 0xC5 },
+	/* Flags, appearance, shortened local name, manufacturer specific data, TX power level */
+	{ 0x02, FLAGS_TYPE, 0x05, 0x03, APPEARANCE_TYPE, 0xC1, 0x03, 0x07, SHORTENED_LOCAL_NAME_TYPE, 'S', 'e', 'n', 's', 'o', 'r',
+	  0x09, MANUFACTURER_SPECIFIC_DATA_TYPE, 0x30, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x02, TX_POWER_LEVEL_TYPE, 0xF4,
+	  0x00, 0x00 },
+	/* Only checked, not timed: a structure of the reserved type 0x00 before the manufacturer specific data */
+	{ 0x02, FLAGS_TYPE, 0x06, 0x03, 0x00, 0xAA, 0xBB, 0x05, MANUFACTURER_SPECIFIC_DATA_TYPE, 0x30, 0x00, 0x01, 0x02,
+	  0x02, TX_POWER_LEVEL_TYPE, 0x00, 0x00 },
+};
+static const uint8_t Types[] = { FLAGS_TYPE, TX_POWER_LEVEL_TYPE, MANUFACTURER_SPECIFIC_DATA_TYPE, SERVICE_DATA_16_BIT_UUID_TYPE,
+		COMPLETE_LOCAL_NAME_TYPE, SHORTENED_LOCAL_NAME_TYPE, INCOMPLT_LIST_16_BIT_SVC_CLASS_UUIDS_TYPE, APPEARANCE_TYPE, 0x00 };
+
+
+/****************************************************************/
+/* Scan_Test()               	          	      				*/
+/* Purpose: Measure the advertising reports filtered by the		*/
+/* cache of the scanner											*/
+/* Parameters: ArgsPtr: [ADVERTISERS], in turn					*/
+/* Return: TRUE if every report was either forwarded or			*/
+/* suppressed, and no data change was suppressed.				*/
+/* Description: Each report is an ADV_NONCONN_IND with 20 bytes	*/
+/* of data, the first one counting the data changes of the 		*/
+/* advertiser. The RSSI changes at every report.				*/
+/****************************************************************/
+uint8_t Scan_Test( SIM_ARGS* ArgsPtr )
+{
+	uint8_t Report[] = { HCI_EVENT_PACKET, LE_META, 32, LE_ADVERTISING_REPORT, 1, /* Num_Reports */
+			0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0xC0, /* ADV_NONCONN_IND from a public address */
+			20, 0x13, 0xFF, 0x30, 0x00, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, /* Manufacturer specific data */
+			0xC4 }; /* RSSI */
+	uint32_t Sent[256] = { 0 };
+	uint8_t Advertisers = MAX( Sim_Get_Arg( ArgsPtr, 0, SIM_SCAN_ADVERTISERS ), 1 );
+	uint32_t StartUs = Bluenrg_Sim_Get_Time_Us();
+	uint32_t Pass = 0;
+	uint32_t Versions = 0;
+	ADV_CACHE_STATISTICS Start = Get_Advertising_Cache_Statistics();
+	uint8_t Passed = TRUE;
+
+	while( ( Bluenrg_Sim_Get_Time_Us() - StartUs ) < SIM_SCAN_TIME_US )
+	{
+		uint8_t Advertiser = Pass % Advertisers;
+
+		Report[7] = Advertiser;
+		Report[18] = Sent[Advertiser] / SIM_SCAN_DATA_CHANGE;
+		Report[sizeof(Report) - 1] = 0xC4 - ( Pass % 8 );
+
+		if( Bluenrg_Sim_Push_Packet( &Report[0], sizeof(Report), 0 ) )
+		{
+			Sent[Advertiser]++;
+			Pass++;
+		}
+		Run_Main_Loop();
+	}
+
+	/* The last reports pushed are read */
+	StartUs = Bluenrg_Sim_Get_Time_Us();
+	while( ( Bluenrg_Sim_Get_Time_Us() - StartUs ) < ( SIM_SCAN_TIME_US / 100 ) )
+	{
+		Run_Main_Loop();
+	}
+
+	ADV_CACHE_STATISTICS End = Get_Advertising_Cache_Statistics();
+	uint32_t Reports = End.Reports - Start.Reports;
+	uint32_t Forwarded = End.Forwarded - Start.Forwarded;
+
+	/* Each advertiser data seen must be forwarded at least once */
+	for( uint16_t i = 0; i < Advertisers; i++ )
+	{
+		Versions += Sent[i] ? ( 1 + ( ( Sent[i] - 1 ) / SIM_SCAN_DATA_CHANGE ) ) : 0;
+	}
+
+	printf( "Scan: %lu reports from %u advertisers, %lu forwarded (%.1f%%), %lu suppressed, %lu refreshed, %lu evictions\n",
+			(unsigned long)Reports, Advertisers, (unsigned long)Forwarded,
+			Reports ? ( 100.0 * Forwarded / Reports ) : 0.0, (unsigned long)( End.Suppressed - Start.Suppressed ),
+			(unsigned long)( End.Refreshed - Start.Refreshed ), (unsigned long)( End.Evictions - Start.Evictions ) );
+
+	/* The checks wait for every report pushed */
+	StartUs = Bluenrg_Sim_Get_Time_Us();
+	while( ( ( Get_Advertising_Cache_Statistics().Reports - Start.Reports ) < Pass ) && ( ( Bluenrg_Sim_Get_Time_Us() - StartUs ) < SIM_SCAN_TIME_US ) )
+	{
+		Run_Main_Loop();
+	}
+
+	End = Get_Advertising_Cache_Statistics();
+	Reports = End.Reports - Start.Reports;
+	Forwarded = End.Forwarded - Start.Forwarded;
+
+	Passed &= SIM_CHECK( ( Reports == Pass ) && ( Reports != 0 ) );
+	Passed &= SIM_CHECK( ( Forwarded + ( End.Suppressed - Start.Suppressed ) ) == Reports );
+	Passed &= SIM_CHECK( Forwarded >= Versions );
+
+	return (Passed);
+}
+
+
+/****************************************************************/
+/* AD_Test()               	          	      					*/
+/* Purpose: Compare the lookup of AD types with a scan of the	*/
+/* payload for each type and with a single index.				*/
+/* Parameters: ArgsPtr: [LOOKUPS], at most 8					*/
+/* Return: TRUE if both methods return the same structure for	*/
+/* every type of every payload.									*/
+/* Description: The figures are in host time. One of the types	*/
+/* looked up is absent from every payload, which is the worst	*/
+/* case of the scan and a common one for a scanner filtering	*/
+/* reports by content. Both count the same types found, since	*/
+/* the scan also stops at a length that overruns the payload.	*/
+/****************************************************************/
+uint8_t AD_Test( SIM_ARGS* ArgsPtr )
+{
+	uint8_t Count = ( sizeof(Payloads) / sizeof(Payloads[0]) ) - 1; /* The last one is not timed */
+	uint8_t Lookups = MIN( Sim_Get_Arg( ArgsPtr, 0, SIM_AD_LOOKUPS ), sizeof(Types) - 1 );
+	uint32_t ScanFound = 0;
+	uint32_t IndexFound = 0;
+	uint32_t Mismatches = 0;
+	AD_INDEX Index;
+	uint8_t Passed = TRUE;
+
+	for( uint8_t i = 0; i < ( sizeof(Payloads) / sizeof(Payloads[0]) ); i++ )
+	{
+		Index_AD_Structures( &Index, &Payloads[i][0], sizeof(Payloads[0]) );
+		for( uint8_t j = 0; j < sizeof(Types); j++ )
+		{
+			Mismatches += ( Get_AD_Type_Ptr( Types[j], &Payloads[i][0], sizeof(Payloads[0]) ) != Get_Indexed_AD_Type_Ptr( &Index, Types[j] ) ) ? 1 : 0;
+		}
+	}
+
+	clock_t Start = clock();
+	for( uint32_t i = 0; i < SIM_AD_RUNS; i++ )
+	{
+		uint8_t* DataPtr = &Payloads[i % Count][0];
+
+		for( uint8_t j = 0; j < Lookups; j++ )
+		{
+			ScanFound += ( Get_AD_Type_Ptr( Types[j], DataPtr, sizeof(Payloads[0]) ) != NULL ) ? 1 : 0;
+		}
+		__asm__ volatile( "" ::: "memory" ); /* Keeps the compiler from hoisting the scans out of the loop */
+	}
+	double ScanS = (double)( clock() - Start ) / CLOCKS_PER_SEC;
+
+	Start = clock();
+	for( uint32_t i = 0; i < SIM_AD_RUNS; i++ )
+	{
+		uint8_t* DataPtr = &Payloads[i % Count][0];
+
+		Index_AD_Structures( &Index, DataPtr, sizeof(Payloads[0]) );
+		for( uint8_t j = 0; j < Lookups; j++ )
+		{
+			IndexFound += ( Get_Indexed_AD_Type_Ptr( &Index, Types[j] ) != NULL ) ? 1 : 0;
+		}
+		__asm__ volatile( "" ::: "memory" );
+	}
+	double IndexS = (double)( clock() - Start ) / CLOCKS_PER_SEC;
+
+	printf( "%u AD types looked up in each payload, %lu lookups differ between the methods\n", Lookups, (unsigned long)Mismatches );
+	printf( "Scan per type: %u payloads, %lu types found in %.3f host s, %.0f ns/payload\n", SIM_AD_RUNS,
+			(unsigned long)ScanFound, ScanS, ScanS * 1e9 / SIM_AD_RUNS );
+	printf( "Single index: %u payloads, %lu types found in %.3f host s, %.0f ns/payload\n", SIM_AD_RUNS,
+			(unsigned long)IndexFound, IndexS, IndexS * 1e9 / SIM_AD_RUNS );
+
+	Passed &= SIM_CHECK( Mismatches == 0 );
+	Passed &= SIM_CHECK( ScanFound == IndexFound );
+
+	return (Passed);
+}
+
+
+/****************************************************************/
+/* Adv_Test()               	          	      				*/
+/* Purpose: Measure the time taken to start advertising again	*/
+/* Parameters: ArgsPtr: [ENTRIES [RESTARTS]], the resolving		*/
+/* list entries, one peer each, and the advertising starts		*/
+/* after the first one											*/
+/* Return: TRUE if every start reached the advertising state	*/
+/* and every stop the standby state.							*/
+/* Description: Advertising uses the resolvable address for the	*/
+/* peer of the first entry. Each start changes the advertising	*/
+/* interval, and the last one also follows the removal of the	*/
+/* last entry from the host list.								*/
+/****************************************************************/
+uint8_t Adv_Test( SIM_ARGS* ArgsPtr )
+{
+	BLUENRG_SIM_STATISTICS* StatsPtr = Bluenrg_Sim_Get_Statistics();
+	ADVERTISING_PARAMETERS Adv;
+	RESOLVING_RECORD Record;
+	uint8_t Entries = MIN( MAX( Sim_Get_Arg( ArgsPtr, 0, MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES ), 1 ), MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES );
+	uint32_t Restarts = Sim_Get_Arg( ArgsPtr, 1, SIM_ADV_RESTARTS );
+	uint32_t FirstUs = 0, FirstCommands = 0, NextUs = 0, NextCommands = 0, NextStarts = 0, ChangeUs = 0, ChangeCommands = 0;
+
+	Clear_Resolving_List();
+	for( uint8_t i = 0; i < Entries; i++ )
+	{
+		memset( &Record, 0, sizeof(Record) );
+		Record.Peer.Peer_Identity_Address.Type = PEER_PUBLIC_DEV_ADDR;
+		memset( &Record.Peer.Peer_Identity_Address.Address.Bytes[0], 0x10 + i, sizeof(BD_ADDR_TYPE) );
+		memset( &Record.Peer.Peer_IRK.Bytes[0], 0xA0 + i, sizeof(IRK_TYPE) );
+		memset( &Record.Peer.Local_IRK.Bytes[0], 0x50 + i, sizeof(IRK_TYPE) );
+		Record.Local_Identity_Address = Get_Identity_Address( PEER_PUBLIC_DEV_ADDR );
+		Add_Record_To_Resolving_List( &Record );
+	}
+
+	memset( &Adv, 0, sizeof(Adv) );
+	Adv.Advertising_Type = ADV_IND;
+	Adv.Own_Address_Type = OWN_RESOL_OR_PUBLIC_ADDR;
+	Adv.Peer_Address_Type = PEER_PUBLIC_DEV_ADDR;
+	memset( &Adv.Peer_Address.Bytes[0], 0x10, sizeof(BD_ADDR_TYPE) );
+	Adv.Advertising_Channel_Map.Val = DEFAULT_LE_ADV_CH_MAP;
+	Adv.connIntervalmin = NO_SPECIFIC_MINIMUM;
+	Adv.connIntervalmax = NO_SPECIFIC_MAXIMUM;
+	Adv.Privacy = TRUE;
+	Adv.Role = PERIPHERAL;
+	Adv.DiscoveryMode = GENERAL_DISCOVERABLE_MODE;
+	Sim_Pause_App( TRUE ); /* Its state machine would change the advertiser */
+
+	for( uint32_t Start = 0; Start <= Restarts; Start++ )
+	{
+		uint8_t ListChange = ( Start == Restarts ) && ( Start > 0 ) && ( Entries > 1 );
+
+		if( ListChange )
+		{
+			memset( &Record.Peer.Peer_Identity_Address.Address.Bytes[0], 0x10 + Entries - 1, sizeof(BD_ADDR_TYPE) );
+			Remove_Record_From_Resolving_List( &Record.Peer.Peer_Identity_Address );
+		}
+
+		Adv.Advertising_Interval_Min = 160 + ( Start % 2 ) * 32;
+		Adv.Advertising_Interval_Max = Adv.Advertising_Interval_Min + 160;
+
+		uint32_t StartUs = Bluenrg_Sim_Get_Time_Us();
+		uint32_t StartCommands = StatsPtr->CommandsReceived;
+
+		if( !SIM_CHECK( Enter_Advertising_Mode( &Adv ) && Wait_BLE_State( ADVERTISING_STATE ) ) )
+		{
+			printf( "Adv: advertising not entered at start %lu, state %u\n", (unsigned long)Start, Get_BLE_State() );
+			return (FALSE);
+		}
+
+		uint32_t Us = Bluenrg_Sim_Get_Time_Us() - StartUs;
+		uint32_t Commands = StatsPtr->CommandsReceived - StartCommands;
+
+		if( !Start )
+		{
+			FirstUs = Us;
+			FirstCommands = Commands;
+		}else if( ListChange )
+		{
+			ChangeUs = Us;
+			ChangeCommands = Commands;
+		}else
+		{
+			NextUs += Us;
+			NextCommands += Commands;
+			NextStarts++;
+		}
+
+		Enter_Standby_Mode();
+		if( !SIM_CHECK( Wait_BLE_State( STANDBY_STATE ) ) )
+		{
+			printf( "Adv: standby not entered after start %lu, state %u\n", (unsigned long)Start, Get_BLE_State() );
+			return (FALSE);
+		}
+	}
+
+	printf( "Adv: %u entries, first start %lu us with %lu commands\n", Entries, (unsigned long)FirstUs, (unsigned long)FirstCommands );
+	if( NextStarts )
+	{
+		printf( "Adv: %lu restarts, %lu us with %lu commands each\n", (unsigned long)NextStarts,
+				(unsigned long)( NextUs / NextStarts ), (unsigned long)( NextCommands / NextStarts ) );
+	}
+	if( ChangeUs )
+	{
+		printf( "Adv: restart after removing an entry, %lu us with %lu commands\n", (unsigned long)ChangeUs, (unsigned long)ChangeCommands );
+	}
+
+	return (TRUE);
+}
+
+
+#endif /* BLE_HAL_SIMULATION */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
@@ -0,0 +1,88 @@
+
+
+/* Scenario of the L2CAP segmentation and reassembly, run by the host build against
+ * the simulated BlueNRG-MS (see BLE_Sim_Main.c). */
+#ifdef BLE_HAL_SIMULATION
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include "BLE_Sim_Test.h"
+#include "Bluenrg.h"
+#include "App.h"
+#include "BLE_HAL_Sim.h"
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define SIM_L2CAP_SDUS			100		  /* Default SDUs of the scenario */
+#define SIM_L2CAP_TIMEOUT_US	10000000UL /* The scenario stops if the SDUs were not received by then */
+
+
+/****************************************************************/
+/* L2CAP_Test()               	          	      				*/
+/* Purpose: Measure the transport of SDUs larger than an ACL	*/
+/* data packet													*/
+/* Parameters: ArgsPtr: [SDUS [SIZE]]							*/
+/* Return: TRUE if every SDU was reassembled without a fragment	*/
+/* dropped.														*/
+/* Description: The controller sends back each fragment, so 	*/
+/* the SDUs are also reassembled by the host. A new SDU is 		*/
+/* given to L2CAP_Send() as soon as the previous one is taken.	*/
+/****************************************************************/
+uint8_t L2CAP_Test( SIM_ARGS* ArgsPtr )
+{
+	uint8_t SDU[L2CAP_MTU];
+	uint32_t SDUs = Sim_Get_Arg( ArgsPtr, 0, SIM_L2CAP_SDUS );
+	uint16_t SDUSize = MIN( Sim_Get_Arg( ArgsPtr, 1, L2CAP_MTU ), L2CAP_MTU );
+	L2CAP_STATISTICS Start = Get_L2CAP_Statistics();
+	L2CAP_STATISTICS End = Start;
+	uint32_t Sent = 0;
+	uint8_t Passed = TRUE;
+
+	if( !SIM_CHECK( Open_Sim_Links( 1 ) ) )
+	{
+		return (FALSE);
+	}
+
+	uint32_t StartUs = Bluenrg_Sim_Get_Time_Us();
+	Bluenrg_Sim_Set_ACL_Loopback( TRUE );
+
+	while( ( ( End.SDUsReceived - Start.SDUsReceived ) < SDUs ) && ( ( Bluenrg_Sim_Get_Time_Us() - StartUs ) < SIM_L2CAP_TIMEOUT_US ) )
+	{
+		if( Sent < SDUs )
+		{
+			memset( &SDU[0], Sent & 0xFF, SDUSize );
+			Sent += L2CAP_Send( SIM_ACL_HANDLE, APP_DATA_CID, &SDU[0], SDUSize ) ? 1 : 0;
+		}
+		Run_Main_Loop();
+		End = Get_L2CAP_Statistics();
+	}
+
+	Bluenrg_Sim_Set_ACL_Loopback( FALSE );
+
+	uint32_t Received = End.SDUsReceived - Start.SDUsReceived;
+	uint32_t ElapsedUs = Bluenrg_Sim_Get_Time_Us() - StartUs;
+
+	printf( "L2CAP: %lu/%lu SDUs of %u bytes in %lu us, %lu fragments sent, %lu received, %lu dropped\n",
+			(unsigned long)Received, (unsigned long)SDUs, SDUSize, (unsigned long)ElapsedUs,
+			(unsigned long)( End.FragmentsSent - Start.FragmentsSent ), (unsigned long)( End.FragmentsReceived - Start.FragmentsReceived ),
+			(unsigned long)( End.FragmentsDropped - Start.FragmentsDropped ) );
+	printf( "L2CAP: %.0f SDUs/s, %.0f SDU bytes/s\n", ( Received * 1e6 ) / ElapsedUs, ( Received * SDUSize * 1e6 ) / ElapsedUs );
+
+	Passed &= SIM_CHECK( Received == SDUs );
+	Passed &= SIM_CHECK( ( End.FragmentsReceived - Start.FragmentsReceived ) == ( End.FragmentsSent - Start.FragmentsSent ) );
+	Passed &= SIM_CHECK( End.FragmentsDropped == Start.FragmentsDropped );
+
+	return (Passed);
+}
+
+
+#endif /* BLE_HAL_SIMULATION */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
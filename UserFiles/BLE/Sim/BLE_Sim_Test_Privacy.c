@@ -0,0 +1,540 @@
+
+
+/* Scenarios of AES-128, of the resolving list and of the address resolution run by
+ * the host, run by the host build against the simulated BlueNRG-MS (see
+ * BLE_Sim_Main.c). */
+#ifdef BLE_HAL_SIMULATION
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include "BLE_Sim_Test.h"
+#include "Bluenrg.h"
+#include "App.h"
+#include "BLE_HAL_Sim.h"
+#include "aes_128.h"
+#include "hosted_functions.h"
+#include "flash.h"
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define SIM_AES_CONTROLLER_RUNS	100
+#define SIM_AES_SOFTWARE_RUNS	100000
+#define SIM_AES_TIMEOUT_US		1000000UL /* Time given to the controller runs */
+#define SIM_SM_RUNS				100000	  /* Identity lookups made by each method of the resolving list scenario */
+#define SIM_RPA_TIME_US			1000000UL /* Simulated time of the RPA scenario */
+#define SIM_RPA_TIMEOUT_US		300000UL  /* Longer than the resolution timeout of the hosted functions */
+#define SIM_LIST_CREDITS		1		  /* Default Num_HCI_Command_Packets of the command scenarios */
+#define SIM_LIST_TIMEOUT_US		1000000UL /* Time given to the resolving list burst to be answered */
+
+
+/****************************************************************/
+/* Static functions declaration                                 */
+/****************************************************************/
+static void Encrypt_Complete( CONTROLLER_ERROR_CODES Status, uint8_t Encrypted_Data[16] );
+static void Encrypt_Status( CONTROLLER_ERROR_CODES Status );
+static RESOLVING_RECORD* Flash_Lookup( IDENTITY_ADDRESS* Peer_Identity_Address );
+static uint32_t Compare_Resolving_Records( IDENTITY_ADDRESS Identities[], uint8_t Count );
+static void List_Command_Complete( CONTROLLER_ERROR_CODES Status );
+
+
+/****************************************************************/
+/* Local variables definition                                   */
+/****************************************************************/
+static uint8_t EncryptKey[16] = { 0xEC, 0x02, 0x34, 0xA3, 0x57, 0xC8, 0xAD, 0x05, 0x34, 0x10, 0x10, 0xA6, 0x0A, 0x39, 0x7D, 0x9B };
+static uint8_t EncryptPlaintext[16]; /* Of the command in flight */
+static volatile uint32_t EncryptCompleted;
+static uint32_t EncryptFailed; /* Answered with an error or with a wrong result */
+static uint32_t ListSucceeded, ListBusy, ListFailed; /* Answers of the resolving list scenario */
+
+
+/****************************************************************/
+/* AES_Test()               	          	      				*/
+/* Purpose: Compare the resolution rate of private addresses	*/
+/* through HCI_LE_Encrypt and through the software AES-128		*/
+/* Parameters: none				         						*/
+/* Return: TRUE if every HCI_LE_Encrypt gave the result of the	*/
+/* software AES-128.											*/
+/* Description: The controller runs are in simulated time, the	*/
+/* software ones in host time.									*/
+/****************************************************************/
+uint8_t AES_Test( SIM_ARGS* ArgsPtr )
+{
+	uint8_t r[3] = { 0x94, 0x81, 0x70 };
+	uint8_t hash[3];
+	uint32_t StartUs = Bluenrg_Sim_Get_Time_Us();
+	uint32_t Issued = 0;
+	uint8_t Passed = TRUE;
+
+	EncryptCompleted = 0;
+	EncryptFailed = 0;
+	memset( &EncryptPlaintext[0], 0, sizeof(EncryptPlaintext) );
+
+	while( ( EncryptCompleted < SIM_AES_CONTROLLER_RUNS ) && ( ( Bluenrg_Sim_Get_Time_Us() - StartUs ) < SIM_AES_TIMEOUT_US ) )
+	{
+		if( Issued == EncryptCompleted )
+		{
+			EncryptPlaintext[15] = Issued & 0xFF;
+			Issued += HCI_LE_Encrypt( &EncryptKey[0], &EncryptPlaintext[0], &Encrypt_Complete, &Encrypt_Status ) ? 1 : 0;
+		}
+		Run_Main_Loop();
+	}
+
+	uint32_t ControllerUs = Bluenrg_Sim_Get_Time_Us() - StartUs;
+
+	clock_t Start = clock();
+	for( uint32_t i = 0; i < SIM_AES_SOFTWARE_RUNS; i++ )
+	{
+		r[0] = i & 0xFF;
+		AES_128_Ah( &EncryptKey[0], &r[0], &hash[0] );
+	}
+	double SoftwareS = (double)( clock() - Start ) / CLOCKS_PER_SEC;
+
+	printf( "HCI_LE_Encrypt: %lu resolutions in %lu simulated us, %.0f resolutions/s, %lu failed\n", (unsigned long)EncryptCompleted,
+			(unsigned long)ControllerUs, EncryptCompleted * 1e6 / ControllerUs, (unsigned long)EncryptFailed );
+	printf( "Software AES-128: %u resolutions in %.3f host s, %.0f resolutions/s\n", SIM_AES_SOFTWARE_RUNS,
+			SoftwareS, SIM_AES_SOFTWARE_RUNS / SoftwareS );
+
+	Passed &= SIM_CHECK( EncryptCompleted == SIM_AES_CONTROLLER_RUNS );
+	Passed &= SIM_CHECK( EncryptFailed == 0 );
+
+	return (Passed);
+}
+
+
+/****************************************************************/
+/* SM_Test()               	          	      					*/
+/* Purpose: Compare the lookup of resolving records by peer		*/
+/* identity on flash and on the indexed RAM copy.				*/
+/* Parameters: ArgsPtr: [ENTRIES]								*/
+/* Return: TRUE if both find the same records, before and after	*/
+/* a removal.													*/
+/* Description: The figures are in host time. Every entry is	*/
+/* looked up in turn, plus an identity absent from the list,	*/
+/* which is the worst case of the flash walk.					*/
+/****************************************************************/
+uint8_t SM_Test( SIM_ARGS* ArgsPtr )
+{
+	RESOLVING_RECORD Record;
+	IDENTITY_ADDRESS Identities[MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES + 1];
+	uint8_t Entries = MIN( Sim_Get_Arg( ArgsPtr, 0, MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES ), MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES );
+	uint32_t FlashFound = 0;
+	uint32_t IndexFound = 0;
+	uint32_t Mismatches = 0;
+	uint8_t Passed = TRUE;
+
+	Clear_Resolving_List();
+	for( uint8_t i = 0; i <= Entries; i++ )
+	{
+		memset( &Record, 0, sizeof(Record) );
+		Record.Peer.Peer_Identity_Address.Type = ( i & 1 ) ? PEER_RANDOM_DEV_ADDR : PEER_PUBLIC_DEV_ADDR;
+		memset( &Record.Peer.Peer_Identity_Address.Address.Bytes[0], 0x10 + i, sizeof(BD_ADDR_TYPE) );
+		memset( &Record.Peer.Peer_IRK.Bytes[0], 0xA0 + i, sizeof(IRK_TYPE) );
+		Identities[i] = Record.Peer.Peer_Identity_Address;
+
+		/* The last identity is kept out of the list */
+		if( ( i < Entries ) && !SIM_CHECK( Add_Record_To_Resolving_List( &Record ) ) )
+		{
+			printf( "Resolving list entry %u not saved\n", i );
+			return (FALSE);
+		}
+	}
+
+	Mismatches += Compare_Resolving_Records( Identities, Entries + 1 );
+
+	clock_t Start = clock();
+	for( uint32_t i = 0; i < SIM_SM_RUNS; i++ )
+	{
+		FlashFound += ( Flash_Lookup( &Identities[i % ( Entries + 1 )] ) != NULL ) ? 1 : 0;
+		__asm__ volatile( "" ::: "memory" ); /* Keeps the compiler from hoisting the lookups out of the loop */
+	}
+	double FlashS = (double)( clock() - Start ) / CLOCKS_PER_SEC;
+
+	Start = clock();
+	for( uint32_t i = 0; i < SIM_SM_RUNS; i++ )
+	{
+		IndexFound += ( Get_Record_From_Peer_Identity( &Identities[i % ( Entries + 1 )] ) != NULL ) ? 1 : 0;
+		__asm__ volatile( "" ::: "memory" );
+	}
+	double IndexS = (double)( clock() - Start ) / CLOCKS_PER_SEC;
+
+	Passed &= SIM_CHECK( Get_Record_From_Peer_Identity( &Identities[Entries] ) == NULL );
+
+	/* The last record moves to the place of the first one */
+	Remove_Record_From_Resolving_List( &Identities[0] );
+	Mismatches += Compare_Resolving_Records( Identities, Entries + 1 );
+	Passed &= SIM_CHECK( Get_Record_From_Peer_Identity( &Identities[0] ) == NULL );
+	Clear_Resolving_List();
+
+	printf( "%u resolving list entries, %lu records differ between flash and RAM\n", Entries, (unsigned long)Mismatches );
+	printf( "Flash walk: %u lookups, %lu found in %.3f host s, %.0f ns/lookup\n", SIM_SM_RUNS,
+			(unsigned long)FlashFound, FlashS, FlashS * 1e9 / SIM_SM_RUNS );
+	printf( "RAM index: %u lookups, %lu found in %.3f host s, %.0f ns/lookup\n", SIM_SM_RUNS,
+			(unsigned long)IndexFound, IndexS, IndexS * 1e9 / SIM_SM_RUNS );
+
+	Passed &= SIM_CHECK( Mismatches == 0 );
+	Passed &= SIM_CHECK( FlashFound == IndexFound );
+
+	return (Passed);
+}
+
+
+/****************************************************************/
+/* RPA_Prepare()               	          	      				*/
+/* Purpose: Give the controller the command credits of the RPA	*/
+/* scenario														*/
+/* Parameters: ArgsPtr: [ENTRIES [ROTATION [CREDITS]]]			*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void RPA_Prepare( SIM_ARGS* ArgsPtr )
+{
+	Bluenrg_Sim_Set_Command_Credits( Sim_Get_Arg( ArgsPtr, 2, SIM_LIST_CREDITS ) );
+}
+
+
+/****************************************************************/
+/* RPA_Test()               	          	      				*/
+/* Purpose: Measure the resolution of the resolvable private	*/
+/* addresses of advertising reports by the host					*/
+/* Parameters: ArgsPtr: [ENTRIES [ROTATION [CREDITS]]], the		*/
+/* resolving list entries, one peer each, and the reports of a	*/
+/* peer between changes of its address, zero to never change it	*/
+/* Return: TRUE if no report was lost and every peer was		*/
+/* resolved to its identity.									*/
+/* Description: Each report is pushed once the previous one		*/
+/* reached the scanner, since the hosted resolution drops the	*/
+/* reports received while it is busy. The peer of the last		*/
+/* entry is the slowest to resolve for the first time. With a	*/
+/* rotation of one, every report misses the RPA cache.			*/
+/****************************************************************/
+uint8_t RPA_Test( SIM_ARGS* ArgsPtr )
+{
+	uint8_t Report[] = { HCI_EVENT_PACKET, LE_META, 12, LE_ADVERTISING_REPORT, 1, /* Num_Reports */
+			ADV_NONCONN_IND_EVT, RANDOM_DEV_ADDR, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0, /* No data */
+			0xC4 }; /* RSSI */
+	BD_ADDR_TYPE RPA[MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES];
+	RESOLVING_RECORD Record;
+	SCANNING_PARAMETERS Scan;
+	uint8_t Entries = MIN( MAX( Sim_Get_Arg( ArgsPtr, 0, MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES ), 1 ), MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES );
+	uint32_t Rotation = Sim_Get_Arg( ArgsPtr, 1, 0 );
+	uint32_t FirstUs = 0, FirstReports = 0, NextUs = 0, NextReports = 0, Lost = 0, Resolved = 0;
+	uint8_t Passed = TRUE;
+
+	Clear_Resolving_List();
+	for( uint8_t i = 0; i < Entries; i++ )
+	{
+		memset( &Record, 0, sizeof(Record) );
+		Record.Peer.Peer_Identity_Address.Type = PEER_PUBLIC_DEV_ADDR;
+		memset( &Record.Peer.Peer_Identity_Address.Address.Bytes[0], 0x10 + i, sizeof(BD_ADDR_TYPE) );
+		memset( &Record.Peer.Peer_IRK.Bytes[0], 0xA0 + i, sizeof(IRK_TYPE) );
+		memset( &Record.Peer.Local_IRK.Bytes[0], 0x50 + i, sizeof(IRK_TYPE) );
+		Record.Local_Identity_Address = Get_Identity_Address( PEER_PUBLIC_DEV_ADDR );
+		Add_Record_To_Resolving_List( &Record );
+
+		/* prand with the two most significant bits set to 0b01 */
+		RPA[i].Bytes[3] = 0x30 + i;
+		RPA[i].Bytes[4] = 0x31;
+		RPA[i].Bytes[5] = 0x40 | 0x12;
+		AES_128_Ah( &Record.Peer.Peer_IRK.Bytes[0], &RPA[i].Bytes[3], &RPA[i].Bytes[0] );
+	}
+
+	memset( &Scan, 0, sizeof(Scan) );
+	Scan.LE_Scan_Type = PASSIVE_SCANNING;
+	Scan.LE_Scan_Interval = 320;
+	Scan.LE_Scan_Window = 320;
+	Scan.Own_Address_Type = OWN_PUBLIC_DEV_ADDR;
+	Scan.Privacy = TRUE;
+	Scan.Role = OBSERVER;
+	Sim_Pause_App( TRUE ); /* Its standby state machine would take the scanner back to standby */
+	Enter_Scanning_Mode( &Scan );
+
+	if( !SIM_CHECK( Wait_BLE_State( SCANNING_STATE ) ) )
+	{
+		printf( "RPA: scanning not entered, state %u\n", Get_BLE_State() );
+		return (FALSE);
+	}
+
+	RPA_CACHE_STATISTICS Start = Get_RPA_Cache_Statistics();
+
+	uint32_t StartUs = Bluenrg_Sim_Get_Time_Us();
+	for( uint32_t Pass = 0; ( Bluenrg_Sim_Get_Time_Us() - StartUs ) < SIM_RPA_TIME_US; Pass++ )
+	{
+		uint8_t Peer = Pass % Entries;
+		uint32_t Reports = Get_Advertising_Cache_Statistics().Reports;
+		uint8_t NewAddress = ( Pass < Entries );
+
+		if( Rotation && ( Pass >= Entries ) && ( ( ( Pass / Entries ) % Rotation ) == 0 ) )
+		{
+			IRK_TYPE IRK;
+
+			memset( &IRK.Bytes[0], 0xA0 + Peer, sizeof(IRK_TYPE) );
+			RPA[Peer].Bytes[3] = Pass;
+			RPA[Peer].Bytes[4] = Pass >> 8;
+			RPA[Peer].Bytes[5] = 0x40 | ( ( Pass >> 16 ) & 0x3F );
+			AES_128_Ah( &IRK.Bytes[0], &RPA[Peer].Bytes[3], &RPA[Peer].Bytes[0] );
+			NewAddress = TRUE;
+		}
+
+		memcpy( &Report[7], &RPA[Peer].Bytes[0], sizeof(BD_ADDR_TYPE) );
+		Report[sizeof(Report) - 1] = 0xC4 - ( Pass % 8 ); /* So that the advertising cache forwards every report */
+
+		uint32_t PushUs = Bluenrg_Sim_Get_Time_Us();
+		while( !Bluenrg_Sim_Push_Packet( &Report[0], sizeof(Report), 0 ) )
+		{
+			Run_Main_Loop();
+		}
+
+		while( ( Get_Advertising_Cache_Statistics().Reports == Reports ) && ( ( Bluenrg_Sim_Get_Time_Us() - PushUs ) < SIM_RPA_TIMEOUT_US ) )
+		{
+			Run_Main_Loop();
+		}
+
+		if( Get_Advertising_Cache_Statistics().Reports == Reports )
+		{
+			Lost++;
+		}else if( NewAddress )
+		{
+			FirstUs += Bluenrg_Sim_Get_Time_Us() - PushUs;
+			FirstReports++;
+		}else
+		{
+			NextUs += Bluenrg_Sim_Get_Time_Us() - PushUs;
+			NextReports++;
+		}
+	}
+
+	for( uint8_t i = 0; i < Entries; i++ )
+	{
+		BD_ADDR_TYPE Identity;
+		int8_t RSSI;
+		uint32_t LastSeen;
+
+		memset( &Identity.Bytes[0], 0x10 + i, sizeof(BD_ADDR_TYPE) );
+		Resolved += Get_Cached_Advertiser( PUBLIC_IDENTITY_ADDR, &Identity, &RSSI, &LastSeen ) ? 1 : 0;
+	}
+
+	RPA_CACHE_STATISTICS End = Get_RPA_Cache_Statistics();
+
+	printf( "RPA: %u entries, %lu reports in %lu simulated us (%.0f reports/s), %lu lost, %lu of %u peers resolved\n", Entries,
+			(unsigned long)( FirstReports + NextReports ), (unsigned long)SIM_RPA_TIME_US,
+			( FirstReports + NextReports ) * 1e6 / SIM_RPA_TIME_US, (unsigned long)Lost, (unsigned long)Resolved, Entries );
+	printf( "Reports with a new address: %lu us mean, with a known address: %lu us mean\n",
+			(unsigned long)( FirstReports ? FirstUs / FirstReports : 0 ), (unsigned long)( NextReports ? NextUs / NextReports : 0 ) );
+	printf( "RPA cache: %lu hits, %lu misses, %lu expired, %lu evictions\n", (unsigned long)( End.Hits - Start.Hits ),
+			(unsigned long)( End.Misses - Start.Misses ), (unsigned long)( End.Expired - Start.Expired ),
+			(unsigned long)( End.Evictions - Start.Evictions ) );
+
+	Passed &= SIM_CHECK( ( FirstReports + NextReports ) != 0 );
+	Passed &= SIM_CHECK( Lost == 0 );
+	Passed &= SIM_CHECK( Resolved == Entries );
+
+	return (Passed);
+}
+
+
+/****************************************************************/
+/* List_Prepare()               	          	      			*/
+/* Purpose: Give the controller the command credits of the		*/
+/* resolving list scenario										*/
+/* Parameters: ArgsPtr: [DEVICES [CREDITS]]						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void List_Prepare( SIM_ARGS* ArgsPtr )
+{
+	Bluenrg_Sim_Set_Command_Credits( Sim_Get_Arg( ArgsPtr, 1, SIM_LIST_CREDITS ) );
+}
+
+
+/****************************************************************/
+/* List_Test()               	          	      				*/
+/* Purpose: Measure a burst of resolving list commands run by	*/
+/* the host												 		*/
+/* Parameters: ArgsPtr: [DEVICES [CREDITS]], the devices added	*/
+/* after clearing the list										*/
+/* Return: TRUE if every command of the burst succeeded.		*/
+/* Description: The whole burst is issued before the first		*/
+/* answer, as fast as the command pipeline takes it. The		*/
+/* controller does not support these commands, so each one		*/
+/* depends on the hosted functions.								*/
+/****************************************************************/
+uint8_t List_Test( SIM_ARGS* ArgsPtr )
+{
+	BD_ADDR_TYPE Address;
+	IRK_TYPE IRK;
+	uint8_t Devices = MIN( MAX( Sim_Get_Arg( ArgsPtr, 0, MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES ), 1 ), MAX_NUMBER_OF_RESOLVING_LIST_ENTRIES );
+	uint8_t Issued = 0;
+	uint8_t Passed = TRUE;
+
+	ListSucceeded = ListBusy = ListFailed = 0;
+	Sim_Pause_App( TRUE ); /* Only the commands of the burst are issued */
+
+	DELEGATED_COMMAND_STATISTICS Start = Get_Delegated_Command_Statistics();
+	uint32_t StartUs = Bluenrg_Sim_Get_Time_Us();
+
+	while( Issued <= Devices )
+	{
+		uint8_t Accepted;
+
+		if( !Issued )
+		{
+			Accepted = HCI_LE_Clear_Resolving_List( &List_Command_Complete, &List_Command_Complete );
+		}else
+		{
+			memset( &Address.Bytes[0], 0x10 + Issued, sizeof(BD_ADDR_TYPE) );
+			memset( &IRK.Bytes[0], 0xA0 + Issued, sizeof(IRK_TYPE) );
+			Accepted = HCI_LE_Add_Device_To_Resolving_List( PEER_PUBLIC_DEV_ADDR, Address, &IRK, &IRK,
+					&List_Command_Complete, &List_Command_Complete );
+		}
+
+		if( Accepted )
+		{
+			Issued++;
+		}else
+		{
+			Run_Main_Loop(); /* The command pipeline is full */
+		}
+	}
+
+	while( ( ( ListSucceeded + ListBusy + ListFailed ) < Issued ) && ( ( Bluenrg_Sim_Get_Time_Us() - StartUs ) < SIM_LIST_TIMEOUT_US ) )
+	{
+		Run_Main_Loop();
+	}
+
+	uint32_t ElapsedUs = Bluenrg_Sim_Get_Time_Us() - StartUs;
+	DELEGATED_COMMAND_STATISTICS End = Get_Delegated_Command_Statistics();
+
+	printf( "List: %u commands in %lu simulated us, %lu succeeded, %lu busy, %lu failed, %lu not answered\n", Issued,
+			(unsigned long)ElapsedUs, (unsigned long)ListSucceeded, (unsigned long)ListBusy, (unsigned long)ListFailed,
+			(unsigned long)( Issued - ListSucceeded - ListBusy - ListFailed ) );
+	printf( "Delegated commands: %lu queued, %lu with the queue full, %lu with lost parameters, %u waiting at most\n",
+			(unsigned long)( End.Queued - Start.Queued ), (unsigned long)( End.Full - Start.Full ),
+			(unsigned long)( End.Lost - Start.Lost ), End.MaxQueued );
+
+	Passed &= SIM_CHECK( ListSucceeded == Issued );
+	Passed &= SIM_CHECK( End.Lost == Start.Lost );
+
+	return (Passed);
+}
+
+
+/****************************************************************/
+/* Encrypt_Complete()               	          	      		*/
+/* Purpose: HCI_LE_Encrypt complete callback of the AES scenario*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The result is checked against the software		*/
+/* AES-128.														*/
+/****************************************************************/
+static void Encrypt_Complete( CONTROLLER_ERROR_CODES Status, uint8_t Encrypted_Data[16] )
+{
+	uint8_t Expected[16];
+
+	AES_128_Encrypt_Block( &EncryptKey[0], &EncryptPlaintext[0], &Expected[0] );
+	if( ( Status != COMMAND_SUCCESS ) || ( memcmp( &Encrypted_Data[0], &Expected[0], sizeof(Expected) ) != 0 ) )
+	{
+		EncryptFailed++;
+	}
+	EncryptCompleted++;
+}
+
+
+/****************************************************************/
+/* Encrypt_Status()               	          	      			*/
+/* Purpose: HCI_LE_Encrypt status callback of the AES scenario	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Only called on failure, the command is counted	*/
+/* as done so that the scenario does not stall.					*/
+/****************************************************************/
+static void Encrypt_Status( CONTROLLER_ERROR_CODES Status )
+{
+	EncryptFailed++;
+	EncryptCompleted++;
+}
+
+
+/****************************************************************/
+/* Flash_Lookup()               	          	      			*/
+/* Purpose: Look a peer identity up on the flash records.		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Reference for the scenario, each record is		*/
+/* read from flash in list order.								*/
+/****************************************************************/
+static RESOLVING_RECORD* Flash_Lookup( IDENTITY_ADDRESS* Peer_Identity_Address )
+{
+	RESOLVING_RECORD* RecordPtr;
+
+	for( uint16_t i = 0; ( RecordPtr = (RESOLVING_RECORD*)FLASH_Read( FLASH_KEY_RESOLVING_RECORD + i, NULL ) ) != NULL; i++ )
+	{
+		if( memcmp( &( RecordPtr->Peer.Peer_Identity_Address ), Peer_Identity_Address, sizeof(IDENTITY_ADDRESS) ) == 0 )
+		{
+			return ( RecordPtr );
+		}
+	}
+
+	return (NULL);
+}
+
+
+/****************************************************************/
+/* Compare_Resolving_Records()               	          	    */
+/* Purpose: Check the RAM records against the flash ones.		*/
+/* Parameters: none				         						*/
+/* Return: Identities found differently on flash and on RAM.	*/
+/* Description:													*/
+/****************************************************************/
+static uint32_t Compare_Resolving_Records( IDENTITY_ADDRESS Identities[], uint8_t Count )
+{
+	uint32_t Mismatches = 0;
+
+	for( uint8_t i = 0; i < Count; i++ )
+	{
+		RESOLVING_RECORD* FlashPtr = Flash_Lookup( &Identities[i] );
+		RESOLVING_RECORD* IndexPtr = Get_Record_From_Peer_Identity( &Identities[i] );
+
+		if( ( ( FlashPtr == NULL ) != ( IndexPtr == NULL ) ) ||
+			( ( FlashPtr != NULL ) && ( memcmp( FlashPtr, IndexPtr, sizeof(RESOLVING_RECORD) ) != 0 ) ) )
+		{
+			Mismatches++;
+		}
+	}
+
+	return (Mismatches);
+}
+
+
+/****************************************************************/
+/* List_Command_Complete()               	          	      	*/
+/* Purpose: Answer of a command of the resolving list scenario	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Also the status callback, which is only called	*/
+/* on failure.													*/
+/****************************************************************/
+static void List_Command_Complete( CONTROLLER_ERROR_CODES Status )
+{
+	if( Status == COMMAND_SUCCESS )
+	{
+		ListSucceeded++;
+	}else if( Status == CONTROLLER_BUSY )
+	{
+		ListBusy++;
+	}else
+	{
+		ListFailed++;
+	}
+}
+
+
+#endif /* BLE_HAL_SIMULATION */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
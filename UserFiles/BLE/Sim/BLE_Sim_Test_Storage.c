@@ -0,0 +1,180 @@
+
+
+/* Scenario of the flash record log, run by the host build against the simulated
+ * flash (see BLE_Sim_Main.c). */
+#ifdef BLE_HAL_SIMULATION
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include "BLE_Sim_Test.h"
+#include "flash.h"
+#include "Flash_Sim.h"
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define SIM_FLASH_TEST_KEY		0x7F00 /* Keys not used by the firmware */
+#define SIM_FLASH_TEST_KEYS		6
+#define SIM_FLASH_TEST_MAX_SIZE	40
+#define SIM_FLASH_UPDATES		2000
+#define SIM_FLASH_POWER_FAILS	1000
+
+
+/****************************************************************/
+/* Static functions declaration                                 */
+/****************************************************************/
+static void Flash_Test_Update( uint16_t Index, uint8_t DataPtr[], uint16_t* DataSize );
+static uint8_t Flash_Test_Check( uint16_t Index, uint8_t DataPtr[], uint16_t DataSize );
+
+
+/****************************************************************/
+/* Local variables definition                                   */
+/****************************************************************/
+static uint8_t FlashShadow[SIM_FLASH_TEST_KEYS][SIM_FLASH_TEST_MAX_SIZE];
+static uint16_t FlashShadowSize[SIM_FLASH_TEST_KEYS]; /* Zero for deleted keys */
+
+
+/****************************************************************/
+/* Flash_Test()               	          	      				*/
+/* Purpose: Exercise the flash record log						*/
+/* Parameters: none				         						*/
+/* Return: TRUE if all values were read back as expected.		*/
+/* Description: Random values (or deletions) are written to a	*/
+/* few keys and checked against a RAM copy. Then the power is	*/
+/* lost in the middle of random writes: after the log is 		*/
+/* scanned again, the interrupted key must hold either the old	*/
+/* or the new value and the other keys must be untouched.		*/
+/****************************************************************/
+uint8_t Flash_Test( SIM_ARGS* ArgsPtr )
+{
+	uint8_t Data[SIM_FLASH_TEST_MAX_SIZE];
+	uint16_t DataSize;
+	uint32_t Errors = 0;
+	uint32_t PowerLosses = 0;
+	FLASH_SIM_STATISTICS* StatsPtr = Flash_Sim_Get_Statistics();
+	uint8_t Passed = TRUE;
+
+	FLASH_Init();
+	for( uint16_t Key = 0; Key < SIM_FLASH_TEST_KEYS; Key++ )
+	{
+		FLASH_Delete( SIM_FLASH_TEST_KEY + Key );
+	}
+	Flash_Sim_Clear_Statistics();
+
+	for( uint32_t i = 0; i < SIM_FLASH_UPDATES; i++ )
+	{
+		uint16_t Index = rand() % SIM_FLASH_TEST_KEYS;
+
+		Flash_Test_Update( Index, &Data[0], &DataSize );
+		memcpy( &FlashShadow[Index][0], &Data[0], DataSize );
+		FlashShadowSize[Index] = DataSize;
+
+		for( uint16_t Key = 0; Key < SIM_FLASH_TEST_KEYS; Key++ )
+		{
+			Errors += Flash_Test_Check( Key, &FlashShadow[Key][0], FlashShadowSize[Key] ) ? 0 : 1;
+		}
+	}
+
+	printf( "Flash: %u updates, %lu halfwords programmed (%.1f per update), %lu erases (", SIM_FLASH_UPDATES,
+			(unsigned long)StatsPtr->HalfwordPrograms, (double)StatsPtr->HalfwordPrograms / SIM_FLASH_UPDATES, (unsigned long)StatsPtr->Erases );
+	for( uint8_t Page = 0; Page < FLASH_NUMBER_OF_PAGES; Page++ )
+	{
+		printf( ( Page == 0 ) ? "%lu" : "/%lu", (unsigned long)StatsPtr->PageErases[Page] );
+	}
+	printf( " per page), %lu program errors\n", (unsigned long)StatsPtr->ProgramErrors );
+
+	Passed &= SIM_CHECK( Errors == 0 );
+	Passed &= SIM_CHECK( StatsPtr->ProgramErrors == 0 );
+
+	for( uint32_t i = 0; i < SIM_FLASH_POWER_FAILS; i++ )
+	{
+		uint16_t Index = rand() % SIM_FLASH_TEST_KEYS;
+
+		Flash_Sim_Power_Fail( rand() % 64 );
+		Flash_Test_Update( Index, &Data[0], &DataSize );
+		PowerLosses += Flash_Sim_Power_Lost() ? 1 : 0;
+		Flash_Sim_Power_Restore();
+
+		/* Restart */
+		FLASH_Init();
+
+		if( Flash_Test_Check( Index, &Data[0], DataSize ) )
+		{
+			memcpy( &FlashShadow[Index][0], &Data[0], DataSize );
+			FlashShadowSize[Index] = DataSize;
+		}else if( !Flash_Test_Check( Index, &FlashShadow[Index][0], FlashShadowSize[Index] ) )
+		{
+			Errors++;
+		}
+
+		for( uint16_t Key = 0; Key < SIM_FLASH_TEST_KEYS; Key++ )
+		{
+			Errors += Flash_Test_Check( Key, &FlashShadow[Key][0], FlashShadowSize[Key] ) ? 0 : 1;
+		}
+	}
+
+	printf( "Flash: %u writes with %lu power losses, %lu errors\n", SIM_FLASH_POWER_FAILS, (unsigned long)PowerLosses, (unsigned long)Errors );
+
+	Passed &= SIM_CHECK( Errors == 0 );
+	Passed &= SIM_CHECK( PowerLosses != 0 ); /* Otherwise the recovery was not exercised */
+
+	return (Passed);
+}
+
+
+/****************************************************************/
+/* Flash_Test_Update()               	          	      		*/
+/* Purpose: Write a random value to a test key, or delete it	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The value written is returned in DataPtr.		*/
+/****************************************************************/
+static void Flash_Test_Update( uint16_t Index, uint8_t DataPtr[], uint16_t* DataSize )
+{
+	*DataSize = ( rand() % 8 ) ? ( 1 + ( rand() % SIM_FLASH_TEST_MAX_SIZE ) ) : 0;
+
+	for( uint16_t i = 0; i < *DataSize; i++ )
+	{
+		DataPtr[i] = rand() & 0xFF;
+	}
+
+	if( *DataSize )
+	{
+		FLASH_Write( SIM_FLASH_TEST_KEY + Index, &DataPtr[0], *DataSize );
+	}else
+	{
+		FLASH_Delete( SIM_FLASH_TEST_KEY + Index );
+	}
+}
+
+
+/****************************************************************/
+/* Flash_Test_Check()               	          	      		*/
+/* Purpose: Compare a test key with the expected value			*/
+/* Parameters: none				         						*/
+/* Return: TRUE if equal.										*/
+/* Description: Zero size means the key must not exist.			*/
+/****************************************************************/
+static uint8_t Flash_Test_Check( uint16_t Index, uint8_t DataPtr[], uint16_t DataSize )
+{
+	uint16_t Size;
+	uint8_t* Ptr = FLASH_Read( SIM_FLASH_TEST_KEY + Index, &Size );
+
+	if( Ptr == NULL )
+	{
+		return ( ( DataSize == 0 ) ? TRUE : FALSE );
+	}
+
+	return ( ( Size == DataSize ) && ( memcmp( Ptr, &DataPtr[0], DataSize ) == 0 ) );
+}
+
+
+#endif /* BLE_HAL_SIMULATION */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
@@ -0,0 +1,544 @@
+
+
+/* Scenarios of the Bluenrg driver and of the HCI transport layer, run by the host
+ * build against the simulated BlueNRG-MS (see BLE_Sim_Main.c). */
+#ifdef BLE_HAL_SIMULATION
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include "BLE_Sim_Test.h"
+#include "Bluenrg.h"
+#include "App.h"
+#include "BLE_HAL_Sim.h"
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define SIM_STARTUP_CREDITS		1		  /* Default Num_HCI_Command_Packets of the startup scenario */
+#define SIM_QUEUE_STRESS_TIME_US 2000000UL /* Simulated time of each queue stress run */
+#define SIM_TRACE_FILE			"hci_trace.btsnoop"
+#define SIM_TRACE_MAX_SIZE		4096	  /* Larger than the btsnoop file of the whole HCI trace ring */
+#define SIM_ACL_PACKETS			100		  /* Default ACL packets of the data scenarios */
+#define SIM_ACL_TIMEOUT_US		10000000UL /* The scenario stops if the packets were not received by then */
+#define SIM_RX_HOLD_TIME_US		1000UL	  /* Default time the application keeps each received ACL packet */
+#define SIM_RX_HELD_PACKETS		8		  /* Packets the application can hold at the same time */
+#define SIM_RX_LEAK_WAIT_US		1500000UL /* Time given to the driver to report the packet never released */
+#define SIM_LINKS				3		  /* Default links of the credit scenario */
+#define SIM_LINKS_TIME_US		1000000UL /* Simulated time of the credit scenario */
+#define SIM_LINKS_BUSY_TRIES	4		  /* Packets tried by the busy link for each one of the others */
+
+
+/****************************************************************/
+/* Static functions declaration                                 */
+/****************************************************************/
+static void Trace_Output( uint8_t* DataPtr, uint16_t DataSize );
+static uint32_t Get_Big_Endian( uint8_t* DataPtr );
+
+
+/****************************************************************/
+/* Local variables definition                                   */
+/****************************************************************/
+static const uint16_t QueueStressLoopDivider[] = { 1, 25, 50, 100, 200 }; /* Main loop passes per firmware run */
+static FILE* TraceFile;
+static uint8_t TraceCopy[SIM_TRACE_MAX_SIZE]; /* What was written to TraceFile */
+static uint16_t TraceSize;
+static uint8_t RXTestRunning = FALSE;
+static uint32_t RXReceived; /* ACL packets read from the controller */
+static uint32_t RXNotHeld;	/* ACL packets the application would have to copy */
+static void* RXHeld[SIM_RX_HELD_PACKETS]; /* Held packets, oldest first */
+static uint32_t RXHeldTimeUs[SIM_RX_HELD_PACKETS];
+static uint8_t RXHeldCount;
+
+
+/****************************************************************/
+/* Startup_Prepare()               	          	      			*/
+/* Purpose: Give the controller the command credits of the		*/
+/* startup scenario												*/
+/* Parameters: ArgsPtr: [CREDITS]								*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Startup_Prepare( SIM_ARGS* ArgsPtr )
+{
+	Bluenrg_Sim_Set_Command_Credits( Sim_Get_Arg( ArgsPtr, 0, SIM_STARTUP_CREDITS ) );
+}
+
+
+/****************************************************************/
+/* Startup_Test()               	          	      			*/
+/* Purpose: Report the time taken by BLE_Init()					*/
+/* Parameters: ArgsPtr: [CREDITS]								*/
+/* Return: TRUE if the setup was done with commands.			*/
+/* Description: Runs once the initial setup is done.			*/
+/****************************************************************/
+uint8_t Startup_Test( SIM_ARGS* ArgsPtr )
+{
+	SIM_SETUP* SetupPtr = Sim_Get_Setup();
+	uint8_t Passed = TRUE;
+
+	printf( "BLE_Init: %lu us, %lu commands with %lu command credits\n", (unsigned long)( SetupPtr->SetupDoneUs - SetupPtr->InitStartUs ),
+			(unsigned long)SetupPtr->InitCommands, (unsigned long)Sim_Get_Arg( ArgsPtr, 0, SIM_STARTUP_CREDITS ) );
+
+	Passed &= SIM_CHECK( SetupPtr->InitStartUs != 0 );
+	Passed &= SIM_CHECK( SetupPtr->SetupDoneUs > SetupPtr->InitStartUs );
+	Passed &= SIM_CHECK( SetupPtr->InitCommands != 0 );
+
+	return (Passed);
+}
+
+
+/****************************************************************/
+/* Queue_Test()               	          	      				*/
+/* Purpose: Flood the driver queues with advertising reports	*/
+/* Parameters: none				         						*/
+/* Return: TRUE if no queue dropped and the driver did not fail	*/
+/* Description: The controller output is kept full, so the 		*/
+/* reports arrive as fast as the SPI can read them. The DMA and	*/
+/* IRQ pin "interrupts" run at every pass of the loop, but the	*/
+/* firmware (and so the consumer of the callback queues) only	*/
+/* runs once every QueueStressLoopDivider passes, like a main	*/
+/* loop busy with other work. The reads must stall rather than	*/
+/* drop when the read callback queue is full.					*/
+/****************************************************************/
+uint8_t Queue_Test( SIM_ARGS* ArgsPtr )
+{
+	uint8_t Report[] = { HCI_EVENT_PACKET, LE_META, 12, LE_ADVERTISING_REPORT, 1, /* Num_Reports */
+			0x03, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0xC0, /* ADV_NONCONN_IND from a public address */
+			0, 0xC4 }; /* No data, RSSI of -60 dBm */
+	BLUENRG_SIM_STATISTICS* StatsPtr = Bluenrg_Sim_Get_Statistics();
+	uint8_t Passed = TRUE;
+
+	for( uint8_t Run = 0; Run < ( sizeof(QueueStressLoopDivider) / sizeof(QueueStressLoopDivider[0]) ); Run++ )
+	{
+		QUEUE_STATISTICS Start[WRITE_CALLBACK_QUEUE + 1];
+		uint32_t DriverErrors = StatsPtr->DriverErrors;
+		uint32_t PacketsSent = StatsPtr->PacketsSent;
+		uint32_t Refused = 0;
+		uint32_t EndUs = Bluenrg_Sim_Get_Time_Us() + SIM_QUEUE_STRESS_TIME_US;
+		uint32_t Pass = 0;
+		uint32_t Drops = 0;
+
+		for( QUEUE_ID QueueId = TRANSPORT_FRAME_QUEUE; QueueId <= WRITE_CALLBACK_QUEUE; QueueId++ )
+		{
+			Start[QueueId] = Get_Queue_Statistics( QueueId );
+		}
+
+		while( (int32_t)( Bluenrg_Sim_Get_Time_Us() - EndUs ) < 0 )
+		{
+			Refused += Bluenrg_Sim_Push_Packet( &Report[0], sizeof(Report), 0 ) ? 0 : 1;
+
+			if( ( Pass++ % QueueStressLoopDivider[Run] ) == 0 )
+			{
+				Run_Bluenrg();
+				Run_BLE();
+				App_Run();
+			}
+			Bluenrg_Sim_Run();
+		}
+
+		printf( "Firmware every %3u passes:", QueueStressLoopDivider[Run] );
+		for( QUEUE_ID QueueId = TRANSPORT_FRAME_QUEUE; QueueId <= READ_CALLBACK_QUEUE; QueueId++ )
+		{
+			QUEUE_STATISTICS End = Get_Queue_Statistics( QueueId );
+			uint32_t Enqueues = End.Enqueues - Start[QueueId].Enqueues;
+			uint32_t QueueDrops = End.Drops - Start[QueueId].Drops;
+
+			printf( " queue %u %lu/%lu dropped (%.1f%%),", QueueId, (unsigned long)QueueDrops, (unsigned long)( Enqueues + QueueDrops ),
+					( Enqueues + QueueDrops ) ? ( 100.0 * QueueDrops / ( Enqueues + QueueDrops ) ) : 0.0 );
+			Drops += QueueDrops;
+		}
+		QUEUE_STATISTICS End = Get_Queue_Statistics( READ_CALLBACK_QUEUE );
+		uint32_t Dequeues = End.Dequeues - Start[READ_CALLBACK_QUEUE].Dequeues;
+		printf( " read callback mean dwell %lu us, %lu read stalls,", Dequeues ?
+				(unsigned long)( ( End.TotalDwellTimeUs - Start[READ_CALLBACK_QUEUE].TotalDwellTimeUs ) / Dequeues ) : 0UL,
+				(unsigned long)( End.Stalls - Start[READ_CALLBACK_QUEUE].Stalls ) );
+		printf( " %lu packets read, %lu refused by the controller,", (unsigned long)( StatsPtr->PacketsSent - PacketsSent ), (unsigned long)Refused );
+		printf( " %lu driver errors\n", (unsigned long)( StatsPtr->DriverErrors - DriverErrors ) );
+
+		Passed &= SIM_CHECK( Drops == 0 );
+		Passed &= SIM_CHECK( StatsPtr->DriverErrors == DriverErrors );
+		Passed &= SIM_CHECK( StatsPtr->PacketsSent != PacketsSent );
+	}
+
+	return (Passed);
+}
+
+
+/****************************************************************/
+/* Trace_Test()               	          	      				*/
+/* Purpose: Write the HCI trace of the run to a btsnoop file	*/
+/* Parameters: ArgsPtr: [FILE]									*/
+/* Return: TRUE if the file is well formed and accounts for		*/
+/* every packet of the run.										*/
+/* Description: Runs at the end of the run. The drop counter of	*/
+/* the first record plus the records dumped must be the packets	*/
+/* exchanged with the controller, and no counter may go back.	*/
+/****************************************************************/
+uint8_t Trace_Test( SIM_ARGS* ArgsPtr )
+{
+	static const uint8_t Identification[8] = { 'b', 't', 's', 'n', 'o', 'o', 'p', '\0' };
+	BLUENRG_SIM_STATISTICS* StatsPtr = Bluenrg_Sim_Get_Statistics();
+	const char* FileName = ( ArgsPtr->Count > 0 ) ? ArgsPtr->Values[0] : SIM_TRACE_FILE;
+	uint32_t FirstDrops = 0, LastDrops = 0, Records = 0, BadRecords = 0;
+	uint64_t LastTimeStamp = 0;
+	uint8_t Passed = TRUE;
+
+	TraceFile = fopen( FileName, "wb" );
+	if( !SIM_CHECK( TraceFile != NULL ) )
+	{
+		return (FALSE);
+	}
+	TraceSize = 0;
+	uint16_t Packets = Bluenrg_Dump_HCI_Trace( &Trace_Output );
+	fclose( TraceFile );
+
+	printf( "HCI trace: %u packets written to %s\n", Packets, FileName );
+
+	Passed &= SIM_CHECK( ( TraceSize >= 16 ) && ( memcmp( &TraceCopy[0], &Identification[0], sizeof(Identification) ) == 0 ) );
+	Passed &= SIM_CHECK( ( TraceSize >= 16 ) && ( Get_Big_Endian( &TraceCopy[8] ) == 1 ) && ( Get_Big_Endian( &TraceCopy[12] ) == 1002 ) ); /* Version 1, H4 */
+
+	for( uint16_t Offset = 16; ( Offset + 24 ) <= TraceSize; Records++ )
+	{
+		uint8_t* RecordPtr = &TraceCopy[Offset];
+		uint32_t IncludedSize = Get_Big_Endian( &RecordPtr[4] );
+		uint32_t Drops = Get_Big_Endian( &RecordPtr[12] );
+		uint64_t TimeStamp = ( (uint64_t)Get_Big_Endian( &RecordPtr[16] ) << 32 ) | Get_Big_Endian( &RecordPtr[20] );
+
+		FirstDrops = ( Records == 0 ) ? Drops : FirstDrops;
+		if( ( IncludedSize == 0 ) || ( IncludedSize > Get_Big_Endian( &RecordPtr[0] ) ) || ( ( Offset + 24 + IncludedSize ) > TraceSize ) ||
+			( ( Records != 0 ) && ( ( Drops < LastDrops ) || ( TimeStamp < LastTimeStamp ) ) ) )
+		{
+			BadRecords++;
+		}
+		LastDrops = Drops;
+		LastTimeStamp = TimeStamp;
+		Offset += 24 + IncludedSize;
+	}
+
+	printf( "HCI trace: %lu records, %lu packets dropped before the first one, %lu malformed\n", (unsigned long)Records,
+			(unsigned long)FirstDrops, (unsigned long)BadRecords );
+
+	Passed &= SIM_CHECK( ( Records == Packets ) && ( Records != 0 ) );
+	Passed &= SIM_CHECK( BadRecords == 0 );
+	Passed &= SIM_CHECK( ( FirstDrops + Records ) == ( StatsPtr->CommandsReceived + StatsPtr->ACLPacketsReceived + StatsPtr->PacketsSent ) );
+
+	return (Passed);
+}
+
+
+/****************************************************************/
+/* ACL_Prepare()               	          	      				*/
+/* Purpose: Make the controller not ready after each ACL packet	*/
+/* Parameters: ArgsPtr: [PACKETS [BUSY_US]]						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void ACL_Prepare( SIM_ARGS* ArgsPtr )
+{
+	Bluenrg_Sim_Set_Busy_Time( Sim_Get_Arg( ArgsPtr, 1, 0 ) );
+}
+
+
+/****************************************************************/
+/* ACL_Test()               	          	      				*/
+/* Purpose: Measure the transport of a burst of ACL packets		*/
+/* Parameters: ArgsPtr: [PACKETS [BUSY_US]]						*/
+/* Return: TRUE if the controller received every packet.		*/
+/* Description: A new 27-byte packet is given to 				*/
+/* HCI_Host_ACL_Data() whenever the previous one was accepted, 	*/
+/* so the rate is set by the data credits of the controller and	*/
+/* by the driver. A busy controller must be waited for with		*/
+/* holds rather than with headers polling it.					*/
+/****************************************************************/
+uint8_t ACL_Test( SIM_ARGS* ArgsPtr )
+{
+	BLUENRG_SIM_STATISTICS* StatsPtr = Bluenrg_Sim_Get_Statistics();
+	HCI_ACL_DATA_PCKT_HEADER Header = { .Handle = SIM_ACL_HANDLE, .PB_Flag = 0, .BC_Flag = 0, .Data_Total_Length = 27 };
+	uint32_t Packets = Sim_Get_Arg( ArgsPtr, 0, SIM_ACL_PACKETS );
+	uint8_t Data[27];
+	uint8_t Passed = TRUE;
+
+	if( !SIM_CHECK( Open_Sim_Links( 1 ) ) )
+	{
+		return (FALSE);
+	}
+
+	uint32_t StartUs = Bluenrg_Sim_Get_Time_Us();
+	uint32_t StartBusTimeUs = StatsPtr->BusTimeUs;
+	uint32_t StartReceived = StatsPtr->ACLPacketsReceived;
+	uint32_t StartHeaderWrites = StatsPtr->HeaderWrites;
+	uint32_t StartPayloadWrites = StatsPtr->PayloadWrites;
+	WRITE_HEADER_STATISTICS Start = Get_Write_Header_Statistics();
+	HOLD_STATISTICS StartHolds = Get_Hold_Statistics();
+	uint32_t Sent = 0;
+
+	while( ( ( StatsPtr->ACLPacketsReceived - StartReceived ) < Packets ) && ( ( Bluenrg_Sim_Get_Time_Us() - StartUs ) < SIM_ACL_TIMEOUT_US ) )
+	{
+		if( Sent < Packets )
+		{
+			memset( &Data[0], Sent & 0xFF, sizeof(Data) );
+			Sent += HCI_Host_ACL_Data( &Header, &Data[0] ) ? 1 : 0;
+		}
+		Run_Main_Loop();
+	}
+
+	WRITE_HEADER_STATISTICS End = Get_Write_Header_Statistics();
+	HOLD_STATISTICS EndHolds = Get_Hold_Statistics();
+
+	uint32_t Received = StatsPtr->ACLPacketsReceived - StartReceived;
+	uint32_t ElapsedUs = Bluenrg_Sim_Get_Time_Us() - StartUs;
+	uint32_t NotReadyHolds = EndHolds.Holds[HOLD_DEVICE_NOT_READY] - StartHolds.Holds[HOLD_DEVICE_NOT_READY];
+
+	printf( "ACL: %lu/%lu packets in %lu us, %lu us of bus time, %lu write headers, %lu headers avoided\n",
+			(unsigned long)Received, (unsigned long)Packets, (unsigned long)ElapsedUs, (unsigned long)( StatsPtr->BusTimeUs - StartBusTimeUs ),
+			(unsigned long)( StatsPtr->HeaderWrites - StartHeaderWrites ), (unsigned long)( End.HeadersAvoided - Start.HeadersAvoided ) );
+	printf( "ACL: %lu writes, %lu packets coalesced, %.0f packets/s, %.0f bytes/s\n",
+			(unsigned long)( StatsPtr->PayloadWrites - StartPayloadWrites ), (unsigned long)( End.PacketsCoalesced - Start.PacketsCoalesced ),
+			( Received * 1e6 ) / ElapsedUs, ( Received * sizeof(Data) * 1e6 ) / ElapsedUs );
+	printf( "Holds: %lu not ready, %lu no write, %lu erroneous, %lu ended by IRQ, %lu us held, longest %lu us\n",
+			(unsigned long)NotReadyHolds,
+			(unsigned long)( EndHolds.Holds[HOLD_NO_ALLOWED_WRITE] - StartHolds.Holds[HOLD_NO_ALLOWED_WRITE] ),
+			(unsigned long)( EndHolds.Holds[HOLD_ERRONEOUS_RESPONSE] - StartHolds.Holds[HOLD_ERRONEOUS_RESPONSE] ),
+			(unsigned long)( EndHolds.WakeUps - StartHolds.WakeUps ), (unsigned long)( EndHolds.TotalHoldTimeUs - StartHolds.TotalHoldTimeUs ),
+			(unsigned long)EndHolds.MaxHoldTimeUs );
+
+	Passed &= SIM_CHECK( Received == Packets );
+	Passed &= SIM_CHECK( ( Sim_Get_Arg( ArgsPtr, 1, 0 ) == 0 ) || ( NotReadyHolds != 0 ) );
+
+	return (Passed);
+}
+
+
+/****************************************************************/
+/* RX_Test()               	          	      					*/
+/* Purpose: Measure the reception of a burst of ACL packets		*/
+/* held by the application										*/
+/* Parameters: ArgsPtr: [PACKETS [HOLD_US]]						*/
+/* Return: TRUE if every packet was received and held, and the	*/
+/* one never released was reported as a leak.					*/
+/* Description: The controller output is kept full. A held 		*/
+/* packet occupies its read callback entry, so the reads stall	*/
+/* when the application holds all of them.						*/
+/****************************************************************/
+uint8_t RX_Test( SIM_ARGS* ArgsPtr )
+{
+	BLUENRG_SIM_STATISTICS* StatsPtr = Bluenrg_Sim_Get_Statistics();
+	/* Each packet holds a whole B-frame of 23 bytes */
+	uint8_t Packet[5 + 27] = { HCI_ACL_DATA_PACKET, SIM_ACL_HANDLE & 0xFF, 0x20 | ( SIM_ACL_HANDLE >> 8 ), 27, 0, 23, 0, APP_DATA_CID, 0 };
+	uint32_t Packets = Sim_Get_Arg( ArgsPtr, 0, SIM_ACL_PACKETS );
+	uint32_t HoldTimeUs = Sim_Get_Arg( ArgsPtr, 1, SIM_RX_HOLD_TIME_US );
+	uint32_t StartUs = Bluenrg_Sim_Get_Time_Us();
+	uint32_t StartStalls = Get_Queue_Statistics( READ_CALLBACK_QUEUE ).Stalls;
+	RECEIVED_PACKET_STATISTICS Start = Get_Received_Packet_Statistics();
+	uint32_t Pushed = 0;
+	uint8_t Passed = TRUE;
+
+	RXReceived = 0;
+	RXNotHeld = 0;
+	RXHeldCount = 0;
+	RXTestRunning = TRUE;
+
+	while( ( RXReceived < Packets ) && ( ( Bluenrg_Sim_Get_Time_Us() - StartUs ) < SIM_ACL_TIMEOUT_US ) )
+	{
+		if( Pushed < Packets )
+		{
+			memset( &Packet[9], Pushed & 0xFF, 23 );
+			Pushed += Bluenrg_Sim_Push_Packet( &Packet[0], sizeof(Packet), 0 ) ? 1 : 0;
+		}
+
+		/* The last packet is kept for the leak detector */
+		if( ( RXHeldCount != 0 ) && ( RXReceived < Packets ) && ( ( Bluenrg_Sim_Get_Time_Us() - RXHeldTimeUs[0] ) >= HoldTimeUs ) )
+		{
+			Release_Received_Packet( RXHeld[0] );
+			RXHeldCount--;
+			memmove( &RXHeld[0], &RXHeld[1], RXHeldCount * sizeof(RXHeld[0]) );
+			memmove( &RXHeldTimeUs[0], &RXHeldTimeUs[1], RXHeldCount * sizeof(RXHeldTimeUs[0]) );
+		}
+		Run_Main_Loop();
+	}
+
+	uint32_t ElapsedUs = Bluenrg_Sim_Get_Time_Us() - StartUs;
+	RECEIVED_PACKET_STATISTICS Held = Get_Received_Packet_Statistics();
+
+	printf( "RX: %lu/%lu packets in %lu us, %.0f packets/s, %lu not held, at most %u held, %lu read stalls\n",
+			(unsigned long)RXReceived, (unsigned long)Packets, (unsigned long)ElapsedUs, ( RXReceived * 1e6 ) / ElapsedUs,
+			(unsigned long)RXNotHeld, Held.HighWaterMark, (unsigned long)( Get_Queue_Statistics( READ_CALLBACK_QUEUE ).Stalls - StartStalls ) );
+
+	/* Only the last packet is still held */
+	while( RXHeldCount > 1 )
+	{
+		RXHeldCount--;
+		Release_Received_Packet( RXHeld[RXHeldCount] );
+	}
+
+	StartUs = Bluenrg_Sim_Get_Time_Us();
+	while( ( Bluenrg_Sim_Get_Time_Us() - StartUs ) < SIM_RX_LEAK_WAIT_US )
+	{
+		Run_Main_Loop();
+	}
+
+	RXTestRunning = FALSE;
+	Held = Get_Received_Packet_Statistics();
+	printf( "RX: %lu holds, %lu releases, %u held, %lu leaks (%lu packets sent by the controller)\n", (unsigned long)Held.Holds,
+			(unsigned long)Held.Releases, Held.Held, (unsigned long)Held.Leaks, (unsigned long)StatsPtr->PacketsSent );
+
+	Passed &= SIM_CHECK( RXReceived == Packets );
+	Passed &= SIM_CHECK( ( Held.Holds - Start.Holds ) == ( RXReceived - RXNotHeld ) );
+	Passed &= SIM_CHECK( ( Held.Releases - Start.Releases ) == ( Held.Holds - Start.Holds - 1 ) ); /* All but the last one */
+	Passed &= SIM_CHECK( ( Held.Leaks - Start.Leaks ) == 1 );
+
+	return (Passed);
+}
+
+
+/****************************************************************/
+/* Links_Test()               	          	      				*/
+/* Purpose: Check how the controller buffers are shared by 		*/
+/* links that always have data to send							*/
+/* Parameters: ArgsPtr: [LINKS], from handle SIM_ACL_HANDLE on	*/
+/* Return: TRUE if every link sent at least half as many		*/
+/* packets as the busiest one.									*/
+/* Description: The first link tries SIM_LINKS_BUSY_TRIES 		*/
+/* packets for each one tried by the others, and before them.	*/
+/****************************************************************/
+uint8_t Links_Test( SIM_ARGS* ArgsPtr )
+{
+	uint8_t Data[27];
+	HCI_ACL_DATA_PCKT_HEADER Header = { .PB_Flag = 0x0, .BC_Flag = 0x0, .Data_Total_Length = sizeof(Data) };
+	uint8_t Links = MAX( Sim_Get_Arg( ArgsPtr, 0, SIM_LINKS ), 1 );
+	uint32_t MostSent = 0;
+	uint32_t LeastSent = UINT32_MAX;
+	uint8_t Passed = TRUE;
+
+	memset( &Data[0], 0x55, sizeof(Data) );
+
+	if( !SIM_CHECK( Open_Sim_Links( Links ) ) )
+	{
+		return (FALSE);
+	}
+
+	uint32_t StartUs = Bluenrg_Sim_Get_Time_Us();
+	while( ( Bluenrg_Sim_Get_Time_Us() - StartUs ) < SIM_LINKS_TIME_US )
+	{
+		for( uint8_t i = 0; i < Links; i++ )
+		{
+			Header.Handle = SIM_ACL_HANDLE + i;
+
+			for( uint8_t j = 0; j < ( ( i == 0 ) ? SIM_LINKS_BUSY_TRIES : 1 ); j++ )
+			{
+				HCI_Host_ACL_Data( &Header, &Data[0] );
+			}
+		}
+		Run_Main_Loop();
+	}
+
+	for( uint8_t i = 0; i < Links; i++ )
+	{
+		HCI_LINK_CREDITS Credits;
+
+		if( SIM_CHECK( HCI_Get_Link_Credits( i, &Credits ) ) )
+		{
+			printf( "Link 0x%04X: %lu packets sent, %u in flight (max %u), %lu credit waits, %lu us waited (max %lu us)\n",
+					Credits.Connection_Handle, (unsigned long)Credits.PacketsSent, Credits.InFlight, Credits.MaxInFlight,
+					(unsigned long)Credits.CreditWaits, (unsigned long)Credits.WaitTimeUs, (unsigned long)Credits.MaxWaitTimeUs );
+			MostSent = MAX( MostSent, Credits.PacketsSent );
+			LeastSent = MIN( LeastSent, Credits.PacketsSent );
+		}else
+		{
+			Passed = FALSE;
+		}
+	}
+
+	Passed &= SIM_CHECK( LeastSent != 0 );
+	Passed &= SIM_CHECK( ( 2 * (uint64_t)LeastSent ) >= MostSent );
+
+	return (Passed);
+}
+
+
+/****************************************************************/
+/* Bluenrg_CallBack_Config()               	          	      	*/
+/* Purpose: Look at each packet read from the controller		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: During RX_Test() the ACL packets are held		*/
+/* here rather than copied, since HCI_Controller_ACL_Data()		*/
+/* belongs to the application.									*/
+/****************************************************************/
+void Bluenrg_CallBack_Config( TRANSFER_CALL_BACK_MODE* CallBackMode, HCI_PACKET_TYPE PacketType, uint8_t* DataPtr )
+{
+	*CallBackMode = CALL_BACK_BUFFERED;
+
+	if( ( !RXTestRunning ) || ( PacketType != HCI_ACL_DATA_PACKET ) )
+	{
+		return;
+	}
+
+	RXReceived++;
+
+	if( ( RXHeldCount < SIM_RX_HELD_PACKETS ) && ( Hold_Received_Packet( DataPtr ) ) )
+	{
+		RXHeld[RXHeldCount] = DataPtr;
+		RXHeldTimeUs[RXHeldCount] = Bluenrg_Sim_Get_Time_Us();
+		RXHeldCount++;
+	}else
+	{
+		RXNotHeld++;
+	}
+}
+
+
+/****************************************************************/
+/* Bluenrg_Received_Packet_Leak()               	          	*/
+/* Purpose: Report of the driver leak detector					*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Bluenrg_Received_Packet_Leak( uint8_t* DataPtr, uint32_t HeldTimeUs )
+{
+	printf( "Leak: packet type %u held for %lu us\n", DataPtr[0], (unsigned long)HeldTimeUs );
+}
+
+
+/****************************************************************/
+/* Trace_Output()               	          	      			*/
+/* Purpose: Write a piece of the HCI trace to the file			*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: A copy is kept for the checks.					*/
+/****************************************************************/
+static void Trace_Output( uint8_t* DataPtr, uint16_t DataSize )
+{
+	fwrite( DataPtr, 1, DataSize, TraceFile );
+
+	if( ( TraceSize + DataSize ) <= SIM_TRACE_MAX_SIZE )
+	{
+		memcpy( &TraceCopy[TraceSize], DataPtr, DataSize );
+		TraceSize += DataSize;
+	}
+}
+
+
+/****************************************************************/
+/* Get_Big_Endian()     	  		               	    		*/
+/* Purpose: Read a 32-bit value most significant byte first		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static uint32_t Get_Big_Endian( uint8_t* DataPtr )
+{
+	return ( ( (uint32_t)DataPtr[0] << 24 ) | ( (uint32_t)DataPtr[1] << 16 ) | ( (uint32_t)DataPtr[2] << 8 ) | DataPtr[3] );
+}
+
+
+#endif /* BLE_HAL_SIMULATION */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
@@ -0,0 +1,268 @@
+
+
+/* RAM stand-in of the STM32F0 flash controller used by the host (Linux) build.
+ * FLASH_DATA_VECTOR is a const object of the host executable (read only pages),
+ * so its pages are unprotected while they are erased or programmed. Like the
+ * target, a halfword can only be programmed when erased or to zero, and a power
+ * loss can be injected after a number of programmed halfwords. */
+#ifdef BLE_HAL_SIMULATION
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include <string.h>
+#include "Flash_Sim.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define FLASH_SIM_ERASED_HALFWORD 0xFFFF
+
+
+/****************************************************************/
+/* Static functions declaration                                 */
+/****************************************************************/
+static void Sim_Flash_Access( uint32_t Address, uint32_t Size, int Protection );
+
+
+/****************************************************************/
+/* extern                                                       */
+/****************************************************************/
+extern const uint8_t FLASH_DATA_VECTOR[];
+
+
+/****************************************************************/
+/* Local variables definition                                   */
+/****************************************************************/
+static FLASH_SIM_STATISTICS Statistics;
+static uint32_t FlashUnlockedAddress = 0;
+static uint32_t FlashUnlockedSize = 0;
+static uint32_t ProgramsBeforeFail = 0;
+static uint8_t PowerFailArmed = FALSE;
+static uint8_t PowerLost = FALSE;
+
+
+/****************************************************************/
+/* Flash_Sim_Power_Fail()               	          	      	*/
+/* Purpose: Lose the power after a number of programmed			*/
+/* halfwords.													*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: From then on, erase and program operations fail	*/
+/* without changing the memory until Flash_Sim_Power_Restore().	*/
+/****************************************************************/
+void Flash_Sim_Power_Fail( uint32_t Programs )
+{
+	ProgramsBeforeFail = Programs;
+	PowerFailArmed = TRUE;
+	PowerLost = FALSE;
+}
+
+
+/****************************************************************/
+/* Flash_Sim_Power_Restore()               	          	      	*/
+/* Purpose: Give back the power to the flash controller			*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Flash_Sim_Power_Restore( void )
+{
+	PowerFailArmed = FALSE;
+	PowerLost = FALSE;
+}
+
+
+/****************************************************************/
+/* Flash_Sim_Power_Lost()               	          	      	*/
+/* Purpose: Tell if the injected power loss happened			*/
+/* Parameters: none				         						*/
+/* Return: TRUE if the power was lost.							*/
+/* Description:													*/
+/****************************************************************/
+uint8_t Flash_Sim_Power_Lost( void )
+{
+	return ( PowerLost );
+}
+
+
+/****************************************************************/
+/* Flash_Sim_Get_Statistics()               	          	    */
+/* Purpose: Return the flash operation counters					*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+FLASH_SIM_STATISTICS* Flash_Sim_Get_Statistics( void )
+{
+	return ( &Statistics );
+}
+
+
+/****************************************************************/
+/* Flash_Sim_Clear_Statistics()               	          	    */
+/* Purpose: Clear the flash operation counters					*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+void Flash_Sim_Clear_Statistics( void )
+{
+	memset( &Statistics, 0, sizeof(Statistics) );
+}
+
+
+/****************************************************************/
+/* HAL_FLASH_Unlock()               	          	      		*/
+/* Purpose: Flash controller unlock								*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The pages are made writable on demand by the 	*/
+/* erase and program functions.									*/
+/****************************************************************/
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+	return ( HAL_OK );
+}
+
+
+/****************************************************************/
+/* HAL_FLASH_Lock()               	          	      			*/
+/* Purpose: Flash controller lock								*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Gives back read only protection to the pages 	*/
+/* written since the unlock.									*/
+/****************************************************************/
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+	if( FlashUnlockedSize )
+	{
+		Sim_Flash_Access( FlashUnlockedAddress, FlashUnlockedSize, PROT_READ );
+		FlashUnlockedSize = 0;
+	}
+
+	return ( HAL_OK );
+}
+
+
+/****************************************************************/
+/* HAL_FLASHEx_Erase()               	          	      		*/
+/* Purpose: Erase flash pages									*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError)
+{
+	uint32_t Size = pEraseInit->NbPages * FLASH_PAGE_SIZE;
+
+	if( PowerLost )
+	{
+		*PageError = pEraseInit->PageAddress;
+		return ( HAL_ERROR );
+	}
+
+	*PageError = 0xFFFFFFFF;
+
+	Sim_Flash_Access( pEraseInit->PageAddress, Size, PROT_READ | PROT_WRITE );
+	memset( (uint8_t*)( (uintptr_t)pEraseInit->PageAddress ), 0xFF, Size );
+
+	for( uint32_t i = 0; i < pEraseInit->NbPages; i++ )
+	{
+		uint32_t Page = ( pEraseInit->PageAddress + ( i * FLASH_PAGE_SIZE ) - (uint32_t)(uintptr_t)( &FLASH_DATA_VECTOR[0] ) ) / FLASH_PAGE_SIZE;
+
+		if( Page < FLASH_SIM_MAX_PAGES )
+		{
+			Statistics.PageErases[Page]++;
+		}
+		Statistics.Erases++;
+	}
+
+	return ( HAL_OK );
+}
+
+
+/****************************************************************/
+/* HAL_FLASH_Program()               	          	      		*/
+/* Purpose: Program flash										*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Like the target, a halfword that is not erased	*/
+/* can only be programmed to zero (PGERR otherwise).			*/
+/****************************************************************/
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+	uint16_t* HalfwordPtr = (uint16_t*)( (uintptr_t)Address );
+
+	if( ( TypeProgram != FLASH_TYPEPROGRAM_HALFWORD ) || ( PowerLost ) )
+	{
+		return ( HAL_ERROR );
+	}
+
+	if( PowerFailArmed )
+	{
+		if( ProgramsBeforeFail == 0 )
+		{
+			PowerLost = TRUE;
+			return ( HAL_ERROR );
+		}
+		ProgramsBeforeFail--;
+	}
+
+	if( ( *HalfwordPtr != FLASH_SIM_ERASED_HALFWORD ) && ( (uint16_t)Data != 0 ) )
+	{
+		Statistics.ProgramErrors++;
+		return ( HAL_ERROR );
+	}
+
+	Sim_Flash_Access( Address, sizeof(uint16_t), PROT_READ | PROT_WRITE );
+	*HalfwordPtr = (uint16_t)Data;
+	Statistics.HalfwordPrograms++;
+
+	return ( HAL_OK );
+}
+
+
+/****************************************************************/
+/* Sim_Flash_Access()               	          	      		*/
+/* Purpose: Change the protection of the host pages holding		*/
+/* the flash data.												*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Sim_Flash_Access( uint32_t Address, uint32_t Size, int Protection )
+{
+	uintptr_t PageSize = sysconf( _SC_PAGESIZE );
+	uintptr_t Start = Address & ~( PageSize - 1 );
+	uintptr_t End = ( Address + Size + PageSize - 1 ) & ~( PageSize - 1 );
+
+	mprotect( (void*)Start, End - Start, Protection );
+
+	if( Protection & PROT_WRITE )
+	{
+		if( !FlashUnlockedSize )
+		{
+			FlashUnlockedAddress = Start;
+			FlashUnlockedSize = End - Start;
+		}else
+		{
+			uintptr_t UnlockedEnd = MAX( (uintptr_t)FlashUnlockedAddress + FlashUnlockedSize, End );
+			FlashUnlockedAddress = MIN( (uintptr_t)FlashUnlockedAddress, Start );
+			FlashUnlockedSize = UnlockedEnd - FlashUnlockedAddress;
+		}
+	}
+}
+
+
+#endif /* BLE_HAL_SIMULATION */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
@@ -0,0 +1,52 @@
+
+
+#ifndef FLASH_SIM_H_
+#define FLASH_SIM_H_
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include "Types.h"
+#include "main.h"
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define FLASH_SIM_MAX_PAGES	8 /* Pages of FLASH_DATA_VECTOR with erase counters */
+
+
+/****************************************************************/
+/* Type Defines                                                 */
+/****************************************************************/
+typedef struct
+{
+	uint32_t Erases;						 /* Page erases */
+	uint32_t HalfwordPrograms;				 /* Halfwords programmed */
+	uint32_t ProgramErrors;					 /* Programming of not erased halfwords (PGERR) */
+	uint32_t PageErases[FLASH_SIM_MAX_PAGES]; /* Erases of each FLASH_DATA_VECTOR page */
+}FLASH_SIM_STATISTICS;
+
+
+/****************************************************************/
+/* External functions declaration (Interface functions)         */
+/****************************************************************/
+void Flash_Sim_Power_Fail( uint32_t Programs );
+void Flash_Sim_Power_Restore( void );
+uint8_t Flash_Sim_Power_Lost( void );
+FLASH_SIM_STATISTICS* Flash_Sim_Get_Statistics( void );
+void Flash_Sim_Clear_Statistics( void );
+
+
+/****************************************************************/
+/* External variables declaration                               */
+/****************************************************************/
+
+
+#endif /* FLASH_SIM_H_ */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
@@ -0,0 +1,37 @@
+
+
+#ifndef MAIN_SIM_H_
+#define MAIN_SIM_H_
+
+
+/****************************************************************/
+/* Host stand-in for Core/Inc/main.h used when building with	*/
+/* BLE_HAL_SIMULATION. Pin names match the CubeMX generated file */
+/****************************************************************/
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include "stm32f0xx_hal.h"
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define BLE_RST_Pin GPIO_PIN_1
+#define BLE_RST_GPIO_Port GPIOC
+#define BLE_IRQ_Pin GPIO_PIN_5
+#define BLE_IRQ_GPIO_Port GPIOC
+#define BLE_CS_Pin GPIO_PIN_15
+#define BLE_CS_GPIO_Port GPIOA
+#define HEART_BEAT_Pin GPIO_PIN_3
+#define HEART_BEAT_GPIO_Port GPIOD
+
+
+#endif /* MAIN_SIM_H_ */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
@@ -0,0 +1,135 @@
+
+
+#ifndef STM32F0XX_HAL_SIM_H_
+#define STM32F0XX_HAL_SIM_H_
+
+
+/****************************************************************/
+/* Host stand-in for the few STM32 HAL symbols used by UserFiles */
+/* when building with BLE_HAL_SIMULATION. This directory must 	*/
+/* only be in the include path of the host build.				*/
+/****************************************************************/
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include <stdint.h>
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define __IO volatile
+
+#define GPIO_PIN_1                 ((uint16_t)0x0002U)
+#define GPIO_PIN_3                 ((uint16_t)0x0008U)
+#define GPIO_PIN_4                 ((uint16_t)0x0010U)
+#define GPIO_PIN_5                 ((uint16_t)0x0020U)
+#define GPIO_PIN_15                ((uint16_t)0x8000U)
+
+#define GPIOA                      (&Sim_GPIO_Ports[0])
+#define GPIOB                      (&Sim_GPIO_Ports[1])
+#define GPIOC                      (&Sim_GPIO_Ports[2])
+#define GPIOD                      (&Sim_GPIO_Ports[3])
+
+#define SysTick                    (&Sim_SysTick)
+#define SCB                        (&Sim_SCB)
+
+#define SCB_ICSR_PENDSTSET_Msk     (1UL << 26U)
+
+#define __HAL_GPIO_EXTI_CLEAR_IT(__EXTI_LINE__) do{ }while( 0 )
+
+#define FLASH_PAGE_SIZE            0x800U
+#define FLASH_TYPEERASE_PAGES      0x00U
+#define FLASH_TYPEPROGRAM_HALFWORD 0x01U
+
+
+/****************************************************************/
+/* Type Defines                                                 */
+/****************************************************************/
+typedef enum
+{
+	HAL_OK       = 0x00U,
+	HAL_ERROR    = 0x01U,
+	HAL_BUSY     = 0x02U,
+	HAL_TIMEOUT  = 0x03U
+}HAL_StatusTypeDef;
+
+
+typedef enum
+{
+	GPIO_PIN_RESET = 0U,
+	GPIO_PIN_SET
+}GPIO_PinState;
+
+
+typedef enum
+{
+	HAL_TICK_FREQ_1KHZ = 1U,
+	HAL_TICK_FREQ_DEFAULT = HAL_TICK_FREQ_1KHZ
+}HAL_TickFreqTypeDef;
+
+
+typedef struct
+{
+	uint32_t ODR;
+}GPIO_TypeDef;
+
+
+typedef struct
+{
+	__IO uint32_t CTRL;
+	__IO uint32_t LOAD;
+	__IO uint32_t VAL;
+	__IO uint32_t CALIB;
+}SysTick_Type;
+
+
+typedef struct
+{
+	__IO uint32_t CPUID;
+	__IO uint32_t ICSR;
+}SCB_Type;
+
+
+typedef struct
+{
+	uint32_t TypeErase;
+	uint32_t PageAddress;
+	uint32_t NbPages;
+}FLASH_EraseInitTypeDef;
+
+
+/****************************************************************/
+/* External functions declaration (Interface functions)         */
+/****************************************************************/
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+void HAL_GPIO_TogglePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin);
+void HAL_IncTick(void);
+uint32_t HAL_GetTick(void);
+uint32_t HAL_RCC_GetHCLKFreq(void);
+void SystemCoreClockUpdate(void);
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError);
+
+
+/****************************************************************/
+/* External variables declaration                               */
+/****************************************************************/
+extern GPIO_TypeDef Sim_GPIO_Ports[4];
+extern SysTick_Type Sim_SysTick;
+extern SCB_Type Sim_SCB;
+extern __IO uint32_t uwTick;
+extern HAL_TickFreqTypeDef uwTickFreq;
+
+
+#endif /* STM32F0XX_HAL_SIM_H_ */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
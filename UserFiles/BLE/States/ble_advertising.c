@@ -19,6 +19,7 @@ typedef enum
 	DISABLE_ADVERTISING,
 	DISABLE_ADDRESS_RESOLUTION,
 	CLEAR_RESOLVING_LIST,
+	REMOVE_FROM_RESOLVING_LIST,
 	ADD_TO_RESOLVING_LIST,
 	VERIFY_ADDRESS,
 	WAIT_FOR_NEW_LOCAL_READ,
@@ -60,11 +61,13 @@ static ADV_CONFIG Check_Local_IRK( RESOLVING_RECORD* ResolvingRecord, uint8_t RP
 static void Read_Local_Resolvable_Address_Complete( CONTROLLER_ERROR_CODES Status, BD_ADDR_TYPE* Local_Resolvable_Address );
 static void LE_Clear_Resolving_List_Complete( CONTROLLER_ERROR_CODES Status );
 static void LE_Add_Device_To_Resolving_List_Complete( CONTROLLER_ERROR_CODES Status );
+static void LE_Remove_Device_From_Resolving_List_Complete( CONTROLLER_ERROR_CODES Status );
 static void Read_Peer_Resolvable_Address_Complete( CONTROLLER_ERROR_CODES Status, BD_ADDR_TYPE* Peer_Resolvable_Address );
 static void LE_Set_Advertising_Enable_Complete( CONTROLLER_ERROR_CODES Status );
 static void LE_Set_Advertising_Parameters_Complete( CONTROLLER_ERROR_CODES Status );
 static void LE_Set_Random_Address_Complete( CONTROLLER_ERROR_CODES Status );
 static void LE_Read_Advertising_Physical_Channel_Tx_Power_Complete( CONTROLLER_ERROR_CODES Status, int8_t TX_Power_Level );
+static void Update_Tx_Power_Level( uint8_t DataPtr[], int16_t DataSize, int8_t TX_Power_Level );
 static void LE_Set_Data_Complete( CONTROLLER_ERROR_CODES Status );
 static void LE_Set_Address_Resolution_Enable_Complete( CONTROLLER_ERROR_CODES Status );
 static uint8_t Check_Broadcaster_Parameters( ADVERTISING_PARAMETERS* AdvPar );
@@ -93,8 +96,9 @@ extern void Set_BLE_State( BLE_STATES NewBLEState );
 static ADVERTISING_PARAMETERS* AdvertisingParameters = NULL;
 static ADV_CONFIG AdvConfig = { DISABLE_ADVERTISING, DISABLE_ADVERTISING, DISABLE_ADVERTISING };
 static BD_ADDR_TYPE RandomAddress;
-static uint16_t SM_Resolving_List_Index;
 static RESOLVING_RECORD* RecordPtr;
+static DEVICE_IDENTITY AddedDevice;
+static IDENTITY_ADDRESS RemovedDevice;
 
 
 /****************************************************************/
@@ -223,12 +227,6 @@ int8_t Advertising_Config( void )
 		break;
 
 	case DISABLE_ADDRESS_RESOLUTION:
-		AdvConfig.Next = CLEAR_RESOLVING_LIST;
-		AdvConfig.Prev = DISABLE_ADDRESS_RESOLUTION;
-		AdvConfig.Actual = HCI_LE_Set_Address_Resolution_Enable( FALSE, &LE_Set_Address_Resolution_Enable_Complete, NULL ) ? WAIT_OPERATION : DISABLE_ADDRESS_RESOLUTION;
-		break;
-
-	case CLEAR_RESOLVING_LIST:
 		if( ( AdvertisingParameters->Own_Address_Type == OWN_RESOL_OR_PUBLIC_ADDR ) || ( AdvertisingParameters->Own_Address_Type == OWN_RESOL_OR_RANDOM_ADDR ) )
 		{
 			IDENTITY_ADDRESS PeerId;
@@ -236,35 +234,71 @@ int8_t Advertising_Config( void )
 			PeerId.Type = AdvertisingParameters->Peer_Address_Type;
 			PeerId.Address = AdvertisingParameters->Peer_Address;
 			RecordPtr = Get_Record_From_Peer_Identity( &PeerId );
-			if( RecordPtr != NULL )
+		}
+
+		/* Address resolution stays enabled only if the controller's list is already up to date and it is used again */
+		if( ( Get_Controller_Address_Resolution() != ADDRESS_RESOLUTION_DISABLED ) &&
+				( ( RecordPtr == NULL ) || ( !AdvertisingParameters->Privacy ) || ( !Controller_Resolving_List_Synchronized() ) ) )
+		{
+			AdvConfig.Next = CLEAR_RESOLVING_LIST;
+			AdvConfig.Prev = DISABLE_ADDRESS_RESOLUTION;
+			AdvConfig.Actual = HCI_LE_Set_Address_Resolution_Enable( FALSE, &LE_Set_Address_Resolution_Enable_Complete, NULL ) ? WAIT_OPERATION : DISABLE_ADDRESS_RESOLUTION;
+		}else
+		{
+			AdvConfig.Actual = CLEAR_RESOLVING_LIST;
+		}
+		break;
+
+	case CLEAR_RESOLVING_LIST:
+		if( RecordPtr != NULL )
+		{
+			/* This device is in the Host's list. When the controller's list is known, only the differences are sent */
+			if( Controller_Resolving_List_Known() )
 			{
-				/* This device is in the Host's list. Clear the controller list to add all list again afterwards */
-				SM_Resolving_List_Index = 0;
-				AdvConfig.Actual = HCI_LE_Clear_Resolving_List( &LE_Clear_Resolving_List_Complete, NULL ) ? WAIT_OPERATION : CLEAR_RESOLVING_LIST;
+				AdvConfig.Actual = REMOVE_FROM_RESOLVING_LIST;
 			}else
 			{
-				/* This peer device identity is not in the Host list */
-				AdvConfig.Actual = VERIFY_ADDRESS;
+				AdvConfig.Actual = HCI_LE_Clear_Resolving_List( &LE_Clear_Resolving_List_Complete, NULL ) ? WAIT_OPERATION : CLEAR_RESOLVING_LIST;
 			}
 		}else
 		{
+			/* This peer device identity is not in the Host list */
 			AdvConfig.Actual = VERIFY_ADDRESS;
 		}
 		break;
 
+	case REMOVE_FROM_RESOLVING_LIST:
+	{
+		/* Remove the devices no longer in the Host's list, or whose keys changed */
+		DEVICE_IDENTITY* DevId = Get_Device_To_Remove_From_Controller();
+		if( DevId != NULL )
+		{
+			RemovedDevice = DevId->Peer_Identity_Address;
+			AdvConfig.Actual = HCI_LE_Remove_Device_From_Resolving_List( RemovedDevice.Type, RemovedDevice.Address,
+					&LE_Remove_Device_From_Resolving_List_Complete, NULL ) ? WAIT_OPERATION : REMOVE_FROM_RESOLVING_LIST;
+		}else
+		{
+			AdvConfig.Actual = ADD_TO_RESOLVING_LIST;
+		}
+	}
+	break;
+
 	case ADD_TO_RESOLVING_LIST:
-		/* Check if we have bonded devices to add to the resolving list */
-		if ( SM_Resolving_List_Index < Get_Number_Of_Resolving_Records() )
+	{
+		/* Check if we have bonded devices the controller does not hold yet */
+		DEVICE_IDENTITY* DevId = Get_Device_To_Add_To_Controller();
+		if ( DevId != NULL )
 		{
-			DEVICE_IDENTITY* DevId = &( Get_Record_From_Index( SM_Resolving_List_Index )->Peer );
-			/* Here we add a device to the controller's resolving list if it exists in the Host's list */
-			AdvConfig.Actual = HCI_LE_Add_Device_To_Resolving_List( DevId->Peer_Identity_Address.Type, DevId->Peer_Identity_Address.Address,
-					&DevId->Peer_IRK, &DevId->Local_IRK, &LE_Add_Device_To_Resolving_List_Complete, NULL ) ? WAIT_OPERATION : ADD_TO_RESOLVING_LIST;
+			/* The device is copied since the Host's list may change before the command completes */
+			AddedDevice = *DevId;
+			AdvConfig.Actual = HCI_LE_Add_Device_To_Resolving_List( AddedDevice.Peer_Identity_Address.Type, AddedDevice.Peer_Identity_Address.Address,
+					&AddedDevice.Peer_IRK, &AddedDevice.Local_IRK, &LE_Add_Device_To_Resolving_List_Complete, NULL ) ? WAIT_OPERATION : ADD_TO_RESOLVING_LIST;
 		}else
 		{
 			AdvConfig.Actual = VERIFY_ADDRESS;
 		}
-		break;
+	}
+	break;
 
 	case VERIFY_ADDRESS:
 	{
@@ -396,7 +430,7 @@ int8_t Advertising_Config( void )
 		break;
 
 	case ENABLE_ADDRESS_RESOLUTION:
-		if( ( RecordPtr != NULL ) && ( AdvertisingParameters->Privacy ) )
+		if( ( RecordPtr != NULL ) && ( AdvertisingParameters->Privacy ) && ( Get_Controller_Address_Resolution() != ADDRESS_RESOLUTION_ENABLED ) )
 		{
 			AdvConfig.Next = SET_ADV_PARAMETERS;
 			AdvConfig.Prev = ENABLE_ADDRESS_RESOLUTION;
@@ -666,7 +700,14 @@ static ADV_CONFIG Check_Local_IRK( RESOLVING_RECORD* ResolvingRecord, uint8_t RP
 /****************************************************************/
 static void LE_Clear_Resolving_List_Complete( CONTROLLER_ERROR_CODES Status )
 {
-	AdvConfig.Actual = ADD_TO_RESOLVING_LIST;
+	if( Status == COMMAND_SUCCESS )
+	{
+		Controller_Resolving_List_Cleared();
+		AdvConfig.Actual = ADD_TO_RESOLVING_LIST;
+	}else
+	{
+		AdvConfig.Actual = CLEAR_RESOLVING_LIST;
+	}
 }
 
 
@@ -678,6 +719,13 @@ static void LE_Clear_Resolving_List_Complete( CONTROLLER_ERROR_CODES Status )
 /****************************************************************/
 static void LE_Set_Address_Resolution_Enable_Complete( CONTROLLER_ERROR_CODES Status )
 {
+	if( Status == COMMAND_SUCCESS )
+	{
+		Set_Controller_Address_Resolution( ( AdvConfig.Prev == ENABLE_ADDRESS_RESOLUTION ) ? ADDRESS_RESOLUTION_ENABLED : ADDRESS_RESOLUTION_DISABLED );
+	}else
+	{
+		Set_Controller_Address_Resolution( ADDRESS_RESOLUTION_UNKNOWN );
+	}
 	AdvConfig.Actual = ( Status == COMMAND_SUCCESS || Status == COMMAND_DISALLOWED ) ? AdvConfig.Next : AdvConfig.Prev;
 }
 
@@ -693,7 +741,7 @@ static void LE_Add_Device_To_Resolving_List_Complete( CONTROLLER_ERROR_CODES Sta
 	if ( Status == COMMAND_SUCCESS )
 	{
 		AdvConfig.Actual = ADD_TO_RESOLVING_LIST;
-		SM_Resolving_List_Index++;
+		Controller_Resolving_List_Added( &AddedDevice );
 	}else if( Status == MEM_CAPACITY_EXCEEDED )
 	{
 		AdvConfig.Actual = VERIFY_ADDRESS;
@@ -704,6 +752,28 @@ static void LE_Add_Device_To_Resolving_List_Complete( CONTROLLER_ERROR_CODES Sta
 }
 
 
+/****************************************************************/
+/* LE_Remove_Device_From_Resolving_List_Complete()	      		*/
+/* Location: 					 								*/
+/* Purpose: 													*/
+/* Description: A device the controller does not have is also	*/
+/* removed from the tracked list. Any other failure makes the	*/
+/* whole list be cleared and added again.						*/
+/****************************************************************/
+static void LE_Remove_Device_From_Resolving_List_Complete( CONTROLLER_ERROR_CODES Status )
+{
+	if( ( Status == COMMAND_SUCCESS ) || ( Status == UNKNOWN_CONNECTION_ID ) )
+	{
+		Controller_Resolving_List_Removed( &RemovedDevice );
+		AdvConfig.Actual = REMOVE_FROM_RESOLVING_LIST;
+	}else
+	{
+		Set_Controller_Resolving_List_Unknown();
+		AdvConfig.Actual = CLEAR_RESOLVING_LIST;
+	}
+}
+
+
 /****************************************************************/
 /* Read_Local_Resolvable_Address_Complete()        	   			*/
 /* Location: 					 								*/
@@ -838,45 +908,41 @@ static void LE_Read_Advertising_Physical_Channel_Tx_Power_Complete( CONTROLLER_E
 
 	if( Status == COMMAND_SUCCESS )
 	{
-		Tx_Power_Level_Type* Ptr;
-		uint8_t* DataPtr = AdvertisingParameters->HostData.Adv_Data_Ptr;
-		int16_t DataSize = AdvertisingParameters->HostData.Adv_Data_Length;
+		Update_Tx_Power_Level( AdvertisingParameters->HostData.Adv_Data_Ptr, AdvertisingParameters->HostData.Adv_Data_Length, TX_Power_Level );
+		Update_Tx_Power_Level( AdvertisingParameters->HostData.Scan_Data_Ptr, AdvertisingParameters->HostData.ScanRsp_Data_Length, TX_Power_Level );
+	}
+}
 
 
-		do
-		{
-			Ptr = Get_AD_Type_Ptr( TX_POWER_LEVEL_TYPE, DataPtr, DataSize );
-			if( Ptr != NULL )
-			{
-				Ptr->Tx_Power_Level = TX_Power_Level;
-				DataPtr = (uint8_t*)( (uint32_t)( Ptr ) + (Ptr->length) + 1 ); /* Points to the next structure */
-				DataSize = AdvertisingParameters->HostData.Adv_Data_Length - ( (uint32_t)( DataPtr ) - (uint32_t)( AdvertisingParameters->HostData.Adv_Data_Ptr ) );
-				if( DataSize < sizeof( Tx_Power_Level_Type ) )
-				{
-					Ptr = NULL;
-				}
-			}
-		}while( Ptr != NULL );
+/****************************************************************/
+/* Update_Tx_Power_Level() 					 					*/
+/* Location: 					 								*/
+/* Purpose: Write the TX power level in every TX power level	*/
+/* AD structure of an advertising or scan response payload.		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The payload is indexed once and the structures	*/
+/* are taken from the index, so the lengths are not read again.	*/
+/****************************************************************/
+static void Update_Tx_Power_Level( uint8_t DataPtr[], int16_t DataSize, int8_t TX_Power_Level )
+{
+	AD_INDEX Index;
 
+	if( DataPtr == NULL )
+	{
+		return;
+	}
 
-		DataPtr = AdvertisingParameters->HostData.Scan_Data_Ptr;
-		DataSize = AdvertisingParameters->HostData.ScanRsp_Data_Length;
+	Index_AD_Structures( &Index, DataPtr, DataSize );
 
+	for( uint8_t i = 0; i < Index.Count; i++ )
+	{
+		Tx_Power_Level_Type* Ptr = (Tx_Power_Level_Type*)&DataPtr[Index.Offset[i]];
 
-		do
+		if( ( Ptr->type == TX_POWER_LEVEL_TYPE ) && ( Ptr->length >= ( sizeof(Tx_Power_Level_Type) - 1 ) ) )
 		{
-			Ptr = Get_AD_Type_Ptr( TX_POWER_LEVEL_TYPE, DataPtr, DataSize );
-			if( Ptr != NULL )
-			{
-				Ptr->Tx_Power_Level = TX_Power_Level;
-				DataPtr = (uint8_t*)( (uint32_t)( Ptr ) + (Ptr->length) + 1 ); /* Points to the next structure */
-				DataSize = AdvertisingParameters->HostData.ScanRsp_Data_Length - ( (uint32_t)( DataPtr ) - (uint32_t)( AdvertisingParameters->HostData.Scan_Data_Ptr ) );
-				if( DataSize < sizeof( Tx_Power_Level_Type ) )
-				{
-					Ptr = NULL;
-				}
-			}
-		}while( Ptr != NULL );
+			Ptr->Tx_Power_Level = TX_Power_Level;
+		}
 	}
 }
 
@@ -8,6 +8,7 @@
 #include "ble_utils.h"
 #include "hosted_functions.h"
 #include "ble_connection.h"
+#include "l2cap.h"
 
 
 /****************************************************************/
@@ -20,9 +21,13 @@
 /****************************************************************/
 void Connection( void );
 static CONNECTION_HANDLE* Search_Connection_Handle( uint16_t ConnHandle );
-static CONNECTION_HANDLE* Add_Connection_Handle( uint16_t ConnHandle, BLE_ROLE Role );
+static CONNECTION* Add_Connection_Handle( uint16_t ConnHandle, BLE_ROLE Role );
 static void Change_Connection_Handle_Status( CONNECTION_HANDLE* HandlePtr, CONN_HANDLE_STATUS Status );
 void Remove_Connection_Index( uint8_t Index );
+static uint8_t Hash_Connection_Handle( uint16_t ConnHandle );
+static void Hash_Connection( uint8_t Index );
+static void Unhash_Connection( uint8_t Index );
+static void Read_RSSI_Complete( CONTROLLER_ERROR_CODES Status, uint16_t Handle, int8_t RSSI );
 
 
 /****************************************************************/
@@ -36,7 +41,8 @@ extern uint8_t Exit_Initiating_Mode( BLE_STATES CurrentState );
 /****************************************************************/
 /* Defines                                                      */
 /****************************************************************/
-#define MAX_NUMBER_OF_CONNECTIONS 4
+#define CONNECTION_HASH_SIZE 16 /* Power of two of at least twice MAX_NUMBER_OF_CONNECTIONS, so the probes are short */
+#define RSSI_NOT_AVAILABLE	 127
 
 
 /****************************************************************/
@@ -47,7 +53,13 @@ extern uint8_t Exit_Initiating_Mode( BLE_STATES CurrentState );
 /****************************************************************/
 /* Local variables definition                                   */
 /****************************************************************/
-static CONNECTION_HANDLE Connection_Handle_List[MAX_NUMBER_OF_CONNECTIONS];
+static CONNECTION Connection_List[MAX_NUMBER_OF_CONNECTIONS];
+
+
+/* Open addressing table, with linear probing, of the connections not
+ * free. Each slot holds a Connection_List index plus one, zero when
+ * empty, so a handle is found without scanning Connection_List. */
+static uint8_t Connection_Hash[CONNECTION_HASH_SIZE];
 
 
 /****************************************************************/
@@ -118,7 +130,7 @@ uint8_t Get_Number_Of_Active_Connections( void )
 
 	for( uint8_t i = 0; i < MAX_NUMBER_OF_CONNECTIONS; i++ )
 	{
-		if ( Connection_Handle_List[i].Status != CONN_HANDLE_FREE )
+		if ( Connection_List[i].Handle.Status != CONN_HANDLE_FREE )
 		{
 			ConnHandleCounter++;
 		}
@@ -141,7 +153,7 @@ CONNECTION_HANDLE* Get_Connection_Handle( uint8_t Index )
 {
 	if( Index < MAX_NUMBER_OF_CONNECTIONS )
 	{
-		return ( &Connection_Handle_List[Index] );
+		return ( &Connection_List[Index].Handle );
 	}
 
 	return ( NULL );
@@ -149,27 +161,70 @@ CONNECTION_HANDLE* Get_Connection_Handle( uint8_t Index )
 
 
 /****************************************************************/
-/* Search_Connection_Handle()        							*/
+/* Get_Connection()        										*/
 /* Location: 					 								*/
-/* Purpose: Verify if a certain connection handle exists.		*/
+/* Purpose: Retrieve the state of a connection.					*/
 /* Parameters: none				         						*/
-/* Return: none  												*/
-/* Description:													*/
+/* Return: NULL if the handle is not a connection of the host.	*/
+/* Description: Looked up in Connection_Hash, without scanning	*/
+/* the connections.												*/
 /****************************************************************/
-static CONNECTION_HANDLE* Search_Connection_Handle( uint16_t ConnHandle )
+CONNECTION* Get_Connection( uint16_t ConnHandle )
 {
-	for( uint8_t i = 0; i < MAX_NUMBER_OF_CONNECTIONS; i++ )
+	uint8_t Slot = Hash_Connection_Handle( ConnHandle );
+
+	while( Connection_Hash[Slot] != 0 )
 	{
-		if ( Connection_Handle_List[i].Handle == ConnHandle )
+		CONNECTION* ConnPtr = &Connection_List[Connection_Hash[Slot] - 1];
+
+		if( ConnPtr->Handle.Handle == ConnHandle )
 		{
-			return ( &Connection_Handle_List[i] ); /* return the list index */
+			return ( ConnPtr );
 		}
+
+		Slot = ( Slot + 1 ) & ( CONNECTION_HASH_SIZE - 1 );
 	}
 
 	return ( NULL );
 }
 
 
+/****************************************************************/
+/* Read_Connection_RSSI()        								*/
+/* Location: 					 								*/
+/* Purpose: Update the RSSI of a connection.					*/
+/* Parameters: none				         						*/
+/* Return: TRUE if the HCI_Read_RSSI command was issued.		*/
+/* Description: The RSSI of the connection is updated when the	*/
+/* controller answers.											*/
+/****************************************************************/
+uint8_t Read_Connection_RSSI( uint16_t ConnHandle )
+{
+	if( Get_Connection( ConnHandle ) != NULL )
+	{
+		return ( HCI_Read_RSSI( ConnHandle, &Read_RSSI_Complete, NULL ) );
+	}
+
+	return (FALSE);
+}
+
+
+/****************************************************************/
+/* Search_Connection_Handle()        							*/
+/* Location: 					 								*/
+/* Purpose: Verify if a certain connection handle exists.		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static CONNECTION_HANDLE* Search_Connection_Handle( uint16_t ConnHandle )
+{
+	CONNECTION* ConnPtr = Get_Connection( ConnHandle );
+
+	return ( ( ConnPtr != NULL ) ? &ConnPtr->Handle : NULL );
+}
+
+
 /****************************************************************/
 /* Add_Connection_Handle()        								*/
 /* Location: 					 								*/
@@ -178,35 +233,23 @@ static CONNECTION_HANDLE* Search_Connection_Handle( uint16_t ConnHandle )
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-static CONNECTION_HANDLE* Add_Connection_Handle( uint16_t ConnHandle, BLE_ROLE Role )
+static CONNECTION* Add_Connection_Handle( uint16_t ConnHandle, BLE_ROLE Role )
 {
-	if( ConnHandle <= MAX_CONNECTION_HANDLE )
+	/* Check if the handle is already loaded */
+	if( ( ConnHandle <= MAX_CONNECTION_HANDLE ) && ( Get_Connection( ConnHandle ) == NULL ) )
 	{
-		/* Check if the handle is already loaded */
-		CONNECTION_HANDLE* HandlePtr = Search_Connection_Handle( ConnHandle );
-
-		if( HandlePtr != NULL ) /* There is already a handler with this code */
+		for( uint8_t i = 0; i < MAX_NUMBER_OF_CONNECTIONS; i++ )
 		{
-			if( HandlePtr->Status == CONN_HANDLE_FREE )
+			/* Search for available room */
+			if ( Connection_List[i].Handle.Status == CONN_HANDLE_FREE )
 			{
-				HandlePtr->Handle = ConnHandle;
-				HandlePtr->Role = Role;
-				HandlePtr->Status = CONN_HANDLE_FULL;
-				return ( HandlePtr );
-			}
-		}else
-		{
-			/* There is no handler with this code */
-			for( uint8_t i = 0; i < MAX_NUMBER_OF_CONNECTIONS; i++ )
-			{
-				/* Search for available room */
-				if ( Connection_Handle_List[i].Status == CONN_HANDLE_FREE )
-				{
-					Connection_Handle_List[i].Handle = ConnHandle;
-					Connection_Handle_List[i].Role = Role;
-					Connection_Handle_List[i].Status = CONN_HANDLE_FULL;
-					return ( &Connection_Handle_List[i] );
-				}
+				memset( &Connection_List[i], 0, sizeof(CONNECTION) );
+				Connection_List[i].Handle.Handle = ConnHandle;
+				Connection_List[i].Handle.Role = Role;
+				Connection_List[i].Handle.Status = CONN_HANDLE_FULL;
+				Connection_List[i].RSSI = RSSI_NOT_AVAILABLE;
+				Hash_Connection( i );
+				return ( &Connection_List[i] );
 			}
 		}
 	}
@@ -226,6 +269,11 @@ static void Change_Connection_Handle_Status( CONNECTION_HANDLE* HandlePtr, CONN_
 {
 	if( HandlePtr != NULL )
 	{
+		/* The handle is the first member of the connection */
+		if( ( Status == CONN_HANDLE_FREE ) && ( HandlePtr->Status != CONN_HANDLE_FREE ) )
+		{
+			Unhash_Connection( (CONNECTION*)HandlePtr - &Connection_List[0] );
+		}
 		HandlePtr->Status = Status;
 	}
 }
@@ -243,7 +291,104 @@ void Remove_Connection_Index( uint8_t Index )
 {
 	if( Index < MAX_NUMBER_OF_CONNECTIONS )
 	{
-		Connection_Handle_List[Index].Status = CONN_HANDLE_FREE;
+		Change_Connection_Handle_Status( &Connection_List[Index].Handle, CONN_HANDLE_FREE );
+	}
+}
+
+
+/****************************************************************/
+/* Hash_Connection_Handle()        								*/
+/* Location: 					 								*/
+/* Purpose: First Connection_Hash slot probed for a handle.		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The controllers give out consecutive handles,	*/
+/* so the low bits are enough to spread them.					*/
+/****************************************************************/
+static uint8_t Hash_Connection_Handle( uint16_t ConnHandle )
+{
+	return ( ( ConnHandle ^ ( ConnHandle >> 4 ) ^ ( ConnHandle >> 8 ) ) & ( CONNECTION_HASH_SIZE - 1 ) );
+}
+
+
+/****************************************************************/
+/* Hash_Connection()        									*/
+/* Location: 					 								*/
+/* Purpose: Insert a connection in Connection_Hash.				*/
+/* Parameters: Index: Connection_List index						*/
+/* Return: none  												*/
+/* Description: There is always an empty slot, since the table	*/
+/* is larger than Connection_List.								*/
+/****************************************************************/
+static void Hash_Connection( uint8_t Index )
+{
+	uint8_t Slot = Hash_Connection_Handle( Connection_List[Index].Handle.Handle );
+
+	while( Connection_Hash[Slot] != 0 )
+	{
+		Slot = ( Slot + 1 ) & ( CONNECTION_HASH_SIZE - 1 );
+	}
+
+	Connection_Hash[Slot] = Index + 1;
+}
+
+
+/****************************************************************/
+/* Unhash_Connection()        									*/
+/* Location: 					 								*/
+/* Purpose: Remove a connection from Connection_Hash.			*/
+/* Parameters: Index: Connection_List index						*/
+/* Return: none  												*/
+/* Description: The connections probed after the removed one	*/
+/* are moved back into the hole, so no lookup stops short of	*/
+/* them.														*/
+/****************************************************************/
+static void Unhash_Connection( uint8_t Index )
+{
+	uint8_t Slot = Hash_Connection_Handle( Connection_List[Index].Handle.Handle );
+
+	while( Connection_Hash[Slot] != ( Index + 1 ) )
+	{
+		if( Connection_Hash[Slot] == 0 )
+		{
+			return; /* Not hashed */
+		}
+		Slot = ( Slot + 1 ) & ( CONNECTION_HASH_SIZE - 1 );
+	}
+
+	Connection_Hash[Slot] = 0;
+
+	for( uint8_t Next = ( Slot + 1 ) & ( CONNECTION_HASH_SIZE - 1 ); Connection_Hash[Next] != 0;
+			Next = ( Next + 1 ) & ( CONNECTION_HASH_SIZE - 1 ) )
+	{
+		uint8_t Home = Hash_Connection_Handle( Connection_List[Connection_Hash[Next] - 1].Handle.Handle );
+
+		/* The connection may fill the hole if its first probe is not after the hole */
+		if( ( ( Next - Home ) & ( CONNECTION_HASH_SIZE - 1 ) ) >= ( ( Next - Slot ) & ( CONNECTION_HASH_SIZE - 1 ) ) )
+		{
+			Connection_Hash[Slot] = Connection_Hash[Next];
+			Connection_Hash[Next] = 0;
+			Slot = Next;
+		}
+	}
+}
+
+
+/****************************************************************/
+/* Read_RSSI_Complete()        									*/
+/* Location: 					 								*/
+/* Purpose: Keep the RSSI read by Read_Connection_RSSI().		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Read_RSSI_Complete( CONTROLLER_ERROR_CODES Status, uint16_t Handle, int8_t RSSI )
+{
+	CONNECTION* ConnPtr = Get_Connection( Handle );
+
+	if( ( Status == COMMAND_SUCCESS ) && ( ConnPtr != NULL ) )
+	{
+		ConnPtr->RSSI = RSSI;
 	}
 }
 
@@ -292,7 +437,17 @@ void Connection( void )
 /****************************************************************/
 void HCI_LE_Enhanced_Connection_Complete( LEEnhancedConnectionComplete* ConnCpltData )
 {
-	Add_Connection_Handle( ConnCpltData->Connection_Handle, ConnCpltData->Role );
+	CONNECTION* ConnPtr = Add_Connection_Handle( ConnCpltData->Connection_Handle, ConnCpltData->Role );
+
+	if( ConnPtr != NULL )
+	{
+		ConnPtr->Peer_Address_Type = ConnCpltData->Peer_Address_Type;
+		ConnPtr->Peer_Address = ConnCpltData->Peer_Address;
+		ConnPtr->Connection_Interval = ConnCpltData->Connection_Interval;
+		ConnPtr->Connection_Latency = ConnCpltData->Connection_Latency;
+		ConnPtr->Supervision_Timeout = ConnCpltData->Supervision_Timeout;
+	}
+
 	if( ConnCpltData->Role == MASTER )
 	{
 		Master_Connection_Complete( ConnCpltData );
@@ -330,6 +485,11 @@ void HCI_Disconnection_Complete( DisconnectionComplete* DisConnCpltData )
 	CONN_HANDLE_STATUS newstatus = ( DisConnCpltData->Status == COMMAND_SUCCESS ) ? CONN_HANDLE_FREE : CONN_HANDLE_FAILED;
 	CONNECTION_HANDLE* HandlePtr = Search_Connection_Handle( DisConnCpltData->Connection_Handle );
 
+	if( newstatus == CONN_HANDLE_FREE )
+	{
+		Release_L2CAP_Link( DisConnCpltData->Connection_Handle );
+	}
+
 	if( state == CONNECTION_STATE )
 	{
 		if( ( newstatus == CONN_HANDLE_FREE ) && ( Get_Number_Of_Active_Connections() == 1 ) )
@@ -362,6 +522,31 @@ void HCI_Disconnection_Complete( DisconnectionComplete* DisConnCpltData )
 }
 
 
+/****************************************************************/
+/* HCI_LE_Connection_Update_Complete()               			*/
+/* Location: 2384 Core_v5.2		 								*/
+/* Purpose: The HCI_LE_Connection_Update_Complete event is used */
+/* to indicate that the Controller process to update the 		*/
+/* connection has completed.									*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The new parameters are kept in the connection.	*/
+/****************************************************************/
+void HCI_LE_Connection_Update_Complete( CONTROLLER_ERROR_CODES Status, uint16_t Connection_Handle, uint16_t Connection_Interval,
+		uint16_t Connection_Latency, uint16_t Supervision_Timeout )
+{
+	CONNECTION* ConnPtr = Get_Connection( Connection_Handle );
+
+	if( ( Status == COMMAND_SUCCESS ) && ( ConnPtr != NULL ) )
+	{
+		ConnPtr->Connection_Interval = Connection_Interval;
+		ConnPtr->Connection_Latency = Connection_Latency;
+		ConnPtr->Supervision_Timeout = Supervision_Timeout;
+		ConnPtr->Parameter_Updates++;
+	}
+}
+
+
 /****************************************************************/
 /* Master_Connection_Complete()     	    					*/
 /* Location: 					 								*/
@@ -11,11 +11,38 @@
 #include "link_layer.h"
 #include "gap.h"
 #include "security_manager.h"
+#include "vendor_specific.h"
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#ifndef MAX_NUMBER_OF_CONNECTIONS
+#define MAX_NUMBER_OF_CONNECTIONS 4 /* Connections held by the host, up to BLUENRG_MAX_CONNECTIONS */
+#endif
+
+#if ( MAX_NUMBER_OF_CONNECTIONS < 1 ) || ( MAX_NUMBER_OF_CONNECTIONS > BLUENRG_MAX_CONNECTIONS )
+#error "MAX_NUMBER_OF_CONNECTIONS must be from 1 to BLUENRG_MAX_CONNECTIONS"
+#endif
 
 
 /****************************************************************/
 /* Type Defines					                                */
 /****************************************************************/
+typedef struct
+{
+	CONNECTION_HANDLE Handle;			/* Handle, status and role */
+	ADDRESS_TYPE Peer_Address_Type :8;
+	BD_ADDR_TYPE Peer_Address;
+	uint16_t Connection_Interval;		/* In 1.25 ms units */
+	uint16_t Connection_Latency;		/* In connection events */
+	uint16_t Supervision_Timeout;		/* In 10 ms units */
+	int8_t RSSI;						/* In dBm, 127 until read by Read_Connection_RSSI() */
+	uint16_t Parameter_Updates;			/* LE_Connection_Update_Complete events received */
+	uint32_t ACL_Packets_Received;
+	uint32_t ACL_Bytes_Received;
+}CONNECTION;
+
 
 
 /****************************************************************/
@@ -27,6 +54,8 @@ void Master_Disconnection_Complete( DisconnectionComplete* DisConnCpltData );
 void Slave_Disconnection_Complete( DisconnectionComplete* DisConnCpltData );
 uint8_t Get_Max_Number_Of_Connections( void );
 uint8_t Get_Number_Of_Active_Connections( void );
+CONNECTION* Get_Connection( uint16_t ConnHandle );
+uint8_t Read_Connection_RSSI( uint16_t ConnHandle );
 
 
 #endif /* BLE_CONNECTION_H_ */
@@ -603,6 +603,13 @@ static void LE_Create_Connection_Cancel_Complete( CONTROLLER_ERROR_CODES Status
 /****************************************************************/
 static void LE_Set_Address_Resolution_Enable_Complete( CONTROLLER_ERROR_CODES Status )
 {
+	if( Status == COMMAND_SUCCESS )
+	{
+		Set_Controller_Address_Resolution( ( InitConfig.Prev == ENABLE_ADDRESS_RESOLUTION ) ? ADDRESS_RESOLUTION_ENABLED : ADDRESS_RESOLUTION_DISABLED );
+	}else
+	{
+		Set_Controller_Address_Resolution( ADDRESS_RESOLUTION_UNKNOWN );
+	}
 	InitConfig.Actual = ( Status == COMMAND_SUCCESS || Status == COMMAND_DISALLOWED ) ? InitConfig.Next : InitConfig.Prev;
 }
 
@@ -615,6 +622,13 @@ static void LE_Set_Address_Resolution_Enable_Complete( CONTROLLER_ERROR_CODES St
 /****************************************************************/
 static void LE_Clear_Resolving_List_Complete( CONTROLLER_ERROR_CODES Status )
 {
+	if( Status == COMMAND_SUCCESS )
+	{
+		Controller_Resolving_List_Cleared();
+	}else
+	{
+		Set_Controller_Resolving_List_Unknown();
+	}
 	InitConfig.Actual = ADD_TO_RESOLVING_LIST;
 }
 
@@ -630,6 +644,7 @@ static void LE_Add_Device_To_Resolving_List_Complete( CONTROLLER_ERROR_CODES Sta
 	if ( Status == COMMAND_SUCCESS )
 	{
 		InitConfig.Actual = ADD_TO_RESOLVING_LIST;
+		Controller_Resolving_List_Added( &( Get_Record_From_Index( SM_Resolving_List_Index )->Peer ) );
 		SM_Resolving_List_Index++;
 	}else if( Status == MEM_CAPACITY_EXCEEDED )
 	{
@@ -41,6 +41,19 @@ typedef struct
 }SCAN_CONFIG;
 
 
+typedef struct
+{
+	BD_ADDR_TYPE Address;
+	uint8_t Address_Type;
+	uint8_t Scan_Response; /* TRUE for SCAN_RSP reports, which carry other data than the advertising ones */
+	uint8_t Used;
+	int8_t RSSI;		   /* Of the last report */
+	uint32_t DataHash;	   /* Hash_Advertising_Data() of the last report */
+	uint32_t LastSeen;	   /* HAL_GetTick() of the last report */
+	uint32_t LastForwarded;/* HAL_GetTick() of the last report given to Advertising_Report() */
+}ADV_CACHE_ENTRY;
+
+
 /****************************************************************/
 /* Local functions declaration                                  */
 /****************************************************************/
@@ -57,6 +70,9 @@ static void LE_Set_Address_Resolution_Enable_Complete( CONTROLLER_ERROR_CODES St
 static uint8_t Check_Scanner_Parameters( SCANNING_PARAMETERS* ScanPar );
 static uint8_t Check_Random_Address_For_Scanning( SCANNING_PARAMETERS* ScanPar );
 static uint8_t Check_Local_Resolvable_Private_Address( SCANNING_PARAMETERS* ScanPar );
+static uint8_t Check_Advertising_Cache( uint8_t Event_Type, uint8_t Address_Type, BD_ADDR_TYPE* Address,
+		uint8_t Data_Length, uint8_t Data[], int8_t RSSI );
+static uint32_t Hash_Advertising_Data( uint8_t Seed, uint8_t Data_Length, uint8_t Data[] );
 
 
 /****************************************************************/
@@ -68,6 +84,9 @@ extern void Set_BLE_State( BLE_STATES NewBLEState );
 /****************************************************************/
 /* Defines                                                      */
 /****************************************************************/
+#define ADV_CACHE_SIZE			32 /* Power of two. Zero gives every report to Advertising_Report() */
+#define ADV_CACHE_WAYS			4  /* Entries probed for an advertiser, the oldest is replaced */
+#define ADV_CACHE_REFRESH_TIME	1000U /* Time in milliseconds after which an unchanged report is given again */
 
 
 /****************************************************************/
@@ -83,6 +102,10 @@ static SCAN_CONFIG ScanConfig = { DISABLE_SCANNING, DISABLE_SCANNING, DISABLE_SC
 static BD_ADDR_TYPE RandomAddress;
 static uint16_t SM_Resolving_List_Index;
 static RESOLVING_RECORD* RecordPtr;
+#if ADV_CACHE_SIZE
+static ADV_CACHE_ENTRY AdvCache[ADV_CACHE_SIZE];
+#endif
+static ADV_CACHE_STATISTICS AdvCacheStatistics;
 
 
 /****************************************************************/
@@ -108,6 +131,9 @@ uint8_t Enter_Scanning_Mode( SCANNING_PARAMETERS* ScanPar )
 				*ScanningParameters = *ScanPar;
 
 				ScanConfig.Actual = DISABLE_SCANNING;
+#if ADV_CACHE_SIZE
+				memset( &AdvCache[0], 0, sizeof(AdvCache) ); /* Every advertiser is reported at least once per scan */
+#endif
 
 				Set_BLE_State( CONFIG_SCANNING );
 				return (TRUE);
@@ -464,6 +490,13 @@ static void LE_Set_Scan_Enable_Complete( CONTROLLER_ERROR_CODES Status )
 /****************************************************************/
 static void LE_Set_Address_Resolution_Enable_Complete( CONTROLLER_ERROR_CODES Status )
 {
+	if( Status == COMMAND_SUCCESS )
+	{
+		Set_Controller_Address_Resolution( ( ScanConfig.Prev == ENABLE_ADDRESS_RESOLUTION ) ? ADDRESS_RESOLUTION_ENABLED : ADDRESS_RESOLUTION_DISABLED );
+	}else
+	{
+		Set_Controller_Address_Resolution( ADDRESS_RESOLUTION_UNKNOWN );
+	}
 	ScanConfig.Actual = ( Status == COMMAND_SUCCESS || Status == COMMAND_DISALLOWED ) ? ScanConfig.Next : ScanConfig.Prev;
 }
 
@@ -476,6 +509,13 @@ static void LE_Set_Address_Resolution_Enable_Complete( CONTROLLER_ERROR_CODES St
 /****************************************************************/
 static void LE_Clear_Resolving_List_Complete( CONTROLLER_ERROR_CODES Status )
 {
+	if( Status == COMMAND_SUCCESS )
+	{
+		Controller_Resolving_List_Cleared();
+	}else
+	{
+		Set_Controller_Resolving_List_Unknown();
+	}
 	ScanConfig.Actual = ADD_TO_RESOLVING_LIST;
 }
 
@@ -491,6 +531,7 @@ static void LE_Add_Device_To_Resolving_List_Complete( CONTROLLER_ERROR_CODES Sta
 	if ( Status == COMMAND_SUCCESS )
 	{
 		ScanConfig.Actual = ADD_TO_RESOLVING_LIST;
+		Controller_Resolving_List_Added( &( Get_Record_From_Index( SM_Resolving_List_Index )->Peer ) );
 		SM_Resolving_List_Index++;
 	}else if( Status == MEM_CAPACITY_EXCEEDED )
 	{
@@ -773,12 +814,197 @@ static uint8_t Check_Local_Resolvable_Private_Address( SCANNING_PARAMETERS* Scan
 /* events that used legacy advertising PDUs.					*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: The reports equal to the last one of the same	*/
+/* advertiser are dropped, since the controller only filters	*/
+/* duplicates by address when asked to, and not on data changes.*/
+/* The reports kept are given to Advertising_Report() in runs	*/
+/* of consecutive reports, straight from the event.				*/
 /****************************************************************/
 void HCI_LE_Advertising_Report( LEAdvertisingReport* AdvReport )
 {
-	Advertising_Report( AdvReport->Num_Reports, AdvReport->Event_Type, AdvReport->Address_Type,
-			AdvReport->Address, AdvReport->Data_Length, AdvReport->Data, AdvReport->RSSI );
+	uint8_t First = 0; /* First report of the run being kept */
+	uint16_t FirstData = 0; /* Data offset of the First report */
+	uint16_t DataOffset = 0;
+
+	for( uint8_t i = 0; i < AdvReport->Num_Reports; i++ )
+	{
+		uint8_t Keep = Check_Advertising_Cache( AdvReport->Event_Type[i], AdvReport->Address_Type[i], &AdvReport->Address[i],
+				AdvReport->Data_Length[i], &AdvReport->Data[DataOffset], AdvReport->RSSI[i] );
+
+		DataOffset += AdvReport->Data_Length[i];
+
+		if( !Keep )
+		{
+			if( i > First )
+			{
+				Advertising_Report( i - First, &AdvReport->Event_Type[First], &AdvReport->Address_Type[First], &AdvReport->Address[First],
+						&AdvReport->Data_Length[First], &AdvReport->Data[FirstData], &AdvReport->RSSI[First] );
+			}
+			First = i + 1;
+			FirstData = DataOffset;
+		}
+	}
+
+	if( AdvReport->Num_Reports > First )
+	{
+		Advertising_Report( AdvReport->Num_Reports - First, &AdvReport->Event_Type[First], &AdvReport->Address_Type[First],
+				&AdvReport->Address[First], &AdvReport->Data_Length[First], &AdvReport->Data[FirstData], &AdvReport->RSSI[First] );
+	}
+}
+
+
+/****************************************************************/
+/* Get_Cached_Advertiser()     	    							*/
+/* Location: 					 								*/
+/* Purpose: Read the last RSSI of an advertiser, also updated	*/
+/* by the reports not forwarded.								*/
+/* Parameters: none				         						*/
+/* Return: TRUE if the advertiser is cached.					*/
+/* Description: LastSeen is the HAL_GetTick() of the report.	*/
+/****************************************************************/
+uint8_t Get_Cached_Advertiser( ADDRESS_TYPE Address_Type, BD_ADDR_TYPE* Address, int8_t* RSSI, uint32_t* LastSeen )
+{
+	uint8_t Found = FALSE;
+
+#if ADV_CACHE_SIZE
+	for( uint8_t Scan_Response = FALSE; Scan_Response <= TRUE; Scan_Response++ )
+	{
+		uint8_t Index = Hash_Advertising_Data( Address_Type | ( Scan_Response << 4 ), sizeof(BD_ADDR_TYPE), &Address->Bytes[0] );
+
+		for( uint8_t Way = 0; Way < ADV_CACHE_WAYS; Way++ )
+		{
+			ADV_CACHE_ENTRY* EntryPtr = &AdvCache[( Index + Way ) & ( ADV_CACHE_SIZE - 1 )];
+
+			if( ( EntryPtr->Used ) && ( EntryPtr->Address_Type == Address_Type ) && ( EntryPtr->Scan_Response == Scan_Response ) &&
+					( memcmp( &EntryPtr->Address, Address, sizeof(BD_ADDR_TYPE) ) == 0 ) )
+			{
+				if( ( !Found ) || ( (int32_t)( EntryPtr->LastSeen - *LastSeen ) > 0 ) )
+				{
+					*RSSI = EntryPtr->RSSI;
+					*LastSeen = EntryPtr->LastSeen;
+					Found = TRUE;
+				}
+			}
+		}
+	}
+#endif
+
+	return (Found);
+}
+
+
+/****************************************************************/
+/* Get_Advertising_Cache_Statistics()     	    				*/
+/* Location: 					 								*/
+/* Purpose: Return the counters of the reports filtered			*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+ADV_CACHE_STATISTICS Get_Advertising_Cache_Statistics( void )
+{
+	return ( AdvCacheStatistics );
+}
+
+
+/****************************************************************/
+/* Check_Advertising_Cache()     	    						*/
+/* Location: 					 								*/
+/* Purpose: Tell if a report brings something new				*/
+/* Parameters: none				         						*/
+/* Return: TRUE if the report should be forwarded.				*/
+/* Description: The advertiser is looked for in ADV_CACHE_WAYS	*/
+/* entries from the hash of its address. A report with the same	*/
+/* data as the cached one only updates the RSSI and LastSeen,	*/
+/* unless it was last forwarded ADV_CACHE_REFRESH_TIME ago. An	*/
+/* advertiser not cached replaces the oldest entry probed.		*/
+/****************************************************************/
+static uint8_t Check_Advertising_Cache( uint8_t Event_Type, uint8_t Address_Type, BD_ADDR_TYPE* Address,
+		uint8_t Data_Length, uint8_t Data[], int8_t RSSI )
+{
+	AdvCacheStatistics.Reports++;
+
+#if ADV_CACHE_SIZE
+	uint32_t Now = HAL_GetTick();
+	uint8_t Scan_Response = ( Event_Type == SCAN_RSP_EVT ) ? TRUE : FALSE;
+	uint32_t DataHash = Hash_Advertising_Data( Event_Type, Data_Length, &Data[0] );
+	uint8_t Index = Hash_Advertising_Data( Address_Type | ( Scan_Response << 4 ), sizeof(BD_ADDR_TYPE), &Address->Bytes[0] );
+	ADV_CACHE_ENTRY* OldestPtr = NULL;
+
+	for( uint8_t Way = 0; Way < ADV_CACHE_WAYS; Way++ )
+	{
+		ADV_CACHE_ENTRY* EntryPtr = &AdvCache[( Index + Way ) & ( ADV_CACHE_SIZE - 1 )];
+
+		if( ( EntryPtr->Used ) && ( EntryPtr->Address_Type == Address_Type ) && ( EntryPtr->Scan_Response == Scan_Response ) &&
+				( memcmp( &EntryPtr->Address, Address, sizeof(BD_ADDR_TYPE) ) == 0 ) )
+		{
+			EntryPtr->RSSI = RSSI;
+			EntryPtr->LastSeen = Now;
+
+			if( EntryPtr->DataHash != DataHash )
+			{
+				EntryPtr->DataHash = DataHash;
+			}else if( ( Now - EntryPtr->LastForwarded ) >= ADV_CACHE_REFRESH_TIME )
+			{
+				AdvCacheStatistics.Refreshed++;
+			}else
+			{
+				AdvCacheStatistics.Suppressed++;
+				return (FALSE);
+			}
+
+			EntryPtr->LastForwarded = Now;
+			AdvCacheStatistics.Forwarded++;
+			return (TRUE);
+		}
+
+		/* A free entry first, else the one not seen for longer */
+		if( ( OldestPtr == NULL ) || ( ( OldestPtr->Used ) &&
+				( ( !EntryPtr->Used ) || ( (int32_t)( EntryPtr->LastSeen - OldestPtr->LastSeen ) < 0 ) ) ) )
+		{
+			OldestPtr = EntryPtr;
+		}
+	}
+
+	AdvCacheStatistics.Evictions += OldestPtr->Used ? 1 : 0;
+
+	OldestPtr->Address = *Address;
+	OldestPtr->Address_Type = Address_Type;
+	OldestPtr->Scan_Response = Scan_Response;
+	OldestPtr->Used = TRUE;
+	OldestPtr->RSSI = RSSI;
+	OldestPtr->DataHash = DataHash;
+	OldestPtr->LastSeen = Now;
+	OldestPtr->LastForwarded = Now;
+#endif
+
+	AdvCacheStatistics.Forwarded++;
+	return (TRUE);
+}
+
+
+/****************************************************************/
+/* Hash_Advertising_Data()     	    							*/
+/* Location: 					 								*/
+/* Purpose: 32-bit FNV-1a hash of a report field				*/
+/* Parameters: Seed: hashed before the data						*/
+/* Return: none  												*/
+/* Description: Used for the AD payloads and for the cache		*/
+/* index of the addresses.										*/
+/****************************************************************/
+static uint32_t Hash_Advertising_Data( uint8_t Seed, uint8_t Data_Length, uint8_t Data[] )
+{
+	uint32_t Hash = 2166136261UL;
+
+	Hash = ( Hash ^ Seed ) * 16777619UL;
+	Hash = ( Hash ^ Data_Length ) * 16777619UL;
+
+	for( uint8_t i = 0; i < Data_Length; i++ )
+	{
+		Hash = ( Hash ^ Data[i] ) * 16777619UL;
+	}
+
+	return ( Hash ^ ( Hash >> 16 ) );
 }
 
 
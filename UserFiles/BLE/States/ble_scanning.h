@@ -43,11 +43,23 @@ typedef struct
 }ADVERTISING_REPORT;
 
 
+typedef struct
+{
+	uint32_t Reports;	/* Reports received from the controller */
+	uint32_t Forwarded;	/* Reports given to Advertising_Report() */
+	uint32_t Suppressed;/* Reports equal to the cached ones */
+	uint32_t Refreshed;	/* Reports equal to the cached ones but forwarded after ADV_CACHE_REFRESH_TIME */
+	uint32_t Evictions;	/* Cached advertisers replaced by new ones */
+}ADV_CACHE_STATISTICS;
+
+
 /****************************************************************/
 /* External functions declaration (Interface functions)         */
 /****************************************************************/
 uint8_t Check_Scanning_Parameters( SCANNING_PARAMETERS* ScanPar );
 uint8_t Get_Scanner_Address( LOCAL_ADDRESS_TYPE* Type, BD_ADDR_TYPE* ScanA );
+uint8_t Get_Cached_Advertiser( ADDRESS_TYPE Address_Type, BD_ADDR_TYPE* Address, int8_t* RSSI, uint32_t* LastSeen );
+ADV_CACHE_STATISTICS Get_Advertising_Cache_Statistics( void );
 void Advertising_Report( uint8_t Num_Reports, uint8_t Event_Type[], uint8_t Address_Type[], BD_ADDR_TYPE Address[],
 		uint8_t Data_Length[], uint8_t Data[], int8_t RSSI[] );
 
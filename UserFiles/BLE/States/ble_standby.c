@@ -8,6 +8,7 @@
 #include "ble_utils.h"
 #include "hosted_functions.h"
 #include "ble_standby.h"
+#include "l2cap.h"
 
 
 /****************************************************************/
@@ -270,6 +271,7 @@ int8_t Standby_Config( void )
 		/* Cancels any ongoing controller's function shared by the host */
 		Hosted_Functions_Enter_Standby( );
 		HCI_Reset_Transport_Layer( );
+		Reset_L2CAP( );
 		return (TRUE);
 		break;
 
@@ -389,6 +391,8 @@ static void Disconnect_Status( CONTROLLER_ERROR_CODES Status )
 /****************************************************************/
 void HCI_Reset_Complete( CONTROLLER_ERROR_CODES Status )
 {
+	Set_Controller_Resolving_List_Unknown();
+	Set_Controller_Address_Resolution( ADDRESS_RESOLUTION_UNKNOWN );
 	if( StandbyConfig.Actual == WAIT_OPERATION )
 	{
 		StandbyConfig.Actual = ( Status == COMMAND_SUCCESS ) ? RECONFIG_VENDOR_SPECIFC : StandbyConfig.BaseStep;
@@ -8,6 +8,7 @@
 #include "ble_utils.h"
 #include "hosted_functions.h"
 #include "security_manager.h"
+#include "l2cap.h"
 
 
 /****************************************************************/
@@ -19,7 +20,6 @@ typedef enum
 	LOCAL_SUPPORTED_FEATURES,
 	SET_EVENT_MASK,
 	SET_LE_EVENT_MASK,
-	READ_BUFFER_SIZE,
 	LE_READ_BUFFER_SIZE,
 	LE_LOCAL_SUPPORTED_FEATURES,
 	READ_BD_ADDRESS,
@@ -30,9 +30,7 @@ typedef enum
 	CLEAR_RESOLVING_LIST,
 	READ_RESOLVING_LIST_SIZE,
 	SET_RPA_TIMEOUT,
-	CLEAR_TIMER,
-	WAIT_STATUS,
-	BLE_INIT_DONE
+	NUMBER_OF_INIT_STEPS
 }BLE_INIT_STEPS;
 
 
@@ -42,6 +40,8 @@ typedef enum
 void Set_BLE_State( BLE_STATES NewBLEState );
 static uint8_t Reset_Controller( void );
 static void Reset_Complete( CONTROLLER_ERROR_CODES Status );
+static uint8_t Issue_Init_Step( BLE_INIT_STEPS Step );
+static void Conclude_Init_Step( BLE_INIT_STEPS Step, uint8_t Success );
 static void Set_Event_Mask_Complete( CONTROLLER_ERROR_CODES Status );
 static void Clear_White_List_Complete( CONTROLLER_ERROR_CODES Status );
 static void LE_Set_Address_Resolution_Enable_Complete( CONTROLLER_ERROR_CODES Status );
@@ -79,19 +79,25 @@ extern void Connection( void );
 /****************************************************************/
 /* Defines                                                      */
 /****************************************************************/
+#define INIT_STEP(Step)		 ( 1U << (Step) )
+#define ALL_INIT_STEPS		 ( INIT_STEP(NUMBER_OF_INIT_STEPS) - 1U )
+#define BLE_INIT_WAIT_TIME	 500U /* Time in milliseconds without any concluded step before the initialization restarts */
 
 
 /****************************************************************/
 /* Global variables definition                                  */
 /****************************************************************/
 uint16_t Default_Num_LE_ACL_Data_Packets = 0;
+uint16_t Default_LE_ACL_Data_Packet_Length = 0;
 
 
 /****************************************************************/
 /* Local variables definition                                   */
 /****************************************************************/
 static BLE_STATES BLEState = RESET_CONTROLLER;
-static BLE_INIT_STEPS BLEInitSteps = LOCAL_SUPPORTED_COMMANDS;
+static uint16_t InitStepsIssued = 0; /* Steps waiting for the controller's response */
+static uint16_t InitStepsDone = 0;
+static uint32_t InitWaitTimer = 0;
 static BLE_STATUS Controller_Reset_Flag = BLE_ERROR;
 static SUPPORTED_COMMANDS HCI_Supported_Commands;
 static SUPPORTED_FEATURES HCI_LMP_Features;
@@ -99,6 +105,28 @@ static LE_SUPPORTED_FEATURES HCI_LE_Features;
 static LOCAL_VERSION_INFORMATION LocalInfo;
 static uint8_t ControllerResolvingListSize;
 
+/* Steps that must be concluded before a step is issued. Only the steps
+ * using the result of others depend on them, so the independent ones
+ * are issued together and the controller works on them as its command
+ * credits allow. */
+static const uint16_t InitStepDependencies[NUMBER_OF_INIT_STEPS] =
+{
+	[LOCAL_SUPPORTED_COMMANDS]		 = 0,
+	[LOCAL_SUPPORTED_FEATURES]		 = INIT_STEP(LOCAL_SUPPORTED_COMMANDS),
+	[SET_EVENT_MASK]				 = INIT_STEP(LOCAL_SUPPORTED_COMMANDS),
+	[SET_LE_EVENT_MASK]				 = INIT_STEP(LOCAL_SUPPORTED_COMMANDS) | INIT_STEP(LOCAL_SUPPORTED_FEATURES),
+	[LE_READ_BUFFER_SIZE]			 = INIT_STEP(LOCAL_SUPPORTED_COMMANDS),
+	[LE_LOCAL_SUPPORTED_FEATURES]	 = INIT_STEP(LOCAL_SUPPORTED_COMMANDS),
+	[READ_BD_ADDRESS]				 = INIT_STEP(LOCAL_SUPPORTED_COMMANDS),
+	[GENERATE_STATIC_RANDOM_ADDRESS] = INIT_STEP(LOCAL_SUPPORTED_COMMANDS) | INIT_STEP(READ_BD_ADDRESS),
+	[READ_LOCAL_VERSION]			 = INIT_STEP(LOCAL_SUPPORTED_COMMANDS),
+	[CLEAR_WHITE_LIST]				 = INIT_STEP(LOCAL_SUPPORTED_COMMANDS),
+	[ADDRESS_RESOLUTION]			 = INIT_STEP(LOCAL_SUPPORTED_COMMANDS),
+	[CLEAR_RESOLVING_LIST]			 = INIT_STEP(LOCAL_SUPPORTED_COMMANDS) | INIT_STEP(ADDRESS_RESOLUTION),
+	[READ_RESOLVING_LIST_SIZE]		 = INIT_STEP(LOCAL_SUPPORTED_COMMANDS),
+	[SET_RPA_TIMEOUT]				 = INIT_STEP(LOCAL_SUPPORTED_COMMANDS)
+};
+
 
 /****************************************************************/
 /* Run_BLE()        	        								*/
@@ -209,6 +237,11 @@ void Run_BLE( void )
 
 	Vendor_Specific_Process();
 	Hosted_Functions_Process();
+	Run_L2CAP();
+
+	/* The commands waiting for controller credits are sent after the state
+	 * machines have handled the responses that returned the credits */
+	HCI_Transmit_Pending_Commands( );
 }
 
 
@@ -288,26 +321,79 @@ LOCAL_VERSION_INFORMATION* Get_Local_Version_Information( void )
 /* Purpose: Init BLE 											*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: Every step whose dependencies are concluded is 	*/
+/* issued while the controller has command credits, so several	*/
+/* commands can be waiting for the controller at the same time.	*/
+/* If no step is concluded for BLE_INIT_WAIT_TIME, the 			*/
+/* initialization starts over.									*/
 /****************************************************************/
 uint8_t BLE_Init( void )
 {
-	static uint32_t WaitCmdTimer;
+	for( BLE_INIT_STEPS Step = LOCAL_SUPPORTED_COMMANDS; Step < NUMBER_OF_INIT_STEPS; Step++ )
+	{
+		if( !HCI_Command_Credits_Available(  ) )
+		{
+			break; /* Up to the number of commands the controller can take */
+		}
+
+		if( ( !( ( InitStepsIssued | InitStepsDone ) & INIT_STEP(Step) ) ) &&
+				( ( InitStepsDone & InitStepDependencies[Step] ) == InitStepDependencies[Step] ) )
+		{
+			if( !Issue_Init_Step( Step ) )
+			{
+				break; /* The transport layer is full, the next steps would not be accepted either */
+			}
+		}
+	}
+
+	if( InitStepsDone == ALL_INIT_STEPS )
+	{
+		InitStepsIssued = 0;
+		InitStepsDone = 0;
+		InitWaitTimer = 0;
+		return (TRUE);
+	}else if( !InitStepsIssued )
+	{
+		InitWaitTimer = 0;
+	}else if( TimeBase_DelayMs( &InitWaitTimer, BLE_INIT_WAIT_TIME, TRUE ) )
+	{
+		InitStepsIssued = 0;
+		InitStepsDone = 0;
+	}
+
+	return (FALSE);
+}
+
+
+/****************************************************************/
+/* Issue_Init_Step()        	       							*/
+/* Location: 					 								*/
+/* Purpose: Send the command of an initialization step			*/
+/* Parameters: none				         						*/
+/* Return: FALSE if the command was not accepted.				*/
+/* Description: The step is marked as issued when its command 	*/
+/* is accepted, concluded when it does not apply to this 		*/
+/* controller and left as it is to be tried again in the next 	*/
+/* call otherwise.												*/
+/****************************************************************/
+static uint8_t Issue_Init_Step( BLE_INIT_STEPS Step )
+{
+	uint8_t Issued = FALSE;
 
-	switch ( BLEInitSteps )
+	switch ( Step )
 	{
 	case LOCAL_SUPPORTED_COMMANDS:
-		BLEInitSteps = HCI_Read_Local_Supported_Commands( &Read_Local_Supported_Commands_Complete, NULL ) ? CLEAR_TIMER : LOCAL_SUPPORTED_COMMANDS;
+		Issued = HCI_Read_Local_Supported_Commands( &Read_Local_Supported_Commands_Complete, NULL );
 		break;
 
 	case LOCAL_SUPPORTED_FEATURES:
 		memset( &HCI_LMP_Features, 0, sizeof(HCI_LMP_Features) );
 		if( HCI_Supported_Commands.Bits.HCI_Read_Local_Supported_Features )
 		{
-			BLEInitSteps = HCI_Read_Local_Supported_Features( &Read_Local_Supported_Features_Complete, NULL ) ? CLEAR_TIMER : LOCAL_SUPPORTED_FEATURES;
+			Issued = HCI_Read_Local_Supported_Features( &Read_Local_Supported_Features_Complete, NULL );
 		}else
 		{
-			BLEInitSteps = SET_EVENT_MASK;
+			Conclude_Init_Step( Step, TRUE );
 		}
 		break;
 
@@ -326,10 +412,10 @@ uint8_t BLE_Init( void )
 			Event_Mask.Bits.Read_Remote_Extended_Features_Complete_event = 1;
 			Event_Mask.Bits.LE_Meta_event = 1;
 
-			BLEInitSteps = HCI_Set_Event_Mask( Event_Mask, &Set_Event_Mask_Complete, NULL ) ? CLEAR_TIMER : SET_EVENT_MASK;
+			Issued = HCI_Set_Event_Mask( Event_Mask, &Set_Event_Mask_Complete, NULL );
 		}else
 		{
-			BLEInitSteps = SET_LE_EVENT_MASK;
+			Conclude_Init_Step( Step, TRUE );
 		}
 		break;
 
@@ -341,10 +427,11 @@ uint8_t BLE_Init( void )
 			/* Enable all events from the LE Controller */
 			memset( &LE_Event_Mask, 0xFF, sizeof(LE_Event_Mask) );
 
-			BLEInitSteps = HCI_LE_Set_Event_Mask( LE_Event_Mask, &LE_Set_Event_Mask_Complete, NULL ) ? CLEAR_TIMER : SET_LE_EVENT_MASK;
+			Issued = HCI_LE_Set_Event_Mask( LE_Event_Mask, &LE_Set_Event_Mask_Complete, NULL );
 		}else
 		{
-			BLEInitSteps = CLEAR_TIMER;
+			/* As before, the initialization is not concluded and starts over after the wait time */
+			Issued = TRUE;
 		}
 		break;
 
@@ -352,34 +439,24 @@ uint8_t BLE_Init( void )
 		if( HCI_Supported_Commands.Bits.HCI_LE_Read_Buffer_Size_v2 )
 		{
 			/* TODO: this command should exist only in more updated BLE versions. */
-			BLEInitSteps = CLEAR_TIMER;
+			Issued = TRUE;
 		}else if( HCI_Supported_Commands.Bits.HCI_LE_Read_Buffer_Size_v1 )
 		{
-			BLEInitSteps = HCI_LE_Read_Buffer_Size( &LE_Read_Buffer_Size_Complete, NULL ) ? CLEAR_TIMER : LE_READ_BUFFER_SIZE;
+			Issued = HCI_LE_Read_Buffer_Size( &LE_Read_Buffer_Size_Complete, NULL );
 		}else
-		{
-			BLEInitSteps = READ_BUFFER_SIZE;
-		}
-		break;
-
-	case READ_BUFFER_SIZE:
-		if( HCI_Supported_Commands.Bits.HCI_Read_Buffer_Size )
 		{
 			/* TODO: this implementation does not make use of HCI_Read_Buffer_Size() used in BR/EDR Bluetooth. */
-			BLEInitSteps = CLEAR_TIMER;
-		}else
-		{
-			BLEInitSteps = CLEAR_TIMER;
+			Issued = TRUE;
 		}
 		break;
 
 	case LE_LOCAL_SUPPORTED_FEATURES:
 		if( HCI_Supported_Commands.Bits.HCI_LE_Read_Local_Supported_Features )
 		{
-			BLEInitSteps = HCI_LE_Read_Local_Supported_Features( &LE_Read_Local_Supported_Features_Complete, NULL ) ? CLEAR_TIMER : LE_LOCAL_SUPPORTED_FEATURES;
+			Issued = HCI_LE_Read_Local_Supported_Features( &LE_Read_Local_Supported_Features_Complete, NULL );
 		}else
 		{
-			BLEInitSteps = CLEAR_TIMER;
+			Issued = TRUE;
 		}
 		break;
 
@@ -387,10 +464,10 @@ uint8_t BLE_Init( void )
 		if( HCI_Supported_Commands.Bits.HCI_Read_BD_ADDR )
 		{
 			/* Read Public Device Address */
-			BLEInitSteps = HCI_Read_BD_ADDR( &Read_BD_ADDR_Complete, NULL ) ? CLEAR_TIMER : READ_BD_ADDRESS;
+			Issued = HCI_Read_BD_ADDR( &Read_BD_ADDR_Complete, NULL );
 		}else
 		{
-			BLEInitSteps = CLEAR_TIMER;
+			Issued = TRUE;
 		}
 		break;
 
@@ -399,71 +476,83 @@ uint8_t BLE_Init( void )
 		{
 			if( Generate_Device_Address( &HCI_Supported_Commands, STATIC_DEVICE_ADDRESS, NULL, 1 ) != NULL )
 			{
-				BLEInitSteps = READ_LOCAL_VERSION;
+				Conclude_Init_Step( Step, TRUE );
 			}
 		}else
 		{
-			BLEInitSteps = READ_LOCAL_VERSION;
+			Conclude_Init_Step( Step, TRUE );
 		}
 		break;
 
 	case READ_LOCAL_VERSION:
 		if( HCI_Supported_Commands.Bits.HCI_Read_Local_Version_Information )
 		{
-			BLEInitSteps = HCI_Read_Local_Version_Information( &Read_Local_Version_Information_Complete, NULL ) ? CLEAR_TIMER : READ_LOCAL_VERSION;
+			Issued = HCI_Read_Local_Version_Information( &Read_Local_Version_Information_Complete, NULL );
 		}else
 		{
-			BLEInitSteps = CLEAR_TIMER;
+			Issued = TRUE;
 		}
 		break;
 
 	case CLEAR_WHITE_LIST:
 		if( HCI_Supported_Commands.Bits.HCI_LE_Clear_White_List )
 		{
-			BLEInitSteps = HCI_LE_Clear_White_List( &Clear_White_List_Complete, NULL ) ? CLEAR_TIMER : CLEAR_WHITE_LIST;
+			Issued = HCI_LE_Clear_White_List( &Clear_White_List_Complete, NULL );
 		}else
 		{
-			BLEInitSteps = CLEAR_TIMER;
+			Issued = TRUE;
 		}
 		break;
 
 	case ADDRESS_RESOLUTION:
 		/* Disable address resolution */
-		BLEInitSteps = HCI_LE_Set_Address_Resolution_Enable( FALSE, &LE_Set_Address_Resolution_Enable_Complete, NULL ) ? CLEAR_TIMER : ADDRESS_RESOLUTION;
+		Issued = HCI_LE_Set_Address_Resolution_Enable( FALSE, &LE_Set_Address_Resolution_Enable_Complete, NULL );
 		break;
 
 	case CLEAR_RESOLVING_LIST:
-		BLEInitSteps = HCI_LE_Clear_Resolving_List( &LE_Clear_Resolving_List_Complete, NULL ) ? CLEAR_TIMER : CLEAR_RESOLVING_LIST;
+		Issued = HCI_LE_Clear_Resolving_List( &LE_Clear_Resolving_List_Complete, NULL );
 		break;
 
 	case READ_RESOLVING_LIST_SIZE:
-		BLEInitSteps = HCI_LE_Read_Resolving_List_Size( &LE_Read_Resolving_List_Size_Complete, NULL ) ? CLEAR_TIMER : READ_RESOLVING_LIST_SIZE;
+		Issued = HCI_LE_Read_Resolving_List_Size( &LE_Read_Resolving_List_Size_Complete, NULL );
 		break;
 
 	case SET_RPA_TIMEOUT:
 		/* 900 seconds is the default value */
-		BLEInitSteps = HCI_LE_Set_Resolvable_Private_Address_Timeout( 900, &LE_Set_Resolvable_Private_Address_Timeout_Complete, NULL ) ? CLEAR_TIMER : SET_RPA_TIMEOUT;
+		Issued = HCI_LE_Set_Resolvable_Private_Address_Timeout( 900, &LE_Set_Resolvable_Private_Address_Timeout_Complete, NULL );
 		break;
 
-	case CLEAR_TIMER:
-		BLEInitSteps = WAIT_STATUS;
-		WaitCmdTimer = 0;
+	default:
 		break;
+	}
 
-	case WAIT_STATUS:
-		BLEInitSteps = TimeBase_DelayMs( &WaitCmdTimer, 500, TRUE ) ? LOCAL_SUPPORTED_COMMANDS : WAIT_STATUS;
-		break;
+	if( Issued )
+	{
+		InitStepsIssued |= INIT_STEP(Step);
+	}
 
-	case BLE_INIT_DONE:
-		BLEInitSteps = LOCAL_SUPPORTED_COMMANDS;
-		return (TRUE);
-		break;
+	/* The static address generation runs on its own and is polled */
+	return ( ( ( InitStepsIssued | InitStepsDone ) & INIT_STEP(Step) ) || ( Step == GENERATE_STATIC_RANDOM_ADDRESS ) ) ? TRUE : FALSE;
+}
 
-	default:
-		break;
-	}
 
-	return (FALSE);
+/****************************************************************/
+/* Conclude_Init_Step()        	       							*/
+/* Location: 					 								*/
+/* Purpose: Register the result of an initialization step		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: A failed step is issued again.					*/
+/****************************************************************/
+static void Conclude_Init_Step( BLE_INIT_STEPS Step, uint8_t Success )
+{
+	InitStepsIssued &= ~INIT_STEP(Step);
+
+	if( Success )
+	{
+		InitStepsDone |= INIT_STEP(Step);
+		InitWaitTimer = 0;
+	}
 }
 
 
@@ -478,11 +567,8 @@ static void Read_Local_Supported_Commands_Complete( CONTROLLER_ERROR_CODES Statu
 	if( Status == COMMAND_SUCCESS )
 	{
 		HCI_Supported_Commands = *Supported_Commands;
-		BLEInitSteps = LOCAL_SUPPORTED_FEATURES;
-	}else
-	{
-		BLEInitSteps = LOCAL_SUPPORTED_COMMANDS;
 	}
+	Conclude_Init_Step( LOCAL_SUPPORTED_COMMANDS, ( Status == COMMAND_SUCCESS ) );
 }
 
 
@@ -497,11 +583,8 @@ static void Read_Local_Supported_Features_Complete( CONTROLLER_ERROR_CODES Statu
 	if( Status == COMMAND_SUCCESS )
 	{
 		HCI_LMP_Features = *LMP_Features;
-		BLEInitSteps = SET_EVENT_MASK;
-	}else
-	{
-		BLEInitSteps = LOCAL_SUPPORTED_FEATURES;
 	}
+	Conclude_Init_Step( LOCAL_SUPPORTED_FEATURES, ( Status == COMMAND_SUCCESS ) );
 }
 
 
@@ -513,7 +596,7 @@ static void Read_Local_Supported_Features_Complete( CONTROLLER_ERROR_CODES Statu
 /****************************************************************/
 static void Clear_White_List_Complete( CONTROLLER_ERROR_CODES Status )
 {
-	BLEInitSteps = ( Status == COMMAND_SUCCESS ) ? ADDRESS_RESOLUTION : CLEAR_WHITE_LIST;
+	Conclude_Init_Step( CLEAR_WHITE_LIST, ( Status == COMMAND_SUCCESS ) );
 }
 
 
@@ -525,7 +608,8 @@ static void Clear_White_List_Complete( CONTROLLER_ERROR_CODES Status )
 /****************************************************************/
 static void LE_Set_Address_Resolution_Enable_Complete( CONTROLLER_ERROR_CODES Status )
 {
-	BLEInitSteps = ( Status == COMMAND_SUCCESS || Status == COMMAND_DISALLOWED ) ? CLEAR_RESOLVING_LIST : ADDRESS_RESOLUTION;
+	Set_Controller_Address_Resolution( ( Status == COMMAND_SUCCESS ) ? ADDRESS_RESOLUTION_DISABLED : ADDRESS_RESOLUTION_UNKNOWN );
+	Conclude_Init_Step( ADDRESS_RESOLUTION, ( Status == COMMAND_SUCCESS || Status == COMMAND_DISALLOWED ) );
 }
 
 
@@ -537,7 +621,11 @@ static void LE_Set_Address_Resolution_Enable_Complete( CONTROLLER_ERROR_CODES St
 /****************************************************************/
 static void LE_Clear_Resolving_List_Complete( CONTROLLER_ERROR_CODES Status )
 {
-	BLEInitSteps = ( Status == COMMAND_SUCCESS ) ? READ_RESOLVING_LIST_SIZE : CLEAR_RESOLVING_LIST;
+	if( Status == COMMAND_SUCCESS )
+	{
+		Controller_Resolving_List_Cleared();
+	}
+	Conclude_Init_Step( CLEAR_RESOLVING_LIST, ( Status == COMMAND_SUCCESS ) );
 }
 
 
@@ -550,7 +638,7 @@ static void LE_Clear_Resolving_List_Complete( CONTROLLER_ERROR_CODES Status )
 static void LE_Read_Resolving_List_Size_Complete( CONTROLLER_ERROR_CODES Status, uint8_t Resolving_List_Size )
 {
 	ControllerResolvingListSize = Resolving_List_Size;
-	BLEInitSteps = ( Status == COMMAND_SUCCESS ) ? SET_RPA_TIMEOUT : READ_RESOLVING_LIST_SIZE;
+	Conclude_Init_Step( READ_RESOLVING_LIST_SIZE, ( Status == COMMAND_SUCCESS ) );
 }
 
 
@@ -562,7 +650,7 @@ static void LE_Read_Resolving_List_Size_Complete( CONTROLLER_ERROR_CODES Status,
 /****************************************************************/
 static void LE_Set_Resolvable_Private_Address_Timeout_Complete( CONTROLLER_ERROR_CODES Status )
 {
-	BLEInitSteps = ( Status == COMMAND_SUCCESS ) ? BLE_INIT_DONE : SET_RPA_TIMEOUT;
+	Conclude_Init_Step( SET_RPA_TIMEOUT, ( Status == COMMAND_SUCCESS ) );
 }
 
 
@@ -574,7 +662,7 @@ static void LE_Set_Resolvable_Private_Address_Timeout_Complete( CONTROLLER_ERROR
 /****************************************************************/
 static void Set_Event_Mask_Complete( CONTROLLER_ERROR_CODES Status )
 {
-	BLEInitSteps = ( Status == COMMAND_SUCCESS ) ? SET_LE_EVENT_MASK : SET_EVENT_MASK;
+	Conclude_Init_Step( SET_EVENT_MASK, ( Status == COMMAND_SUCCESS ) );
 }
 
 
@@ -586,7 +674,7 @@ static void Set_Event_Mask_Complete( CONTROLLER_ERROR_CODES Status )
 /****************************************************************/
 static void LE_Set_Event_Mask_Complete( CONTROLLER_ERROR_CODES Status )
 {
-	BLEInitSteps = ( Status == COMMAND_SUCCESS ) ? LE_READ_BUFFER_SIZE : SET_LE_EVENT_MASK;
+	Conclude_Init_Step( SET_LE_EVENT_MASK, ( Status == COMMAND_SUCCESS ) );
 }
 
 
@@ -601,18 +689,18 @@ static void LE_Read_Buffer_Size_Complete( CONTROLLER_ERROR_CODES Status, uint16_
 {
 	if( Status == COMMAND_SUCCESS )
 	{
-		if( ( !LE_ACL_Data_Packet_Length ) || ( !Total_Num_LE_ACL_Data_Packets ) )
-		{
-			BLEInitSteps = READ_BUFFER_SIZE;
-		}else
+		if( ( LE_ACL_Data_Packet_Length ) && ( Total_Num_LE_ACL_Data_Packets ) )
 		{
 			Default_Num_LE_ACL_Data_Packets = Total_Num_LE_ACL_Data_Packets;
+			Default_LE_ACL_Data_Packet_Length = LE_ACL_Data_Packet_Length;
 			Set_Default_Number_Of_HCI_Data_Packets( );
-			BLEInitSteps = LE_LOCAL_SUPPORTED_FEATURES;
+			Conclude_Init_Step( LE_READ_BUFFER_SIZE, TRUE );
 		}
+		/* Otherwise the shared buffers of HCI_Read_Buffer_Size() should be used (not
+		 * implemented): the initialization starts over after the wait time */
 	}else
 	{
-		BLEInitSteps = LE_READ_BUFFER_SIZE;
+		Conclude_Init_Step( LE_READ_BUFFER_SIZE, FALSE );
 	}
 }
 
@@ -628,11 +716,8 @@ static void LE_Read_Local_Supported_Features_Complete( CONTROLLER_ERROR_CODES St
 	if( Status == COMMAND_SUCCESS )
 	{
 		HCI_LE_Features = *LE_Features;
-		BLEInitSteps = READ_BD_ADDRESS;
-	}else
-	{
-		BLEInitSteps = LE_LOCAL_SUPPORTED_FEATURES;
 	}
+	Conclude_Init_Step( LE_LOCAL_SUPPORTED_FEATURES, ( Status == COMMAND_SUCCESS ) );
 }
 
 
@@ -646,16 +731,15 @@ static void Read_BD_ADDR_Complete( CONTROLLER_ERROR_CODES Status, BD_ADDR_TYPE*
 {
 	if( Status == COMMAND_SUCCESS )
 	{
+		/* A different address means the vendor specific configuration did not
+		 * take effect: the initialization starts over after the wait time */
 		if( memcmp( Get_Public_Device_Address( ).AddrPtr, BD_ADDR, sizeof(BD_ADDR_TYPE) ) == 0 )
 		{
-			BLEInitSteps = GENERATE_STATIC_RANDOM_ADDRESS;
-		}else
-		{
-			BLEInitSteps = CLEAR_TIMER;
+			Conclude_Init_Step( READ_BD_ADDRESS, TRUE );
 		}
 	}else
 	{
-		BLEInitSteps = READ_BD_ADDRESS;
+		Conclude_Init_Step( READ_BD_ADDRESS, FALSE );
 	}
 }
 
@@ -694,6 +778,8 @@ static uint8_t Reset_Controller( void )
 /****************************************************************/
 static void Reset_Complete( CONTROLLER_ERROR_CODES Status )
 {
+	Set_Controller_Resolving_List_Unknown();
+	Set_Controller_Address_Resolution( ADDRESS_RESOLUTION_UNKNOWN );
 	Controller_Reset_Flag = ( Status == COMMAND_SUCCESS ) ? BLE_TRUE : BLE_ERROR;
 }
 
@@ -710,11 +796,8 @@ static void Read_Local_Version_Information_Complete( CONTROLLER_ERROR_CODES Stat
 	if( Status == COMMAND_SUCCESS )
 	{
 		LocalInfo = *Local_Version_Information;
-		BLEInitSteps = CLEAR_WHITE_LIST;
-	}else
-	{
-		BLEInitSteps = READ_LOCAL_VERSION;
 	}
+	Conclude_Init_Step( READ_LOCAL_VERSION, ( Status == COMMAND_SUCCESS ) );
 }
 
 
@@ -0,0 +1,226 @@
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include <string.h>
+#include "aes_128.h"
+
+
+/****************************************************************/
+/* Defines                                                      */
+/****************************************************************/
+#define AES_128_ROUNDS	10
+
+/* Multiplication by x in GF(2^8) without data dependent branches */
+#define XTIME(x) ( (uint8_t)( ( (x) << 1 ) ^ ( 0x1B & ( -( (x) >> 7 ) ) ) ) )
+
+
+/****************************************************************/
+/* Static functions declaration                                 */
+/****************************************************************/
+static void Sub_Bytes_Shift_Rows( uint8_t State[16] );
+static void Mix_Columns( uint8_t State[16] );
+static void Next_Round_Key( uint8_t RoundKey[16], uint8_t Rcon );
+
+
+/****************************************************************/
+/* Local variables definition                                   */
+/****************************************************************/
+static const uint8_t SBox[256] =
+{
+	0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+	0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+	0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+	0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+	0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+	0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+	0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+	0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+	0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+	0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+	0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+	0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+	0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+	0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+	0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+	0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16
+};
+
+
+/****************************************************************/
+/* AES_128_Encrypt_Block()        								*/
+/* Location: FIPS-197											*/
+/* Purpose: Software AES-128 block encryption, the same 		*/
+/* operation requested to the controller by HCI_LE_Encrypt.		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The most significant octet of Key, 				*/
+/* Plaintext_Data and Encrypted_Data is the index [0], as in the*/
+/* FIPS-197 notation. The round keys are expanded on the fly, so*/
+/* only 32 bytes of stack are used. There are no branches nor 	*/
+/* table indexes depending on data other than the S-box lookup,	*/
+/* which takes constant time on cores without data cache such as*/
+/* the Cortex-M0.												*/
+/****************************************************************/
+void AES_128_Encrypt_Block( uint8_t Key[16], uint8_t Plaintext_Data[16], uint8_t Encrypted_Data[16] )
+{
+	uint8_t State[16];
+	uint8_t RoundKey[16];
+	uint8_t Rcon = 0x01;
+
+	for( uint8_t i = 0; i < sizeof(State); i++ )
+	{
+		RoundKey[i] = Key[i];
+		State[i] = Plaintext_Data[i] ^ RoundKey[i];
+	}
+
+	for( uint8_t Round = 1; Round <= AES_128_ROUNDS; Round++ )
+	{
+		Sub_Bytes_Shift_Rows( &State[0] );
+
+		if( Round != AES_128_ROUNDS )
+		{
+			Mix_Columns( &State[0] );
+		}
+
+		Next_Round_Key( &RoundKey[0], Rcon );
+		Rcon = XTIME( Rcon );
+
+		for( uint8_t i = 0; i < sizeof(State); i++ )
+		{
+			State[i] ^= RoundKey[i];
+		}
+	}
+
+	memcpy( &Encrypted_Data[0], &State[0], sizeof(State) );
+}
+
+
+/****************************************************************/
+/* AES_128_Ah()        											*/
+/* Location: 3140 Core_v5.2										*/
+/* Purpose: Random address hash function ah used to generate	*/
+/* and resolve private resolvable addresses.					*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: ah( k, r ) = e( k, r' ) mod 2^24, where r' is 	*/
+/* r padded with zeros. The r and hash arrays follow the device	*/
+/* address byte order, that is, the least significant octet is	*/
+/* the index [0]. The IRK is in FIPS-197 order like the key of	*/
+/* AES_128_Encrypt_Block().										*/
+/****************************************************************/
+void AES_128_Ah( uint8_t IRK[16], uint8_t r[3], uint8_t hash[3] )
+{
+	uint8_t Data[16];
+
+	memset( &Data[0], 0, sizeof(Data) );
+	Data[15] = r[0];
+	Data[14] = r[1];
+	Data[13] = r[2];
+
+	AES_128_Encrypt_Block( &IRK[0], &Data[0], &Data[0] );
+
+	hash[0] = Data[15];
+	hash[1] = Data[14];
+	hash[2] = Data[13];
+}
+
+
+/****************************************************************/
+/* Sub_Bytes_Shift_Rows()        								*/
+/* Location: FIPS-197											*/
+/* Purpose: SubBytes and ShiftRows transformations in a single 	*/
+/* pass. The state is stored by columns.						*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Sub_Bytes_Shift_Rows( uint8_t State[16] )
+{
+	uint8_t Temp;
+
+	/* Row 0: no shift */
+	State[0]  = SBox[ State[0] ];
+	State[4]  = SBox[ State[4] ];
+	State[8]  = SBox[ State[8] ];
+	State[12] = SBox[ State[12] ];
+
+	/* Row 1: shift left by one */
+	Temp	  = State[1];
+	State[1]  = SBox[ State[5] ];
+	State[5]  = SBox[ State[9] ];
+	State[9]  = SBox[ State[13] ];
+	State[13] = SBox[ Temp ];
+
+	/* Row 2: shift left by two */
+	Temp	  = State[2];
+	State[2]  = SBox[ State[10] ];
+	State[10] = SBox[ Temp ];
+	Temp	  = State[6];
+	State[6]  = SBox[ State[14] ];
+	State[14] = SBox[ Temp ];
+
+	/* Row 3: shift left by three */
+	Temp	  = State[15];
+	State[15] = SBox[ State[11] ];
+	State[11] = SBox[ State[7] ];
+	State[7]  = SBox[ State[3] ];
+	State[3]  = SBox[ Temp ];
+}
+
+
+/****************************************************************/
+/* Mix_Columns()        										*/
+/* Location: FIPS-197											*/
+/* Purpose: MixColumns transformation							*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Mix_Columns( uint8_t State[16] )
+{
+	uint8_t a0, a1, a2, a3, All;
+
+	for( uint8_t c = 0; c < 16; c += 4 )
+	{
+		a0 = State[c];
+		a1 = State[c + 1];
+		a2 = State[c + 2];
+		a3 = State[c + 3];
+		All = a0 ^ a1 ^ a2 ^ a3;
+
+		State[c]	 = a0 ^ All ^ XTIME( a0 ^ a1 );
+		State[c + 1] = a1 ^ All ^ XTIME( a1 ^ a2 );
+		State[c + 2] = a2 ^ All ^ XTIME( a2 ^ a3 );
+		State[c + 3] = a3 ^ All ^ XTIME( a3 ^ a0 );
+	}
+}
+
+
+/****************************************************************/
+/* Next_Round_Key()        										*/
+/* Location: FIPS-197											*/
+/* Purpose: Expand the next round key from the current one		*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static void Next_Round_Key( uint8_t RoundKey[16], uint8_t Rcon )
+{
+	/* RotWord, SubWord and Rcon over the last word */
+	RoundKey[0] ^= SBox[ RoundKey[13] ] ^ Rcon;
+	RoundKey[1] ^= SBox[ RoundKey[14] ];
+	RoundKey[2] ^= SBox[ RoundKey[15] ];
+	RoundKey[3] ^= SBox[ RoundKey[12] ];
+
+	for( uint8_t i = 4; i < 16; i++ )
+	{
+		RoundKey[i] ^= RoundKey[i - 4];
+	}
+}
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
@@ -0,0 +1,40 @@
+
+
+#ifndef AES_128_H_
+#define AES_128_H_
+
+
+/****************************************************************/
+/* Includes                                                     */
+/****************************************************************/
+#include "Types.h"
+
+
+/****************************************************************/
+/* Defines 					                            		*/
+/****************************************************************/
+
+
+/****************************************************************/
+/* Type Defines 					                            */
+/****************************************************************/
+
+
+/****************************************************************/
+/* External functions declaration (Interface functions)         */
+/****************************************************************/
+void AES_128_Encrypt_Block( uint8_t Key[16], uint8_t Plaintext_Data[16], uint8_t Encrypted_Data[16] );
+void AES_128_Ah( uint8_t IRK[16], uint8_t r[3], uint8_t hash[3] );
+
+
+/****************************************************************/
+/* External variables declaration                               */
+/****************************************************************/
+
+
+#endif /* AES_128_H_ */
+
+
+/****************************************************************/
+/* End of file	                                                */
+/****************************************************************/
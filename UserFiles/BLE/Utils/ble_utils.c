@@ -6,6 +6,7 @@
 #include "ble_utils.h"
 #include "TimeFunctions.h"
 #include "hci_transport_layer.h"
+#include "aes_128.h"
 
 
 /****************************************************************/
@@ -48,8 +49,10 @@ static uint8_t Check_Bit_Presence( uint8_t Random_Part[], uint8_t Size_In_Bytes
 static void Hash_CallBack_Function(uint8_t EncryptedData[16], CONTROLLER_ERROR_CODES status);
 static void Resolve_Private_Address_CallBack(uint8_t EncryptedData[16], CONTROLLER_ERROR_CODES status);
 static void Confirm_Private_Addr(uint8_t resolvingstatus, CONTROLLER_ERROR_CODES status);
+#ifndef SOFTWARE_AES_128
 static void LE_Encrypt_Complete( CONTROLLER_ERROR_CODES Status, uint8_t Encrypted_Data[16] );
 static void LE_Encrypt_Status( CONTROLLER_ERROR_CODES Status );
+#endif
 static void LE_Rand_Complete( CONTROLLER_ERROR_CODES Status, uint8_t Random_Number[8] );
 static uint8_t Set_Static_Random_Device_Address( BD_ADDR_TYPE* StaticAddress );
 extern uint8_t LE_Write_Address( LE_BD_ADDR_TYPE* Address );
@@ -153,7 +156,7 @@ BD_ADDR_TYPE* Generate_Device_Address( SUPPORTED_COMMANDS* HCI_Sup_Cmd, RANDOM_A
 						status = FALSE;
 					}else
 					{
-						RANDOM_ADDRESS = *StaticAddr.AddrPtr;
+						RANDOM_ADDRESS = *( (BD_ADDR_TYPE*)( &Rand_Bytes ) );
 					}
 				}else
 				{
@@ -207,7 +210,12 @@ BD_ADDR_TYPE* Generate_Device_Address( SUPPORTED_COMMANDS* HCI_Sup_Cmd, RANDOM_A
 			plaintextData[ sizeof(plaintextData) - 2 ] = Rand_Bytes[ 2 * sizeof(BD_ADDR_TYPE) + 1 ];
 			plaintextData[ sizeof(plaintextData) - 3 ] = Rand_Bytes[ 2 * sizeof(BD_ADDR_TYPE) + 2 ];
 
-			BD_Config = AES_128_Encrypt( HCI_Sup_Cmd, &IRK->Bytes[0], &plaintextData[0], &Hash_CallBack_Function ) ? WAIT_OPERATION_A : REQUEST_HASH_CALC;
+			/* The callback may be called before returning when AES-128 runs in software */
+			BD_Config = WAIT_OPERATION_A;
+			if( !AES_128_Encrypt( HCI_Sup_Cmd, &IRK->Bytes[0], &plaintextData[0], &Hash_CallBack_Function ) )
+			{
+				BD_Config = REQUEST_HASH_CALC;
+			}
 			break;
 
 		case LOAD_RESOLVABLE_ADDRESS:
@@ -218,7 +226,11 @@ BD_ADDR_TYPE* Generate_Device_Address( SUPPORTED_COMMANDS* HCI_Sup_Cmd, RANDOM_A
 
 		case VERIFY_RESOLVABLE_ADDRESS:
 			TimeoutCounter = 0;
-			BD_Config = Resolve_Private_Address( HCI_Sup_Cmd, &RANDOM_ADDRESS, IRK, 0, &Confirm_Private_Addr ) ? WAIT_OPERATION_A : VERIFY_RESOLVABLE_ADDRESS;
+			BD_Config = WAIT_OPERATION_A;
+			if( !Resolve_Private_Address( HCI_Sup_Cmd, &RANDOM_ADDRESS, IRK, 0, &Confirm_Private_Addr ) )
+			{
+				BD_Config = VERIFY_RESOLVABLE_ADDRESS;
+			}
 			break;
 
 		case END_ADDRESSES_CONFIG:
@@ -266,20 +278,32 @@ void Cancel_Device_Address_Generation( void )
 /* Purpose: AES-128 encrypt machine.							*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: With SOFTWARE_AES_128 defined, or when the		*/
+/* controller does not support HCI_LE_Encrypt, the block is		*/
+/* encrypted locally and the callback is called before this 	*/
+/* function returns. Callers must be ready for that.			*/
 /****************************************************************/
 uint8_t AES_128_Encrypt( SUPPORTED_COMMANDS* HCI_Sup_Cmd, uint8_t Key[16], uint8_t Plaintext_Data[16], EncryptCallBack CallBack )
 {
+	uint8_t Encrypted_Data[16];
+
 	if( Encrypt_CallBack == NULL ) /* The encrypt operation is free */
 	{
+#ifndef SOFTWARE_AES_128
 		if( HCI_Sup_Cmd->Bits.HCI_LE_Encrypt ) /* The module supports encryption. */
 		{
 			Encrypt_CallBack = HCI_LE_Encrypt( &Key[0], &Plaintext_Data[0], &LE_Encrypt_Complete, &LE_Encrypt_Status ) ? CallBack : NULL;
 			return ( ( Encrypt_CallBack == NULL ) ? FALSE : TRUE );
-		}else
+		}
+#endif
+		AES_128_Encrypt_Block( &Key[0], &Plaintext_Data[0], &Encrypted_Data[0] );
+
+		if( CallBack != NULL )
 		{
-			/* TODO: implement the AES-128 algorithm in software and call the callback function here! */
+			CallBack( &Encrypted_Data[0], COMMAND_SUCCESS );
 		}
+
+		return (TRUE);
 	}
 
 	return (FALSE);
@@ -297,7 +321,7 @@ uint8_t AES_128_Encrypt( SUPPORTED_COMMANDS* HCI_Sup_Cmd, uint8_t Key[16], uint8
 uint8_t Resolve_Private_Address( SUPPORTED_COMMANDS* HCI_Sup_Cmd, BD_ADDR_TYPE* PrivateAddress, IRK_TYPE* IRK, uint8_t Token, StatusCallBack CallBack )
 {
 	static volatile uint8_t Acquire = 0; /* This function can be called by more than one process at same time */
-	uint8_t* DataPtr;
+	uint8_t Data[16];
 
 	EnterCritical(); /* Critical section enter */
 
@@ -314,30 +338,23 @@ uint8_t Resolve_Private_Address( SUPPORTED_COMMANDS* HCI_Sup_Cmd, BD_ADDR_TYPE*
 
 	if( Encrypt_CallBack == NULL ) /* The encrypt operation is free */
 	{
-		DataPtr = malloc( 16 );
-		if( DataPtr != NULL )
-		{
-			memset( DataPtr, 0, 16 );  /* Clear data */
-			DataPtr[15] = PrivateAddress->Bytes[3];
-			DataPtr[14] = PrivateAddress->Bytes[4];
-			DataPtr[13] = PrivateAddress->Bytes[5];
+		memset( &Data[0], 0, sizeof(Data) );  /* Clear data */
+		Data[15] = PrivateAddress->Bytes[3];
+		Data[14] = PrivateAddress->Bytes[4];
+		Data[13] = PrivateAddress->Bytes[5];
 
-			ResolveStruct.CallBack = CallBack;
-			ResolveStruct.hash[0] = PrivateAddress->Bytes[0];
-			ResolveStruct.hash[1] = PrivateAddress->Bytes[1];
-			ResolveStruct.hash[2] = PrivateAddress->Bytes[2];
+		ResolveStruct.CallBack = CallBack;
+		ResolveStruct.hash[0] = PrivateAddress->Bytes[0];
+		ResolveStruct.hash[1] = PrivateAddress->Bytes[1];
+		ResolveStruct.hash[2] = PrivateAddress->Bytes[2];
 
-			if ( AES_128_Encrypt( HCI_Sup_Cmd, &IRK->Bytes[0], DataPtr, &Resolve_Private_Address_CallBack ) )
-			{
-				free( DataPtr );
-
-				EnterCritical(); /* Critical section enter */
-				Acquire = 0;
-				ExitCritical(); /* Critical section exit */
+		if ( AES_128_Encrypt( HCI_Sup_Cmd, &IRK->Bytes[0], &Data[0], &Resolve_Private_Address_CallBack ) )
+		{
+			EnterCritical(); /* Critical section enter */
+			Acquire = 0;
+			ExitCritical(); /* Critical section exit */
 
-				return (TRUE);
-			}
-			free( DataPtr );
+			return (TRUE);
 		}
 	}
 
@@ -379,9 +396,8 @@ GET_BD_ADDR Get_Public_Device_Address( void )
 	GET_BD_ADDR ReturnVal = { .Status = FALSE };
 
 	LE_BD_ADDR_TYPE* Ptr = LE_Read_Address( PEER_PUBLIC_DEV_ADDR );
-	uint8_t Type = ( Ptr->Reserved << 1 ) | ( Ptr->Type );
 
-	if( Type != PEER_PUBLIC_DEV_ADDR ) /* Address is not initialized */
+	if( ( Ptr == NULL ) || ( ( ( Ptr->Reserved << 1 ) | ( Ptr->Type ) ) != PEER_PUBLIC_DEV_ADDR ) ) /* Address is not initialized */
 	{
 		LE_BD_ADDR_TYPE PublicAddrRecord;
 		PublicAddrRecord.Address = Configure_Public_Device_Address();
@@ -391,6 +407,13 @@ GET_BD_ADDR Get_Public_Device_Address( void )
 		{
 			return (ReturnVal);
 		}
+
+		/* The saved address may be in another place */
+		Ptr = LE_Read_Address( PEER_PUBLIC_DEV_ADDR );
+		if( Ptr == NULL )
+		{
+			return (ReturnVal);
+		}
 	}
 
 	ReturnVal.Status = TRUE;
@@ -413,9 +436,8 @@ GET_BD_ADDR Get_Static_Random_Device_Address( void )
 	GET_BD_ADDR ReturnVal = { .Status = FALSE };
 
 	LE_BD_ADDR_TYPE* Ptr = LE_Read_Address( PEER_RANDOM_DEV_ADDR );
-	uint8_t Type = ( Ptr->Reserved << 1 ) | ( Ptr->Type );
 
-	if( Type == PEER_RANDOM_DEV_ADDR ) /* Address is initialized? */
+	if( ( Ptr != NULL ) && ( ( ( Ptr->Reserved << 1 ) | ( Ptr->Type ) ) == PEER_RANDOM_DEV_ADDR ) ) /* Address is initialized? */
 	{
 		ReturnVal.Status = TRUE;
 		ReturnVal.AddrPtr = (BD_ADDR_TYPE*)( &Ptr->Address );
@@ -780,6 +802,7 @@ static void LE_Rand_Complete( CONTROLLER_ERROR_CODES Status, uint8_t Random_Numb
 }
 
 
+#ifndef SOFTWARE_AES_128
 /****************************************************************/
 /* LE_Encrypt_Complete()        								*/
 /* Location: 					 								*/
@@ -825,6 +848,7 @@ static void LE_Encrypt_Status( CONTROLLER_ERROR_CODES Status )
 		Encrypt_CallBack = NULL;
 	}
 }
+#endif
 
 
 /****************************************************************/
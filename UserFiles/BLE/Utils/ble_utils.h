@@ -17,6 +17,13 @@
 /****************************************************************/
 /* Defines 					                            		*/
 /****************************************************************/
+/* Encrypt with the local AES-128 instead of the HCI_LE_Encrypt command.
+ * Private addresses are generated and resolved without using the SPI bus.
+ * Define CONTROLLER_AES_128 in the build to let the controller encrypt when
+ * it supports the command. */
+#ifndef CONTROLLER_AES_128
+#define SOFTWARE_AES_128
+#endif
 
 
 /****************************************************************/
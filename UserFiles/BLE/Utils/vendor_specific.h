@@ -24,6 +24,7 @@
 #define SLAVE_AND_MASTER_12KB 		0x2 /* Slave and master Only one connection 12 kB of RAM retention */
 #define MASTER_AND_SLAVE_8CON 		0x3 /* Master and slave Up to 8 connections 12 kB of RAM retention */
 #define MASTER_AND_SLAVE_4CON 		0x4 /* Master and slave Up to 4 connections Simultaneous advertising and scanning */
+#define BLUENRG_MAX_CONNECTIONS		8	/* Connections of MASTER_AND_SLAVE_8CON, the most the BlueNRG-MS holds */
 
 
 /****************************************************************/
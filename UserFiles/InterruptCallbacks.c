@@ -43,6 +43,7 @@ void HAL_IncTick(void)
 {
   uwTick += uwTickFreq;
   Bluerng_Command_Timeout(  );
+  Bluenrg_Hold_Timeout(  );
 }
 
 
@@ -9,18 +9,53 @@
 /****************************************************************/
 /* Type Defines                                                 */
 /****************************************************************/
+typedef struct
+{
+	uint16_t State;
+	uint16_t Sequence; /* Incremented at every compaction, the newest active page is the valid one */
+}FLASH_PAGE_HEADER;
+
+
+typedef struct
+{
+	uint16_t Key;
+	uint16_t Size;	   /* Zero for deleted keys */
+	uint16_t Checksum;
+	uint16_t Commit;   /* Programmed after the data, so incomplete records are ignored */
+	uint8_t Data[];
+}FLASH_RECORD;
 
 
 /****************************************************************/
 /* Static functions declaration                                 */
 /****************************************************************/
+static FLASH_RECORD* Flash_Next_Record( uint8_t Page, uint16_t* Offset );
+static FLASH_RECORD* Flash_Find( uint8_t Page, uint16_t Key );
+static uint8_t Flash_Valid_Record( FLASH_RECORD* Record );
+static uint16_t* Flash_Key_Slot( uint8_t Page, uint16_t Key );
+static uint8_t Flash_Append( uint8_t Page, uint16_t* Offset, uint16_t Key, uint8_t DataPtr[], uint16_t DataSize );
+static uint8_t Flash_Compact( uint16_t Key, uint8_t DataPtr[], uint16_t DataSize );
+static uint8_t Flash_Update( uint16_t Key, uint8_t DataPtr[], uint16_t DataSize );
+static uint8_t Flash_Program( uint32_t Address, uint8_t DataPtr[], uint16_t DataSize );
+static uint8_t Flash_Erase_Page( uint8_t Page );
+static uint16_t Flash_Checksum( uint16_t Key, uint8_t DataPtr[], uint16_t DataSize );
 
 
 /****************************************************************/
 /* Defines                                                      */
 /****************************************************************/
-#define BT_BASIC_INFO_BASE_ADDRESS  		( (uint32_t)( &FLASH_DATA_VECTOR[0x000] ) )
-#define LE_RESOLVING_LIST_BASE_ADDRESS		( (uint32_t)( &FLASH_DATA_VECTOR[0x100] ) )
+#define FLASH_PAGE_ACTIVE			0x0000
+#define FLASH_RECORD_COMMITTED		0x0000
+#define FLASH_KEY_FREE				0xFFFF
+#define FLASH_MAX_DATA_SIZE			( FLASH_PAGE_SIZE - sizeof(FLASH_PAGE_HEADER) - sizeof(FLASH_RECORD) )
+#define FLASH_KEY_HASH_SIZE			256 /* Power of two above the records a page holds, so the hash is never full */
+
+#if ( ( FLASH_KEY_HASH_SIZE & ( FLASH_KEY_HASH_SIZE - 1 ) ) || ( FLASH_KEY_HASH_SIZE < ( FLASH_PAGE_SIZE / 8 ) ) )
+#error "FLASH_KEY_HASH_SIZE must be a power of two of at least FLASH_PAGE_SIZE / 8, the size of the deleted key records"
+#endif
+
+#define PAGE_POINTER(Page)			( &FlashDataPtr[ (Page) * FLASH_PAGE_SIZE ] )
+#define RECORD_SPACE(Size)			( ( sizeof(FLASH_RECORD) + (Size) + 3 ) & ~3 ) /* Records are word aligned */
 
 
 /****************************************************************/
@@ -31,148 +66,531 @@
 /****************************************************************/
 /* Local variables definition                                   */
 /****************************************************************/
-__attribute__( (aligned(FLASH_PAGE_SIZE)) ) const uint8_t FLASH_DATA_VECTOR[FLASH_PAGE_SIZE] = { [0 ... FLASH_PAGE_SIZE - 1] = 0xFF };
+__attribute__( (aligned(FLASH_PAGE_SIZE)) ) const uint8_t FLASH_DATA_VECTOR[FLASH_NUMBER_OF_PAGES * FLASH_PAGE_SIZE] = { [0 ... ( FLASH_NUMBER_OF_PAGES * FLASH_PAGE_SIZE ) - 1] = 0xFF };
+/* The vector is read through a volatile pointer, otherwise the compiler would use the const initializer */
+static const uint8_t* volatile FlashDataPtr = &FLASH_DATA_VECTOR[0];
+static uint8_t Initialized = FALSE;
+static uint8_t ActivePage;
+static uint16_t WriteOffset;
+static uint8_t Damaged = FALSE; /* The active page holds a committed record with a wrong checksum */
+/* Used by Flash_Compact() only: open addressing hash of the keys of the page being compacted. Each slot
+ * holds the offset of the newest record of a key, zero when empty, as no record is at the page header. */
+static uint16_t Key_Hash[FLASH_KEY_HASH_SIZE];
 
 
 /****************************************************************/
-/* GET_BT_BASIC_INFO_BASE_ADDRESS()		      					*/
+/* FLASH_Init()		 		       								*/
 /* Location: 					 								*/
-/* Purpose: Return the flash address for basic Bluetooth Info.	*/
+/* Purpose: Find the active page of the record log.				*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: The active page with the newest sequence number	*/
+/* is used. Pages being compacted when the power was lost are	*/
+/* not active yet and are erased before being used again. A		*/
+/* blank (or foreign) memory is formatted. The checksums are 	*/
+/* only verified here and by Flash_Compact(): a damaged page is	*/
+/* compacted, so the lookups just compare the keys.				*/
 /****************************************************************/
-uint32_t GET_BT_BASIC_INFO_BASE_ADDRESS( void )
+void FLASH_Init( void )
 {
-	return ( BT_BASIC_INFO_BASE_ADDRESS );
+	FLASH_PAGE_HEADER* Header;
+	FLASH_RECORD* Record;
+	uint8_t Found = FALSE;
+
+	for( uint8_t Page = 0; Page < FLASH_NUMBER_OF_PAGES; Page++ )
+	{
+		Header = (FLASH_PAGE_HEADER*)PAGE_POINTER( Page );
+
+		if( Header->State == FLASH_PAGE_ACTIVE )
+		{
+			if( ( !Found ) ||
+					( (int16_t)( Header->Sequence - ( (FLASH_PAGE_HEADER*)PAGE_POINTER( ActivePage ) )->Sequence ) > 0 ) )
+			{
+				ActivePage = Page;
+				Found = TRUE;
+			}
+		}
+	}
+
+	if( !Found )
+	{
+		ActivePage = 0;
+		uint16_t Page_Header[2] = { FLASH_PAGE_ACTIVE, 0 };
+
+		HAL_FLASH_Unlock();
+		if( Flash_Erase_Page( ActivePage ) )
+		{
+			Flash_Program( (uint32_t)(uintptr_t)PAGE_POINTER( ActivePage ), (uint8_t*)&Page_Header[0], sizeof(Page_Header) );
+		}
+		HAL_FLASH_Lock();
+	}
+
+	/* Walk the log to find the free space */
+	WriteOffset = sizeof(FLASH_PAGE_HEADER);
+	Damaged = FALSE;
+	while( ( Record = Flash_Next_Record( ActivePage, &WriteOffset ) ) != NULL )
+	{
+		Damaged |= !Flash_Valid_Record( Record );
+	}
+
+	Initialized = TRUE;
+
+	/* The damaged records are left behind. Until then, the lookups verify the checksums. */
+	if( Damaged )
+	{
+		HAL_FLASH_Unlock();
+		Flash_Compact( FLASH_KEY_FREE, NULL, 0 );
+		HAL_FLASH_Lock();
+	}
 }
 
 
 /****************************************************************/
-/* GET_LE_RESOLVING_LIST_BASE_ADDRESS()		   					*/
+/* FLASH_Write()		 		       							*/
 /* Location: 					 								*/
-/* Purpose: Return the flash address for Low Energy (LE) Device */
-/* Identity resolving list.										*/
+/* Purpose: Save a value in NVM flash.							*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: The value is appended to the log of the active	*/
+/* page, which costs only the programming of the record. The 	*/
+/* page is compacted into the next one when it gets full.		*/
 /****************************************************************/
-uint32_t GET_LE_RESOLVING_LIST_BASE_ADDRESS( void )
+uint8_t FLASH_Write( uint16_t Key, void* DataPtr, uint16_t DataSize )
 {
-	return ( LE_RESOLVING_LIST_BASE_ADDRESS );
+	if( ( DataSize == 0 ) || ( DataSize > FLASH_MAX_DATA_SIZE ) || ( Key == FLASH_KEY_FREE ) )
+	{
+		return (FALSE);
+	}
+
+	return ( Flash_Update( Key, (uint8_t*)DataPtr, DataSize ) );
 }
 
 
 /****************************************************************/
-/* LE_Write_Address()		        							*/
+/* FLASH_Read()		 		       								*/
 /* Location: 					 								*/
-/* Purpose: Save address to NVM memory. It should be 			*/
-/* implemented on application side.								*/
+/* Purpose: Read a value from NVM flash.						*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Returns a pointer to the value in flash or NULL	*/
+/* if the key was never written or was deleted. The pointer is	*/
+/* valid until the page holding it is reused, which takes at	*/
+/* least one compaction.										*/
+/****************************************************************/
+void* FLASH_Read( uint16_t Key, uint16_t* DataSize )
+{
+	if( !Initialized )
+	{
+		FLASH_Init();
+	}
+
+	FLASH_RECORD* Record = Flash_Find( ActivePage, Key );
+
+	if( ( Record == NULL ) || ( Record->Size == 0 ) )
+	{
+		return (NULL);
+	}
+
+	if( DataSize != NULL )
+	{
+		*DataSize = Record->Size;
+	}
+
+	return ( &Record->Data[0] );
+}
+
+
+/****************************************************************/
+/* FLASH_Delete()		 		       							*/
+/* Location: 					 								*/
+/* Purpose: Delete a value from NVM flash.						*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
 /* Description:													*/
 /****************************************************************/
-uint8_t LE_Write_Address( LE_BD_ADDR_TYPE* Address )
+uint8_t FLASH_Delete( uint16_t Key )
 {
-	uint8_t DataBytes[ sizeof(LE_BD_ADDR_TYPE) + 1 ];
+	if( Key == FLASH_KEY_FREE )
+	{
+		return (FALSE);
+	}
 
-	uint8_t Status;
+	return ( Flash_Update( Key, NULL, 0 ) );
+}
 
-	/* The first byte acts as the index for the LE address type */
-	DataBytes[0] = Address->Type;
 
-	memcpy( &DataBytes[1], (uint8_t*)Address, sizeof(LE_BD_ADDR_TYPE) );
+/****************************************************************/
+/* Flash_Update()		 		       							*/
+/* Location: 					 								*/
+/* Purpose: Append a new value for the key, compacting the log 	*/
+/* when needed. Zero size deletes the key.						*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static uint8_t Flash_Update( uint16_t Key, uint8_t DataPtr[], uint16_t DataSize )
+{
+	uint8_t Status;
 
-	uint32_t MemAddress = ( DataBytes[0] * sizeof(DataBytes) ) + GET_BT_BASIC_INFO_BASE_ADDRESS();
+	if( !Initialized )
+	{
+		FLASH_Init();
+	}
 
-	Status = FLASH_Program( MemAddress, &DataBytes[0], sizeof(DataBytes) );
+	FLASH_RECORD* Record = Flash_Find( ActivePage, Key );
 
-	if( ( Status ) &&
-			( memcmp( &DataBytes[0], (uint8_t*)MemAddress, sizeof(DataBytes) ) == 0 ) )
+	/* Unchanged values are not programmed again */
+	if( ( Record == NULL ) || ( Record->Size == 0 ) )
+	{
+		if( DataSize == 0 )
+		{
+			return (TRUE);
+		}
+	}else if( ( Record->Size == DataSize ) && ( memcmp( &Record->Data[0], &DataPtr[0], DataSize ) == 0 ) )
 	{
 		return (TRUE);
-	}else
+	}
+
+	HAL_FLASH_Unlock();
+
+	Status = Flash_Append( ActivePage, &WriteOffset, Key, &DataPtr[0], DataSize );
+
+	if( !Status )
+	{
+		Status = Flash_Compact( Key, &DataPtr[0], DataSize );
+	}
+
+	HAL_FLASH_Lock();
+
+	return (Status);
+}
+
+
+/****************************************************************/
+/* Flash_Compact()		 		       							*/
+/* Location: 					 								*/
+/* Purpose: Copy the valid records and the new value of the key*/
+/* to the next page, which becomes the active one.				*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: The next page is only marked as active after	*/
+/* all records are copied. If the power is lost before that, 	*/
+/* the previous page is still the active one. Pages are erased	*/
+/* in turns, spreading the wear among them. A first walk hashes	*/
+/* the newest intact record of each key, a second one copies	*/
+/* them, so the page is not walked again for each record.		*/
+/****************************************************************/
+static uint8_t Flash_Compact( uint16_t Key, uint8_t DataPtr[], uint16_t DataSize )
+{
+	uint8_t NewPage = ( ActivePage + 1 ) % FLASH_NUMBER_OF_PAGES;
+	uint16_t NewOffset = sizeof(FLASH_PAGE_HEADER);
+	uint16_t Offset = sizeof(FLASH_PAGE_HEADER);
+	uint16_t State = FLASH_PAGE_ACTIVE;
+	uint16_t Sequence = ( (FLASH_PAGE_HEADER*)PAGE_POINTER( ActivePage ) )->Sequence + 1;
+	FLASH_RECORD* Record;
+
+	if( ( !Flash_Erase_Page( NewPage ) ) ||
+			( !Flash_Program( (uint32_t)(uintptr_t)&( (FLASH_PAGE_HEADER*)PAGE_POINTER( NewPage ) )->Sequence, (uint8_t*)&Sequence, sizeof(Sequence) ) ) )
 	{
 		return (FALSE);
 	}
+
+	memset( &Key_Hash[0], 0, sizeof(Key_Hash) );
+
+	while( ( Record = Flash_Next_Record( ActivePage, &Offset ) ) != NULL )
+	{
+		if( Flash_Valid_Record( Record ) )
+		{
+			*Flash_Key_Slot( ActivePage, Record->Key ) = (const uint8_t*)Record - PAGE_POINTER( ActivePage );
+		}
+	}
+
+	Offset = sizeof(FLASH_PAGE_HEADER);
+
+	while( ( Record = Flash_Next_Record( ActivePage, &Offset ) ) != NULL )
+	{
+		/* Only the newest value of each key is kept */
+		if( ( Record->Size != 0 ) && ( Record->Key != Key ) &&
+				( *Flash_Key_Slot( ActivePage, Record->Key ) == ( (const uint8_t*)Record - PAGE_POINTER( ActivePage ) ) ) )
+		{
+			if( !Flash_Append( NewPage, &NewOffset, Record->Key, &Record->Data[0], Record->Size ) )
+			{
+				return (FALSE);
+			}
+		}
+	}
+
+	/* Deleted keys are just not copied */
+	if( ( DataSize != 0 ) && ( !Flash_Append( NewPage, &NewOffset, Key, &DataPtr[0], DataSize ) ) )
+	{
+		return (FALSE);
+	}
+
+	if( !Flash_Program( (uint32_t)(uintptr_t)PAGE_POINTER( NewPage ), (uint8_t*)&State, sizeof(State) ) )
+	{
+		return (FALSE);
+	}
+
+	ActivePage = NewPage;
+	WriteOffset = NewOffset;
+	Damaged = FALSE;
+
+	return (TRUE);
 }
 
 
 /****************************************************************/
-/* LE_Read_Address()		        							*/
+/* Flash_Append()		 		       							*/
 /* Location: 					 								*/
-/* Purpose: Read address from NVM memory. It should be 			*/
-/* implemented on application side.								*/
+/* Purpose: Program a record at the offset of the page.			*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: A failed record is never committed and the 		*/
+/* page is considered full, so the next write compacts it.		*/
 /****************************************************************/
-LE_BD_ADDR_TYPE* LE_Read_Address( PEER_ADDR_TYPE AddressType )
+static uint8_t Flash_Append( uint8_t Page, uint16_t* Offset, uint16_t Key, uint8_t DataPtr[], uint16_t DataSize )
 {
-	uint8_t* MemAddress = ( ( AddressType & 0x1 ) * ( sizeof(LE_BD_ADDR_TYPE) + 1 ) ) +  (uint8_t*)( GET_BT_BASIC_INFO_BASE_ADDRESS() );
+	uint32_t Address = (uint32_t)(uintptr_t)PAGE_POINTER( Page ) + *Offset;
+	uint16_t Header[3] = { Key, DataSize, Flash_Checksum( Key, &DataPtr[0], DataSize ) };
+	uint16_t Commit = FLASH_RECORD_COMMITTED;
 
-	return ( (LE_BD_ADDR_TYPE*)( &MemAddress[1] ) );
+	if( RECORD_SPACE( DataSize ) > ( FLASH_PAGE_SIZE - *Offset ) )
+	{
+		return (FALSE);
+	}
+
+	if( ( Flash_Program( Address, (uint8_t*)&Header[0], sizeof(Header) ) ) &&
+			( Flash_Program( Address + offsetof(FLASH_RECORD,Data), &DataPtr[0], DataSize ) ) &&
+			( Flash_Program( Address + offsetof(FLASH_RECORD,Commit), (uint8_t*)&Commit, sizeof(Commit) ) ) )
+	{
+		*Offset += RECORD_SPACE( DataSize );
+		return (TRUE);
+	}
+
+	*Offset = FLASH_PAGE_SIZE;
+	return (FALSE);
 }
 
 
 /****************************************************************/
-/* FLASH_Program()		 		       							*/
+/* Flash_Next_Record()		 		       						*/
 /* Location: 					 								*/
-/* Purpose: Write bytes to NVM flash.							*/
+/* Purpose: Return the committed record at or after the offset,	*/
+/* advancing the offset beyond it.								*/
 /* Parameters: none				         						*/
 /* Return: none  												*/
-/* Description:													*/
+/* Description: Returns NULL at the end of the log, leaving the	*/
+/* offset at the free space. A damaged header ends the log at	*/
+/* the end of the page. The checksum is not verified.			*/
 /****************************************************************/
-uint8_t FLASH_Program( uint32_t Address, uint8_t DataPtr[], uint16_t DataSize )
+static FLASH_RECORD* Flash_Next_Record( uint8_t Page, uint16_t* Offset )
 {
-	/* TODO: This is not the best approach for saving information in flash memory
-	 * since we erase and reprogram all the pages at every write operation.
-	 * This is being let for future improvement. */
-	if( ( DataSize ) && ( Address >= (uint32_t)( &FLASH_DATA_VECTOR[0] ) ) &&
-			( ( Address + DataSize ) <= (uint32_t)( &FLASH_DATA_VECTOR[ sizeof(FLASH_DATA_VECTOR) ] ) ) )
+	FLASH_RECORD* Record;
+
+	while( ( *Offset + sizeof(FLASH_RECORD) ) <= FLASH_PAGE_SIZE )
 	{
-		EnterCritical();
+		Record = (FLASH_RECORD*)( PAGE_POINTER( Page ) + *Offset );
 
-		uint32_t MirrorPointer = (uint32_t)malloc( sizeof(FLASH_DATA_VECTOR) );
-		if ( (uint8_t*)MirrorPointer == NULL )
+		if( Record->Key == FLASH_KEY_FREE )
+		{
+			return (NULL);
+		}else if( RECORD_SPACE( Record->Size ) > ( FLASH_PAGE_SIZE - *Offset ) )
 		{
-			ExitCritical();
-			return (FALSE);
+			break;
 		}
 
-		memcpy( (uint8_t*)MirrorPointer, &FLASH_DATA_VECTOR[0], sizeof(FLASH_DATA_VECTOR) );
-		uint32_t MirrorOffset = Address - (uint32_t)( &FLASH_DATA_VECTOR[0] );
-		memcpy( (uint8_t*)( MirrorPointer + MirrorOffset ), &DataPtr[0], DataSize );
+		*Offset += RECORD_SPACE( Record->Size );
 
-		FLASH_EraseInitTypeDef Erase;
-		uint32_t PageError;
-		Erase.NbPages = sizeof(FLASH_DATA_VECTOR) / FLASH_PAGE_SIZE;
-		Erase.PageAddress = (uint32_t)( &FLASH_DATA_VECTOR[0] );
-		Erase.TypeErase = FLASH_TYPEERASE_PAGES;
+		if( Record->Commit == FLASH_RECORD_COMMITTED )
+		{
+			return (Record);
+		}
+	}
 
-		HAL_FLASH_Unlock();
+	*Offset = FLASH_PAGE_SIZE;
+	return (NULL);
+}
 
-		HAL_FLASHEx_Erase( &Erase, &PageError );
 
-		uint16_t* Mirror = (uint16_t*)MirrorPointer;
-		uint16_t* Flash = (uint16_t*)( &FLASH_DATA_VECTOR[0] );
+/****************************************************************/
+/* Flash_Find()		 		       								*/
+/* Location: 					 								*/
+/* Purpose: Return the newest record of the key in the page.	*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Only the keys are compared, unless the page is	*/
+/* still damaged.												*/
+/****************************************************************/
+static FLASH_RECORD* Flash_Find( uint8_t Page, uint16_t Key )
+{
+	FLASH_RECORD* Found = NULL;
+	FLASH_RECORD* Record;
+	uint16_t Offset = sizeof(FLASH_PAGE_HEADER);
 
-		for ( uint32_t i = 0; i < ( sizeof(FLASH_DATA_VECTOR) / sizeof( uint16_t ) ); i++ )
+	while( ( Record = Flash_Next_Record( Page, &Offset ) ) != NULL )
+	{
+		if( ( Record->Key == Key ) && ( ( !Damaged ) || ( Flash_Valid_Record( Record ) ) ) )
 		{
-			if( Mirror[i] != Flash[i] )
-			{
-				HAL_FLASH_Program( FLASH_TYPEPROGRAM_HALFWORD, (uint32_t)( &Flash[i] ), Mirror[i] );
-			}
+			Found = Record;
 		}
+	}
 
-		HAL_FLASH_Lock();
-		free( (uint8_t*)MirrorPointer );
+	return (Found);
+}
+
+
+/****************************************************************/
+/* Flash_Valid_Record()		 		       						*/
+/* Location: 					 								*/
+/* Purpose: Verify the checksum of a committed record.			*/
+/* Parameters: none				         						*/
+/* Return: TRUE if the record is intact.						*/
+/* Description:													*/
+/****************************************************************/
+static uint8_t Flash_Valid_Record( FLASH_RECORD* Record )
+{
+	return ( ( Record->Checksum == Flash_Checksum( Record->Key, &Record->Data[0], Record->Size ) ) ? TRUE : FALSE );
+}
+
+
+/****************************************************************/
+/* Flash_Key_Slot()		 		       							*/
+/* Location: 					 								*/
+/* Purpose: Search the key in Key_Hash.							*/
+/* Parameters: Page: the page whose records are hashed			*/
+/* Return: The slot of the key, or the empty slot where it goes.*/
+/* Description: The keys are read from the hashed records.		*/
+/****************************************************************/
+static uint16_t* Flash_Key_Slot( uint8_t Page, uint16_t Key )
+{
+	uint16_t Slot = ( Key ^ ( Key >> 8 ) ) & ( FLASH_KEY_HASH_SIZE - 1 );
+
+	while( ( Key_Hash[Slot] != 0 ) && ( ( (FLASH_RECORD*)( PAGE_POINTER( Page ) + Key_Hash[Slot] ) )->Key != Key ) )
+	{
+		Slot = ( Slot + 1 ) & ( FLASH_KEY_HASH_SIZE - 1 );
+	}
+
+	return ( &Key_Hash[Slot] );
+}
+
+
+/****************************************************************/
+/* Flash_Program()		 		       							*/
+/* Location: 					 								*/
+/* Purpose: Write bytes to NVM flash.							*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Address must be halfword aligned. Interrupts are*/
+/* only blocked during each halfword programming.				*/
+/****************************************************************/
+static uint8_t Flash_Program( uint32_t Address, uint8_t DataPtr[], uint16_t DataSize )
+{
+	HAL_StatusTypeDef Status = HAL_OK;
+	uint16_t Halfword;
+
+	for( uint16_t i = 0; ( i < DataSize ) && ( Status == HAL_OK ); i += sizeof(uint16_t) )
+	{
+		/* The last odd byte is padded with the erased value */
+		Halfword = ( ( i + 1 ) < DataSize ) ? ( DataPtr[i] | ( DataPtr[i + 1] << 8 ) ) : ( DataPtr[i] | 0xFF00 );
+
+		EnterCritical();
+		Status = HAL_FLASH_Program( FLASH_TYPEPROGRAM_HALFWORD, Address + i, Halfword );
 		ExitCritical();
+	}
+
+	return ( ( Status == HAL_OK ) ? TRUE : FALSE );
+}
+
+
+/****************************************************************/
+/* Flash_Erase_Page()		 		       						*/
+/* Location: 					 								*/
+/* Purpose: Erase a page of the record log.						*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+static uint8_t Flash_Erase_Page( uint8_t Page )
+{
+	FLASH_EraseInitTypeDef Erase;
+	uint32_t PageError;
+	HAL_StatusTypeDef Status;
+
+	Erase.NbPages = 1;
+	Erase.PageAddress = (uint32_t)(uintptr_t)PAGE_POINTER( Page );
+	Erase.TypeErase = FLASH_TYPEERASE_PAGES;
+
+	EnterCritical();
+	Status = HAL_FLASHEx_Erase( &Erase, &PageError );
+	ExitCritical();
+
+	return ( ( Status == HAL_OK ) ? TRUE : FALSE );
+}
+
+
+/****************************************************************/
+/* Flash_Checksum()		 		       							*/
+/* Location: 					 								*/
+/* Purpose: Checksum of the record key, size and data.			*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description: Fletcher-16. The sums are only reduced at the	*/
+/* end: the Cortex-M0 has no divider, and with 32-bit sums a	*/
+/* record of a page cannot overflow them.						*/
+/****************************************************************/
+static uint16_t Flash_Checksum( uint16_t Key, uint8_t DataPtr[], uint16_t DataSize )
+{
+	uint32_t Sum1 = ( Key & 0xFF ) + ( Key >> 8 );
+	uint32_t Sum2 = Sum1 + ( DataSize & 0xFF ) + ( DataSize >> 8 );
+
+	Sum1 = Sum2;
+
+	for( uint16_t i = 0; i < DataSize; i++ )
+	{
+		Sum1 += DataPtr[i];
+		Sum2 += Sum1;
+	}
+
+	return ( ( ( Sum2 % 255 ) << 8 ) | ( Sum1 % 255 ) );
+}
 
+
+/****************************************************************/
+/* LE_Write_Address()		        							*/
+/* Location: 					 								*/
+/* Purpose: Save address to NVM memory. It should be 			*/
+/* implemented on application side.								*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+uint8_t LE_Write_Address( LE_BD_ADDR_TYPE* Address )
+{
+	uint16_t Key = FLASH_KEY_LE_ADDRESS + Address->Type;
+
+	if( ( FLASH_Write( Key, (uint8_t*)Address, sizeof(LE_BD_ADDR_TYPE) ) ) &&
+			( memcmp( FLASH_Read( Key, NULL ), (uint8_t*)Address, sizeof(LE_BD_ADDR_TYPE) ) == 0 ) )
+	{
 		return (TRUE);
+	}else
+	{
+		return (FALSE);
 	}
+}
 
-	return (FALSE);
+
+/****************************************************************/
+/* LE_Read_Address()		        							*/
+/* Location: 					 								*/
+/* Purpose: Read address from NVM memory. It should be 			*/
+/* implemented on application side.								*/
+/* Parameters: none				         						*/
+/* Return: none  												*/
+/* Description:													*/
+/****************************************************************/
+LE_BD_ADDR_TYPE* LE_Read_Address( PEER_ADDR_TYPE AddressType )
+{
+	return ( (LE_BD_ADDR_TYPE*)FLASH_Read( FLASH_KEY_LE_ADDRESS + ( AddressType & 0x1 ), NULL ) );
 }
 
 
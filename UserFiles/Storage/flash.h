@@ -15,6 +15,11 @@
 /****************************************************************/
 /* Defines                                                      */
 /****************************************************************/
+#define FLASH_NUMBER_OF_PAGES		2 /* Flash pages used by the record log (at least 2) */
+
+/* Record keys */
+#define FLASH_KEY_LE_ADDRESS		0x0000 /* Plus the address type (public or random) */
+#define FLASH_KEY_RESOLVING_RECORD	0x0100 /* Plus the resolving list index */
 
 
 /****************************************************************/
@@ -25,9 +30,10 @@
 /****************************************************************/
 /* External functions declaration (Interface functions)         */
 /****************************************************************/
-uint8_t FLASH_Program( uint32_t Address, uint8_t DataPtr[], uint16_t DataSize );
-uint32_t GET_BT_BASIC_INFO_BASE_ADDRESS( void );
-uint32_t GET_LE_RESOLVING_LIST_BASE_ADDRESS( void );
+void FLASH_Init( void );
+uint8_t FLASH_Write( uint16_t Key, void* DataPtr, uint16_t DataSize );
+void* FLASH_Read( uint16_t Key, uint16_t* DataSize );
+uint8_t FLASH_Delete( uint16_t Key );
 
 
 /****************************************************************/
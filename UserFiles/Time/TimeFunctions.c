@@ -226,6 +226,43 @@ void Wait_DelayUs(uint32_t us)
 }
 
 
+/****************************************************************/
+/* TimeBase_Get_Us()                                  			*/
+/****************************************************************/
+/*                                                              */
+/* Purpose: Free running time in microseconds                   */
+/* Return: Time in microseconds. It wraps around, so only the   */
+/* difference between two readings is meaningful.              	*/
+/* Description: The millisecond tick is completed with the 		*/
+/* SysTick down counter. The tick is read again to detect a 	*/
+/* SysTick interrupt between both readings. When the interrupts	*/
+/* are masked, or from an interrupt that blocks the SysTick one,*/
+/* the counter may have reloaded without the tick being counted	*/
+/* yet: the pending SysTick interrupt then adds the millisecond,*/
+/* so the time never goes backwards.							*/
+/****************************************************************/
+uint32_t TimeBase_Get_Us(void)
+{
+	uint32_t Tick;
+	uint32_t Count;
+	uint32_t Pending;
+
+	do
+	{
+		Tick = HAL_GetTick();
+		Pending = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+		Count = SysTick->VAL;
+	}while( ( Tick != HAL_GetTick() ) || ( Pending != ( SCB->ICSR & SCB_ICSR_PENDSTSET_Msk ) ) );
+
+	if( Pending )
+	{
+		Tick++; /* The counter already reloaded for the next millisecond */
+	}
+
+	return ( ( Tick * 1000UL ) + ( ( SysTick->LOAD - Count ) / ( HAL_RCC_GetHCLKFreq() / 1000000UL ) ) );
+}
+
+
 /****************************************************************/
 /* End of file	                                                */
 /****************************************************************/
@@ -25,6 +25,7 @@ uint32_t TimeBase_DelayMsV2( uint32_t* ui32Buffer, uint32_t ui32Time,
 uint8_t TimerON( uint32_t* Counter, uint32_t Time, uint8_t Input );
 uint8_t TimerOFF( uint32_t* Counter, uint32_t Time, uint8_t Input );
 void Wait_DelayUs(uint32_t us);
+uint32_t TimeBase_Get_Us(void);
 
 
 /****************************************************************/
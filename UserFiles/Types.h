@@ -29,8 +29,20 @@
 #endif
 
 
+#ifdef BLE_HAL_SIMULATION
+/* In the host build the "interrupts" are delivered by the simulated controller
+ * from the main loop, so they never preempt a critical section. */
+#define EnterCritical() do{ }while( 0 )
+#define ExitCritical() do{ }while( 0 )
+#else
 #define EnterCritical() asm ( "CPSID i\n\t" ) /* Disable exceptions */
 #define ExitCritical() asm ( "CPSIE i\n\t" )  /* Enable exceptions */
+#endif
+
+/* Keeps the compiler from moving memory accesses across this point. The Cortex-M0
+ * has a single core without write buffer reordering, so this is enough to publish
+ * data from an interrupt to the main loop (and back) in the intended order. */
+#define CompilerBarrier() asm volatile ( "" ::: "memory" )
 
 /* Max statement */
 #define MAX(a,b) \